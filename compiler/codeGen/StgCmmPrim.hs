@@ -42,6 +42,7 @@ import TyCon
 import CLabel
 import CmmUtils
 import PrimOp
+import Module ( rtsUnitId )
 import SMRep
 import FastString
 import Outputable
@@ -1620,18 +1621,38 @@ doWritePtrArrayOp addr idx val
        emit (setInfo addr (CmmLit (CmmLabel mkMAP_DIRTY_infoLabel)))
   -- the write barrier.  We must write a byte into the mark table:
   -- bits8[a + header_size + StgMutArrPtrs_size(a) + x >> N]
-       emit $ mkStore (
-         cmmOffsetExpr dflags
-          (cmmOffsetExprW dflags (cmmOffsetB dflags addr (arrPtrsHdrSize dflags))
-                         (loadArrPtrsSize dflags addr))
-          (CmmMachOp (mo_wordUShr dflags) [idx,
-                                           mkIntExpr dflags (mUT_ARR_PTRS_CARD_BITS dflags)])
-         ) (CmmLit (CmmInt 1 W8))
+  -- unless the RTS remembers the cards of this array, in which case it
+  -- sets the byte itself when it is clear (see Note [Card remembered
+  -- set] in rts/sm/Scav.c).
+       card <- assignTempE $ cardCmm dflags idx
+       let card_p = cmmOffsetExpr dflags
+              (cmmOffsetExprW dflags (cmmOffsetB dflags addr (arrPtrsHdrSize dflags))
+                             (loadArrPtrsSize dflags addr))
+              card
+       dirty <- getCode $ emitCCall
+                [{-no results-}]
+                (CmmLit (CmmLabel mkDirty_MUT_ARR_PTRS_card_Label))
+                [(baseExpr, AddrHint), (addr, AddrHint), (card, NoHint)]
+       remembered <- mkCmmIfThen'
+           (cmmEqWord dflags (CmmMachOp (mo_u_8ToWord dflags) [CmmLoad card_p b8])
+                             (zeroExpr dflags))
+           dirty (Just False)
+       emit =<< mkCmmIfThenElse' (isCardRemSetArray dflags addr)
+           remembered (mkStore card_p (CmmLit (CmmInt 1 W8))) (Just False)
 
 loadArrPtrsSize :: DynFlags -> CmmExpr -> CmmExpr
 loadArrPtrsSize dflags addr = CmmLoad (cmmOffsetB dflags addr off) (bWord dflags)
  where off = fixedHdrSize dflags + oFFSET_StgMutArrPtrs_ptrs dflags
 
+-- | Whether the RTS remembers the dirty cards of this array itself; the
+-- same test as isCardRemSetArray() in rts/sm/Storage.h.
+isCardRemSetArray :: DynFlags -> CmmExpr -> CmmExpr
+isCardRemSetArray dflags addr =
+    cmmUGeWord dflags (loadArrPtrsSize dflags addr)
+        (CmmLoad (mkLblExpr (mkCmmDataLabel rtsUnitId
+                                            (fsLit "card_remset_min_ptrs")))
+                 (bWord dflags))
+
 mkBasicIndexedRead :: ByteOff      -- Initial offset in bytes
                    -> Maybe MachOp -- Optional result cast
                    -> CmmType      -- Type of element we are accessing
@@ -2198,7 +2219,7 @@ emitCopyArray copy src0 src_off dst0 dst_off0 n = do
         dst_cards_p <- assignTempE $ cmmOffsetExprW dflags dst_elems_p
                        (loadArrPtrsSize dflags dst)
 
-        emitSetCards dst_off dst_cards_p n
+        emitSetCards dst dst_off dst_cards_p n
 
 doCopySmallArrayOp :: CmmExpr -> CmmExpr -> CmmExpr -> CmmExpr -> WordOff
                    -> FCode ()
@@ -2330,22 +2351,31 @@ emitCloneSmallArray info_p res_r src src_off n = do
 
     emit $ mkAssign (CmmLocal res_r) (CmmReg arr)
 
--- | Takes and offset in the destination array, the base address of
--- the card table, and the number of elements affected (*not* the
+-- | Takes the destination array, an offset in it, the base address of
+-- its card table, and the number of elements affected (*not* the
 -- number of cards). The number of elements may not be zero.
--- Marks the relevant cards as dirty.
-emitSetCards :: CmmExpr -> CmmExpr -> WordOff -> FCode ()
-emitSetCards dst_start dst_cards_start n = do
+-- Marks the relevant cards as dirty. If the RTS remembers the cards of
+-- the array, it does this itself (see Note [Card remembered set] in
+-- rts/sm/Scav.c).
+emitSetCards :: CmmExpr -> CmmExpr -> CmmExpr -> WordOff -> FCode ()
+emitSetCards dst dst_start dst_cards_start n = do
     dflags <- getDynFlags
     start_card <- assignTempE $ cardCmm dflags dst_start
     let end_card = cardCmm dflags
                    (cmmSubWord dflags
                     (cmmAddWord dflags dst_start (mkIntExpr dflags n))
                     (mkIntExpr dflags 1))
-    emitMemsetCall (cmmAddWord dflags dst_cards_start start_card)
+    remembered <- getCode $ emitCCall
+        [{-no results-}]
+        (CmmLit (CmmLabel mkDirty_MUT_ARR_PTRS_cards_Label))
+        [(baseExpr, AddrHint), (dst, AddrHint),
+         (dst_start, NoHint), (mkIntExpr dflags n, NoHint)]
+    set <- getCode $ emitMemsetCall (cmmAddWord dflags dst_cards_start start_card)
         (mkIntExpr dflags 1)
         (cmmAddWord dflags (cmmSubWord dflags end_card start_card) (mkIntExpr dflags 1))
         1 -- no alignment (1 byte)
+    emit =<< mkCmmIfThenElse' (isCardRemSetArray dflags dst)
+        remembered set (Just False)
 
 -- Convert an element index to a card index
 cardCmm :: DynFlags -> CmmExpr -> CmmExpr
@@ -869,7 +869,7 @@
         prim %memcpy(dst_p, src_p, bytes, SIZEOF_W);              \
                                                                   \
         dst_cards_p = dst_elems_p + WDS(StgMutArrPtrs_ptrs(dst)); \
-        setCards(dst_cards_p, dst_off, n);                        \
+        setCards(dst, dst_cards_p, dst_off, n);                   \
     }                                                             \
                                                                   \
     return ();
@@ -892,21 +892,28 @@
         }                                                         \
                                                                   \
         dst_cards_p = dst_elems_p + WDS(StgMutArrPtrs_ptrs(dst)); \
-        setCards(dst_cards_p, dst_off, n);                        \
+        setCards(dst, dst_cards_p, dst_off, n);                   \
     }                                                             \
                                                                   \
     return ();
 
 /*
  * Set the cards in the cards table pointed to by dst_cards_p for an
- * update to n elements, starting at element dst_off.
+ * update to n elements of the array dst, starting at element dst_off.
+ * If the RTS remembers the dirty cards of dst individually, it has to
+ * set them itself; see Note [Card remembered set] in rts/sm/Scav.c.
  */
-#define setCards(dst_cards_p, dst_off, n)                      \
-    W_ __start_card, __end_card, __cards;                      \
-    __start_card = mutArrPtrCardDown(dst_off);                 \
-    __end_card = mutArrPtrCardDown((dst_off) + (n) - 1);       \
-    __cards = __end_card - __start_card + 1;                   \
-    prim %memset((dst_cards_p) + __start_card, 1, __cards, 1);
+#define setCards(dst, dst_cards_p, dst_off, n)                      \
+    W_ __start_card, __end_card, __cards;                           \
+    if (StgMutArrPtrs_ptrs(dst) >= W_[card_remset_min_ptrs]) {      \
+        ccall dirty_MUT_ARR_PTRS_cards(BaseReg "ptr", dst "ptr",    \
+                                       dst_off, n);                 \
+    } else {                                                        \
+        __start_card = mutArrPtrCardDown(dst_off);                  \
+        __end_card = mutArrPtrCardDown((dst_off) + (n) - 1);        \
+        __cards = __end_card - __start_card + 1;                    \
+        prim %memset((dst_cards_p) + __start_card, 1, __cards, 1);  \
+    }
 
 /* Complete function body for the clone family of small (mutable)
    array ops. Defined as a macro to avoid function call overhead or
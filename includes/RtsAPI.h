@@ -153,6 +153,27 @@ typedef struct GCDetails_ {
   Time elapsed_ns;
 } GCDetails;
 
+//
+// A histogram of GC pause times.  Bucket 0 counts the pauses shorter
+// than 2^GC_PAUSE_HIST_MIN_SHIFT ns (about 1us).  Above that, each power
+// of two is divided into four buckets: bucket 1 + 4*k + j counts the
+// pauses of at least (4 + j) * 2^(GC_PAUSE_HIST_MIN_SHIFT + k - 2) ns,
+// up to the start of the next bucket.  The last bucket also counts any
+// longer pauses.
+//
+#define GC_PAUSE_HIST_MIN_SHIFT 10
+#define GC_PAUSE_HIST_BUCKETS   128
+
+// The number of generations that have their own pause histogram.  GCs of
+// older generations are counted in the last one.
+#define GC_PAUSE_HIST_GENS      4
+
+typedef struct GCPauseHistogram_ {
+    // The number of pauses counted
+  uint64_t count;
+  uint64_t buckets[GC_PAUSE_HIST_BUCKETS];
+} GCPauseHistogram;
+
 //
 // Stats about the RTS currently, and since the start of execution
 //
@@ -241,6 +262,30 @@ typedef struct _RTSStats {
     // The number of times a GC thread has iterated it's outer loop across all
     // parallel GCs
   uint64_t scav_find_work;
+    // The number of stack chunks of the standard size (+RTS -kc) that were
+    // reused from a Capability's stack chunk cache
+  uint64_t stack_chunk_cache_hits;
+    // The number of stack chunks of the standard size that had to be
+    // allocated because the stack chunk cache was empty
+  uint64_t stack_chunk_cache_misses;
+
+  // -----------------------------------
+  // Distribution of GC pauses
+
+    // The elapsed time of each GC (GCDetails.elapsed_ns), by generation
+  GCPauseHistogram gc_pause_hist[GC_PAUSE_HIST_GENS];
+    // The time taken to stop the mutator before each GC
+    // (GCDetails.sync_elapsed_ns)
+  GCPauseHistogram gc_sync_hist;
+    // Percentiles of the GC pauses of all generations, estimated from the
+    // histograms (never more than the longest pause)
+  Time gc_pause_p50_ns;
+  Time gc_pause_p99_ns;
+  Time gc_pause_p999_ns;
+    // Percentiles of the sync times
+  Time gc_sync_p50_ns;
+  Time gc_sync_p99_ns;
+  Time gc_sync_p999_ns;
 } RTSStats;
 
 void getRTSStats (RTSStats *s);
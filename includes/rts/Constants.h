@@ -170,6 +170,12 @@
 /* The size of a megablock (2^MBLOCK_SHIFT bytes) */
 #define MBLOCK_SHIFT   20
 
+/* The number of entries in a segment of the stable pointer table
+ * (2^STABLE_PTR_SEGMENT_BITS); see Note [Stable pointer table] in
+ * rts/StablePtr.c */
+#define STABLE_PTR_SEGMENT_BITS 10
+#define STABLE_PTR_SEGMENT_SIZE (1 << STABLE_PTR_SEGMENT_BITS)
+
 /* -----------------------------------------------------------------------------
    Bitmap/size fields (used in info tables)
    -------------------------------------------------------------------------- */
@@ -181,12 +181,18 @@
 
 #define EVENT_USER_BINARY_MSG              181
 
+#define EVENT_ALLOC_SAMPLE                 182 /* (thread, info, closure_type,
+                                                  bytes, n_frames, frames) */
+
+#define EVENT_GC_PAUSE_HISTOGRAM           183 /* (histogram, count,
+                                                  n_buckets, buckets) */
+
 /*
  * The highest event code +1 that ghc itself emits. Note that some event
  * ranges higher than this are reserved but not currently emitted by ghc.
  * This must match the size of the EventDesc[] array in EventLog.c
  */
-#define NUM_GHC_EVENT_TAGS        182
+#define NUM_GHC_EVENT_TAGS        184
 
 #if 0  /* DEPRECATED EVENTS: */
 /* we don't actually need to record the thread, it's implicit */
@@ -234,6 +240,12 @@
 #define CAPSET_TYPE_OSPROCESS   2  /* caps belong to the same OS process */
 #define CAPSET_TYPE_CLOCKDOMAIN 3  /* caps share a local clock/time      */
 
+/*
+ * Histogram values for EVENT_GC_PAUSE_HISTOGRAM: a generation number for
+ * the pauses of that generation's GCs, or this for the sync times
+ */
+#define GC_PAUSE_HIST_SYNC      0xffff
+
 /*
  * Heap profile breakdown types. See EVENT_HEAP_PROF_BEGIN.
  */
@@ -60,6 +60,10 @@ typedef struct _GC_FLAGS {
 
     bool sweep;		/* use "mostly mark-sweep" instead of copying
                                  * for the oldest generation */
+    bool lazySweep;             /* sweep the oldest generation between GCs */
+    bool fillHoles;             /* promote into holes left by sweeping */
+    bool concurrentMark;        /* mark the oldest generation in a
+                                 * separate thread */
     bool ringBell;
 
     Time    idleGCDelayTime;    /* units: TIME_RESOLUTION */
@@ -68,6 +72,12 @@ typedef struct _GC_FLAGS {
     Time    longGCSync;         /* units: TIME_RESOLUTION */
 
     StgWord heapBase;           /* address to ask the OS for memory */
+    bool hugePages;             /* back the heap with huge pages */
+    bool cardRemSet;            /* remember dirty cards, not arrays */
+    bool prefetch;              /* prefetch ahead of evacuate() */
+    bool reusePinned;           /* reuse holes in pinned blocks */
+    StgWord decommitRate;       /* bytes per second returned to the OS
+                                 * in the background; 0 == in the GC */
 
     StgWord allocLimitGrace;    /* units: *blocks*
                                  * After an AllocationLimitExceeded
@@ -155,6 +165,9 @@ typedef struct _PROFILING_FLAGS {
     const char*         retainerSelector;
     const char*         bioSelector;
 
+    bool        heapSnapshotSignal;  /* +RTS --heap-snapshot: on SIGUSR2 */
+    const char* heapSnapshotPrefix;  /* NULL: the program name */
+
 } PROFILING_FLAGS;
 
 #define TRACE_NONE      0
@@ -171,6 +184,10 @@ typedef struct _TRACE_FLAGS {
     bool sparks_full;    /* trace spark events 100% accurately */
     bool user;           /* trace user events (emitted from Haskell code) */
     char *trace_output;  /* output filename for eventlog */
+    StgWord allocSample; /* bytes between allocation samples (0 = off) */
+    bool allocSampleStacks; /* add a stack trace to each allocation sample */
+    bool gcPauseHist;    /* log GC pause histograms */
+    Time gcPauseHistInterval; /* at most this often */
 } TRACE_FLAGS;
 
 /* See Note [Synchronization of flags and base APIs] */
@@ -199,8 +216,14 @@ typedef struct _MISC_FLAGS {
     bool internalCounters;       /* See Note [Internal Counter Stats] */
     StgWord linkerMemBase;       /* address to ask the OS for memory
                                   * for the linker, NULL ==> off */
+    uint32_t ioBackend;          /* IO_BACKEND_*, non-threaded RTS only */
 } MISC_FLAGS;
 
+/* See Note [Event-driven I/O waiting] in rts/posix/Select.c */
+#define IO_BACKEND_DEFAULT 0     /* epoll if available, else select */
+#define IO_BACKEND_SELECT  1
+#define IO_BACKEND_EPOLL   2
+
 /* See Note [Synchronization of flags and base APIs] */
 typedef struct _PAR_FLAGS {
   uint32_t       nCapabilities;  /* number of threads to run simultaneously */
@@ -227,6 +250,10 @@ typedef struct _PAR_FLAGS {
                                  /* Use this many threads for parallel
                                   * GC (default: use all nNodes). */
 
+  bool           parCompactEnabled;
+                                 /* compact the oldest generation in
+                                  * parallel (with -c) */
+
   bool           setAffinity;    /* force thread affinity with CPUs */
 } PAR_FLAGS;
 
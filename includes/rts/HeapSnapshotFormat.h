@@ -0,0 +1,85 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team, 2018
+ *
+ * Heap snapshot format
+ *
+ * A heap snapshot is written by performHeapSnapshot() and by
+ * +RTS --heap-snapshot (see rts/HeapSnapshot.c).  It describes the live
+ * heap after a major GC as a graph: a node for each closure and an edge
+ * for each pointer.  It is streamed out as the heap is walked, so the
+ * writer never holds the graph in memory; a reader that wants to do
+ * anything but count has to load it (see utils/heap-snapshot).
+ *
+ * All numbers are unsigned or signed LEB128 (ULEB / SLEB below), so the
+ * format is endian-independent and small values take a single byte.
+ * Addresses are the addresses of the closures in the running program,
+ * untagged.
+ *
+ * The format
+ * ----------
+ *
+ * snapshot : HSNAP_MAGIC           -- 8 bytes
+ *            ULEB                  -- HSNAP_VERSION
+ *            ULEB                  -- word size of the program in bytes
+ *            Record*
+ *            HSNAP_END ULEB ULEB   -- number of nodes, number of roots
+ *
+ * Record : HSNAP_NODE
+ *            ULEB                  -- address
+ *            ULEB                  -- info pointer
+ *            ULEB                  -- closure type (rts/storage/ClosureTypes.h)
+ *            ULEB                  -- size in words
+ *            ULEB                  -- number of pointers
+ *            SLEB*                 -- each pointer, minus the address
+ *        | HSNAP_ROOT
+ *            ULEB                  -- root kind (HSNAP_ROOT_*)
+ *            ULEB                  -- address of the object
+ *        | HSNAP_COMPACT_BEGIN
+ *            ULEB                  -- address of the COMPACT_NFDATA
+ *        | HSNAP_COMPACT_END
+ *
+ * Each live closure appears in exactly one HSNAP_NODE record, in no
+ * particular order; a pointer may refer to a node that comes later.
+ * Pointers to things that are not closures (e.g. into the middle of a
+ * stack) may not match any node, and a reader should ignore them.
+ *
+ * The nodes between HSNAP_COMPACT_BEGIN and HSNAP_COMPACT_END are the
+ * objects in a compact region.  They are kept alive by the region as a
+ * whole, so a reader should treat them as retained by the
+ * COMPACT_NFDATA node.
+ *
+ * Weak pointers (WEAK) have no edge to their key, because a weak
+ * pointer does not keep its key alive.
+ *
+ * A snapshot that is cut short has no HSNAP_END record.
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#define HSNAP_MAGIC             "GHCHSNAP"
+#define HSNAP_MAGIC_LEN         8
+#define HSNAP_VERSION           1
+
+/*
+ * Record tags
+ */
+#define HSNAP_END               0
+#define HSNAP_NODE              1
+#define HSNAP_ROOT              2
+#define HSNAP_COMPACT_BEGIN     3
+#define HSNAP_COMPACT_END       4
+
+/*
+ * Root kinds
+ */
+#define HSNAP_ROOT_CAPABILITY   0   /* run queues, inboxes, foreign calls */
+#define HSNAP_ROOT_SCHEDULER    1   /* blocked and sleeping queues */
+#define HSNAP_ROOT_STABLE_PTR   2
+#define HSNAP_ROOT_CAF          3   /* the value of a retained CAF */
+#define HSNAP_ROOT_SPARK        4
+#define HSNAP_ROOT_THREAD       5   /* every live thread */
+#define HSNAP_ROOT_WEAK         6   /* every live weak pointer */
+
+#define HSNAP_N_ROOT_KINDS      7
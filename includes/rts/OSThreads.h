@@ -181,6 +181,10 @@ extern void closeCondition        ( Condition* pCond );
 extern bool broadcastCondition    ( Condition* pCond );
 extern bool signalCondition       ( Condition* pCond );
 extern bool waitCondition         ( Condition* pCond, Mutex* pMut );
+// Like waitCondition, but gives up after the given time; returns false
+// if it timed out.
+extern bool timedWaitCondition    ( Condition* pCond, Mutex* pMut,
+                                    Time timeout );
 
 //
 // Mutexes
@@ -21,15 +21,17 @@ StgStablePtr getStablePtr  (StgPtr p);
    -------------------------------------------------------------------------- */
 
 typedef struct {
-    StgPtr addr;         // Haskell object when entry is in use, next free
-                         // entry (NULL when this is the last free entry)
+    StgPtr addr;         // Haskell object when entry is in use, NULL
                          // otherwise.
 } spEntry;
 
-extern DLL_IMPORT_RTS spEntry *stable_ptr_table;
+// The spine of the table: an array of pointers to fixed-size segments.
+extern DLL_IMPORT_RTS spEntry **stable_ptr_table;
 
 EXTERN_INLINE
 StgPtr deRefStablePtr(StgStablePtr sp)
 {
-    return stable_ptr_table[(StgWord)sp].addr;
+    StgWord i = (StgWord)sp;
+    return stable_ptr_table[i >> STABLE_PTR_SEGMENT_BITS]
+                           [i & (STABLE_PTR_SEGMENT_SIZE - 1)].addr;
 }
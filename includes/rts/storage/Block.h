@@ -153,6 +153,12 @@ typedef struct bdescr_ {
 #define BF_SWEPT     256
 /* Block is part of a Compact */
 #define BF_COMPACT   512
+/* Block of pinned objects whose live objects are being marked */
+#define BF_PINNED_MARKS 1024
+/* Block is in the snapshot of a concurrent mark (sm/ConcMark.c) */
+#define BF_CONC_MARK 2048
+/* Large object or compact found live by the concurrent mark */
+#define BF_CONC_MARKED 4096
 /* Maximum flag value (do not define anything higher than this!) */
 #define BF_FLAG_MAX  (1 << 15)
 
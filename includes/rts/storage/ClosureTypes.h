@@ -16,6 +16,7 @@
  *   - the closure flags table in rts/ClosureFlags.c
  *   - isRetainer in rts/RetainerProfile.c
  *   - the closure_type_names list in rts/Printer.c
+ *   - the closure_type_names list in utils/heap-snapshot/HeapSnapshotReader.c
  */
 
 /* Object tag 0 raises an internal error */
@@ -458,9 +458,10 @@ typedef struct StgCompactNFData_ {
     StgCompactNFDataBlock *last;
       // the last block of the chain (to know where to append new
       // blocks for resize)
-    struct hashtable *hash;
-      // the hash table for the current compaction, or NULL if
-      // there's no (sharing-preserved) compaction in progress.
+    struct CompactHash_ *hash;
+      // the objects already copied by the current compaction (see
+      // rts/sm/CNF.h), or NULL if there's no (sharing-preserved)
+      // compaction in progress.
     StgClosure *result;
       // Used temporarily to store the result of compaction.  Doesn't need to be
       // a GC root.
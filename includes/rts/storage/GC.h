@@ -156,7 +156,6 @@ typedef struct generation_ {
     bdescr *     bitmap;                // bitmap for compacting collection
 
     StgTSO *     old_threads;
-    StgWeak *    old_weak_ptr_list;
 } generation;
 
 extern generation * generations;
@@ -214,6 +213,11 @@ extern W_ large_alloc_lim;
 void performGC(void);
 void performMajorGC(void);
 
+/* Do a major GC and write a heap snapshot to the given file (see
+ * rts/HeapSnapshotFormat.h).  Returns false if it couldn't be written.
+ */
+bool performHeapSnapshot(const char *path);
+
 /* -----------------------------------------------------------------------------
    The CAF table - used to let us revert CAFs in GHCi
    -------------------------------------------------------------------------- */
@@ -236,6 +240,29 @@ void setKeepCAFs (void);
 
 void dirty_MUT_VAR(StgRegTable *reg, StgClosure *p);
 
+/* -----------------------------------------------------------------------------
+   The card write barrier for MUT_ARR_PTRS: mark the card holding an
+   element (or the cards holding a range of elements) as dirty.
+   -------------------------------------------------------------------------- */
+
+void dirty_MUT_ARR_PTRS_card(StgRegTable *reg, StgMutArrPtrs *a, W_ card);
+void dirty_MUT_ARR_PTRS_cards(StgRegTable *reg, StgMutArrPtrs *a,
+                              W_ off, W_ n);
+
+// Compiled code only calls these for arrays with at least this many
+// elements, and otherwise sets the card bytes itself:
+extern W_ card_remset_min_ptrs;
+
+/* -----------------------------------------------------------------------------
+   Compact files (see Note [Compact files] in rts/sm/CNF.c), used by
+   GHC.Compact.Serialized.writeCompactFile and readCompactFile.
+   -------------------------------------------------------------------------- */
+
+int compactWriteFile (StgCompactNFDataBlock *first, StgClosure *root,
+                      const char *path);
+int compactReadFile  (const char *path, StgCompactNFDataBlock **first,
+                      StgClosure **root);
+
 /* set to disable CAF garbage collection in GHCi. */
 /* (needed when dynamic libraries are used). */
 extern bool keepCAFs;
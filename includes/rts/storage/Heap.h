@@ -16,3 +16,16 @@ void heap_view_closure_ptrs_in_pap_payload(StgClosure *ptrs[], StgWord *nptrs
                         , StgClosure *fun, StgClosure **payload, StgWord size);
 
 StgWord heap_view_closureSize(StgClosure *closure);
+
+/*
+ * Collect the pointers of a closure into ptrs[], which must have room
+ * for closure_sizeW(closure) + 1 entries.  Returns the number of
+ * pointers.  With srts, the SRTs of thunks, functions and stack frames
+ * are included, and so is the stack in the payload of an AP_STACK.
+ * collect_closure_pointers() is the same, with the closure's info
+ * pointer already read by the caller.
+ */
+StgWord collect_pointers(StgClosure *closure, StgClosure *ptrs[], bool srts);
+StgWord collect_closure_pointers(StgClosure *closure,
+                                 const StgInfoTable *info,
+                                 StgClosure *ptrs[], bool srts);
@@ -54,11 +54,10 @@ typedef union {
   StgAsyncIOResult *async_result;
 #endif
 #if !defined(THREADED_RTS)
-  StgWord target;
-    // Only for the non-threaded RTS: the target time for a thread
-    // blocked in threadDelay, in units of 1ms.  This is a
-    // compromise: we don't want to take up much space in the TSO.  If
-    // you want better resolution for threadDelay, use -threaded.
+  StgWord sleeper;
+    // Only for the non-threaded RTS: for a thread blocked in
+    // threadDelay, the index of its entry in the heap of sleeping
+    // threads.  See Note [Sleeping threads] in rts/posix/Select.c.
 #endif
 } StgTSOBlockInfo;
 
@@ -238,9 +237,9 @@ void dirty_STACK (Capability *cap, StgStack *stack);
 
         BlockedOnMsgThrowTo    MessageThrowTo *     TSO->blocked_exception
 
-        BlockedOnRead          NULL                 blocked_queue
-        BlockedOnWrite         NULL                 blocked_queue
-        BlockedOnDelay         NULL                 blocked_queue
+        BlockedOnRead          fd                   blocked_queue or fd queue
+        BlockedOnWrite         fd                   blocked_queue or fd queue
+        BlockedOnDelay         heap index           sleepers heap
 
       tso->link == END_TSO_QUEUE, if the thread is currently running.
 
@@ -497,7 +497,6 @@ extern StgWord rts_breakpoint_io_action[];
 
 // Schedule.c
 extern StgWord RTS_VAR(blocked_queue_hd), RTS_VAR(blocked_queue_tl);
-extern StgWord RTS_VAR(sleeping_queue);
 extern StgWord RTS_VAR(sched_mutex);
 
 // Apply.cmm
@@ -509,6 +508,7 @@ extern const StgWord stg_stack_save_entries[];
 // Storage.c
 extern unsigned int RTS_VAR(g0);
 extern unsigned int RTS_VAR(large_alloc_lim);
+extern StgWord RTS_VAR(card_remset_min_ptrs);
 extern StgWord RTS_VAR(atomic_modify_mutvar_mutex);
 
 // RtsFlags
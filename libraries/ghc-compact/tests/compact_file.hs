@@ -0,0 +1,49 @@
+module Main where
+
+import Control.Exception
+import System.Mem
+
+import GHC.Compact
+import GHC.Compact.Serialized
+
+assertFail :: String -> IO ()
+assertFail msg = throwIO $ AssertionFailed msg
+
+assertEquals :: (Eq a, Show a) => a -> a -> IO ()
+assertEquals expected actual =
+  if expected == actual then return ()
+  else assertFail $ "expected " ++ (show expected)
+       ++ ", got " ++ (show actual)
+
+load :: FilePath -> IO (Compact [(Int, String)])
+load path = do
+  mcnf <- readCompactFile path
+  case mcnf of
+    Nothing -> assertFail "load failed" >> undefined
+    Just cnf -> return cnf
+
+main = do
+  let val = [ (i, show i) | i <- [1..20000] ] :: [(Int, String)]
+
+  -- small blocks, so that the file has lots of them
+  cnf <- compactSized 4096 True val
+  writeCompactFile "compact_file.cnf" cnf
+  performMajorGC
+
+  -- The first load can normally go where the file was laid out; the
+  -- second can't, and has to be fixed up.
+  cnf1 <- load "compact_file.cnf"
+  cnf2 <- load "compact_file.cnf"
+  -- the compacts don't depend on the file once they are loaded
+  writeFile "compact_file.cnf" ""
+  performMajorGC
+  assertEquals val (getCompact cnf1)
+  assertEquals val (getCompact cnf2)
+  print . (== 0) . flip mod 4096 =<< compactSize cnf1
+
+  -- anything else is rejected
+  writeFile "compact_file.bad" (replicate 10000 'x')
+  bad <- readCompactFile "compact_file.bad" :: IO (Maybe (Compact ()))
+  case bad of
+    Nothing -> putStrLn "rejected"
+    Just _ -> assertFail "loaded a bad file"
@@ -0,0 +1,37 @@
+{-# LANGUAGE BangPatterns #-}
+import Control.Exception
+import GHC.Compact
+import Data.Time.Clock
+import Text.Printf
+import System.Environment
+import System.Mem
+
+-- Benchmark compactWithSharing on a heavily shared DAG: every node is
+-- referenced twice, so the table of copied objects is hit on every
+-- other pointer.  e.g. (10M nodes)
+--   ./compact_share_bench 5000000
+
+data T = Leaf | Node !Int T T
+
+-- 2n nodes, but 2^n paths from the root; compact would not terminate.
+ladder :: Int -> T
+ladder n = go 1 Leaf Leaf
+  where
+    go !i a b
+      | i > n = Node 0 a b
+      | otherwise = let !a' = Node i a b; !b' = Node (-i) a b
+                    in go (i+1) a' b'
+
+main = do
+  [n] <- map read <$> getArgs
+  t <- evaluate (ladder n)
+  timeIt "compactWithSharing" $ compactWithSharing t >>= compactSize >>= print
+
+timeIt :: String -> IO a -> IO a
+timeIt str io = do
+  performMajorGC
+  t0 <- getCurrentTime
+  a <- io
+  t1 <- getCurrentTime
+  printf "%s: %.2f\n" str (realToFrac (t1 `diffUTCTime` t0) :: Double)
+  return a
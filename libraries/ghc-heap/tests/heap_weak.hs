@@ -0,0 +1,29 @@
+{-# LANGUAGE MagicHash, UnboxedTuples #-}
+
+-- The pointers of a Weak# include the link to the next weak pointer,
+-- which is NULL at the end of the list. It must not be returned by
+-- unpackClosure#, or the next GC would follow it.
+
+import GHC.Exts
+import GHC.Exts.Heap
+import GHC.IO
+import GHC.Weak
+import System.Mem
+
+data Ptrs = Ptrs (Array# Any)
+
+weakPtrs :: Weak a -> IO Ptrs
+weakPtrs (Weak w) = IO $ \s -> case unpackClosure# w of
+  (# _, _, ps #) -> (# s, Ptrs ps #)
+
+main :: IO ()
+main = do
+  ws <- mapM (\i -> mkWeakPtr i Nothing) [1 .. 10 :: Int]
+  performMajorGC
+  ps <- mapM weakPtrs ws
+  cs <- mapM (\(Weak w) -> getClosureData w) ws
+  -- keep the pointer arrays alive across a GC
+  performMajorGC
+  print (and [ I# (sizeofArray# a) > 0 | Ptrs a <- ps ])
+  print (all ((== WEAK) . tipe . info) cs)
+  mapM_ deRefWeak ws
@@ -0,0 +1,209 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Allocation sampling (+RTS --alloc-sample).
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "Capability.h"
+#include "RtsFlags.h"
+#include "Trace.h"
+#include "Libdw.h"
+#include "AllocSample.h"
+
+/* -----------------------------------------------------------------------------
+   Note [Allocation sampling]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   With +RTS --alloc-sample=<size> -l, each capability emits an
+   EVENT_ALLOC_SAMPLE for about every <size> bytes that it allocates.
+   The event gives the info pointer and closure type of a sampled
+   object, the thread that allocated it, the number of bytes allocated
+   since the previous sample (so that a tool can scale the samples up),
+   and, with --alloc-sample-stacks, the innermost frames of a stack
+   trace from libdw.  This works in the normal RTS, so allocation
+   hotspots can be found without a profiled build.
+
+   Compiled code allocates by bumping Hp, so we can't look at every
+   allocation.  Instead we sample at the places where allocation is
+   already accounted for (see Note [allocation accounting] in
+   Storage.c): whenever a capability finishes with a nursery block,
+   finishedNurseryBlock() and stg_gc_noregs subtract the bytes used in
+   the block from cap->alloc_sample_left, and when that drops below
+   zero they call allocSample().  Large objects are accounted for in
+   allocateMightFail(), which calls allocSampleLarge().  When sampling
+   is off, alloc_sample_left starts at HS_INT_MAX, so the cost is a
+   subtraction and a test per block.  On a 32-bit machine it can still
+   run out after 2GB of allocation, so allocSample() and
+   allocSampleLarge() check that sampling is on before taking a sample.
+
+   The object we sample is the first one in the block: the allocation
+   that overflowed the previous block and had to move on to this one.
+   Larger allocations are more likely to overflow a block, so this picks
+   objects with a probability proportional to their size, which is what
+   we want.  By the time the block is finished, its first object has
+   been initialised.  If it was a thunk that has since been updated, we
+   see the indirection instead.
+
+   A large object is returned by allocate() before its header has been
+   written, so allocSampleLarge() only records it (and takes the stack
+   trace) in cap->alloc_sample_pending, and flushAllocSample() emits the
+   event later: at the next sample, or at the start of the next GC,
+   before the object can have been freed.
+
+   Stack traces are only taken when the capability is running a Haskell
+   thread; samples taken by the scheduler or the GC record thread 0.
+   Unwinding the stack takes far longer than the rest of the sample, so
+   --alloc-sample-stacks should be used with a larger <size>.
+   -------------------------------------------------------------------------- */
+
+#define ALLOC_SAMPLE_MAX_FRAMES 32
+
+static bool
+alloc_sampling (void)
+{
+#if defined(TRACING)
+    return RtsFlags.TraceFlags.tracing == TRACE_EVENTLOG &&
+           RtsFlags.TraceFlags.allocSample != 0;
+#else
+    return false;
+#endif
+}
+
+static StgInt
+alloc_sample_interval (void)
+{
+    if (alloc_sampling()) {
+        return RtsFlags.TraceFlags.allocSample;
+    }
+    return HS_INT_MAX;
+}
+
+void
+initAllocSampling (Capability *cap)
+{
+    cap->alloc_sample_left = alloc_sample_interval();
+    cap->alloc_sample_pending.obj = NULL;
+    cap->alloc_sample_pending.stack = NULL;
+}
+
+// Start counting towards the next sample, and return the number of
+// bytes allocated since the last one.
+static W_
+next_sample (Capability *cap)
+{
+    StgInt interval = alloc_sample_interval();
+    W_ bytes = interval - cap->alloc_sample_left;
+
+    cap->alloc_sample_left = interval;
+    return bytes;
+}
+
+static StgThreadID
+sample_thread (Capability *cap)
+{
+    if (cap->r.rCurrentTSO != NULL) {
+        return cap->r.rCurrentTSO->id;
+    } else {
+        return 0;
+    }
+}
+
+#if USE_LIBDW
+typedef struct {
+    uint32_t n_frames;
+    StgWord64 frames[ALLOC_SAMPLE_MAX_FRAMES];
+} SampleFrames;
+
+static int
+sample_frame (StgPtr pc, void *data)
+{
+    SampleFrames *sf = (SampleFrames *)data;
+
+    sf->frames[sf->n_frames++] = (StgWord64)(W_)pc;
+    return sf->n_frames == ALLOC_SAMPLE_MAX_FRAMES;
+}
+#endif
+
+static Backtrace *
+sample_stack (Capability *cap STG_UNUSED)
+{
+#if USE_LIBDW && defined(TRACING)
+    if (RtsFlags.TraceFlags.allocSampleStacks &&
+        cap->r.rCurrentTSO != NULL) {
+        LibdwSession *session = libdwPoolTake();
+        Backtrace *bt;
+
+        if (session == NULL) {
+            return NULL;
+        }
+        bt = libdwGetBacktrace(session);
+        libdwPoolRelease(session);
+        return bt;
+    }
+#endif
+    return NULL;
+}
+
+static void
+post_sample (Capability *cap, StgClosure *p, StgThreadID thread,
+             W_ bytes, Backtrace *stack)
+{
+#if USE_LIBDW
+    SampleFrames sf;
+
+    sf.n_frames = 0;
+    if (stack != NULL) {
+        libdwForEachFrameOutwards(stack, sample_frame, &sf);
+        backtraceFree(stack);
+    }
+    traceAllocSample(cap, thread, p, bytes, sf.n_frames, sf.frames);
+#else
+    traceAllocSample(cap, thread, p, bytes, 0, NULL);
+#endif
+}
+
+void
+flushAllocSample (Capability *cap)
+{
+    PendingAllocSample *s = &cap->alloc_sample_pending;
+
+    if (s->obj != NULL) {
+        post_sample(cap, s->obj, s->thread, s->bytes, s->stack);
+        s->obj = NULL;
+        s->stack = NULL;
+    }
+}
+
+void
+allocSample (Capability *cap, bdescr *bd)
+{
+    W_ bytes = next_sample(cap);
+
+    if (!alloc_sampling()) {
+        return;
+    }
+    flushAllocSample(cap);
+    post_sample(cap, (StgClosure *)bd->start, sample_thread(cap), bytes,
+                sample_stack(cap));
+}
+
+void
+allocSampleLarge (Capability *cap, bdescr *bd)
+{
+    PendingAllocSample *s = &cap->alloc_sample_pending;
+    W_ bytes = next_sample(cap);
+
+    if (!alloc_sampling()) {
+        return;
+    }
+    flushAllocSample(cap);
+    s->bytes = bytes;
+    s->obj = (StgClosure *)bd->start;
+    s->thread = sample_thread(cap);
+    s->stack = sample_stack(cap);
+}
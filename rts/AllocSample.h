@@ -0,0 +1,33 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Allocation sampling (+RTS --alloc-sample).  See Note [Allocation
+ * sampling] in AllocSample.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+/* A large object that has been allocated but not yet sampled, because
+ * allocate() returns it before its header has been written.
+ */
+typedef struct {
+    StgClosure *obj;            // NULL if there is nothing to sample
+    StgThreadID thread;         // allocating thread, or 0 if unknown
+    W_ bytes;                   // bytes allocated since the last sample
+    Backtrace *stack;           // NULL unless --alloc-sample-stacks
+} PendingAllocSample;
+
+void initAllocSampling      (Capability *cap);
+
+// Called when cap->alloc_sample_left drops below zero
+void allocSample            (Capability *cap, bdescr *bd);
+void allocSampleLarge       (Capability *cap, bdescr *bd);
+
+// Sample the pending large object, if there is one
+void flushAllocSample       (Capability *cap);
+
+#include "EndPrivate.h"
@@ -18,4 +18,30 @@
  */
 RTS_PRIVATE void awaitEvent(bool wait);  /* In posix/Select.c or
                                           * win32/AwaitEvent.c */
+
+#if !defined(mingw32_HOST_OS)
+/* Threads blocked in waitRead#/waitWrite#.
+ * See Note [Event-driven I/O waiting] in posix/Select.c.
+ *
+ * Called from STG :  blockOnFd only
+ * Locks assumed   :  sched_mutex
+ */
+RTS_PRIVATE void blockOnFd (StgTSO *tso);
+RTS_PRIVATE void removeFdWaiter (Capability *cap, StgTSO *tso);
+RTS_PRIVATE bool anyFdWaiters (void);
+RTS_PRIVATE void markFdWaiters (evac_fn evac, void *user);
+RTS_PRIVATE void resetFdWaitersAfterFork (void);
+
+/* Threads blocked in threadDelay.
+ * See Note [Sleeping threads] in posix/Select.c.
+ *
+ * Called from STG :  insertSleeper only
+ * Locks assumed   :  sched_mutex
+ */
+RTS_PRIVATE void insertSleeper (StgTSO *tso, StgWord target);
+RTS_PRIVATE void removeSleeper (StgTSO *tso);
+RTS_PRIVATE bool anySleepers (void);
+RTS_PRIVATE StgWord getSleeperTarget (StgTSO *tso);
+RTS_PRIVATE void markSleepers (evac_fn evac, void *user);
+#endif
 #endif
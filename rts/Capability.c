@@ -27,6 +27,7 @@
 #include "STM.h"
 #include "RtsUtils.h"
 #include "sm/OSMem.h"
+#include "sm/Storage.h" // for ACQUIRE_SM_LOCK
 
 #if !defined(mingw32_HOST_OS)
 #include "rts/IOManager.h" // for setIOManagerControlFd()
@@ -279,6 +280,7 @@ initCapability (Capability *cap, uint32_t i)
 #endif
 #endif
     cap->total_allocated        = 0;
+    initAllocSampling(cap);
 
     cap->f.stgEagerBlackholeInfo = (W_)&__stg_EAGER_BLACKHOLE_info;
     cap->f.stgGCEnter1     = (StgFunPtr)__stg_gc_enter_1;
@@ -304,6 +306,17 @@ initCapability (Capability *cap, uint32_t i)
     cap->context_switch = 0;
     cap->pinned_object_block = NULL;
     cap->pinned_object_blocks = NULL;
+    for (g = 0; g < N_HOLE_CLASSES; g++) {
+        cap->pinned_holes[g] = NULL;
+    }
+    cap->pinned_hole_mask = 0;
+    initBlockMagazine(&cap->block_mag, cap->node);
+    cap->sp_cache.n = 0;
+    cap->n_stack_chunks = 0;
+    cap->stack_chunk_hits = 0;
+    cap->stack_chunk_misses = 0;
+    cap->n_thread_stacks = 0;
+    cap->finished_stack = NULL;
 
 #if defined(PROFILING)
     cap->r.rCCCS = CCS_SYSTEM;
@@ -1151,6 +1164,28 @@ freeCapabilities (void)
     traceCapsetDelete(CAPSET_CLOCKDOMAIN_DEFAULT);
 }
 
+/* ---------------------------------------------------------------------------
+   Allocate a block from the Capability's block magazine, refilling it
+   from the block allocator if it is empty.  See Note [Block magazines]
+   in BlockAlloc.c.
+   ------------------------------------------------------------------------ */
+
+bdescr *
+allocBlockOnCap (Capability *cap)
+{
+    BlockMagazine *mag = &cap->block_mag;
+
+    if (mag->blocks == NULL) {
+        ACQUIRE_SM_LOCK;
+        refillBlockMagazine(mag);
+        RELEASE_SM_LOCK;
+        mag->refills++;
+    } else {
+        mag->hits++;
+    }
+    return takeMagazineBlock(mag);
+}
+
 /* ---------------------------------------------------------------------------
    Mark everything directly reachable from the Capabilities.  When
    using multiple GC threads, each GC thread marks all Capabilities
@@ -1186,6 +1221,13 @@ markCapability (evac_fn evac, void *user, Capability *cap,
 
     // Free STM structures for this Capability
     stmPreGCHook(cap);
+
+    // The cached stack chunks and thread stacks are garbage, and the GC
+    // is about to reclaim them.  See Note [Stack chunk cache] and Note
+    // [Recycling thread stacks] in Threads.c.
+    cap->n_stack_chunks = 0;
+    cap->n_thread_stacks = 0;
+    cap->finished_stack = NULL;
 }
 
 void
@@ -21,11 +21,25 @@
 #pragma once
 
 #include "sm/GC.h" // for evac_fn
+#include "sm/BlockAlloc.h" // for BlockMagazine
+#include "sm/HoleLists.h" // for N_HOLE_CLASSES
+#include "StablePtr.h" // for StablePtrCache
+#include "AllocSample.h" // for PendingAllocSample
 #include "Task.h"
 #include "Sparks.h"
 
 #include "BeginPrivate.h"
 
+/* The number of free stack chunks each Capability keeps for reuse.
+ * See Note [Stack chunk cache] in Threads.c.
+ */
+#define STACK_CHUNK_CACHE_SIZE 4
+
+/* The number of stacks of finished threads each Capability keeps for
+ * new threads.  See Note [Recycling thread stacks] in Threads.c.
+ */
+#define THREAD_STACK_POOL_SIZE 64
+
 struct Capability_ {
     // State required by the STG virtual machine when running Haskell
     // code.  During STG execution, the BaseReg register always points
@@ -88,6 +102,34 @@ struct Capability_ {
     bdescr *pinned_object_block;
     // full pinned object blocks allocated since the last GC
     bdescr *pinned_object_blocks;
+    // holes in older pinned blocks that allocatePinned() can reuse
+    // (+RTS --reuse-pinned), and bit n set <=> pinned_holes[n] != NULL
+    StgPtr pinned_holes[N_HOLE_CLASSES];
+    StgWord pinned_hole_mask;
+
+    // free single blocks for allocate(), allocatePinned() and the
+    // mutable lists.  See Note [Block magazines] in BlockAlloc.c
+    BlockMagazine block_mag;
+
+    // free stable pointer entries, see Note [Stable pointer table] in
+    // StablePtr.c
+    StablePtrCache sp_cache;
+
+    // stack chunks of the standard size (+RTS -kc) dropped by
+    // threadStackUnderflow() since the last GC, and how often
+    // threadStackOverflow() found one.  See Note [Stack chunk cache] in
+    // Threads.c
+    StgStack *stack_chunks[STACK_CHUNK_CACHE_SIZE];
+    uint32_t n_stack_chunks;
+    uint64_t stack_chunk_hits;
+    uint64_t stack_chunk_misses;
+
+    // initial-sized stacks of threads that finished since the last GC,
+    // for createThread(), and the empty stack that those threads now
+    // point to.  See Note [Recycling thread stacks] in Threads.c
+    StgStack *thread_stacks[THREAD_STACK_POOL_SIZE];
+    uint32_t n_thread_stacks;
+    StgStack *finished_stack;
 
     // per-capability weak pointer list associated with nursery (older
     // lists stored in generation object)
@@ -112,6 +154,12 @@ struct Capability_ {
     // See Note [allocation accounting] in Storage.c
     W_ total_allocated;
 
+    // Bytes left to allocate before the next allocation sample, and a
+    // large object that is waiting to be sampled.  See Note
+    // [Allocation sampling] in AllocSample.c
+    StgInt alloc_sample_left;
+    PendingAllocSample alloc_sample_pending;
+
 #if defined(THREADED_RTS)
     // Worker Tasks waiting in the wings.  Singly-linked.
     Task *spare_workers;
@@ -292,6 +340,9 @@ void waitForCapability (Capability **cap/*in/out*/, Task *task);
 EXTERN_INLINE void recordMutableCap (const StgClosure *p, Capability *cap,
                                         uint32_t gen);
 
+EXTERN_INLINE void recordMutableCardCap (StgMutArrPtrs *a, W_ card,
+                                         Capability *cap, uint32_t gen);
+
 EXTERN_INLINE void recordClosureMutated (Capability *cap, StgClosure *p);
 
 #if defined(THREADED_RTS)
@@ -368,6 +419,10 @@ void markCapabilities (evac_fn evac, void *user);
 
 void traverseSparkQueues (evac_fn evac, void *user);
 
+// Allocate a single block from the Capability's block magazine (see
+// Note [Block magazines] in BlockAlloc.c).  We must own the Capability.
+bdescr *allocBlockOnCap (Capability *cap);
+
 /* -----------------------------------------------------------------------------
    NUMA
    -------------------------------------------------------------------------- */
@@ -410,7 +465,7 @@ recordMutableCap (const StgClosure *p, Capability *cap, uint32_t gen)
     bd = cap->mut_lists[gen];
     if (bd->free >= bd->start + BLOCK_SIZE_W) {
         bdescr *new_bd;
-        new_bd = allocBlockOnNode_lock(cap->node);
+        new_bd = allocBlockOnCap(cap);
         new_bd->link = bd;
         bd = new_bd;
         cap->mut_lists[gen] = bd;
@@ -418,6 +473,30 @@ recordMutableCap (const StgClosure *p, Capability *cap, uint32_t gen)
     *bd->free++ = (StgWord)p;
 }
 
+// A card entry on a mutable list takes two words: the array pointer
+// tagged with MUT_LIST_CARD_TAG, followed by the card index.  See Note
+// [Card remembered set] in Scav.c.
+#define MUT_LIST_CARD_TAG 1
+#define IS_MUT_LIST_CARD(w) (((StgWord)(w)) & MUT_LIST_CARD_TAG)
+
+EXTERN_INLINE void
+recordMutableCardCap (StgMutArrPtrs *a, W_ card, Capability *cap,
+                      uint32_t gen)
+{
+    bdescr *bd;
+
+    bd = cap->mut_lists[gen];
+    if (bd->free + 1 >= bd->start + BLOCK_SIZE_W) {
+        bdescr *new_bd;
+        new_bd = allocBlockOnCap(cap);
+        new_bd->link = bd;
+        bd = new_bd;
+        cap->mut_lists[gen] = bd;
+    }
+    *bd->free++ = (StgWord)a | MUT_LIST_CARD_TAG;
+    *bd->free++ = card;
+}
+
 EXTERN_INLINE void
 recordClosureMutated (Capability *cap, StgClosure *p)
 {
@@ -76,24 +76,165 @@ void heap_view_closure_ptrs_in_pap_payload(StgClosure *ptrs[], StgWord *nptrs
     }
 }
 
-StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
-    ASSERT(LOOKS_LIKE_CLOSURE_PTR(closure));
+static StgClosure **
+collect_ptrs_in_small_bitmap(StgClosure *ptrs[], StgWord *nptrs
+                        , StgClosure **p, StgWord size, StgWord bitmap)
+{
+    while (size > 0) {
+        if ((bitmap & 1) == 0) {
+            ptrs[(*nptrs)++] = *p;
+        }
+        bitmap = bitmap >> 1;
+        p++;
+        size--;
+    }
+    return p;
+}
 
-    StgWord size = heap_view_closureSize(closure);
+static void
+collect_srt(StgClosure *ptrs[], StgWord *nptrs, StgClosure *srt)
+{
+    ptrs[(*nptrs)++] = srt;
+}
+
+/* -----------------------------------------------------------------------------
+   Pointers in a stack chunk.  This follows scavenge_stack() in
+   sm/Scav.c: each time around the loop we are looking at an activation
+   record.
+   -------------------------------------------------------------------------- */
+
+static void
+collect_stack_ptrs(StgClosure *ptrs[], StgWord *nptrs
+                   , StgPtr p, StgPtr stack_end, bool srts)
+{
+    const StgRetInfoTable *info;
+    StgWord bitmap;
+    StgWord size;
+
+    while (p < stack_end) {
+        info = get_ret_itbl((StgClosure *)p);
+
+        switch (info->i.type) {
+
+        case UPDATE_FRAME:
+            ptrs[(*nptrs)++] = ((StgUpdateFrame *)p)->updatee;
+            p += sizeofW(StgUpdateFrame);
+            continue;
+
+        case CATCH_STM_FRAME:
+        case CATCH_RETRY_FRAME:
+        case ATOMICALLY_FRAME:
+        case UNDERFLOW_FRAME:
+        case STOP_FRAME:
+        case CATCH_FRAME:
+        case RET_SMALL:
+            bitmap = BITMAP_BITS(info->i.layout.bitmap);
+            size   = BITMAP_SIZE(info->i.layout.bitmap);
+            p++;
+            p = (StgPtr)collect_ptrs_in_small_bitmap(ptrs, nptrs,
+                                                     (StgClosure **)p,
+                                                     size, bitmap);
+        follow_srt:
+            if (srts && info->i.srt) {
+                collect_srt(ptrs, nptrs, (StgClosure *)GET_SRT(info));
+            }
+            continue;
+
+        case RET_BCO: {
+            StgBCO *bco;
+
+            p++;
+            ptrs[(*nptrs)++] = (StgClosure *)*p;
+            bco = (StgBCO *)*p;
+            p++;
+            size = BCO_BITMAP_SIZE(bco);
+            heap_view_closure_ptrs_in_large_bitmap(ptrs, nptrs,
+                                                   (StgClosure **)p,
+                                                   BCO_BITMAP(bco), size);
+            p += size;
+            continue;
+        }
+
+        case RET_BIG:
+            size = GET_LARGE_BITMAP(&info->i)->size;
+            p++;
+            heap_view_closure_ptrs_in_large_bitmap(ptrs, nptrs,
+                                                   (StgClosure **)p,
+                                                   GET_LARGE_BITMAP(&info->i),
+                                                   size);
+            p += size;
+            goto follow_srt;
+
+        case RET_FUN: {
+            StgRetFun *ret_fun = (StgRetFun *)p;
+            const StgFunInfoTable *fun_info;
+
+            ptrs[(*nptrs)++] = ret_fun->fun;
+            fun_info = get_fun_itbl(UNTAG_CLOSURE(ret_fun->fun));
+            switch (fun_info->f.fun_type) {
+            case ARG_GEN:
+                bitmap = BITMAP_BITS(fun_info->f.b.bitmap);
+                size   = BITMAP_SIZE(fun_info->f.b.bitmap);
+                p = (StgPtr)collect_ptrs_in_small_bitmap(ptrs, nptrs,
+                                                         ret_fun->payload,
+                                                         size, bitmap);
+                break;
+            case ARG_GEN_BIG:
+                size = GET_FUN_LARGE_BITMAP(fun_info)->size;
+                heap_view_closure_ptrs_in_large_bitmap(ptrs, nptrs,
+                                                 ret_fun->payload,
+                                                 GET_FUN_LARGE_BITMAP(fun_info),
+                                                 size);
+                p = (StgPtr)ret_fun->payload + size;
+                break;
+            default:
+                bitmap = BITMAP_BITS(stg_arg_bitmaps[fun_info->f.fun_type]);
+                size   = BITMAP_SIZE(stg_arg_bitmaps[fun_info->f.fun_type]);
+                p = (StgPtr)collect_ptrs_in_small_bitmap(ptrs, nptrs,
+                                                         ret_fun->payload,
+                                                         size, bitmap);
+                break;
+            }
+            goto follow_srt;
+        }
+
+        default:
+            barf("collect_stack_ptrs: weird activation record found on stack: %d",
+                 (int)(info->i.type));
+        }
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   collect_pointers: store the pointer fields of a closure in ptrs[], and
+   return how many there were.  ptrs[] must have room for
+   closure_sizeW(closure) + 1 entries.
+
+   With srts, the SRT of a thunk, function or stack frame counts as a
+   pointer too, as it does in a major GC; this is what the heap snapshot
+   (HeapSnapshot.c) needs to see what a closure retains.  The pointers
+   are returned as they are in the closure, that is, possibly tagged.
+
+   collect_closure_pointers() takes the info pointer that the caller has
+   already read, for the concurrent marker (sm/ConcMark.c), which must
+   look at a closure through the info pointer it read only once.
+   -------------------------------------------------------------------------- */
+
+StgWord collect_pointers(StgClosure *closure, StgClosure *ptrs[], bool srts)
+{
+    return collect_closure_pointers(closure, get_itbl(closure), ptrs, srts);
+}
+
+StgWord collect_closure_pointers(StgClosure *closure,
+                                 const StgInfoTable *info,
+                                 StgClosure *ptrs[], bool srts)
+{
     StgWord nptrs = 0;
     StgWord i;
 
-    // First collect all pointers here, with the comfortable memory bound
-    // of the whole closure. Afterwards we know how many pointers are in
-    // the closure and then we can allocate space on the heap and copy them
-    // there
-    StgClosure *ptrs[size];
-
     StgClosure **end;
     StgClosure **ptr;
 
-    const StgInfoTable *info = get_itbl(closure);
-
     switch (info->type) {
         case INVALID_OBJECT:
             barf("Invalid Object");
@@ -101,6 +242,8 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
 
         // No pointers
         case ARR_WORDS:
+        case COMPACT_NFDATA:
+        case WHITEHOLE:
             break;
 
         // Default layout
@@ -110,9 +253,16 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
         case CONSTR_1_1:
         case CONSTR_0_2:
         case CONSTR:
+        case CONSTR_NOCAF:
 
 
         case PRIM:
+        case MUT_PRIM:
+            end = closure->payload + info->layout.payload.ptrs;
+            for (ptr = closure->payload; ptr < end; ptr++) {
+                ptrs[nptrs++] = *ptr;
+            }
+            break;
 
         case FUN:
         case FUN_1_0:
@@ -125,6 +275,10 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
             for (ptr = closure->payload; ptr < end; ptr++) {
                 ptrs[nptrs++] = *ptr;
             }
+            if (srts && itbl_to_fun_itbl(info)->i.srt) {
+                collect_srt(ptrs, &nptrs,
+                            (StgClosure *)GET_FUN_SRT(itbl_to_fun_itbl(info)));
+            }
             break;
 
         case THUNK:
@@ -138,6 +292,10 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
             for (ptr = ((StgThunk *)closure)->payload; ptr < end; ptr++) {
                 ptrs[nptrs++] = *ptr;
             }
+            if (srts && itbl_to_thunk_itbl(info)->i.srt) {
+                collect_srt(ptrs, &nptrs,
+                            (StgClosure *)GET_SRT(itbl_to_thunk_itbl(info)));
+            }
             break;
 
         case THUNK_SELECTOR:
@@ -165,11 +323,17 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
             /*
               The payload is a stack, which consists of a mixture of pointers
               and non-pointers.  We can't simply pretend it's all pointers,
-              because that will cause crashes in the GC later.  We could
-              traverse the stack and extract pointers and non-pointers, but that
-              would be complicated, so let's just ignore the payload for now.
-              See #15375.
+              because that will cause crashes in the GC later, so
+              heap_view_closurePtrs() ignores the payload for now (see
+              #15375).
+              With srts the caller wants everything the closure retains,
+              so we walk the frames as we do for a STACK.
             */
+            if (srts) {
+                StgAP_STACK *ap = (StgAP_STACK *)closure;
+                collect_stack_ptrs(ptrs, &nptrs, (StgPtr)ap->payload,
+                                   (StgPtr)ap->payload + ap->size, srts);
+            }
             break;
 
         case BCO:
@@ -192,6 +356,16 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
                 ptrs[nptrs++] = ((StgMutArrPtrs *)closure)->payload[i];
             }
             break;
+
+        case SMALL_MUT_ARR_PTRS_CLEAN:
+        case SMALL_MUT_ARR_PTRS_DIRTY:
+        case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+        case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+            for (i = 0; i < ((StgSmallMutArrPtrs *)closure)->ptrs; ++i) {
+                ptrs[nptrs++] = ((StgSmallMutArrPtrs *)closure)->payload[i];
+            }
+            break;
+
         case MUT_VAR_CLEAN:
         case MUT_VAR_DIRTY:
             ptrs[nptrs++] = ((StgMutVar *)closure)->var;
@@ -203,12 +377,108 @@ StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
             ptrs[nptrs++] = ((StgMVar *)closure)->value;
             break;
 
+        case TVAR:
+            ptrs[nptrs++] = ((StgTVar *)closure)->current_value;
+            ptrs[nptrs++] =
+                (StgClosure *)((StgTVar *)closure)->first_watch_queue_entry;
+            break;
+
+        case WEAK:
+            ptrs[nptrs++] = ((StgWeak *)closure)->cfinalizers;
+            ptrs[nptrs++] = ((StgWeak *)closure)->key;
+            ptrs[nptrs++] = ((StgWeak *)closure)->value;
+            ptrs[nptrs++] = ((StgWeak *)closure)->finalizer;
+            ptrs[nptrs++] = (StgClosure *)((StgWeak *)closure)->link;
+            break;
+
+        case BLOCKING_QUEUE:
+        {
+            StgBlockingQueue *bq = (StgBlockingQueue *)closure;
+            ptrs[nptrs++] = (StgClosure *)bq->link;
+            ptrs[nptrs++] = bq->bh;
+            ptrs[nptrs++] = (StgClosure *)bq->owner;
+            ptrs[nptrs++] = (StgClosure *)bq->queue;
+            break;
+        }
+
+        case TREC_CHUNK:
+        {
+            StgTRecChunk *tc = (StgTRecChunk *)closure;
+            TRecEntry *e = &(tc->entries[0]);
+
+            ptrs[nptrs++] = (StgClosure *)tc->prev_chunk;
+            for (i = 0; i < tc->next_entry_idx; i++, e++) {
+                ptrs[nptrs++] = (StgClosure *)e->tvar;
+                ptrs[nptrs++] = e->expected_value;
+                ptrs[nptrs++] = e->new_value;
+            }
+            break;
+        }
+
+        case TSO:
+        {
+            // The same fields as scavengeTSO() in sm/Scav.c
+            StgTSO *tso = (StgTSO *)closure;
+
+            ptrs[nptrs++] = (StgClosure *)tso->blocked_exceptions;
+            ptrs[nptrs++] = (StgClosure *)tso->bq;
+            ptrs[nptrs++] = (StgClosure *)tso->trec;
+            ptrs[nptrs++] = (StgClosure *)tso->stackobj;
+            ptrs[nptrs++] = (StgClosure *)tso->_link;
+            if (   tso->why_blocked == BlockedOnMVar
+                || tso->why_blocked == BlockedOnMVarRead
+                || tso->why_blocked == BlockedOnBlackHole
+                || tso->why_blocked == BlockedOnMsgThrowTo
+                || tso->why_blocked == NotBlocked
+                ) {
+                ptrs[nptrs++] = tso->block_info.closure;
+            }
+            break;
+        }
+
+        case STACK:
+        {
+            StgStack *stack = (StgStack *)closure;
+
+            collect_stack_ptrs(ptrs, &nptrs, stack->sp,
+                               stack->stack + stack->stack_size, srts);
+            break;
+        }
+
         default:
             fprintf(stderr,"closurePtrs: Cannot handle type %s yet\n",
                            closure_type_names[info->type]);
             break;
     }
 
+    return nptrs;
+}
+
+StgMutArrPtrs *heap_view_closurePtrs(Capability *cap, StgClosure *closure) {
+    ASSERT(LOOKS_LIKE_CLOSURE_PTR(closure));
+
+    StgWord size = heap_view_closureSize(closure);
+    StgWord nptrs;
+    StgWord i;
+
+    // First collect all pointers here, with the comfortable memory bound
+    // of the whole closure. Afterwards we know how many pointers are in
+    // the closure and then we can allocate space on the heap and copy them
+    // there
+    StgClosure *ptrs[size + 1];
+
+    nptrs = collect_pointers(closure, ptrs, false);
+
+    // Some fields are NULL, e.g. the link of the last weak pointer in a
+    // list. They must not reach the heap, where the GC would follow them.
+    StgWord n = 0;
+    for (i = 0; i < nptrs; i++) {
+        if (ptrs[i] != NULL) {
+            ptrs[n++] = ptrs[i];
+        }
+    }
+    nptrs = n;
+
     size = nptrs + mutArrPtrsCardTableSize(nptrs);
     StgMutArrPtrs *arr =
         (StgMutArrPtrs *)allocate(cap, sizeofW(StgMutArrPtrs) + size);
@@ -0,0 +1,612 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Heap snapshots: performHeapSnapshot() and +RTS --heap-snapshot.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+#include "rts/HeapSnapshotFormat.h"
+
+#include "Capability.h"
+#include "RtsFlags.h"
+#include "RtsUtils.h"
+#include "Hash.h"
+#include "Schedule.h"
+#include "Sparks.h"
+#include "StablePtr.h"
+#include "Trace.h"
+#include "sm/GC.h"
+#include "sm/GCThread.h"
+#include "sm/Pinned.h"
+#include "HeapSnapshot.h"
+
+#include <fs_rts.h>
+#include <string.h>
+
+/* -----------------------------------------------------------------------------
+   Note [Heap snapshots]
+   ~~~~~~~~~~~~~~~~~~~~~
+
+   A heap snapshot is a file describing every live closure: its address,
+   info pointer, closure type, size and pointers (the format is in
+   includes/rts/HeapSnapshotFormat.h).  It is meant for finding leaks in
+   heaps too big for the heap profiler to say much about: a separate
+   tool (utils/heap-snapshot) loads it, computes the dominator tree and
+   reports which closures retain the most memory.
+
+   A snapshot is requested either by calling performHeapSnapshot(), which
+   does a major GC and waits for it, or, with +RTS --heap-snapshot, by
+   sending the process SIGUSR2.  The signal handler only sets a flag and
+   asks every capability to return to the scheduler, which then does a
+   major GC (see schedule()).  Either way, GarbageCollect() calls
+   writeHeapSnapshots() at the end of the next major GC, at the same
+   point as a heap census: after the live objects have been copied, and
+   before resurrectThreads() overwrites anything.
+
+   We write the snapshot as we walk the heap, so apart from the stdio
+   buffer it needs very little memory, however big the heap is.  Every
+   heap object is found by walking the blocks of each generation once,
+   in order, and the pointers in each object are found by
+   collect_pointers() (Heap.c).  Most blocks can be walked linearly, as
+   the heap census does (ProfHeap.c), but two kinds can't:
+
+     - pinned blocks, which have alignment padding between their
+       objects, and may have holes (see Note [Reusing pinned holes] in
+       sm/Pinned.c);
+
+     - blocks swept by the mark/sweep collector (BF_SWEPT), in which the
+       live objects are interleaved with dead ones.
+
+   For these we use the mark bitmaps that the GC has just built, which
+   have a bit set for the first word of each live object.  A block
+   swept in this GC has its bitmap in bd->u.bitmap.  For pinned blocks
+   the GC asks preparePinnedBlocks() to mark the live objects, as it
+   does for +RTS --reuse-pinned, including those in the blocks that the
+   capabilities are still allocating into.  GarbageCollect() decides at
+   the start of the GC whether it will write a snapshot, and keeps both
+   kinds of bitmap until the snapshot has been written.
+
+   Static closures aren't in the heap, so they are written out when we
+   first see a pointer to them, through a stack of closures still to do.
+   We remember the static closures we have seen in a hash table, so
+   each is pushed at most once, and the stack never holds more than the
+   program has static closures.
+
+   The roots are the same as the GC's, except that we don't want
+   markCapability(), which has side effects; and we add every live
+   thread and weak pointer, because nothing else in the heap points to
+   them in a way that says what they retain.
+   -------------------------------------------------------------------------- */
+
+typedef struct {
+    FILE *file;
+    StgWord n_nodes;
+    StgWord n_roots;
+    uint32_t root_kind;         // kind of the roots being marked
+
+    // scratch space for collect_pointers()
+    StgClosure **ptrs;
+    StgWord ptrs_size;
+
+    // static closures that we have seen a pointer to, but not yet
+    // written
+    StgClosure **todo;
+    StgWord todo_len;
+    StgWord todo_size;
+
+    HashTable *statics;         // static closures seen
+} Snapshot;
+
+// The snapshot that performHeapSnapshot() asked for
+static const char *snapshot_path = NULL;
+static bool snapshot_ok;
+
+// Set by the SIGUSR2 handler
+static volatile StgWord snapshot_signalled = 0;
+static uint32_t snapshot_count = 0;
+
+#if defined(THREADED_RTS)
+static Mutex snapshot_mutex;
+#endif
+
+static void snapshot_node (Snapshot *s, StgClosure *p);
+
+/* -----------------------------------------------------------------------------
+   Encoding
+   -------------------------------------------------------------------------- */
+
+static void
+put_uleb (Snapshot *s, StgWord w)
+{
+    do {
+        uint8_t b = w & 0x7f;
+        w >>= 7;
+        if (w != 0) {
+            b |= 0x80;
+        }
+        putc(b, s->file);
+    } while (w != 0);
+}
+
+static void
+put_sleb (Snapshot *s, StgInt i)
+{
+    bool more;
+
+    do {
+        uint8_t b = i & 0x7f;
+        i >>= 7;    // arithmetic shift
+        more = !((i == 0 && !(b & 0x40)) || (i == -1 && (b & 0x40)));
+        if (more) {
+            b |= 0x80;
+        }
+        putc(b, s->file);
+    } while (more);
+}
+
+/* -----------------------------------------------------------------------------
+   Static closures
+   -------------------------------------------------------------------------- */
+
+static void
+push_todo (Snapshot *s, StgClosure *p)
+{
+    if (s->todo_len == s->todo_size) {
+        s->todo_size = s->todo_size == 0 ? 1024 : s->todo_size * 2;
+        s->todo = stgReallocBytes(s->todo, s->todo_size * sizeof(StgClosure *),
+                                  "push_todo");
+    }
+    s->todo[s->todo_len++] = p;
+}
+
+// Called on every pointer we write out: make sure that a static closure
+// gets written too.  Everything else is found by walking the heap.
+static void
+note_pointer (Snapshot *s, StgClosure *p)
+{
+    if (!HEAP_ALLOCED(p)
+        && lookupHashTable(s->statics, (StgWord)p) == NULL) {
+        insertHashTable(s->statics, (StgWord)p, p);
+        push_todo(s, p);
+    }
+}
+
+static void
+snapshot_todo (Snapshot *s)
+{
+    while (s->todo_len > 0) {
+        snapshot_node(s, s->todo[--s->todo_len]);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Nodes
+   -------------------------------------------------------------------------- */
+
+static void
+put_pointer (Snapshot *s, StgClosure *node, StgClosure *q)
+{
+    q = UNTAG_CLOSURE(q);
+    put_sleb(s, (StgInt)((W_)q - (W_)node));
+    note_pointer(s, q);
+}
+
+// Some pointer fields may be NULL (e.g. the end of a weak pointer list),
+// so leave those out.
+static void
+put_pointers (Snapshot *s, StgClosure *node, StgClosure **ptrs, StgWord n)
+{
+    StgWord i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        if (ptrs[i] != NULL) {
+            count++;
+        }
+    }
+    put_uleb(s, count);
+    for (i = 0; i < n; i++) {
+        if (ptrs[i] != NULL) {
+            put_pointer(s, node, ptrs[i]);
+        }
+    }
+}
+
+// The info table of a COMPACT_NFDATA doesn't give its real size, see
+// fixup_block() in sm/CNF.c.
+static StgWord
+snapshot_sizeW (StgClosure *p)
+{
+    if (get_itbl(p)->type == COMPACT_NFDATA) {
+        return sizeofW(StgCompactNFData);
+    }
+    return closure_sizeW(p);
+}
+
+static void
+snapshot_node (Snapshot *s, StgClosure *p)
+{
+    const StgInfoTable *info = get_itbl(p);
+    StgWord size = snapshot_sizeW(p);
+    StgWord i;
+
+    s->n_nodes++;
+    putc(HSNAP_NODE, s->file);
+    put_uleb(s, (W_)p);
+    put_uleb(s, (W_)p->header.info);
+    put_uleb(s, info->type);
+    put_uleb(s, size);
+
+    switch (info->type) {
+
+    // Arrays can be very large, so we don't copy their pointers.
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+    {
+        StgMutArrPtrs *arr = (StgMutArrPtrs *)p;
+        put_uleb(s, arr->ptrs);
+        for (i = 0; i < arr->ptrs; i++) {
+            put_pointer(s, p, arr->payload[i]);
+        }
+        break;
+    }
+
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+    case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+    case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+    {
+        StgSmallMutArrPtrs *arr = (StgSmallMutArrPtrs *)p;
+        put_uleb(s, arr->ptrs);
+        for (i = 0; i < arr->ptrs; i++) {
+            put_pointer(s, p, arr->payload[i]);
+        }
+        break;
+    }
+
+    // A weak pointer doesn't keep its key alive.
+    case WEAK:
+    {
+        StgWeak *w = (StgWeak *)p;
+        StgClosure *ptrs[4];
+
+        ptrs[0] = w->cfinalizers;
+        ptrs[1] = w->value;
+        ptrs[2] = w->finalizer;
+        ptrs[3] = (StgClosure *)w->link;
+        put_pointers(s, p, ptrs, 4);
+        break;
+    }
+
+    default:
+        if (s->ptrs_size < size + 1) {
+            s->ptrs_size = size + 1;
+            s->ptrs = stgReallocBytes(s->ptrs,
+                                      s->ptrs_size * sizeof(StgClosure *),
+                                      "snapshot_node");
+        }
+        put_pointers(s, p, s->ptrs, collect_pointers(p, s->ptrs, true));
+        break;
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Walking the heap
+   -------------------------------------------------------------------------- */
+
+// Write out the objects in the single block bd whose first words are
+// marked in bitmap.
+static void
+snapshot_marked (Snapshot *s, bdescr *bd, StgWord *bitmap)
+{
+    StgWord i, j, w;
+
+    for (i = 0; i < BLOCK_SIZE_W / BITS_IN(W_); i++) {
+        for (w = bitmap[i], j = 0; w != 0; w >>= 1, j++) {
+            if (w & 1) {
+                snapshot_node(s, (StgClosure *)
+                              (bd->start + i * BITS_IN(W_) + j));
+            }
+        }
+    }
+}
+
+static void
+snapshot_block (Snapshot *s, bdescr *bd)
+{
+    StgPtr p;
+    StgWord *marks;
+
+    if (bd->flags & BF_PINNED) {
+        marks = pinnedBlockMarks(bd);
+        if (marks != NULL) {
+            snapshot_marked(s, bd, marks);
+            return;
+        }
+        // otherwise it is a large object, as below
+        ASSERT(bd->flags & BF_LARGE);
+    }
+
+    if (bd->flags & BF_SWEPT) {
+        snapshot_marked(s, bd, bd->u.bitmap);
+        return;
+    }
+
+    // A large object is a single object, and bd->free may be past its
+    // end if it is an ARR_WORDS that has been shrunk (#11627).
+    if (bd->flags & BF_LARGE) {
+        snapshot_node(s, (StgClosure *)bd->start);
+        return;
+    }
+
+    p = bd->start;
+    while (p < bd->free) {
+        snapshot_node(s, (StgClosure *)p);
+        p += closure_sizeW((StgClosure *)p);
+
+        // skip over slop, see checkHeapChain()
+        while (p < bd->free &&
+               (*p < 0x1000 || !LOOKS_LIKE_INFO_PTR(*p))) { p++; }
+    }
+}
+
+static void
+snapshot_chain (Snapshot *s, bdescr *bd)
+{
+    for (; bd != NULL; bd = bd->link) {
+        snapshot_block(s, bd);
+    }
+}
+
+static void
+snapshot_compacts (Snapshot *s, bdescr *bd)
+{
+    StgCompactNFDataBlock *block;
+    StgPtr p;
+
+    for (; bd != NULL; bd = bd->link) {
+        block = (StgCompactNFDataBlock *)bd->start;
+        putc(HSNAP_COMPACT_BEGIN, s->file);
+        put_uleb(s, (W_)block->owner);
+
+        // The COMPACT_NFDATA itself comes first, straight after the
+        // first block's header.
+        for (; block != NULL; block = block->next) {
+            p = (P_)block + sizeofW(StgCompactNFDataBlock);
+            while (p < Bdescr((P_)block)->free) {
+                snapshot_node(s, (StgClosure *)p);
+                p += snapshot_sizeW((StgClosure *)p);
+            }
+        }
+        putc(HSNAP_COMPACT_END, s->file);
+    }
+}
+
+static void
+snapshot_root (void *user, StgClosure **root)
+{
+    Snapshot *s = (Snapshot *)user;
+    StgClosure *p = UNTAG_CLOSURE(*root);
+
+    if (p == NULL || p == (StgClosure *)END_TSO_QUEUE) {
+        return;
+    }
+    s->n_roots++;
+    putc(HSNAP_ROOT, s->file);
+    put_uleb(s, s->root_kind);
+    put_uleb(s, (W_)p);
+    note_pointer(s, p);
+}
+
+static void
+snapshot_roots (Snapshot *s)
+{
+    uint32_t n, g;
+    InCall *incall;
+    StgTSO *t;
+    StgWeak *w;
+
+    // The same as markCapability(), without stmPreGCHook()
+    s->root_kind = HSNAP_ROOT_CAPABILITY;
+    for (n = 0; n < n_capabilities; n++) {
+        Capability *cap = capabilities[n];
+        snapshot_root(s, (StgClosure **)(void *)&cap->run_queue_hd);
+#if defined(THREADED_RTS)
+        snapshot_root(s, (StgClosure **)(void *)&cap->inbox);
+#endif
+        for (incall = cap->suspended_ccalls; incall != NULL;
+             incall = incall->next) {
+            snapshot_root(s, (StgClosure **)(void *)&incall->suspended_tso);
+        }
+    }
+
+#if defined(THREADED_RTS)
+    s->root_kind = HSNAP_ROOT_SPARK;
+    for (n = 0; n < n_capabilities; n++) {
+        traverseSparkQueue(snapshot_root, s, capabilities[n]);
+    }
+#endif
+
+    s->root_kind = HSNAP_ROOT_SCHEDULER;
+    markScheduler(snapshot_root, s);
+
+    s->root_kind = HSNAP_ROOT_CAF;
+    markCAFs(snapshot_root, s);
+
+    s->root_kind = HSNAP_ROOT_STABLE_PTR;
+    markStablePtrTable(snapshot_root, s);
+
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        s->root_kind = HSNAP_ROOT_THREAD;
+        for (t = generations[g].threads; t != END_TSO_QUEUE;
+             t = t->global_link) {
+            snapshot_root(s, (StgClosure **)(void *)&t);
+        }
+        s->root_kind = HSNAP_ROOT_WEAK;
+        for (w = generations[g].weak_ptr_list; w != NULL; w = w->link) {
+            snapshot_root(s, (StgClosure **)(void *)&w);
+        }
+    }
+}
+
+static bool
+write_snapshot (const char *path)
+{
+    Snapshot s;
+    uint32_t g, n;
+    gen_workspace *ws;
+    bool ok;
+
+    s.file = __rts_fopen(path, "wb");
+    if (s.file == NULL) {
+        sysErrorBelch("can't write heap snapshot to %s", path);
+        return false;
+    }
+    setvbuf(s.file, NULL, _IOFBF, 1024 * 1024);
+
+    s.n_nodes = 0;
+    s.n_roots = 0;
+    s.root_kind = 0;
+    s.ptrs = NULL;
+    s.ptrs_size = 0;
+    s.todo = NULL;
+    s.todo_len = 0;
+    s.todo_size = 0;
+    s.statics = allocHashTable();
+
+    fwrite(HSNAP_MAGIC, 1, HSNAP_MAGIC_LEN, s.file);
+    put_uleb(&s, HSNAP_VERSION);
+    put_uleb(&s, sizeof(W_));
+
+    snapshot_roots(&s);
+    snapshot_todo(&s);
+
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        snapshot_chain(&s, generations[g].blocks);
+        snapshot_chain(&s, generations[g].large_objects);
+        snapshot_compacts(&s, generations[g].compact_objects);
+
+        for (n = 0; n < n_capabilities; n++) {
+            ws = &gc_threads[n]->gens[g];
+            snapshot_chain(&s, ws->todo_bd);
+            snapshot_chain(&s, ws->part_list);
+            snapshot_chain(&s, ws->scavd_list);
+        }
+        snapshot_todo(&s);
+    }
+
+    // The blocks that allocatePinned() is still filling aren't on any
+    // list
+    for (n = 0; n < n_capabilities; n++) {
+        if (capabilities[n]->pinned_object_block != NULL) {
+            snapshot_block(&s, capabilities[n]->pinned_object_block);
+        }
+    }
+    snapshot_todo(&s);
+
+    putc(HSNAP_END, s.file);
+    put_uleb(&s, s.n_nodes);
+    put_uleb(&s, s.n_roots);
+
+    ok = !ferror(s.file);
+    if (fclose(s.file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        sysErrorBelch("error writing heap snapshot to %s", path);
+    }
+
+    debugTrace(DEBUG_gc, "heap snapshot %s: %" FMT_Word " nodes, "
+               "%" FMT_Word " roots", path, s.n_nodes, s.n_roots);
+
+    stgFree(s.ptrs);
+    stgFree(s.todo);
+    freeHashTable(s.statics, NULL);
+    return ok;
+}
+
+/* -----------------------------------------------------------------------------
+   Requesting snapshots
+   -------------------------------------------------------------------------- */
+
+void
+initHeapSnapshot (void)
+{
+#if defined(THREADED_RTS)
+    initMutex(&snapshot_mutex);
+#endif
+}
+
+void
+exitHeapSnapshot (void)
+{
+#if defined(THREADED_RTS)
+    closeMutex(&snapshot_mutex);
+#endif
+}
+
+bool
+performHeapSnapshot (const char *path)
+{
+    bool ok;
+
+    ACQUIRE_LOCK(&snapshot_mutex);
+    snapshot_path = path;
+    snapshot_ok = false;
+    performMajorGC();
+    ok = snapshot_ok;
+    snapshot_path = NULL;
+    RELEASE_LOCK(&snapshot_mutex);
+
+    return ok;
+}
+
+// Called from the SIGUSR2 handler, so it mustn't do anything fancy.
+void
+requestHeapSnapshot (void)
+{
+    snapshot_signalled = 1;
+    contextSwitchAllCapabilities();
+#if defined(THREADED_RTS)
+    wakeUpRts();
+#endif
+}
+
+bool
+heapSnapshotRequested (void)
+{
+    return snapshot_signalled != 0;
+}
+
+bool
+heapSnapshotPending (void)
+{
+    return snapshot_path != NULL || snapshot_signalled != 0;
+}
+
+void
+writeHeapSnapshots (void)
+{
+    if (snapshot_path != NULL) {
+        snapshot_ok = write_snapshot(snapshot_path);
+        snapshot_path = NULL;
+    }
+
+    if (snapshot_signalled) {
+        const char *prefix = RtsFlags.ProfFlags.heapSnapshotPrefix;
+        char *path;
+
+        snapshot_signalled = 0;
+        if (prefix == NULL) {
+            prefix = prog_name;
+        }
+        path = stgMallocBytes(strlen(prefix) + 20, "writeHeapSnapshots");
+        sprintf(path, "%s.%u.hsnap", prefix, ++snapshot_count);
+        write_snapshot(path);
+        stgFree(path);
+    }
+}
@@ -0,0 +1,27 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Heap snapshots.  See Note [Heap snapshots] in HeapSnapshot.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+void initHeapSnapshot       (void);
+void exitHeapSnapshot       (void);
+
+// Called from the SIGUSR2 handler (+RTS --heap-snapshot)
+void requestHeapSnapshot    (void);
+
+// True if the signal handler has asked for a snapshot; the scheduler
+// then does a major GC
+bool heapSnapshotRequested  (void);
+
+// True if the next major GC should call writeHeapSnapshots()
+bool heapSnapshotPending    (void);
+void writeHeapSnapshots     (void);
+
+#include "EndPrivate.h"
@@ -704,18 +704,20 @@ removeFromQueues(Capability *cap, StgTSO *tso)
   case BlockedOnWrite:
 #if defined(mingw32_HOST_OS)
   case BlockedOnDoProc:
-#endif
       removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
-#if defined(mingw32_HOST_OS)
       /* (Cooperatively) signal that the worker thread should abort
        * the request.
        */
       abandonWorkRequest(tso->block_info.async_result->reqID);
+#else
+      removeFdWaiter(cap, tso);
 #endif
       goto done;
 
   case BlockedOnDelay:
-        removeThreadFromQueue(cap, &sleeping_queue, tso);
+#if !defined(mingw32_HOST_OS)
+        removeSleeper(tso);
+#endif
         goto done;
 #endif
 
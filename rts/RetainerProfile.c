@@ -1784,6 +1784,13 @@ computeRetainerSet( void )
           for (bd = capabilities[n]->mut_lists[g]; bd != NULL; bd = bd->link) {
             for (ml = bd->start; ml < bd->free; ml++) {
 
+                // card entries name an array and a card, and the array
+                // is reachable anyway; skip both words.
+                if (IS_MUT_LIST_CARD(*ml)) {
+                    ml++;
+                    continue;
+                }
+
                 maybeInitRetainerSet((StgClosure *)*ml);
 
 #if defined(DEBUG_RETAINER)
@@ -158,6 +158,9 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.compact            = false;
     RtsFlags.GcFlags.compactThreshold   = 30.0;
     RtsFlags.GcFlags.sweep              = false;
+    RtsFlags.GcFlags.lazySweep          = false;
+    RtsFlags.GcFlags.fillHoles          = false;
+    RtsFlags.GcFlags.concurrentMark     = false;
     RtsFlags.GcFlags.idleGCDelayTime    = USToTime(300000); // 300ms
 #if defined(THREADED_RTS)
     RtsFlags.GcFlags.doIdleGC           = true;
@@ -165,6 +168,11 @@ void initRtsFlagsDefaults(void)
     RtsFlags.GcFlags.doIdleGC           = false;
 #endif
     RtsFlags.GcFlags.heapBase           = 0;   /* means don't care */
+    RtsFlags.GcFlags.hugePages          = false;
+    RtsFlags.GcFlags.cardRemSet         = false;
+    RtsFlags.GcFlags.prefetch           = false;
+    RtsFlags.GcFlags.reusePinned        = false;
+    RtsFlags.GcFlags.decommitRate       = 0;
     RtsFlags.GcFlags.allocLimitGrace    = (100*1024) / BLOCK_SIZE;
     RtsFlags.GcFlags.numa               = false;
     RtsFlags.GcFlags.numaMask           = 1;
@@ -196,6 +204,8 @@ void initRtsFlagsDefaults(void)
 
     RtsFlags.ProfFlags.doHeapProfile      = false;
     RtsFlags.ProfFlags.heapProfileInterval = USToTime(100000); // 100ms
+    RtsFlags.ProfFlags.heapSnapshotSignal = false;
+    RtsFlags.ProfFlags.heapSnapshotPrefix = NULL;
 
 #if defined(PROFILING)
     RtsFlags.ProfFlags.includeTSOs        = false;
@@ -220,6 +230,10 @@ void initRtsFlagsDefaults(void)
     RtsFlags.TraceFlags.sparks_full   = false;
     RtsFlags.TraceFlags.user          = false;
     RtsFlags.TraceFlags.trace_output  = NULL;
+    RtsFlags.TraceFlags.allocSample   = 0;
+    RtsFlags.TraceFlags.allocSampleStacks = false;
+    RtsFlags.TraceFlags.gcPauseHist   = false;
+    RtsFlags.TraceFlags.gcPauseHistInterval = SecondsToTime(1);
 #endif
 
 #if defined(PROFILING)
@@ -237,6 +251,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.MiscFlags.machineReadable         = false;
     RtsFlags.MiscFlags.internalCounters        = false;
     RtsFlags.MiscFlags.linkerMemBase           = 0;
+    RtsFlags.MiscFlags.ioBackend               = IO_BACKEND_DEFAULT;
 
 #if defined(THREADED_RTS)
     RtsFlags.ParFlags.nCapabilities     = 1;
@@ -247,6 +262,7 @@ void initRtsFlagsDefaults(void)
     RtsFlags.ParFlags.parGcLoadBalancingGen = ~0u; /* auto, based on -A */
     RtsFlags.ParFlags.parGcNoSyncWithIdle   = 0;
     RtsFlags.ParFlags.parGcThreads      = 0; /* defaults to -N */
+    RtsFlags.ParFlags.parCompactEnabled = false;
     RtsFlags.ParFlags.setAffinity       = 0;
 #endif
 
@@ -294,6 +310,9 @@ usage_text[] = {
 "  -xb<addr> Sets the address from which a suitable start for the heap memory",
 "            will be searched from. This is useful if the default address",
 "            clashes with some third-party library.",
+"  --huge-pages",
+"            Align the heap to 2MB and ask the OS to back it with",
+"            transparent huge pages (Linux only)",
 "  -m<n>     Minimum % of heap which must be available (default 3%)",
 "  -G<n>     Number of generations (default: 2)",
 "  -c<n>     Use in-place compaction instead of copying in the oldest generation",
@@ -302,6 +321,29 @@ usage_text[] = {
 "  -c       Use in-place compaction for all oldest generation collections",
 "           (the default is to use copying)",
 "  -w       Use mark-region for the oldest generation (experimental)",
+"  --lazy-sweep",
+"           Like -w, but sweep the oldest generation lazily, between",
+"           collections (experimental)",
+"  --fill-holes",
+"           Like -w, but reuse the free space in partly-live blocks",
+"           of the oldest generation (experimental)",
+"  --card-remset",
+"           Put the dirty cards of large mutable arrays on the remembered",
+"           set, rather than the whole array",
+"  --gc-prefetch",
+"           Prefetch the objects that the GC is about to copy, a few",
+"           fields ahead of copying them",
+"  --reuse-pinned",
+"           Allocate small pinned objects in the free space between the",
+"           live objects of older pinned blocks",
+#if defined(THREADED_RTS)
+"  --concurrent-mark",
+"           Like -w, but mark the oldest generation in a separate thread",
+"           while the program runs (experimental)",
+"  --decommit-rate=<size>",
+"           Return free memory to the OS in the background, at most",
+"           <size> bytes per second (default: 0 == during GC)",
+#endif
 #if defined(THREADED_RTS)
 "  -I<sec>  Perform full GC after <sec> idle time (default: 0.3, 0 == off)",
 #endif
@@ -370,6 +412,16 @@ usage_text[] = {
 #  endif
 "               -x    disable an event class, for any flag above",
 "             the initial enabled event classes are 'sgpu'",
+"  --alloc-sample[=<size>]",
+"             Log an allocation sample for about every <size> bytes",
+"             allocated (default: 1m)",
+#  if USE_LIBDW
+"  --alloc-sample-stacks",
+"             Add a stack trace to each allocation sample",
+#  endif
+"  --gc-pause-hist[=<secs>]",
+"             Log the GC pause histograms at most every <secs> seconds",
+"             (default: 1)",
 #endif
 
 #if !defined(PROFILING)
@@ -377,6 +429,11 @@ usage_text[] = {
 "  -h       Heap residency profile (output file <program>.hp)",
 #endif
 "  -i<sec>  Time between heap profile samples (seconds, default: 0.1)",
+#if !defined(mingw32_HOST_OS)
+"  --heap-snapshot[=<prefix>]",
+"           Write a heap snapshot to <prefix>.<n>.hsnap on SIGUSR2",
+"           (default prefix: <program>)",
+#endif
 "",
 #if defined(TICKY_TICKY)
 "  -r<file>  Produce ticky-ticky statistics (with -rstderr for stderr)",
@@ -426,6 +483,9 @@ usage_text[] = {
 "            (default: 1 for -A < 32M, 0 otherwise;",
 "             -qb alone turns off load-balancing)",
 "  -qn<n>    Use <n> threads for parallel GC (defaults to value of -N)",
+"  -qc       Use the parallel GC threads to compact or sweep the oldest",
+"            generation",
+"            (see -c and -w)",
 "  -qa       Use the OS to set thread affinity (experimental)",
 "  -qm       Don't automatically migrate threads between CPUs",
 "  -qi<n>    If a processor has been idle for the last <n> GCs, do not",
@@ -442,6 +502,11 @@ usage_text[] = {
 #endif
 "  --install-signal-handlers=<yes|no>",
 "            Install signal handlers (default: yes)",
+#if !defined(mingw32_HOST_OS)
+"  --io-backend=<select|epoll>",
+"            How the non-threaded RTS waits for I/O (default: epoll if",
+"            supported, otherwise select)",
+#endif
 #if defined(mingw32_HOST_OS)
 "  --install-seh-handlers=<yes|no>",
 "            Install exception handlers (default: yes)",
@@ -903,6 +968,30 @@ error = true;
                       OPTION_SAFE;
                       RtsFlags.MiscFlags.internalCounters = true;
                   }
+#if !defined(mingw32_HOST_OS)
+                  else if (strequal("io-backend=select",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.ioBackend = IO_BACKEND_SELECT;
+                  }
+                  else if (strequal("io-backend=epoll",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.MiscFlags.ioBackend = IO_BACKEND_EPOLL;
+                  }
+                  else if (strequal("heap-snapshot",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.ProfFlags.heapSnapshotSignal = true;
+                  }
+                  else if (!strncmp("heap-snapshot=",
+                                    &rts_argv[arg][2], 14)) {
+                      OPTION_UNSAFE;
+                      RtsFlags.ProfFlags.heapSnapshotSignal = true;
+                      RtsFlags.ProfFlags.heapSnapshotPrefix =
+                          rts_argv[arg]+16;
+                  }
+#endif
                   else if (strequal("info",
                                &rts_argv[arg][2])) {
                       OPTION_SAFE;
@@ -961,6 +1050,98 @@ error = true;
                       }
                   }
 #endif
+                  else if (strequal("huge-pages",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      if (!osHugePagesAvailable()) {
+                          errorBelch("%s: huge pages are not supported "
+                                     "on this platform", rts_argv[arg]);
+                          error = true;
+                          break;
+                      }
+                      RtsFlags.GcFlags.hugePages = true;
+                  }
+                  else if (strequal("card-remset",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.cardRemSet = true;
+                  }
+                  else if (strequal("gc-prefetch",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      RtsFlags.GcFlags.prefetch = true;
+                  }
+                  else if (strequal("reuse-pinned",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.reusePinned = true;
+                  }
+                  else if (strequal("lazy-sweep",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.sweep = true;
+                      RtsFlags.GcFlags.lazySweep = true;
+                  }
+                  else if (strequal("fill-holes",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      RtsFlags.GcFlags.sweep = true;
+                      RtsFlags.GcFlags.fillHoles = true;
+                  }
+                  else if (strequal("concurrent-mark",
+                               &rts_argv[arg][2])) {
+                      OPTION_UNSAFE;
+                      THREADED_BUILD_ONLY(
+                          RtsFlags.GcFlags.sweep = true;
+                          RtsFlags.GcFlags.concurrentMark = true;
+                      ) break;
+                  }
+                  else if (strequal("alloc-sample",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.allocSample = 1024 * 1024;
+                      ) break;
+                  }
+                  else if (!strncmp("alloc-sample=",
+                                    &rts_argv[arg][2], 13)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.allocSample =
+                              decodeSize(rts_argv[arg], 15, 1, HS_INT_MAX);
+                      ) break;
+                  }
+                  else if (strequal("alloc-sample-stacks",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.allocSampleStacks = true;
+                      ) break;
+                  }
+                  else if (strequal("gc-pause-hist",
+                               &rts_argv[arg][2])) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.gcPauseHist = true;
+                      ) break;
+                  }
+                  else if (!strncmp("gc-pause-hist=",
+                                    &rts_argv[arg][2], 14)) {
+                      OPTION_SAFE;
+                      TRACING_BUILD_ONLY(
+                          RtsFlags.TraceFlags.gcPauseHist = true;
+                          RtsFlags.TraceFlags.gcPauseHistInterval =
+                              fsecondsToTime(atof(rts_argv[arg]+16));
+                      ) break;
+                  }
+                  else if (!strncmp("decommit-rate=",
+                                    &rts_argv[arg][2], 14)) {
+                      OPTION_SAFE;
+                      THREADED_BUILD_ONLY(
+                          RtsFlags.GcFlags.decommitRate =
+                              decodeSize(rts_argv[arg], 16, 0, HS_WORD_MAX);
+                      ) break;
+                  }
                   else if (!strncmp("long-gc-sync=", &rts_argv[arg][2], 13)) {
                       OPTION_SAFE;
                       if (rts_argv[arg][2] == '\0') {
@@ -1389,6 +1570,9 @@ error = true;
                         }
                         break;
                     }
+                    case 'c':
+                        RtsFlags.ParFlags.parCompactEnabled = true;
+                        break;
                     case 'a':
                         RtsFlags.ParFlags.setAffinity = true;
                         break;
@@ -1666,6 +1850,15 @@ static void normaliseRtsOpts (void)
         RtsFlags.GcFlags.minAllocAreaSize = RtsFlags.GcFlags.maxHeapSize;
     }
 
+    // The holes that these fill may be in blocks that a concurrent mark
+    // is about to sweep; see Note [Concurrent marking] in ConcMark.c.
+    if (RtsFlags.GcFlags.concurrentMark &&
+        (RtsFlags.GcFlags.fillHoles || RtsFlags.GcFlags.reusePinned)) {
+        errorBelch("--concurrent-mark cannot be used with --fill-holes "
+                   "or --reuse-pinned");
+        errorUsage();
+    }
+
     // If we have -A16m or larger, use -n4m.
     if (RtsFlags.GcFlags.minAllocAreaSize >= (16*1024*1024) / BLOCK_SIZE) {
         RtsFlags.GcFlags.nurseryChunkSize = (4*1024*1024) / BLOCK_SIZE;
@@ -31,6 +31,7 @@
 #include "StaticPtrTable.h"
 #include "Hash.h"
 #include "Profiling.h"
+#include "HeapSnapshot.h"
 #include "Timer.h"
 #include "Globals.h"
 #include "FileLock.h"
@@ -302,6 +303,8 @@ hs_init_ghc(int *argc, char **argv[], RtsConfig rts_config)
 
     initProfiling();
 
+    initHeapSnapshot();
+
     /* start the virtual timer 'subsystem'. */
     initTimer();
     startTimer();
@@ -436,6 +439,9 @@ hs_exit_(bool wait_foreign)
     // also outputs the stats (+RTS -s) info.
     exitStorage();
 
+    /* myTask() can't be used once the tasks are freed */
+    stopStablePtrCaches();
+
     /* free the tasks */
     freeScheduler();
 
@@ -472,6 +478,8 @@ hs_exit_(bool wait_foreign)
     endProfiling();
     freeProfiling();
 
+    exitHeapSnapshot();
+
 #if defined(PROFILING)
     // Originally, this was in report_ccs_profiling().  Now, retainer
     // profiling might tack some extra stuff on to the end of this file
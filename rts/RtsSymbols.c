@@ -573,6 +573,8 @@
       SymI_HasProto(stg_compactGetNextBlockzh)                          \
       SymI_HasProto(stg_compactAllocateBlockzh)                         \
       SymI_HasProto(stg_compactFixupPointerszh)                         \
+      SymI_HasProto(compactWriteFile)                                   \
+      SymI_HasProto(compactReadFile)                                    \
       SymI_HasProto(stg_compactSizzezh)                                 \
       SymI_HasProto(closure_flags)                                      \
       SymI_HasProto(cmp_thread)                                         \
@@ -584,6 +586,8 @@
       SymI_HasProto(stg_deRefWeakzh)                                    \
       SymI_HasProto(stg_deRefStablePtrzh)                               \
       SymI_HasProto(dirty_MUT_VAR)                                      \
+      SymI_HasProto(dirty_MUT_ARR_PTRS_card)                            \
+      SymI_HasProto(dirty_MUT_ARR_PTRS_cards)                           \
       SymI_HasProto(dirty_TVAR)                                         \
       SymI_HasProto(stg_forkzh)                                         \
       SymI_HasProto(stg_forkOnzh)                                       \
@@ -687,6 +691,7 @@
       SymI_HasProto(newSpark)                                           \
       SymI_HasProto(performGC)                                          \
       SymI_HasProto(performMajorGC)                                     \
+      SymI_HasProto(performHeapSnapshot)                                \
       SymI_HasProto(prog_argc)                                          \
       SymI_HasProto(prog_argv)                                          \
       SymI_HasProto(stg_putMVarzh)                                      \
@@ -899,6 +904,7 @@
       SymI_NeedsProto(stg_interp_constr7_entry)                         \
       SymI_HasProto(stg_arg_bitmaps)                                    \
       SymI_HasProto(large_alloc_lim)                                    \
+      SymI_HasProto(card_remset_min_ptrs)                               \
       SymI_HasProto(g0)                                                 \
       SymI_HasProto(allocate)                                           \
       SymI_HasProto(allocateExec)                                       \
@@ -25,9 +25,12 @@
 #include "Updates.h"
 #include "Proftimer.h"
 #include "ProfHeap.h"
+#include "HeapSnapshot.h"
 #include "Weak.h"
 #include "sm/GC.h" // waitForGcThreads, releaseGCThreads, N
 #include "sm/GCThread.h"
+#include "sm/Sweep.h"
+#include "sm/ConcMark.h"
 #include "Sparks.h"
 #include "Capability.h"
 #include "Task.h"
@@ -68,10 +71,9 @@
  * -------------------------------------------------------------------------- */
 
 #if !defined(THREADED_RTS)
-// Blocked/sleeping threads
+// Blocked threads; sleeping threads are in posix/Select.c
 StgTSO *blocked_queue_hd = NULL;
 StgTSO *blocked_queue_tl = NULL;
-StgTSO *sleeping_queue = NULL;    // perhaps replace with a hash table?
 #endif
 
 // Bytes allocated since the last time a HeapOverflow exception was thrown by
@@ -549,6 +551,12 @@ run_thread:
     if (ready_to_gc || scheduleNeedHeapProfile(ready_to_gc)) {
       scheduleDoGC(&cap,task,false);
     }
+
+    // +RTS --heap-snapshot: a SIGUSR2 asked for a snapshot, which the
+    // next major GC will write.
+    if (heapSnapshotRequested()) {
+      scheduleDoGC(&cap,task,true);
+    }
   } /* end of while() */
 }
 
@@ -881,7 +889,7 @@ scheduleCheckBlockedThreads(Capability *cap USED_IF_NOT_THREADS)
     // run queue is empty, and there are no other tasks running, we
     // can wait indefinitely for something to happen.
     //
-    if ( !emptyQueue(blocked_queue_hd) || !emptyQueue(sleeping_queue) )
+    if ( !EMPTY_BLOCKED_QUEUE() || !EMPTY_SLEEPING_QUEUE() )
     {
         awaitEvent (emptyRunQueue(cap));
     }
@@ -1340,6 +1348,10 @@ scheduleHandleThreadFinished (Capability *cap, Task *task, StgTSO *t)
           return true; // tells schedule() to return
       }
 
+      // the next forkIO can have its stack, see Note [Recycling thread
+      // stacks] in Threads.c
+      recycleThreadStack(cap, t);
+
       return false;
 }
 
@@ -1516,6 +1528,7 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
     uint32_t collect_gen;
     bool major_gc;
 #if defined(THREADED_RTS)
+    bool conc_mark;
     uint32_t gc_type;
     uint32_t i;
     uint32_t need_idle;
@@ -1540,13 +1553,26 @@ scheduleDoGC (Capability **pcap, Task *task USED_IF_THREADS,
     // Figure out which generation we are collecting, so that we can
     // decide whether this is a parallel GC or not.
     collect_gen = calcNeeded(force_major || heap_census, NULL);
+#if defined(THREADED_RTS)
+    // A major GC may become the start of a concurrent mark, see Note
+    // [Concurrent marking] in sm/ConcMark.c.
+    collect_gen = concMarkCollectGen(collect_gen, force_major || heap_census,
+                                     &conc_mark);
+#endif
     major_gc = (collect_gen == RtsFlags.GcFlags.generations-1);
 
 #if defined(THREADED_RTS)
     if (sched_state < SCHED_INTERRUPTING
         && RtsFlags.ParFlags.parGcEnabled
         && collect_gen >= RtsFlags.ParFlags.parGcGen
-        && ! oldest_gen->mark)
+        && (! oldest_gen->mark ||
+            // marking is sequential, but compaction and sweeping can be
+            // done in parallel: see Note [Parallel compaction] in
+            // Compact.c and Note [Parallel sweeping] in Sweep.c.  A lazy
+            // sweep leaves the sweeping to the mutator.
+            (major_gc && RtsFlags.ParFlags.parCompactEnabled &&
+             (oldest_gen->compact || !RtsFlags.GcFlags.lazySweep ||
+              RtsFlags.GcFlags.fillHoles))))
     {
         gc_type = SYNC_GC_PAR;
     } else {
@@ -1794,13 +1820,24 @@ delete_threads_and_gc:
     }
 #endif
 
-    // Do any remaining idle GC work from the previous GC
-    doIdleGCWork(cap, true /* all of it */);
+    // Do any remaining idle GC work from the previous GC.  Sweeping left
+    // over from the last major GC only has to be finished before the
+    // next one; before a minor GC we only do a part of it (see Note
+    // [Lazy sweeping] in sm/Sweep.c).
+    if (major_gc) {
+        doIdleGCWork(cap, true /* all of it */);
+    } else {
+        paceLazySweep();
+        runSomeFinalizers(true);
+    }
 
 #if defined(THREADED_RTS)
     // reset pending_sync *before* GC, so that when the GC threads
     // emerge they don't immediately re-enter the GC.
     pending_sync = 0;
+    if (conc_mark) {
+        requestConcMark();
+    }
     GarbageCollect(collect_gen, heap_census, gc_type, cap, idle_cap);
 #else
     GarbageCollect(collect_gen, heap_census, 0, cap, NULL);
@@ -1985,6 +2022,10 @@ forkProcess(HsStablePtr *entry
 
     stopTimer(); // See #4074
 
+    // See Note [Background decommit] in sm/MBlock.c
+    stopDecommitThread();
+    stopConcMarkThread();
+
 #if defined(TRACING)
     flushEventLog(); // so that child won't inherit dirty file buffers
 #endif
@@ -1994,6 +2035,8 @@ forkProcess(HsStablePtr *entry
     if (pid) { // parent
 
         startTimer(); // #4074
+        startDecommitThread();
+        startConcMarkThread();
 
         RELEASE_LOCK(&sched_mutex);
         RELEASE_LOCK(&sm_mutex);
@@ -2032,10 +2075,21 @@ forkProcess(HsStablePtr *entry
         initMutex(&all_tasks_mutex);
 #endif
 
+        // restart the decommit thread if it has work left, and the
+        // concurrent marker if a mark is under way
+        startDecommitThread();
+        startConcMarkThread();
+
 #if defined(TRACING)
         resetTracing();
 #endif
 
+#if !defined(THREADED_RTS)
+        // Don't touch the epoll instance we share with the parent
+        // while deleting the threads below.
+        resetFdWaitersAfterFork();
+#endif
+
         // Now, all OS threads except the thread that forked are
         // stopped.  We need to stop all Haskell threads, including
         // those involved in foreign calls.  Also we need to delete
@@ -2294,8 +2348,8 @@ deleteAllThreads ()
     // being GC'd, and we don't want the "main thread has been GC'd" panic.
 
 #if !defined(THREADED_RTS)
-    ASSERT(blocked_queue_hd == END_TSO_QUEUE);
-    ASSERT(sleeping_queue == END_TSO_QUEUE);
+    ASSERT(EMPTY_BLOCKED_QUEUE());
+    ASSERT(EMPTY_SLEEPING_QUEUE());
 #endif
 }
 
@@ -2613,7 +2667,6 @@ initScheduler(void)
 #if !defined(THREADED_RTS)
   blocked_queue_hd  = END_TSO_QUEUE;
   blocked_queue_tl  = END_TSO_QUEUE;
-  sleeping_queue    = END_TSO_QUEUE;
 #endif
 
   sched_state    = SCHED_RUNNING;
@@ -2702,7 +2755,10 @@ void markScheduler (evac_fn evac USED_IF_NOT_THREADS,
 #if !defined(THREADED_RTS)
     evac(user, (StgClosure **)(void *)&blocked_queue_hd);
     evac(user, (StgClosure **)(void *)&blocked_queue_tl);
-    evac(user, (StgClosure **)(void *)&sleeping_queue);
+#if !defined(mingw32_HOST_OS)
+    markFdWaiters(evac, user);
+    markSleepers(evac, user);
+#endif
 #endif
 }
 
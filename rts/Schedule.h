@@ -12,6 +12,7 @@
 #include "rts/OSThreads.h"
 #include "Capability.h"
 #include "Trace.h"
+#include "AwaitEvent.h"
 
 #include "BeginPrivate.h"
 
@@ -97,7 +98,6 @@ extern volatile StgWord recent_activity;
  */
 #if !defined(THREADED_RTS)
 extern  StgTSO *blocked_queue_hd, *blocked_queue_tl;
-extern  StgTSO *sleeping_queue;
 #endif
 
 extern bool heap_overflow;
@@ -229,8 +229,13 @@ truncateRunQueue(Capability *cap)
 }
 
 #if !defined(THREADED_RTS)
+#if defined(mingw32_HOST_OS)
 #define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd))
-#define EMPTY_SLEEPING_QUEUE() (emptyQueue(sleeping_queue))
+#define EMPTY_SLEEPING_QUEUE() (true)
+#else
+#define EMPTY_BLOCKED_QUEUE()  (emptyQueue(blocked_queue_hd) && !anyFdWaiters())
+#define EMPTY_SLEEPING_QUEUE() (!anySleepers())
+#endif
 #endif
 
 INLINE_HEADER bool
@@ -16,6 +16,7 @@
 #include "Sparks.h"
 #include "ThreadLabels.h"
 #include "sm/HeapAlloc.h"
+#include "sm/ConcMark.h"
 
 #if defined(THREADED_RTS)
 
@@ -195,7 +196,9 @@ pruneSparkQueue (Capability *cap)
                   traceEventSparkFizzle(cap);
               }
           } else if (HEAP_ALLOCED(spark)) {
-              if ((Bdescr((P_)spark)->flags & BF_EVACUATED)) {
+              // see Note [Concurrent marking] in sm/ConcMark.c
+              if ((Bdescr((P_)spark)->flags & BF_EVACUATED)
+                  && !(conc_mark_active && concMarkIsDead(spark))) {
                   if (closure_SHOULD_SPARK(spark)) {
                       elements[botInd] = spark; // keep entry (new address)
                       botInd++;
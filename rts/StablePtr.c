@@ -16,6 +16,8 @@
 #include "RtsUtils.h"
 #include "Trace.h"
 #include "StablePtr.h"
+#include "Capability.h"
+#include "Task.h"
 
 #include <string.h>
 
@@ -79,25 +81,75 @@
   application, etc of a stable pointer.
 
   Stable Pointers are exported to the outside world as indices and not
-  pointers, because the stable pointer table is allowed to be
-  reallocated for growth. The table is never shrunk for its space to
-  be reclaimed.
+  pointers. The table is never shrunk for its space to be reclaimed.
 
   Future plans for stable ptrs include distinguishing them by the
   generation of the pointed object. See
   http://ghc.haskell.org/trac/ghc/ticket/7670 for details.
 */
 
-spEntry *stable_ptr_table = NULL;
-static spEntry *stable_ptr_free = NULL;
-static unsigned int SPT_size = 0;
-#define INIT_SPT_SIZE 64
+/* Note [Stable pointer table]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * A stable pointer is an index into the table.  The table is made of
+ * segments of STABLE_PTR_SEGMENT_SIZE entries each, and
+ * stable_ptr_table is the "spine": an array of pointers to the
+ * segments.  Entry i is
+ *
+ *     stable_ptr_table[i >> STABLE_PTR_SEGMENT_BITS]
+ *                     [i & (STABLE_PTR_SEGMENT_SIZE - 1)]
+ *
+ * The table grows by adding a segment, so entries never move and
+ * deRefStablePtr() needs no lock.  When the spine itself is full we copy
+ * it into one twice the size.  That is cheap (a word per segment), but
+ * the old copy must be kept until the next GC; see Note [Enlarging the
+ * stable pointer table].
+ *
+ * A free entry has addr == NULL.  The indices of free entries are kept
+ * on stacks, not threaded through the entries:
+ *
+ *  - Each Capability has a small cache of free indices (cap->sp_cache).
+ *    getStablePtr() and freeStablePtr() use it without locking when
+ *    called by the Task that owns the Capability, which covers
+ *    makeStablePtr# and freeStablePtr in Haskell code.  The cache is
+ *    refilled from the global stack, and spilled back to it,
+ *    STABLE_PTR_CACHE_BATCH indices at a time.
+ *
+ *    The caches are only used between hs_init() and the point in
+ *    hs_exit() where the Tasks are freed (sp_caches_on).  The table is
+ *    also used outside that window, e.g. by hs_spt_insert() called from
+ *    C constructors, when we can't call myTask(): without native
+ *    thread-local storage it reads currentTaskKey, which isn't set up.
+ *
+ *  - The global stack (sp_free) is protected by stable_ptr_mutex.
+ *    Everyone else uses it directly, e.g. a thread in a safe foreign
+ *    call, or freeStablePtrUnsafe().
+ *
+ * Since free entries are NULL, whether an entry is live can be told from
+ * the entry alone, so segments can be marked independently.  The GC
+ * threads share the segments out between them (markStablePtrSegment), as
+ * do the threads of a parallel compaction (see Note [Parallel
+ * compaction] in sm/Compact.c).
+ */
+
+spEntry **stable_ptr_table = NULL;
+static uint32_t n_segments = 0;     // segments allocated
+static uint32_t spine_size = 0;     // capacity of stable_ptr_table
+
+// The global stack of free indices
+static StgWord *sp_free = NULL;
+static StgWord n_sp_free = 0;
+static StgWord sp_free_size = 0;
+
+// Whether the per-Capability caches may be used
+static bool sp_caches_on = false;
+
+#define INIT_SPINE_SIZE 4
 
-/* Each time the stable pointer table is enlarged, we temporarily retain the old
- * version to ensure dereferences are thread-safe (see Note [Enlarging the
- * stable pointer table]).  Since we double the size of the table each time, we
- * can (theoretically) enlarge it at most N times on an N-bit machine.  Thus,
- * there will never be more than N old versions of the table.
+/* Each time the spine is enlarged, we temporarily retain the old version to
+ * ensure dereferences are thread-safe (see Note [Enlarging the stable pointer
+ * table]).  Since we double the size of the spine each time, we can
+ * (theoretically) enlarge it at most N times on an N-bit machine.  Thus,
+ * there will never be more than N old versions of the spine.
  */
 #if SIZEOF_VOID_P == 4
 #define MAX_N_OLD_SPTS 32
@@ -107,7 +159,7 @@ static unsigned int SPT_size = 0;
 #error unknown SIZEOF_VOID_P
 #endif
 
-static spEntry *old_SPTs[MAX_N_OLD_SPTS];
+static spEntry **old_SPTs[MAX_N_OLD_SPTS];
 static uint32_t n_old_SPTs = 0;
 
 #if defined(THREADED_RTS)
@@ -116,15 +168,24 @@ Mutex stable_ptr_mutex;
 
 static void enlargeStablePtrTable(void);
 
+STATIC_INLINE spEntry *
+spEntryAt(StgWord sp)
+{
+    return &stable_ptr_table[sp >> STABLE_PTR_SEGMENT_BITS]
+                            [sp & (STABLE_PTR_SEGMENT_SIZE - 1)];
+}
+
 /* -----------------------------------------------------------------------------
  * We must lock the StablePtr table during GC, to prevent simultaneous
  * calls to freeStablePtr().
  * -------------------------------------------------------------------------- */
 
+static void initStablePtrTable_(void);
+
 void
 stablePtrLock(void)
 {
-    initStablePtrTable();
+    initStablePtrTable_();
     ACQUIRE_LOCK(&stable_ptr_mutex);
 }
 
@@ -138,29 +199,35 @@ stablePtrUnlock(void)
  * Initialising the table
  * -------------------------------------------------------------------------- */
 
-STATIC_INLINE void
-initSpEntryFreeList(spEntry *table, uint32_t n, spEntry *free)
+// Called by hs_init(), or by stablePtrLock() if the table is used first.
+static void
+initStablePtrTable_(void)
 {
-  spEntry *p;
-  for (p = table + n - 1; p >= table; p--) {
-      p->addr = (P_)free;
-      free = p;
-  }
-  stable_ptr_free = table;
+    if (spine_size > 0) return;
+    spine_size = INIT_SPINE_SIZE;
+    stable_ptr_table = stgMallocBytes(spine_size * sizeof(spEntry *),
+                                      "initStablePtrTable");
+    enlargeStablePtrTable();
+
+#if defined(THREADED_RTS)
+    initMutex(&stable_ptr_mutex);
+#endif
 }
 
 void
 initStablePtrTable(void)
 {
-    if (SPT_size > 0) return;
-    SPT_size = INIT_SPT_SIZE;
-    stable_ptr_table = stgMallocBytes(SPT_size * sizeof(spEntry),
-                                      "initStablePtrTable");
-    initSpEntryFreeList(stable_ptr_table,INIT_SPT_SIZE,NULL);
+    initStablePtrTable_();
+    sp_caches_on = true;
+}
 
-#if defined(THREADED_RTS)
-    initMutex(&stable_ptr_mutex);
-#endif
+// Called by hs_exit() before the Tasks and Capabilities are freed.  The
+// indices left in the caches are simply lost: the table is about to be
+// freed too.
+void
+stopStablePtrCaches(void)
+{
+    sp_caches_on = false;
 }
 
 /* -----------------------------------------------------------------------------
@@ -169,23 +236,30 @@ initStablePtrTable(void)
 
 // Must be holding stable_ptr_mutex
 static void
-enlargeStablePtrTable(void)
+growFreeStack(StgWord n)
 {
-    uint32_t old_SPT_size = SPT_size;
-    spEntry *new_stable_ptr_table;
+    if (n_sp_free + n <= sp_free_size) return;
+
+    while (n_sp_free + n > sp_free_size) {
+        sp_free_size = sp_free_size == 0 ? STABLE_PTR_SEGMENT_SIZE
+                                         : sp_free_size * 2;
+    }
+    sp_free = stgReallocBytes(sp_free, sp_free_size * sizeof(StgWord),
+                              "growFreeStack");
+}
 
-    // 2nd and subsequent times
-    SPT_size *= 2;
+// Must be holding stable_ptr_mutex
+static void
+enlargeSpine(void)
+{
+    spEntry **new_spine;
 
     /* We temporarily retain the old version instead of freeing it; see Note
      * [Enlarging the stable pointer table].
      */
-    new_stable_ptr_table =
-        stgMallocBytes(SPT_size * sizeof(spEntry),
-                       "enlargeStablePtrTable");
-    memcpy(new_stable_ptr_table,
-           stable_ptr_table,
-           old_SPT_size * sizeof(spEntry));
+    new_spine = stgMallocBytes(spine_size * 2 * sizeof(spEntry *),
+                               "enlargeSpine");
+    memcpy(new_spine, stable_ptr_table, spine_size * sizeof(spEntry *));
     ASSERT(n_old_SPTs < MAX_N_OLD_SPTS);
     old_SPTs[n_old_SPTs++] = stable_ptr_table;
 
@@ -193,33 +267,102 @@ enlargeStablePtrTable(void)
      * be atomic, so that another thread simultaneously dereferencing a stable
      * pointer will always read a valid address.
      */
-    stable_ptr_table = new_stable_ptr_table;
+    write_barrier();
+    stable_ptr_table = new_spine;
+    spine_size *= 2;
+}
+
+// Must be holding stable_ptr_mutex
+static void
+enlargeStablePtrTable(void)
+{
+    StgWord base, i;
+
+    if (n_segments == spine_size) {
+        enlargeSpine();
+    }
+
+    base = (StgWord)n_segments << STABLE_PTR_SEGMENT_BITS;
+    stable_ptr_table[n_segments++] =
+        stgCallocBytes(STABLE_PTR_SEGMENT_SIZE, sizeof(spEntry),
+                       "enlargeStablePtrTable");
 
-    initSpEntryFreeList(stable_ptr_table + old_SPT_size, old_SPT_size, NULL);
+    // push the new entries so that the lowest index is used first
+    growFreeStack(STABLE_PTR_SEGMENT_SIZE);
+    for (i = STABLE_PTR_SEGMENT_SIZE; i > 0; i--) {
+        sp_free[n_sp_free++] = base + i - 1;
+    }
 }
 
 /* Note [Enlarging the stable pointer table]
  *
- * To enlarge the stable pointer table, we allocate a new table, copy the
- * existing entries, and then store the old version of the table in old_SPTs
- * until we free it during GC.  By not immediately freeing the old version
- * (or equivalently by not growing the table using realloc()), we ensure that
- * another thread simultaneously dereferencing a stable pointer using the old
- * version can safely access the table without causing a segfault (see Trac
- * #10296).
+ * To enlarge the spine of the stable pointer table, we allocate a new spine,
+ * copy the existing segment pointers, and then store the old version of the
+ * spine in old_SPTs until we free it during GC.  By not immediately freeing
+ * the old version (or equivalently by not growing the spine using
+ * realloc()), we ensure that another thread simultaneously dereferencing a
+ * stable pointer using the old version can safely access the table without
+ * causing a segfault (see Trac #10296).  The segments themselves never move.
  *
- * Note that because the stable pointer table is doubled in size each time it is
- * enlarged, the total memory needed to store the old versions is always less
- * than that required to hold the current version.
+ * Note that because the spine is doubled in size each time it is enlarged,
+ * the total memory needed to store the old versions is always less than that
+ * required to hold the current version.
  */
 
+/* -----------------------------------------------------------------------------
+ * Per-Capability caches of free entries
+ * -------------------------------------------------------------------------- */
+
+// The cache of the Capability we are running on, or NULL if we don't
+// hold one (see Note [Stable pointer table]).
+STATIC_INLINE StablePtrCache *
+myStablePtrCache(void)
+{
+#if defined(THREADED_RTS)
+    Task *task;
+
+    if (!sp_caches_on) return NULL;
+
+    task = myTask();
+    if (task != NULL && task->cap != NULL && task->cap->running_task == task) {
+        return &task->cap->sp_cache;
+    }
+#endif
+    return NULL;
+}
+
+static void
+refillStablePtrCache(StablePtrCache *cache)
+{
+    StgWord n;
+
+    stablePtrLock();
+    if (n_sp_free == 0) enlargeStablePtrTable();
+    n = stg_min(n_sp_free, STABLE_PTR_CACHE_BATCH);
+    n_sp_free -= n;
+    memcpy(cache->free, &sp_free[n_sp_free], n * sizeof(StgWord));
+    cache->n = n;
+    stablePtrUnlock();
+}
+
+static void
+spillStablePtrCache(StablePtrCache *cache)
+{
+    stablePtrLock();
+    growFreeStack(STABLE_PTR_CACHE_BATCH);
+    cache->n -= STABLE_PTR_CACHE_BATCH;
+    memcpy(&sp_free[n_sp_free], &cache->free[cache->n],
+           STABLE_PTR_CACHE_BATCH * sizeof(StgWord));
+    n_sp_free += STABLE_PTR_CACHE_BATCH;
+    stablePtrUnlock();
+}
 
 /* -----------------------------------------------------------------------------
  * Freeing entries and tables
  * -------------------------------------------------------------------------- */
 
-static void
-freeOldSPTs(void)
+void
+freeOldStablePtrTables(void)
 {
     uint32_t i;
 
@@ -232,38 +375,54 @@ freeOldSPTs(void)
 void
 exitStablePtrTable(void)
 {
+    uint32_t i;
+
+    for (i = 0; i < n_segments; i++) {
+        stgFree(stable_ptr_table[i]);
+    }
     if (stable_ptr_table)
         stgFree(stable_ptr_table);
     stable_ptr_table = NULL;
-    SPT_size = 0;
+    n_segments = 0;
+    spine_size = 0;
+
+    if (sp_free)
+        stgFree(sp_free);
+    sp_free = NULL;
+    n_sp_free = 0;
+    sp_free_size = 0;
 
-    freeOldSPTs();
+    freeOldStablePtrTables();
 
 #if defined(THREADED_RTS)
     closeMutex(&stable_ptr_mutex);
 #endif
 }
 
-STATIC_INLINE void
-freeSpEntry(spEntry *sp)
-{
-    sp->addr = (P_)stable_ptr_free;
-    stable_ptr_free = sp;
-}
-
 void
 freeStablePtrUnsafe(StgStablePtr sp)
 {
-    ASSERT((StgWord)sp < SPT_size);
-    freeSpEntry(&stable_ptr_table[(StgWord)sp]);
+    ASSERT((StgWord)sp < ((StgWord)n_segments << STABLE_PTR_SEGMENT_BITS));
+    spEntryAt((StgWord)sp)->addr = NULL;
+    growFreeStack(1);
+    sp_free[n_sp_free++] = (StgWord)sp;
 }
 
 void
 freeStablePtr(StgStablePtr sp)
 {
-    stablePtrLock();
-    freeStablePtrUnsafe(sp);
-    stablePtrUnlock();
+    StablePtrCache *cache = myStablePtrCache();
+
+    if (cache != NULL) {
+        ASSERT((StgWord)sp < ((StgWord)n_segments << STABLE_PTR_SEGMENT_BITS));
+        spEntryAt((StgWord)sp)->addr = NULL;
+        if (cache->n == STABLE_PTR_CACHE_SIZE) spillStablePtrCache(cache);
+        cache->free[cache->n++] = (StgWord)sp;
+    } else {
+        stablePtrLock();
+        freeStablePtrUnsafe(sp);
+        stablePtrUnlock();
+    }
 }
 
 /* -----------------------------------------------------------------------------
@@ -273,14 +432,20 @@ freeStablePtr(StgStablePtr sp)
 StgStablePtr
 getStablePtr(StgPtr p)
 {
+  StablePtrCache *cache = myStablePtrCache();
   StgWord sp;
 
-  stablePtrLock();
-  if (!stable_ptr_free) enlargeStablePtrTable();
-  sp = stable_ptr_free - stable_ptr_table;
-  stable_ptr_free  = (spEntry*)(stable_ptr_free->addr);
-  stable_ptr_table[sp].addr = p;
-  stablePtrUnlock();
+  if (cache != NULL) {
+      if (cache->n == 0) refillStablePtrCache(cache);
+      sp = cache->free[--cache->n];
+      spEntryAt(sp)->addr = p;
+  } else {
+      stablePtrLock();
+      if (n_sp_free == 0) enlargeStablePtrTable();
+      sp = sp_free[--n_sp_free];
+      spEntryAt(sp)->addr = p;
+      stablePtrUnlock();
+  }
   return (StgStablePtr)(sp);
 }
 
@@ -288,30 +453,35 @@ getStablePtr(StgPtr p)
  * Treat stable pointers as roots for the garbage collector.
  * -------------------------------------------------------------------------- */
 
-#define FOR_EACH_STABLE_PTR(p, CODE)                                    \
-    do {                                                                \
-        spEntry *p;                                                     \
-        spEntry *__end_ptr = &stable_ptr_table[SPT_size];               \
-        for (p = stable_ptr_table; p < __end_ptr; p++) {                \
-            /* Internal pointers are free slots. NULL is last in free */ \
-            /* list. */                                                 \
-            if (p->addr &&                                              \
-                (p->addr < (P_)stable_ptr_table || p->addr >= (P_)__end_ptr)) \
-            {                                                           \
-                do { CODE } while(0);                                   \
-            }                                                           \
-        }                                                               \
-    } while(0)
+uint32_t
+stablePtrTableSegments(void)
+{
+    return n_segments;
+}
+
+void
+markStablePtrSegment(uint32_t seg, evac_fn evac, void *user)
+{
+    spEntry *p, *end;
+
+    ASSERT(seg < n_segments);
+    p = stable_ptr_table[seg];
+    end = p + STABLE_PTR_SEGMENT_SIZE;
+    for (; p < end; p++) {
+        if (p->addr != NULL) {
+            evac(user, (StgClosure **)&p->addr);
+        }
+    }
+}
 
 void
 markStablePtrTable(evac_fn evac, void *user)
 {
-    /* Since no other thread can currently be dereferencing a stable pointer, it
-     * is safe to free the old versions of the table.
-     */
-    freeOldSPTs();
+    uint32_t i;
 
-    FOR_EACH_STABLE_PTR(p, evac(user, (StgClosure **)&p->addr););
+    for (i = 0; i < n_segments; i++) {
+        markStablePtrSegment(i, evac, user);
+    }
 }
 
 /* -----------------------------------------------------------------------------
@@ -325,5 +495,5 @@ markStablePtrTable(evac_fn evac, void *user)
 void
 threadStablePtrTable( evac_fn evac, void *user )
 {
-    FOR_EACH_STABLE_PTR(p, evac(user, (StgClosure **)&p->addr););
+    markStablePtrTable(evac, user);
 }
@@ -25,14 +25,38 @@ void    freeStablePtr         ( StgStablePtr sp );
 void    freeStablePtrUnsafe   ( StgStablePtr sp );
 
 void    initStablePtrTable      ( void );
+void    stopStablePtrCaches     ( void );
 void    exitStablePtrTable      ( void );
 
+/* A Capability's cache of free stable pointer entries; see
+ * Note [Stable pointer table] in StablePtr.c.
+ */
+#define STABLE_PTR_CACHE_SIZE  64
+#define STABLE_PTR_CACHE_BATCH 32
+
+typedef struct {
+    uint32_t n;
+    StgWord  free[STABLE_PTR_CACHE_SIZE];
+} StablePtrCache;
+
 /* Call given function on every stable ptr. markStablePtrTable depends
  * on the function updating its pointers in case the object is
  * moved.
  */
 void    markStablePtrTable    ( evac_fn evac, void *user );
 
+/* The same, for one segment of the table, so that several GC threads
+ * can mark the table between them.  The number of segments only
+ * changes while the table is unlocked.
+ */
+uint32_t stablePtrTableSegments ( void );
+void    markStablePtrSegment  ( uint32_t seg, evac_fn evac, void *user );
+
+/* Free the copies of the table retained for concurrent readers; only
+ * safe during GC.  See Note [Enlarging the stable pointer table].
+ */
+void    freeOldStablePtrTables ( void );
+
 void    threadStablePtrTable  ( evac_fn evac, void *user );
 
 void    stablePtrLock         ( void );
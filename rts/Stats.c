@@ -18,6 +18,7 @@
 #include "sm/Storage.h"
 #include "sm/GCThread.h"
 #include "sm/BlockAlloc.h"
+#include "sm/OSMem.h"
 
 // for spin/yield counters
 #include "sm/GC.h"
@@ -43,6 +44,33 @@ static Time HC_start_time, HC_tot_time = 0;     // heap census prof user time
 static Time HCe_start_time, HCe_tot_time = 0;   // heap census prof elap time
 #endif
 
+// compaction of the oldest generation, see Compact.c
+static Time Compact_start_time, Compact_tot_time = 0;    // user time
+static Time Compacte_start_time, Compacte_tot_time = 0;  // elapsed time
+static uint32_t compact_count = 0, compact_par_count = 0;
+
+// bytes copied by the GC threads on each NUMA node, and the blocks they
+// stole from threads on the same node and on other nodes; see Note
+// [NUMA-aware GC] in GC.c
+static uint64_t numa_copied_bytes[MAX_NUMA_NODES];
+static uint64_t numa_steals_local[MAX_NUMA_NODES];
+static uint64_t numa_steals_remote[MAX_NUMA_NODES];
+
+// static objects scavenged in major GCs, the lists of them that GC
+// threads took from each other, and the time spent on them summed over
+// the GC threads; see Note [Parallel static scavenging] in Scav.c
+static uint64_t static_scavenged = 0;
+static uint64_t static_steals = 0;
+static Time static_time = 0;
+
+// the pinned blocks at the last major GC, the words of live objects and
+// of holes in them, and the words allocated in holes since the start
+// (+RTS --reuse-pinned); see Note [Reusing pinned holes] in Pinned.c
+static W_ pinned_blocks = 0;
+static W_ pinned_live = 0;
+static W_ pinned_holes = 0;
+static uint64_t pinned_reused = 0;
+
 #if defined(PROFILING)
 #define PROF_VAL(x)   (x)
 #else
@@ -73,6 +101,8 @@ static Time *GC_coll_max_pause = NULL;
 static void statsPrintf( char *s, ... ) GNUC3_ATTRIBUTE(format (PRINTF, 1, 2));
 static void statsFlush( void );
 static void statsClose( void );
+static void stat_stackChunkCache( RTSStats *s );
+static void stat_pausePercentiles( RTSStats *s );
 
 /* -----------------------------------------------------------------------------
    Current elapsed time
@@ -138,6 +168,26 @@ initStats0(void)
     end_exit_cpu     = 0;
     end_exit_elapsed  = 0;
 
+    Compact_start_time = 0;
+    Compact_tot_time = 0;
+    Compacte_start_time = 0;
+    Compacte_tot_time = 0;
+    compact_count = 0;
+    compact_par_count = 0;
+
+    memset(numa_copied_bytes, 0, sizeof(numa_copied_bytes));
+    memset(numa_steals_local, 0, sizeof(numa_steals_local));
+    memset(numa_steals_remote, 0, sizeof(numa_steals_remote));
+
+    static_scavenged = 0;
+    static_steals = 0;
+    static_time = 0;
+
+    pinned_blocks = 0;
+    pinned_live = 0;
+    pinned_holes = 0;
+    pinned_reused = 0;
+
 #if defined(PROFILING)
     RP_start_time  = 0;
     RP_tot_time  = 0;
@@ -173,6 +223,8 @@ initStats0(void)
         .any_work = 0,
         .no_work = 0,
         .scav_find_work = 0,
+        .stack_chunk_cache_hits = 0,
+        .stack_chunk_cache_misses = 0,
         .init_cpu_ns = 0,
         .init_elapsed_ns = 0,
         .mutator_cpu_ns = 0,
@@ -276,6 +328,142 @@ stat_startGCSync (gc_thread *gct)
     gct->gc_sync_start_elapsed = getProcessElapsedTime();
 }
 
+/* -----------------------------------------------------------------------------
+   GC pause histograms
+
+   Note [GC pause histograms]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   The maximum and average pause say little about latency: a service
+   with a 10ms target wants to know how many GCs took longer than that.
+   So stat_endGC() also counts each GC's elapsed time in a histogram for
+   its generation (stats.gc_pause_hist), and the time it took to stop the
+   mutator in stats.gc_sync_hist.
+
+   The buckets are logarithmic, with four to each power of two (see
+   GCPauseHistogram in RtsAPI.h).  This fits pauses from 1us to half an
+   hour in 128 buckets, and a percentile read from it is never off by
+   more than 25%.  Finding the bucket is a count-leading-zeros and a
+   shift, so recording is cheap enough to leave on.  We only record when
+   we measure GC times at all, i.e. with +RTS -T, -s and friends, with
+   a gcDoneHook, or with +RTS --gc-pause-hist.
+
+   getRTSStats() and the machine-readable report turn the histograms into
+   the 50th, 99th and 99.9th percentiles.  We take the end of the bucket
+   that holds the percentile, which errs on the long side, but never more
+   than the longest pause we have seen.
+
+   With +RTS -l --gc-pause-hist[=<interval>], the histograms also go to
+   the eventlog as EVENT_GC_PAUSE_HISTOGRAM, at the end of the first GC
+   at least <interval> after the last time.  The counts are cumulative,
+   so a tool finds the pauses in an interval by subtracting consecutive
+   events, and no GC means no event because nothing changed.
+   -------------------------------------------------------------------------- */
+
+// the longest sync so far, GC_coll_max_pause[] has the longest pauses
+static Time max_sync_ns = 0;
+
+// when we last posted EVENT_GC_PAUSE_HISTOGRAM
+static Time last_pause_hist_event = 0;
+
+static uint32_t
+pause_hist_bucket (Time t)
+{
+    uint32_t msb, i;
+
+    if (t < ((Time)1 << GC_PAUSE_HIST_MIN_SHIFT)) {
+        return 0;
+    }
+    msb = 63 - __builtin_clzll((StgWord64)t);
+    i = 1 + (msb - GC_PAUSE_HIST_MIN_SHIFT) * 4 + ((t >> (msb - 2)) & 3);
+    return stg_min(i, GC_PAUSE_HIST_BUCKETS - 1);
+}
+
+// The start of bucket i+1
+static Time
+pause_hist_bucket_end (uint32_t i)
+{
+    return (Time)(4 + i % 4) << (GC_PAUSE_HIST_MIN_SHIFT + i / 4 - 2);
+}
+
+static void
+pause_hist_record (GCPauseHistogram *hist, Time t)
+{
+    hist->count++;
+    hist->buckets[pause_hist_bucket(t)]++;
+}
+
+// The per_mille'th per-mille of count pauses, no longer than max
+static Time
+pause_hist_percentile (const uint64_t *buckets, uint64_t count,
+                       uint32_t per_mille, Time max)
+{
+    uint64_t rank, seen = 0;
+    uint32_t i;
+
+    if (count == 0) {
+        return 0;
+    }
+    rank = stg_max((count * per_mille + 999) / 1000, 1);
+    for (i = 0; i < GC_PAUSE_HIST_BUCKETS - 1; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return stg_min(pause_hist_bucket_end(i), max);
+        }
+    }
+    return max;
+}
+
+static void
+stat_pausePercentiles( RTSStats *s )
+{
+    uint64_t all[GC_PAUSE_HIST_BUCKETS];
+    uint64_t count = 0;
+    Time max = 0;
+    uint32_t g, i;
+
+    memset(all, 0, sizeof(all));
+    for (g = 0; g < GC_PAUSE_HIST_GENS; g++) {
+        count += s->gc_pause_hist[g].count;
+        for (i = 0; i < GC_PAUSE_HIST_BUCKETS; i++) {
+            all[i] += s->gc_pause_hist[g].buckets[i];
+        }
+    }
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        max = stg_max(max, GC_coll_max_pause[g]);
+    }
+
+    s->gc_pause_p50_ns  = pause_hist_percentile(all, count, 500, max);
+    s->gc_pause_p99_ns  = pause_hist_percentile(all, count, 990, max);
+    s->gc_pause_p999_ns = pause_hist_percentile(all, count, 999, max);
+
+    s->gc_sync_p50_ns  = pause_hist_percentile(s->gc_sync_hist.buckets,
+                             s->gc_sync_hist.count, 500, max_sync_ns);
+    s->gc_sync_p99_ns  = pause_hist_percentile(s->gc_sync_hist.buckets,
+                             s->gc_sync_hist.count, 990, max_sync_ns);
+    s->gc_sync_p999_ns = pause_hist_percentile(s->gc_sync_hist.buckets,
+                             s->gc_sync_hist.count, 999, max_sync_ns);
+}
+
+// Show the non-empty buckets of a histogram as "<start ns>:<count> ...",
+// for the machine-readable report
+static void
+show_pause_hist (const GCPauseHistogram *hist, char *buf, size_t size)
+{
+    uint32_t i;
+    size_t n = 0;
+
+    buf[0] = '\0';
+    for (i = 0; i < GC_PAUSE_HIST_BUCKETS && n < size; i++) {
+        if (hist->buckets[i] != 0) {
+            n += snprintf(buf + n, size - n, "%s%" FMT_Word64 ":%" FMT_Word64,
+                          n == 0 ? "" : " ",
+                          i == 0 ? 0 : (StgWord64)pause_hist_bucket_end(i-1),
+                          hist->buckets[i]);
+        }
+    }
+}
+
 /* -----------------------------------------------------------------------------
    Called at the beginning of each GC
    -------------------------------------------------------------------------- */
@@ -343,7 +531,8 @@ stat_endGC (Capability *cap, gc_thread *gct, W_ live, W_ copied, W_ slop,
         rtsConfig.gcDoneHook != NULL;
 
     if (stats_enabled
-      || RtsFlags.ProfFlags.doHeapProfile) // heap profiling needs GC_tot_time
+      || RtsFlags.ProfFlags.doHeapProfile // heap profiling needs GC_tot_time
+      || RtsFlags.TraceFlags.gcPauseHist)
     {
         // We only update the times when stats are explicitly enabled since
         // getProcessTimes (e.g. requiring a system call) can be expensive on
@@ -357,6 +546,28 @@ stat_endGC (Capability *cap, gc_thread *gct, W_ live, W_ copied, W_ slop,
             gct->gc_start_elapsed - gct->gc_sync_start_elapsed;
         stats.gc.elapsed_ns = current_elapsed - gct->gc_start_elapsed;
         stats.gc.cpu_ns = current_cpu - gct->gc_start_cpu;
+
+        // See Note [GC pause histograms]
+        pause_hist_record(&stats.gc_pause_hist[stg_min(gen,
+                                                GC_PAUSE_HIST_GENS - 1)],
+                          stats.gc.elapsed_ns);
+        pause_hist_record(&stats.gc_sync_hist, stats.gc.sync_elapsed_ns);
+        if (stats.gc.sync_elapsed_ns > max_sync_ns) {
+            max_sync_ns = stats.gc.sync_elapsed_ns;
+        }
+
+        if (RtsFlags.TraceFlags.gcPauseHist &&
+            stats.elapsed_ns - last_pause_hist_event
+                >= RtsFlags.TraceFlags.gcPauseHistInterval) {
+            uint32_t g;
+            for (g = 0; g < GC_PAUSE_HIST_GENS
+                        && g < RtsFlags.GcFlags.generations; g++) {
+                traceGcPauseHistogram(cap, g, &stats.gc_pause_hist[g]);
+            }
+            traceGcPauseHistogram(cap, GC_PAUSE_HIST_SYNC,
+                                  &stats.gc_sync_hist);
+            last_pause_hist_event = stats.elapsed_ns;
+        }
     }
     // -------------------------------------------------
     // Update the cumulative stats
@@ -385,6 +596,22 @@ stat_endGC (Capability *cap, gc_thread *gct, W_ live, W_ copied, W_ slop,
         stats.gc_spin_yield += gc_spin_yield;
         stats.mut_spin_spin += mut_spin_spin;
         stats.mut_spin_yield += mut_spin_yield;
+
+        uint32_t i;
+        for (i = 0; i < par_n_threads; i++) {
+            const gc_thread *t = gc_threads[i];
+            uint32_t node = capNoToNumaNode(i);
+            numa_copied_bytes[node]  += t->copied * sizeof(W_);
+            numa_steals_local[node]  += t->steals_local;
+            numa_steals_remote[node] += t->steals_remote;
+            static_scavenged += t->static_scavenged;
+            static_steals    += t->static_steals;
+            static_time      += t->static_time;
+        }
+    } else {
+        numa_copied_bytes[cap->node] += stats.gc.copied_bytes;
+        static_scavenged += gct->static_scavenged;
+        static_time      += gct->static_time;
     }
     stats.gc_cpu_ns += stats.gc.cpu_ns;
     stats.gc_elapsed_ns += stats.gc.elapsed_ns;
@@ -482,6 +709,52 @@ stat_endGC (Capability *cap, gc_thread *gct, W_ live, W_ copied, W_ slop,
     }
 }
 
+/* -----------------------------------------------------------------------------
+   Called around the compaction of the oldest generation in a major GC
+   -------------------------------------------------------------------------- */
+
+void
+stat_startCompact(void)
+{
+    Time user, elapsed;
+    getProcessTimes( &user, &elapsed );
+
+    Compact_start_time = user;
+    Compacte_start_time = elapsed;
+}
+
+void
+stat_endCompact(uint32_t n_compact_threads)
+{
+    Time user, elapsed;
+    getProcessTimes( &user, &elapsed );
+
+    Compact_tot_time += user - Compact_start_time;
+    Compacte_tot_time += elapsed - Compacte_start_time;
+    compact_count++;
+    if (n_compact_threads > 1) {
+        compact_par_count++;
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Called at the end of each GC with +RTS --reuse-pinned, with the pinned
+   blocks it examined and the words allocated in holes since the last GC.
+   See Note [Reusing pinned holes] in Pinned.c.
+   -------------------------------------------------------------------------- */
+
+void
+stat_pinnedHoles (bool major, W_ blocks, W_ live, W_ holes, W_ reused)
+{
+    // a major GC examines all the pinned blocks
+    if (major) {
+        pinned_blocks = blocks;
+        pinned_live = live;
+        pinned_holes = holes;
+    }
+    pinned_reused += reused;
+}
+
 /* -----------------------------------------------------------------------------
    Called at the beginning of each Retainer Profiliing
    -------------------------------------------------------------------------- */
@@ -678,6 +951,26 @@ static void report_summary(const RTSSummaryStats* sum)
     showStgWord64(stats.max_slop_bytes, temp, true/*commas*/);
     statsPrintf("%16s bytes maximum slop\n", temp);
 
+    if (RtsFlags.GcFlags.reusePinned) {
+        // See Note [Reusing pinned holes] in Pinned.c
+        statsPrintf("%16" FMT_Word64 " MB in pinned blocks at the last "
+                    "major GC (%.1f%% in holes), %" FMT_Word64
+                    " MB reused\n",
+                    sum->pinned_block_bytes / (1024 * 1024),
+                    sum->pinned_block_bytes == 0 ? 0 :
+                    (double)sum->pinned_hole_bytes * 100
+                        / (double)sum->pinned_block_bytes,
+                    sum->pinned_reused_bytes / (1024 * 1024));
+    }
+
+    if (RtsFlags.GcFlags.hugePages) {
+        // See Note [Huge pages] in BlockAlloc.c
+        statsPrintf("%16" FMT_Word64 " MB in huge pages at exit "
+                    "(%.1f%% of the heap)\n",
+                    sum->huge_page_bytes / (1024 * 1024),
+                    sum->huge_page_coverage * 100);
+    }
+
     statsPrintf("%16" FMT_Word64 " MB total memory in use (%"
                 FMT_Word64 " MB lost due to fragmentation)\n\n",
                 stats.max_live_bytes  / (1024 * 1024),
@@ -700,6 +993,26 @@ static void report_summary(const RTSSummaryStats* sum)
                     TimeToSecondsDbl(gen_stats->max_pause_ns));
     }
 
+    if (sum->compact_count > 0) {
+        // compaction is part of the GC time of the oldest generation
+        statsPrintf("  Compact    %5d colls"
+                    ", %5d par   %6.3fs  %6.3fs\n",
+                    sum->compact_count,
+                    sum->compact_par_count,
+                    TimeToSecondsDbl(sum->compact_cpu_ns),
+                    TimeToSecondsDbl(sum->compact_elapsed_ns));
+    }
+
+    if (sum->static_scavenged > 0) {
+        // summed over the GC threads, see Note [Parallel static
+        // scavenging] in Scav.c
+        statsPrintf("  Statics  %10" FMT_Word64 " objs, %5" FMT_Word64
+                    " lists shared  %6.3fs (all GC threads)\n",
+                    sum->static_scavenged,
+                    sum->static_steals,
+                    TimeToSecondsDbl(sum->static_elapsed_ns));
+    }
+
     statsPrintf("\n");
 
 #if defined(THREADED_RTS)
@@ -710,6 +1023,20 @@ static void report_summary(const RTSSummaryStats* sum)
                     sum->work_balance * 100);
     }
 
+    if (n_numa_nodes > 1) {
+        // See Note [NUMA-aware GC] in GC.c
+        uint32_t node;
+        for (node = 0; node < n_numa_nodes; node++) {
+            statsPrintf("  NUMA node %" FMT_Word32 ": %" FMT_Word64
+                        " MB copied, %" FMT_Word64 " blocks stolen (%"
+                        FMT_Word64 " from other nodes)\n",
+                        node, numa_copied_bytes[node] / (1024 * 1024),
+                        numa_steals_local[node] + numa_steals_remote[node],
+                        numa_steals_remote[node]);
+        }
+        statsPrintf("\n");
+    }
+
     statsPrintf("  TASKS: %d "
                 "(%d bound, %d peak workers (%d total), using -N%d)\n\n",
                 taskCount, sum->bound_task_count,
@@ -769,6 +1096,15 @@ static void report_summary(const RTSSummaryStats* sum)
     // following counters. If you add a counter here, please remember
     // to update the Note.
     if (RtsFlags.MiscFlags.internalCounters) {
+        statsPrintf("  Block magazines:  mutator %5.1f%% hits"
+                    ", GC %5.1f%% hits, %" FMT_Word64 " spills\n\n",
+                    sum->mut_block_mag_hit_rate * 100,
+                    sum->gc_block_mag_hit_rate * 100,
+                    sum->block_mag_spills);
+        statsPrintf("  Stack chunk cache: %" FMT_Word64 " hits"
+                    ", %" FMT_Word64 " misses\n\n",
+                    stats.stack_chunk_cache_hits,
+                    stats.stack_chunk_cache_misses);
 #if defined(THREADED_RTS) && defined(PROF_SPIN)
         const int32_t col_width[] = {4, -30, 14, 14};
         statsPrintf("Internal Counters:\n");
@@ -862,12 +1198,16 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     // we should not not use any data from outside of globals, sum and stats
     // here. See Note [RTS Stats Reporting]
     uint32_t g;
+    char hist_buf[GC_PAUSE_HIST_BUCKETS * 40];
 
 #define MR_STAT(field_name,format,value) \
     statsPrintf(" ,(\"" field_name "\", \"%" format "\")\n", value)
 #define MR_STAT_GEN(gen,field_name,format,value) \
     statsPrintf(" ,(\"gen_%" FMT_Word32 "_" field_name "\", \"%" \
       format "\")\n", g, value)
+#define MR_STAT_NODE(node,field_name,format,value) \
+    statsPrintf(" ,(\"numa_node_%" FMT_Word32 "_" field_name "\", \"%" \
+      format "\")\n", node, value)
 
     // These first values are for backwards compatibility.
     // Some of these first fields are duplicated with more machine-readable
@@ -898,6 +1238,39 @@ static void report_machine_readable (const RTSSummaryStats * sum)
 
     MR_STAT("exit_cpu_seconds", "f", TimeToSecondsDbl(sum->exit_cpu_ns));
     MR_STAT("exit_wall_seconds", "f", TimeToSecondsDbl(sum->exit_elapsed_ns));
+    MR_STAT("compact_count", FMT_Word32, sum->compact_count);
+    MR_STAT("compact_par_count", FMT_Word32, sum->compact_par_count);
+    MR_STAT("compact_cpu_seconds", "f",
+            TimeToSecondsDbl(sum->compact_cpu_ns));
+    MR_STAT("compact_wall_seconds", "f",
+            TimeToSecondsDbl(sum->compact_elapsed_ns));
+    MR_STAT("static_objects_scavenged", FMT_Word64, sum->static_scavenged);
+    MR_STAT("static_lists_shared", FMT_Word64, sum->static_steals);
+    MR_STAT("static_scavenge_seconds", "f",
+            TimeToSecondsDbl(sum->static_elapsed_ns));
+    MR_STAT("mut_block_mag_hits", FMT_Word64, sum->mut_block_mag_hits);
+    MR_STAT("mut_block_mag_refills", FMT_Word64, sum->mut_block_mag_refills);
+    MR_STAT("gc_block_mag_hits", FMT_Word64, sum->gc_block_mag_hits);
+    MR_STAT("gc_block_mag_refills", FMT_Word64, sum->gc_block_mag_refills);
+    MR_STAT("block_mag_spills", FMT_Word64, sum->block_mag_spills);
+    MR_STAT("stack_chunk_cache_hits", FMT_Word64,
+            stats.stack_chunk_cache_hits);
+    MR_STAT("stack_chunk_cache_misses", FMT_Word64,
+            stats.stack_chunk_cache_misses);
+    MR_STAT("gc_pause_p50_seconds", "f",
+            TimeToSecondsDbl(stats.gc_pause_p50_ns));
+    MR_STAT("gc_pause_p99_seconds", "f",
+            TimeToSecondsDbl(stats.gc_pause_p99_ns));
+    MR_STAT("gc_pause_p999_seconds", "f",
+            TimeToSecondsDbl(stats.gc_pause_p999_ns));
+    MR_STAT("gc_sync_p50_seconds", "f",
+            TimeToSecondsDbl(stats.gc_sync_p50_ns));
+    MR_STAT("gc_sync_p99_seconds", "f",
+            TimeToSecondsDbl(stats.gc_sync_p99_ns));
+    MR_STAT("gc_sync_p999_seconds", "f",
+            TimeToSecondsDbl(stats.gc_sync_p999_ns));
+    show_pause_hist(&stats.gc_sync_hist, hist_buf, sizeof(hist_buf));
+    MR_STAT("gc_sync_histogram", "s", hist_buf);
 #if defined(PROFILING)
     MR_STAT("rp_cpu_seconds", "f", TimeToSecondsDbl(sum->rp_cpu_ns));
     MR_STAT("rp_wall_seconds", "f", TimeToSecondsDbl(sum->rp_elapsed_ns));
@@ -924,6 +1297,12 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("max_slop_bytes", FMT_Word64, stats.max_slop_bytes);
     // This duplicates, except for unit, peak_megabytes_allocated above
     MR_STAT("max_mem_in_use_bytes", FMT_Word64, stats.max_mem_in_use_bytes);
+    MR_STAT("huge_page_bytes", FMT_Word64, sum->huge_page_bytes);
+    MR_STAT("huge_page_coverage", "f", sum->huge_page_coverage);
+    MR_STAT("pinned_block_bytes", FMT_Word64, sum->pinned_block_bytes);
+    MR_STAT("pinned_live_bytes", FMT_Word64, sum->pinned_live_bytes);
+    MR_STAT("pinned_hole_bytes", FMT_Word64, sum->pinned_hole_bytes);
+    MR_STAT("pinned_reused_bytes", FMT_Word64, sum->pinned_reused_bytes);
     MR_STAT("cumulative_live_bytes", FMT_Word64, stats.cumulative_live_bytes);
     MR_STAT("copied_bytes", FMT_Word64, stats.copied_bytes);
     MR_STAT("par_copied_bytes", FMT_Word64, stats.par_copied_bytes);
@@ -956,6 +1335,19 @@ static void report_machine_readable (const RTSSummaryStats * sum)
     MR_STAT("sparks_fizzled", FMT_Word, sum->sparks.fizzled);
     MR_STAT("work_balance", "f", sum->work_balance);
 
+    // numa_node_0_copied_bytes etc., see Note [NUMA-aware GC] in GC.c
+    if (n_numa_nodes > 1) {
+        uint32_t node;
+        for (node = 0; node < n_numa_nodes; node++) {
+            MR_STAT_NODE(node, "copied_bytes", FMT_Word64,
+                         numa_copied_bytes[node]);
+            MR_STAT_NODE(node, "steals_local", FMT_Word64,
+                         numa_steals_local[node]);
+            MR_STAT_NODE(node, "steals_remote", FMT_Word64,
+                         numa_steals_remote[node]);
+        }
+    }
+
     // next, globals (other than internal counters)
     MR_STAT("n_capabilities", FMT_Word32, n_capabilities);
     MR_STAT("task_count", FMT_Word32, taskCount);
@@ -1006,6 +1398,13 @@ static void report_machine_readable (const RTSSummaryStats * sum)
                     TimeToSecondsDbl(gc_sum->max_pause_ns));
         MR_STAT_GEN(g, "avg_pause_seconds", "f",
                     TimeToSecondsDbl(gc_sum->avg_pause_ns));
+        // older generations share the last histogram, see Note [GC pause
+        // histograms]
+        if (g < GC_PAUSE_HIST_GENS) {
+            show_pause_hist(&stats.gc_pause_hist[g], hist_buf,
+                            sizeof(hist_buf));
+            MR_STAT_GEN(g, "pause_histogram", "s", hist_buf);
+        }
 #if defined(THREADED_RTS) && defined(PROF_SPIN)
         MR_STAT_GEN(g, "sync_spin", FMT_Word64, gc_sum->sync_spin);
         MR_STAT_GEN(g, "sync_yield", FMT_Word64, gc_sum->sync_yield);
@@ -1081,6 +1480,30 @@ stat_exit (void)
             stats.gc_cpu_ns      -=  prof_cpu;
             stats.gc_elapsed_ns  -=  prof_elapsed;
 
+            sum.compact_count = compact_count;
+            sum.compact_par_count = compact_par_count;
+            sum.compact_cpu_ns = Compact_tot_time;
+            sum.compact_elapsed_ns = Compacte_tot_time;
+
+            sum.static_scavenged = static_scavenged;
+            sum.static_steals = static_steals;
+            sum.static_elapsed_ns = static_time;
+
+            // Asking the OS means reading all of /proc/self/smaps, so
+            // we only do it here rather than in the GC pause.
+            if (RtsFlags.GcFlags.hugePages) {
+                W_ in_use = mblocks_allocated * MBLOCK_SIZE;
+                sum.huge_page_bytes = osHugePageBytes();
+                sum.huge_page_coverage = in_use == 0 ? 0 :
+                    (double)sum.huge_page_bytes / (double)in_use;
+            }
+
+            sum.pinned_block_bytes =
+                (uint64_t)pinned_blocks * BLOCK_SIZE;
+            sum.pinned_live_bytes = (uint64_t)pinned_live * sizeof(W_);
+            sum.pinned_hole_bytes = (uint64_t)pinned_holes * sizeof(W_);
+            sum.pinned_reused_bytes = pinned_reused * sizeof(W_);
+
 #if defined(PROFILING)
             sum.rp_cpu_ns = RP_tot_time;
             sum.rp_elapsed_ns = RPe_tot_time;
@@ -1139,8 +1562,31 @@ stat_exit (void)
             }
         }
 
+        stat_stackChunkCache(&stats);
+        stat_pausePercentiles(&stats);
+
         // We populate the remainder (non-time elements) of sum
         {
+            uint32_t c;
+            for (c = 0; c < n_capabilities; c++) {
+                BlockMagazine *mag = &capabilities[c]->block_mag;
+                sum.mut_block_mag_hits    += mag->hits;
+                sum.mut_block_mag_refills += mag->refills;
+                sum.block_mag_spills      += mag->spills;
+                mag = &gc_threads[c]->block_mag;
+                sum.gc_block_mag_hits     += mag->hits;
+                sum.gc_block_mag_refills  += mag->refills;
+                sum.block_mag_spills      += mag->spills;
+            }
+            sum.mut_block_mag_hit_rate =
+                sum.mut_block_mag_hits + sum.mut_block_mag_refills == 0 ? 0 :
+                (double)sum.mut_block_mag_hits
+                / (double)(sum.mut_block_mag_hits + sum.mut_block_mag_refills);
+            sum.gc_block_mag_hit_rate =
+                sum.gc_block_mag_hits + sum.gc_block_mag_refills == 0 ? 0 :
+                (double)sum.gc_block_mag_hits
+                / (double)(sum.gc_block_mag_hits + sum.gc_block_mag_refills);
+
     #if defined(THREADED_RTS)
             uint32_t i;
             sum.bound_task_count = taskCount - workerCount;
@@ -1398,6 +1844,27 @@ Parallel garbage collector counters:
 * scav_find_work:
     Called to do work when any_work return true.
 
+Block magazine counters (printed in every RTS way, not just with PROF_SPIN):
+* hits:
+    Single blocks taken from a Capability's (mutator) or gc_thread's (GC)
+    block magazine without touching the block allocator's lock.
+* refills:
+    Blocks taken after refilling an empty magazine.  The hit rate is
+    hits / (hits + refills).
+* spills:
+    The number of times a full magazine gave a batch of blocks back to
+    the free list.
+See Note [Block magazines] in BlockAlloc.c.
+
+Stack chunk cache counters (also printed in every RTS way):
+* hits:
+    Stack overflows that reused a standard-sized chunk from the
+    Capability's cache instead of allocating one.
+* misses:
+    Stack overflows that wanted a standard-sized chunk and found the
+    cache empty.
+See Note [Stack chunk cache] in Threads.c.
+
 */
 
 /* -----------------------------------------------------------------------------
@@ -1485,6 +1952,21 @@ int getRTSStatsEnabled( void )
     return RtsFlags.GcFlags.giveStats != NO_GC_STATS;
 }
 
+/* The stack chunk cache counters live in the Capabilities, see Note
+   [Stack chunk cache] in Threads.c.  We read them without stopping the
+   other Capabilities, so the totals may be slightly behind. */
+static void stat_stackChunkCache( RTSStats *s )
+{
+    uint32_t i;
+
+    s->stack_chunk_cache_hits = 0;
+    s->stack_chunk_cache_misses = 0;
+    for (i = 0; i < n_capabilities; i++) {
+        s->stack_chunk_cache_hits += capabilities[i]->stack_chunk_hits;
+        s->stack_chunk_cache_misses += capabilities[i]->stack_chunk_misses;
+    }
+}
+
 void getRTSStats( RTSStats *s )
 {
     Time current_elapsed = 0;
@@ -1499,6 +1981,9 @@ void getRTSStats( RTSStats *s )
     s->mutator_cpu_ns = current_cpu - end_init_cpu - stats.gc_cpu_ns;
     s->mutator_elapsed_ns = current_elapsed - end_init_elapsed -
         stats.gc_elapsed_ns;
+
+    stat_stackChunkCache(s);
+    stat_pausePercentiles(s);
 }
 
 /* -----------------------------------------------------------------------------
@@ -37,6 +37,12 @@ void      stat_endGC  (Capability *cap, struct gc_thread_ *_gct, W_ live,
                        W_ mut_spin_yield, W_ any_work, W_ no_work,
                        W_ scav_find_work);
 
+void      stat_startCompact(void);
+void      stat_endCompact(uint32_t n_compact_threads);
+
+void      stat_pinnedHoles(bool major, W_ blocks, W_ live, W_ holes,
+                           W_ reused);
+
 #if defined(PROFILING)
 void      stat_startRP(void);
 void      stat_endRP(uint32_t,
@@ -94,6 +100,38 @@ typedef struct RTSSummaryStats_ {
     Time exit_cpu_ns;
     Time exit_elapsed_ns;
 
+    // compaction of the oldest generation (+RTS -c)
+    uint32_t compact_count;
+    uint32_t compact_par_count;
+    Time compact_cpu_ns;
+    Time compact_elapsed_ns;
+
+    // scavenging static objects in major GCs, see Note [Parallel static
+    // scavenging] in Scav.c
+    uint64_t static_scavenged;
+    uint64_t static_steals;
+    Time static_elapsed_ns;         // summed over the GC threads
+
+    // +RTS --huge-pages, see Note [Huge pages] in BlockAlloc.c; sampled
+    // at exit
+    uint64_t huge_page_bytes;
+    double huge_page_coverage;
+
+    // +RTS --reuse-pinned, see Note [Reusing pinned holes] in Pinned.c
+    uint64_t pinned_block_bytes;    // at the last major GC
+    uint64_t pinned_live_bytes;
+    uint64_t pinned_hole_bytes;
+    uint64_t pinned_reused_bytes;   // allocated in holes
+
+    // block magazines, see Note [Block magazines] in BlockAlloc.c
+    uint64_t mut_block_mag_hits;
+    uint64_t mut_block_mag_refills;
+    uint64_t gc_block_mag_hits;
+    uint64_t gc_block_mag_refills;
+    uint64_t block_mag_spills;
+    double mut_block_mag_hit_rate;
+    double gc_block_mag_hit_rate;
+
 #if defined(THREADED_RTS)
     uint32_t bound_task_count;
     uint64_t sparks_count;
@@ -80,12 +80,21 @@ createThread(Capability *cap, W_ size)
      * of a benchmark hack, but it doesn't do any harm.
      */
     stack_size = round_to_mblocks(size - sizeofW(StgTSO));
-    stack = (StgStack *)allocate(cap, stack_size);
-    TICK_ALLOC_STACK(stack_size);
-    SET_HDR(stack, &stg_STACK_info, cap->r.rCCCS);
+    if (cap->n_thread_stacks > 0 &&
+        cap->thread_stacks[cap->n_thread_stacks - 1]->stack_size
+            == stack_size - sizeofW(StgStack)) {
+        // See Note [Recycling thread stacks]
+        stack = cap->thread_stacks[--cap->n_thread_stacks];
+        SET_HDR(stack, &stg_STACK_info, cap->r.rCCCS);
+        dirty_STACK(cap, stack);
+    } else {
+        stack = (StgStack *)allocate(cap, stack_size);
+        TICK_ALLOC_STACK(stack_size);
+        SET_HDR(stack, &stg_STACK_info, cap->r.rCCCS);
+        stack->dirty    = 1;
+    }
     stack->stack_size   = stack_size - sizeofW(StgStack);
     stack->sp           = stack->stack + stack->stack_size;
-    stack->dirty        = 1;
 
     tso = (StgTSO *)allocate(cap, sizeofW(StgTSO));
     TICK_ALLOC_TSO();
@@ -135,6 +144,98 @@ createThread(Capability *cap, W_ size)
     return tso;
 }
 
+/* ---------------------------------------------------------------------------
+   Recycle the stack of a finished thread.
+
+   Note [Recycling thread stacks]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   A program that forks a thread per request creates and finishes
+   threads at a great rate, and most of what createThread() allocates
+   is the initial stack (+RTS -ki, 1k by default).  So when a thread
+   finishes (scheduleHandleThreadFinished()) we take its stack away and
+   keep it in cap->thread_stacks, and createThread() on the same
+   Capability uses it instead of allocating a new one.  The stack of a
+   thread that has grown ends with a standard chunk instead, which goes
+   into the cache for threadStackOverflow(), see Note [Stack chunk
+   cache].
+
+   Nothing needs zeroing: createThread() only resets the header and the
+   stack pointer, and nothing looks at the stack below sp.  Like a stack
+   chunk, a recycled stack keeps its dirty flag and dirty_STACK() puts it
+   on a mutable list if it needs to be.
+
+   The TSO of the finished thread can't be recycled, because a ThreadId
+   is a pointer to the TSO: a thread that still holds the ThreadId of the
+   finished thread would see it come back to life as a different
+   thread.  The TSO stays around until the GC finds it unreachable, and
+   still needs a valid stackobj, so we point it at cap->finished_stack,
+   a clean empty stack shared by all the threads that finished on this
+   Capability since the last GC.  It must not point to its old stack,
+   which would then be shared with a running thread.
+
+   We don't recycle the stack of a bound thread, because the caller of
+   rts_eval() and friends reads the result off it.
+
+   As with the stack chunk cache, markCapability() empties the pool and
+   the GC reclaims the stacks.
+   ------------------------------------------------------------------------ */
+
+void
+recycleThreadStack (Capability *cap, StgTSO *tso)
+{
+    StgStack *stack = tso->stackobj, *finished;
+    StgUnderflowFrame *frame;
+    W_ size = stack->stack_size + sizeofW(StgStack);
+
+    ASSERT(tso->bound == NULL);
+    ASSERT(tso->what_next == ThreadComplete || tso->what_next == ThreadKilled);
+
+    // a thread can only finish in its last chunk, but check
+    frame = (StgUnderflowFrame*)(stack->stack + stack->stack_size
+                                 - sizeofW(StgUnderflowFrame));
+    if (frame->info == &stg_stack_underflow_frame_info) {
+        return;
+    }
+
+    if (size == round_to_mblocks(RtsFlags.GcFlags.initialStkSize
+                                 - sizeofW(StgTSO))) {
+        if (cap->n_thread_stacks == THREAD_STACK_POOL_SIZE) {
+            return;
+        }
+    } else if (size == RtsFlags.GcFlags.stkChunkSize) {
+        if (cap->n_stack_chunks == STACK_CHUNK_CACHE_SIZE) {
+            return;
+        }
+    } else {
+        return;
+    }
+
+    finished = cap->finished_stack;
+    if (finished == NULL) {
+        finished = (StgStack *)allocate(cap, sizeofW(StgStack)
+                                             + sizeofW(StgStopFrame));
+        SET_HDR(finished, &stg_STACK_info, CCS_SYSTEM);
+        finished->stack_size = sizeofW(StgStopFrame);
+        finished->sp = finished->stack;
+        finished->dirty = 0;
+        SET_HDR((StgClosure*)finished->sp,
+                (StgInfoTable *)&stg_stop_thread_info, CCS_SYSTEM);
+        cap->finished_stack = finished;
+    }
+
+    tso->stackobj = finished;
+    tso->tot_stack_size = finished->stack_size;
+    dirty_TSO(cap, tso);
+
+    stack->sp = stack->stack + stack->stack_size;
+    if (size == RtsFlags.GcFlags.stkChunkSize) {
+        cap->stack_chunks[cap->n_stack_chunks++] = stack;
+    } else {
+        cap->thread_stacks[cap->n_thread_stacks++] = stack;
+    }
+}
+
 /* ---------------------------------------------------------------------------
  * Comparing Thread ids.
  *
@@ -588,19 +689,36 @@ threadStackOverflow (Capability *cap, StgTSO *tso)
                   "allocating new stack chunk of size %d bytes",
                   chunk_size * sizeof(W_));
 
-    // Charge the current thread for allocating stack.  Stack usage is
-    // non-deterministic, because the chunk boundaries might vary from
-    // run to run, but accounting for this is better than not
-    // accounting for it, since a deep recursion will otherwise not be
-    // subject to allocation limits.
-    cap->r.rCurrentTSO = tso;
-    new_stack = (StgStack*) allocate(cap, chunk_size);
-    cap->r.rCurrentTSO = NULL;
+    if (chunk_size == RtsFlags.GcFlags.stkChunkSize
+        && cap->n_stack_chunks > 0)
+    {
+        // Reuse a chunk dropped by threadStackUnderflow().  It keeps its
+        // dirty flag, which tells dirty_STACK() below whether it is
+        // already on a mutable list.  See Note [Stack chunk cache].
+        new_stack = cap->stack_chunks[--cap->n_stack_chunks];
+        cap->stack_chunk_hits++;
+        SET_HDR(new_stack, &stg_STACK_info, old_stack->header.prof.ccs);
+    }
+    else
+    {
+        if (chunk_size == RtsFlags.GcFlags.stkChunkSize) {
+            cap->stack_chunk_misses++;
+        }
+
+        // Charge the current thread for allocating stack.  Stack usage is
+        // non-deterministic, because the chunk boundaries might vary from
+        // run to run, but accounting for this is better than not
+        // accounting for it, since a deep recursion will otherwise not be
+        // subject to allocation limits.
+        cap->r.rCurrentTSO = tso;
+        new_stack = (StgStack*) allocate(cap, chunk_size);
+        cap->r.rCurrentTSO = NULL;
 
-    SET_HDR(new_stack, &stg_STACK_info, old_stack->header.prof.ccs);
-    TICK_ALLOC_STACK(chunk_size);
+        SET_HDR(new_stack, &stg_STACK_info, old_stack->header.prof.ccs);
+        TICK_ALLOC_STACK(chunk_size);
 
-    new_stack->dirty = 0; // begin clean, we'll mark it dirty below
+        new_stack->dirty = 0; // begin clean, we'll mark it dirty below
+    }
     new_stack->stack_size = chunk_size - sizeofW(StgStack);
     new_stack->sp = new_stack->stack + new_stack->stack_size;
 
@@ -682,6 +800,38 @@ threadStackOverflow (Capability *cap, StgTSO *tso)
    Stack underflow - called from the stg_stack_underflow_info frame
    ------------------------------------------------------------------------ */
 
+/*
+  Note [Stack chunk cache]
+  ~~~~~~~~~~~~~~~~~~~~~~~~
+
+  A recursion that goes back and forth across a stack chunk boundary
+  (a parser, a deep fold) overflows into a fresh chunk, underflows out
+  of it again, and repeats.  Each round allocated another 32k chunk
+  (+RTS -kc) and dropped the last one, so the nursery filled with dead
+  stacks and we GC'd far more often than the program's own allocation
+  would need.
+
+  So threadStackUnderflow() keeps the chunk it drops, if it is of the
+  standard size, in a small per-Capability cache (cap->stack_chunks),
+  and threadStackOverflow() takes a chunk from there before allocating
+  one.  recycleThreadStack() puts the last chunk of a finished thread
+  there too.  Nothing else points to a chunk once the thread has left it,
+  apart perhaps from a mutable list, so it can be handed to any thread
+  on the same Capability.  The chunk keeps its dirty flag: if it is set
+  the chunk is already on a mutable list, and if not dirty_STACK() puts
+  it on one as usual.
+
+  The cache is not a GC root.  markCapability() empties it, and the GC
+  then reclaims the chunks like any other garbage, so the cache never
+  keeps memory alive past a GC.  A chunk taken from the cache is not
+  charged to the thread's allocation counter, because nothing was
+  allocated; a recursion that keeps getting deeper still allocates its
+  new chunks.
+
+  The hit and miss counts are reported by getRTSStats() as
+  stack_chunk_cache_hits and stack_chunk_cache_misses.
+*/
+
 W_ // returns offset to the return address
 threadStackUnderflow (Capability *cap, StgTSO *tso)
 {
@@ -723,6 +873,14 @@ threadStackUnderflow (Capability *cap, StgTSO *tso)
     // restore the stack parameters, and update tot_stack_size
     tso->tot_stack_size -= old_stack->stack_size;
 
+    // keep the old chunk for the next overflow on this Capability, see
+    // Note [Stack chunk cache]
+    if (old_stack->stack_size + sizeofW(StgStack)
+            == RtsFlags.GcFlags.stkChunkSize
+        && cap->n_stack_chunks < STACK_CHUNK_CACHE_SIZE) {
+        cap->stack_chunks[cap->n_stack_chunks++] = old_stack;
+    }
+
     // we're about to run it, better mark it dirty
     dirty_STACK(cap, new_stack);
 
@@ -830,7 +988,11 @@ printThreadBlockage(StgTSO *tso)
     debugBelch("is blocked on write to fd %d", (int)(tso->block_info.fd));
     break;
   case BlockedOnDelay:
-    debugBelch("is blocked until %ld", (long)(tso->block_info.target));
+#if defined(mingw32_HOST_OS)
+    debugBelch("is blocked on a delay");
+#else
+    debugBelch("is blocked until %ld", (long)getSleeperTarget(tso));
+#endif
     break;
 #endif
   case BlockedOnMVar:
@@ -36,6 +36,9 @@ bool removeThreadFromDeQueue   (Capability *cap, StgTSO **head, StgTSO **tail, S
 
 StgBool isThreadBound (StgTSO* tso);
 
+// Keep the stack of a finished thread for the next createThread()
+void recycleThreadStack (Capability *cap, StgTSO *tso);
+
 // Overfow/underflow
 void threadStackOverflow  (Capability *cap, StgTSO *tso);
 W_   threadStackUnderflow (Capability *cap, StgTSO *tso);
@@ -652,6 +652,25 @@ void traceHeapProfSampleCostCentre(StgWord8 profile_id,
 }
 #endif
 
+void traceAllocSample(Capability *cap, StgThreadID thread,
+                      StgClosure *p, StgWord bytes,
+                      uint32_t n_frames, StgWord64 *frames)
+{
+    if (eventlog_enabled) {
+        postAllocSample(cap, thread, (StgWord64)(W_)p->header.info,
+                        get_itbl(p)->type, bytes, n_frames, frames);
+    }
+}
+
+void traceGcPauseHistogram(Capability *cap, uint32_t hist,
+                           const GCPauseHistogram *h)
+{
+    if (eventlog_enabled) {
+        postGcPauseHistogram(cap, hist, h->count,
+                             GC_PAUSE_HIST_BUCKETS, h->buckets);
+    }
+}
+
 #if defined(DEBUG)
 static void vtraceCap_stderr(Capability *cap, char *msg, va_list ap)
 {
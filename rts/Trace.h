@@ -300,6 +300,19 @@ void traceHeapProfSampleCostCentre(StgWord8 profile_id,
                                    CostCentreStack *stack, StgWord residency);
 #endif /* PROFILING */
 
+/*
+ * An allocation sample, see Note [Allocation sampling] in AllocSample.c
+ */
+void traceAllocSample(Capability *cap, StgThreadID thread,
+                      StgClosure *p, StgWord bytes,
+                      uint32_t n_frames, StgWord64 *frames);
+
+/*
+ * A GC pause histogram, see Note [GC pause histograms] in Stats.c
+ */
+void traceGcPauseHistogram(Capability *cap, uint32_t hist,
+                           const GCPauseHistogram *h);
+
 void flushTrace(void);
 
 #else /* !TRACING */
@@ -337,6 +350,8 @@ void flushTrace(void);
 #define traceHeapProfSampleBegin(era) /* nothing */
 #define traceHeapProfSampleCostCentre(profile_id, stack, residency) /* nothing */
 #define traceHeapProfSampleString(profile_id, label, residency) /* nothing */
+#define traceAllocSample(cap, thread, p, bytes, n_frames, frames) /* nothing */
+#define traceGcPauseHistogram(cap, hist, h) /* nothing */
 
 #define flushTrace() /* nothing */
 
@@ -105,7 +105,9 @@ char *EventDesc[] = {
   [EVENT_HEAP_PROF_SAMPLE_BEGIN]  = "Start of heap profile sample",
   [EVENT_HEAP_PROF_SAMPLE_STRING] = "Heap profile string sample",
   [EVENT_HEAP_PROF_SAMPLE_COST_CENTRE] = "Heap profile cost-centre sample",
-  [EVENT_USER_BINARY_MSG]     = "User binary message"
+  [EVENT_USER_BINARY_MSG]     = "User binary message",
+  [EVENT_ALLOC_SAMPLE]        = "Allocation sample",
+  [EVENT_GC_PAUSE_HISTOGRAM]  = "GC pause histogram"
 };
 
 // Event type.
@@ -442,6 +444,11 @@ postHeaderEvents(void)
             eventTypes[t].size = EVENT_SIZE_DYNAMIC;
             break;
 
+        case EVENT_ALLOC_SAMPLE:
+        case EVENT_GC_PAUSE_HISTOGRAM:
+            eventTypes[t].size = EVENT_SIZE_DYNAMIC;
+            break;
+
         default:
             continue; /* ignore deprecated events */
         }
@@ -1275,6 +1282,66 @@ void postHeapProfSampleCostCentre(StgWord8 profile_id,
 }
 #endif /* PROFILING */
 
+void postAllocSample(Capability    *cap,
+                     EventThreadID  thread,
+                     StgWord64      info,
+                     StgWord16      closure_type,
+                     StgWord64      bytes,
+                     StgWord16      n_frames,
+                     StgWord64     *frames)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    StgWord16 i;
+
+    StgWord len = sizeof(EventThreadID)+8+2+8+2+n_frames*8;
+    if (ensureRoomForVariableEvent(eb, len)) {
+        errorBelch("Event size exceeds buffer size, bail out");
+        return;
+    }
+    postEventHeader(eb, EVENT_ALLOC_SAMPLE);
+    postPayloadSize(eb, len);
+    postThreadID(eb, thread);
+    postWord64(eb, info);
+    postWord16(eb, closure_type);
+    postWord64(eb, bytes);
+    postWord16(eb, n_frames);
+    for (i = 0; i < n_frames; i++) {
+        postWord64(eb, frames[i]);
+    }
+}
+
+// Only the non-empty buckets are posted, as (index, count) pairs
+void postGcPauseHistogram(Capability      *cap,
+                          StgWord16        hist,
+                          StgWord64        count,
+                          uint32_t         n_buckets,
+                          const uint64_t  *buckets)
+{
+    EventsBuf *eb = &capEventBuf[cap->no];
+    StgWord16 i, n = 0;
+
+    for (i = 0; i < n_buckets; i++) {
+        if (buckets[i] != 0) n++;
+    }
+
+    StgWord len = 2+8+2+n*(2+8);
+    if (ensureRoomForVariableEvent(eb, len)) {
+        errorBelch("Event size exceeds buffer size, bail out");
+        return;
+    }
+    postEventHeader(eb, EVENT_GC_PAUSE_HISTOGRAM);
+    postPayloadSize(eb, len);
+    postWord16(eb, hist);
+    postWord64(eb, count);
+    postWord16(eb, n);
+    for (i = 0; i < n_buckets; i++) {
+        if (buckets[i] != 0) {
+            postWord16(eb, i);
+            postWord64(eb, buckets[i]);
+        }
+    }
+}
+
 void printAndClearEventBuf (EventsBuf *ebuf)
 {
     closeBlockMarker(ebuf);
@@ -157,6 +157,20 @@ void postHeapProfSampleCostCentre(StgWord8 profile_id,
                                   StgWord64 residency);
 #endif /* PROFILING */
 
+void postAllocSample(Capability    *cap,
+                     EventThreadID  thread,
+                     StgWord64      info,
+                     StgWord16      closure_type,
+                     StgWord64      bytes,
+                     StgWord16      n_frames,
+                     StgWord64     *frames);
+
+void postGcPauseHistogram(Capability      *cap,
+                          StgWord16        hist,
+                          StgWord64        count,
+                          uint32_t         n_buckets,
+                          const uint64_t  *buckets);
+
 #else /* !TRACING */
 
 INLINE_HEADER void postSchedEvent (Capability *cap  STG_UNUSED,
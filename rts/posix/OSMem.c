@@ -42,6 +42,7 @@
 #endif
 
 #include <errno.h>
+#include <stdio.h>
 
 #if defined(darwin_HOST_OS) || defined(ios_HOST_OS)
 #include <mach/mach.h>
@@ -162,6 +163,14 @@ post_mmap_madvise(int operation, W_ size, void *ret)
 {
 #if defined(MADV_WILLNEED)
     if (operation & MEM_COMMIT) {
+# if defined(MADV_HUGEPAGE)
+        // Before MADV_WILLNEED, so that the pages are faulted in as
+        // huge pages where possible.  It fails harmlessly if the kernel
+        // has no transparent huge page support.
+        if (RtsFlags.GcFlags.hugePages) {
+            madvise(ret, size, MADV_HUGEPAGE);
+        }
+# endif
         madvise(ret, size, MADV_WILLNEED);
 # if defined(MADV_DODUMP)
         madvise(ret, size, MADV_DODUMP);
@@ -469,6 +478,53 @@ void setExecutable (void *p, W_ len, bool exec)
     }
 }
 
+bool osHugePagesAvailable (void)
+{
+#if defined(MADV_HUGEPAGE)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Returns the number of bytes of the heap that the kernel has backed
+   with transparent huge pages, by adding up the AnonHugePages of our
+   mappings in /proc/self/smaps.  With a large address space we only
+   count the mappings inside the heap; otherwise we count them all.
+   Returns 0 if the information is not available. */
+W_ osHugePageBytes (void)
+{
+#if defined(linux_HOST_OS)
+    FILE *f;
+    char line[256];
+    unsigned long start, end, kb;
+    bool in_heap = false;
+    W_ total = 0;
+
+    f = fopen("/proc/self/smaps", "r");
+    if (f == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+#if defined(USE_LARGE_ADDRESS_SPACE)
+            in_heap = start < mblock_address_space.end
+                && end > mblock_address_space.begin;
+#else
+            in_heap = true;
+#endif
+        } else if (in_heap &&
+                   sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+            total += (W_)kb * 1024;
+        }
+    }
+    fclose(f);
+    return total;
+#else
+    return 0;
+#endif
+}
+
 #if defined(USE_LARGE_ADDRESS_SPACE)
 
 static void *
@@ -477,21 +533,25 @@ osTryReserveHeapMemory (W_ len, void *hint)
     void *base, *top;
     void *start, *end;
 
-    ASSERT((len & ~MBLOCK_MASK) == len);
+    // With +RTS --huge-pages, align the heap to a huge page so that
+    // the block allocator can hand out whole huge pages.
+    W_ align = RtsFlags.GcFlags.hugePages ? HUGE_PAGE_SIZE : MBLOCK_SIZE;
 
-    /* We try to allocate len + MBLOCK_SIZE,
-       because we need memory which is MBLOCK_SIZE aligned,
+    ASSERT((len & ~(align-1)) == len);
+
+    /* We try to allocate len + align,
+       because we need memory which is aligned,
        and then we discard what we don't need */
 
-    base = my_mmap(hint, len + MBLOCK_SIZE, MEM_RESERVE);
+    base = my_mmap(hint, len + align, MEM_RESERVE);
     if (base == NULL)
         return NULL;
 
-    top = (void*)((W_)base + len + MBLOCK_SIZE);
+    top = (void*)((W_)base + len + align);
 
-    if (((W_)base & MBLOCK_MASK) != 0) {
-        start = MBLOCK_ROUND_UP(base);
-        end = MBLOCK_ROUND_DOWN(top);
+    if (((W_)base & (align-1)) != 0) {
+        start = (void*)(((W_)base + align - 1) & ~(align-1));
+        end = (void*)((W_)top & ~(align-1));
         ASSERT(((W_)end - (W_)start) == len);
 
         if (munmap(base, (W_)start-(W_)base) < 0) {
@@ -555,7 +615,11 @@ void *osReserveHeapMemory(void *startAddressPtr, W_ *len)
 
     attempt = 0;
     while (1) {
-        *len &= ~MBLOCK_MASK;
+        if (RtsFlags.GcFlags.hugePages) {
+            *len &= ~(HUGE_PAGE_SIZE-1);
+        } else {
+            *len &= ~MBLOCK_MASK;
+        }
 
         if (*len < MBLOCK_SIZE) {
             // Give up if the system won't even give us 16 blocks worth of heap
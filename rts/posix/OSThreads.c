@@ -58,6 +58,10 @@
 #if defined(HAVE_SYS_PARAM_H)
 #include <sys/param.h>
 #endif
+
+#if defined(HAVE_SYS_TIME_H)
+#include <sys/time.h>
+#endif
 #if defined(HAVE_SYS_CPUSET_H)
 #include <sys/cpuset.h>
 #endif
@@ -117,6 +121,21 @@ waitCondition ( Condition* pCond, Mutex* pMut )
   return (pthread_cond_wait(pCond,pMut) == 0);
 }
 
+bool
+timedWaitCondition ( Condition* pCond, Mutex* pMut, Time timeout )
+{
+  struct timeval tv;
+  struct timespec ts;
+  Time t;
+
+  // pthread_cond_timedwait() wants an absolute time on the realtime clock
+  gettimeofday(&tv, NULL);
+  t = SecondsToTime(tv.tv_sec) + USToTime(tv.tv_usec) + timeout;
+  ts.tv_sec  = TimeToSeconds(t);
+  ts.tv_nsec = TimeToNS(t - SecondsToTime(ts.tv_sec));
+  return (pthread_cond_timedwait(pCond,pMut,&ts) == 0);
+}
+
 void
 yieldThread(void)
 {
@@ -18,6 +18,7 @@
 #include "RaiseAsync.h"
 #include "RtsUtils.h"
 #include "Capability.h"
+#include "Threads.h"
 #include "Select.h"
 #include "AwaitEvent.h"
 #include "Stats.h"
@@ -33,13 +34,24 @@
 
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
+#include <fcntl.h>
+#define USED_IF_EPOLL
+#else
+#define USED_IF_EPOLL STG_UNUSED
+#endif
 
 #include "Clock.h"
 
 #if !defined(THREADED_RTS)
 
 // The target time for a threadDelay is stored in a one-word quantity
-// in the TSO (tso->block_info.target).  On a 32-bit machine we
+// (see Note [Sleeping threads]).  On a 32-bit machine we
 // therefore can't afford to use nanosecond resolution because it
 // would overflow too quickly, so instead we use millisecond
 // resolution.
@@ -82,6 +94,145 @@ LowResTime getDelayTarget (HsInt us)
     }
 }
 
+/* Note [Sleeping threads]
+ * ~~~~~~~~~~~~~~~~~~~~~~~
+ * Threads blocked in threadDelay are kept in sleepers[], a 4-ary
+ * min-heap ordered by target time.  Each entry holds the target and the
+ * TSO, and the TSO's block_info.sleeper is the index of its entry,
+ * updated whenever the entry moves.  So:
+ *
+ *   - insertSleeper (from stg_delayzh) is O(log n),
+ *   - removeSleeper (when a sleeping thread is killed or times out) is
+ *     O(log n), with no search for the thread,
+ *   - the next wakeup time is sleepers[0], and each expired thread
+ *     costs O(log n) to take off the heap.
+ *
+ * A 4-ary heap is shallow: 8 levels hold 65536 sleepers.  (We used to
+ * keep a sorted linked list, with O(n) insertion in stg_delayzh, which
+ * hurt programs with many thousands of concurrent timeouts.)
+ *
+ * Targets are compared with the wrap-around trick described at
+ * wakeUpSleepingThreads, so the heap order is still right when the
+ * clock wraps.
+ *
+ * The TSOs in sleepers[] are GC roots (markSleepers).
+ */
+
+typedef struct {
+    LowResTime target;
+    StgTSO    *tso;
+} Sleeper;
+
+static Sleeper *sleepers = NULL;
+static uint32_t n_sleepers = 0;
+static uint32_t sleepers_size = 0;
+
+#define SLEEPER_ARITY 4
+#define SLEEPER_PARENT(i) (((i) - 1) / SLEEPER_ARITY)
+#define SLEEPER_CHILD(i)  ((i) * SLEEPER_ARITY + 1)
+
+#define TARGET_BEFORE(a,b) (((long)(a) - (long)(b)) < 0)
+
+static void setSleeper (uint32_t i, Sleeper s)
+{
+    sleepers[i] = s;
+    s.tso->block_info.sleeper = i;
+}
+
+static void siftUpSleeper (uint32_t i, Sleeper s)
+{
+    while (i > 0) {
+        uint32_t parent = SLEEPER_PARENT(i);
+        if (!TARGET_BEFORE(s.target, sleepers[parent].target)) {
+            break;
+        }
+        setSleeper(i, sleepers[parent]);
+        i = parent;
+    }
+    setSleeper(i, s);
+}
+
+static void siftDownSleeper (uint32_t i, Sleeper s)
+{
+    for (;;) {
+        uint32_t c, child, min = i;
+        LowResTime min_target = s.target;
+
+        child = SLEEPER_CHILD(i);
+        for (c = child; c < child + SLEEPER_ARITY && c < n_sleepers; c++) {
+            if (TARGET_BEFORE(sleepers[c].target, min_target)) {
+                min = c;
+                min_target = sleepers[c].target;
+            }
+        }
+        if (min == i) {
+            break;
+        }
+        setSleeper(i, sleepers[min]);
+        i = min;
+    }
+    setSleeper(i, s);
+}
+
+static void removeSleeperAt (uint32_t i)
+{
+    Sleeper last;
+
+    ASSERT(i < n_sleepers);
+    last = sleepers[--n_sleepers];
+    if (i == n_sleepers) {
+        return;
+    }
+    if (i > 0 && TARGET_BEFORE(last.target,
+                               sleepers[SLEEPER_PARENT(i)].target)) {
+        siftUpSleeper(i, last);
+    } else {
+        siftDownSleeper(i, last);
+    }
+}
+
+/* Called from threadDelay with why_blocked already set. */
+void insertSleeper (StgTSO *tso, StgWord target)
+{
+    Sleeper s;
+
+    if (n_sleepers == sleepers_size) {
+        sleepers_size = sleepers_size == 0 ? 64 : sleepers_size * 2;
+        sleepers = stgReallocBytes(sleepers, sleepers_size * sizeof(Sleeper),
+                                   "insertSleeper");
+    }
+    s.target = target;
+    s.tso = tso;
+    siftUpSleeper(n_sleepers++, s);
+}
+
+/* Called when a sleeping thread is killed or times out. */
+void removeSleeper (StgTSO *tso)
+{
+    ASSERT(tso->why_blocked == BlockedOnDelay);
+    ASSERT(sleepers[tso->block_info.sleeper].tso == tso);
+    removeSleeperAt(tso->block_info.sleeper);
+}
+
+bool anySleepers (void)
+{
+    return n_sleepers > 0;
+}
+
+StgWord getSleeperTarget (StgTSO *tso)
+{
+    return sleepers[tso->block_info.sleeper].target;
+}
+
+void markSleepers (evac_fn evac, void *user)
+{
+    uint32_t i;
+
+    for (i = 0; i < n_sleepers; i++) {
+        evac(user, (StgClosure **)(void *)&sleepers[i].tso);
+    }
+}
+
 /* There's a clever trick here to avoid problems when the time wraps
  * around.  Since our maximum delay is smaller than 31 bits of ticks
  * (it's actually 31 bits of microseconds), we can safely check
@@ -98,12 +249,12 @@ static bool wakeUpSleepingThreads (LowResTime now)
     StgTSO *tso;
     bool flag = false;
 
-    while (sleeping_queue != END_TSO_QUEUE) {
-        tso = sleeping_queue;
-        if (((long)now - (long)tso->block_info.target) < 0) {
+    while (n_sleepers > 0) {
+        if (TARGET_BEFORE(now, sleepers[0].target)) {
             break;
         }
-        sleeping_queue = tso->_link;
+        tso = sleepers[0].tso;
+        removeSleeperAt(0);
         tso->why_blocked = NotBlocked;
         tso->_link = END_TSO_QUEUE;
         IF_DEBUG(scheduler, debugBelch("Waking up sleeping thread %lu\n",
@@ -203,12 +354,43 @@ static enum FdState fdPollWriteState (int fd)
         return RTS_FD_IS_READY;
 }
 
-/* Argument 'wait' says whether to wait for I/O to become available,
- * or whether to just check and return immediately.  If there are
- * other threads ready to run, we normally do the non-waiting variety,
- * otherwise we wait (see Schedule.c).
- *
- * SMP note: must be called with sched_mutex locked.
+/*
+ * Called when select() or epoll_wait() fails with EINTR.  Returns true
+ * if awaitEvent() should return to the scheduler rather than wait again.
+ */
+static bool interruptedWait (void)
+{
+    /* We got a signal; could be one of ours.  If so, we need
+     * to start up the signal handler straight away, otherwise
+     * we could block for a long time before the signal is
+     * serviced.
+     */
+#if defined(RTS_USER_SIGNALS)
+    if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
+        startSignalHandlers(&MainCapability);
+        return true;
+    }
+#endif
+
+    /* we were interrupted, return to the scheduler immediately.
+     */
+    if (sched_state >= SCHED_INTERRUPTING) {
+        return true;
+    }
+
+    /* check for threads that need waking up
+     */
+    wakeUpSleepingThreads(getLowResTimeOfDay());
+
+    /* If new runnable threads have arrived, stop waiting for
+     * I/O and run them.
+     */
+    return !emptyRunQueue(&MainCapability);
+}
+
+/* The select() backend: threads blocked on I/O are kept on
+ * blocked_queue, and every call rebuilds the fd_sets from the whole
+ * queue.  See Note [Event-driven I/O waiting] for the epoll backend.
  *
  * Windows: select only works on sockets, so this doesn't really work,
  * though it makes things better than before. MsgWaitForMultipleObjects
@@ -216,8 +398,8 @@ static enum FdState fdPollWriteState (int fd)
  * not write handles.
  *
  */
-void
-awaitEvent(bool wait)
+static void
+awaitEventSelect(bool wait)
 {
     StgTSO *tso, *prev, *next;
     fd_set rfd,wfd;
@@ -227,14 +409,6 @@ awaitEvent(bool wait)
     struct timeval tv, *ptv;
     LowResTime now;
 
-    IF_DEBUG(scheduler,
-             debugBelch("scheduler: checking for threads blocked on I/O");
-             if (wait) {
-                 debugBelch(" (waiting)");
-             }
-             debugBelch("\n");
-             );
-
     /* loop until we've woken up some threads.  This loop is needed
      * because the select timing isn't accurate, we sometimes sleep
      * for a while but not long enough to wake up a thread in
@@ -298,7 +472,7 @@ awaitEvent(bool wait)
           tv.tv_sec  = 0;
           tv.tv_usec = 0;
           ptv = &tv;
-      } else if (sleeping_queue != END_TSO_QUEUE) {
+      } else if (n_sleepers > 0) {
           /* SUSv2 allows implementations to have an implementation defined
            * maximum timeout for select(2). The standard requires
            * implementations to silently truncate values exceeding this maximum
@@ -317,7 +491,7 @@ awaitEvent(bool wait)
            */
           const time_t max_seconds = 2678400; // 31 * 24 * 60 * 60
 
-          Time min = LowResTimeToTime(sleeping_queue->block_info.target - now);
+          Time min = LowResTimeToTime(sleepers[0].target - now);
           tv.tv_sec  = TimeToSeconds(min);
           if (tv.tv_sec < max_seconds) {
               tv.tv_usec = TimeToUS(min) % 1000000;
@@ -343,32 +517,7 @@ awaitEvent(bool wait)
             }
           }
 
-          /* We got a signal; could be one of ours.  If so, we need
-           * to start up the signal handler straight away, otherwise
-           * we could block for a long time before the signal is
-           * serviced.
-           */
-#if defined(RTS_USER_SIGNALS)
-          if (RtsFlags.MiscFlags.install_signal_handlers && signals_pending()) {
-              startSignalHandlers(&MainCapability);
-              return; /* still hold the lock */
-          }
-#endif
-
-          /* we were interrupted, return to the scheduler immediately.
-           */
-          if (sched_state >= SCHED_INTERRUPTING) {
-              return; /* still hold the lock */
-          }
-
-          /* check for threads that need waking up
-           */
-          wakeUpSleepingThreads(getLowResTimeOfDay());
-
-          /* If new runnable threads have arrived, stop waiting for
-           * I/O and run them.
-           */
-          if (!emptyRunQueue(&MainCapability)) {
+          if (interruptedWait()) {
               return; /* still hold the lock */
           }
       }
@@ -455,4 +604,523 @@ awaitEvent(bool wait)
              && emptyRunQueue(&MainCapability));
 }
 
+/* Note [Event-driven I/O waiting]
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * In the non-threaded RTS, a thread that calls waitRead# or waitWrite#
+ * stays blocked until awaitEvent() sees its file descriptor become
+ * ready.  The select() backend keeps all such threads on
+ * blocked_queue and, on every call, builds fd_sets from the whole
+ * queue, calls select(), and walks the queue again to find the
+ * threads to wake.  That is O(blocked threads) per scheduler
+ * iteration even when nothing is ready, and select() cannot handle
+ * fds >= FD_SETSIZE at all.
+ *
+ * Where epoll is available we instead keep the blocked threads in a
+ * table indexed by fd (fd_waiters[]).  Each entry holds the queue of
+ * threads waiting on that fd and the events (EPOLLIN and/or EPOLLOUT)
+ * currently registered for it with the kernel.  The fd is registered
+ * when the first thread blocks on it (blockOnFd), modified when a
+ * thread waits for the other direction, and deregistered when the
+ * last waiter goes away, whether woken, killed or timed out.
+ * awaitEvent() then only looks at the fds that epoll_wait() reports,
+ * so a wakeup costs O(ready fds + threads woken).
+ *
+ * A few cases need care:
+ *
+ *  - epoll refuses regular files and directories (EPERM).  select()
+ *    considers those always ready, so we do too: the fd goes on
+ *    pending_fds[] and its waiters are woken by the next awaitEvent().
+ *
+ *  - An invalid fd (EBADF) is also put on pending_fds[], and its
+ *    waiters get the blockedOnBadFD exception as with select() (Trac
+ *    #4934).
+ *
+ *  - An fd that is closed while it is registered is dropped by the
+ *    kernel without telling us, so epoll_wait() never reports it.
+ *    Its waiters would stay blocked forever, and since they keep
+ *    anyFdWaiters() true, deadlock detection would not save us either.
+ *    So before waiting indefinitely, and whenever epoll_wait() times
+ *    out, checkClosedFds() asks fcntl() about every fd with waiters,
+ *    and those that have gone (EBADF) are treated as above.  That is
+ *    O(fds waited on), but only when there is nothing else to do.
+ *
+ *  - After forkProcess() the child shares the parent's epoll instance,
+ *    so it must not deregister anything from it.
+ *    resetFdWaitersAfterFork() closes the child's copy and forgets the
+ *    registrations; a new instance is created when next needed.
+ *
+ *  - The queues in fd_waiters[] are GC roots (markFdWaiters).  The fds
+ *    that have waiters are also kept in the dense active_fds[] array,
+ *    so that marking is O(fds waited on) rather than O(largest fd).
+ *
+ * The backend is chosen when the first thread blocks on I/O: epoll,
+ * unless +RTS --io-backend=select was given or epoll_create1() fails.
+ * Once a backend has waiting threads we never switch.
+ */
+
+static enum {
+    IO_BACKEND_UNDECIDED,
+    IO_BACKEND_USE_SELECT,
+    IO_BACKEND_USE_EPOLL,
+} io_backend = IO_BACKEND_UNDECIDED;
+
+#if defined(USE_EPOLL)
+
+typedef struct {
+    StgTSO  *hd, *tl;      // threads blocked on this fd
+    uint32_t events;       // events registered with the kernel, or 0
+    uint32_t active_ix;    // index in active_fds[], if hd is non-empty
+    int      pending;      // errno if on pending_fds[], else 0
+} FdWaiters;
+
+static int epoll_fd = -1;
+
+static FdWaiters *fd_waiters = NULL;
+static uint32_t   fd_waiters_size = 0;
+
+static int     *active_fds = NULL;
+static uint32_t n_active_fds = 0;
+static uint32_t active_fds_size = 0;
+
+static int     *pending_fds = NULL;
+static uint32_t n_pending_fds = 0;
+static uint32_t pending_fds_size = 0;
+
+#define MAX_EPOLL_EVENTS 64
+
+static void growFdWaiters (int fd)
+{
+    uint32_t i, size;
+
+    size = fd_waiters_size == 0 ? 64 : fd_waiters_size;
+    while (size <= (uint32_t)fd) {
+        size *= 2;
+    }
+    fd_waiters = stgReallocBytes(fd_waiters, size * sizeof(FdWaiters),
+                                 "growFdWaiters");
+    for (i = fd_waiters_size; i < size; i++) {
+        fd_waiters[i].hd = END_TSO_QUEUE;
+        fd_waiters[i].tl = END_TSO_QUEUE;
+        fd_waiters[i].events = 0;
+        fd_waiters[i].active_ix = 0;
+        fd_waiters[i].pending = 0;
+    }
+    fd_waiters_size = size;
+}
+
+static void pushFd (int **arr, uint32_t *n, uint32_t *size, int fd)
+{
+    if (*n == *size) {
+        *size = *size == 0 ? 16 : *size * 2;
+        *arr = stgReallocBytes(*arr, *size * sizeof(int), "pushFd");
+    }
+    (*arr)[(*n)++] = fd;
+}
+
+static void addActiveFd (int fd)
+{
+    fd_waiters[fd].active_ix = n_active_fds;
+    pushFd(&active_fds, &n_active_fds, &active_fds_size, fd);
+}
+
+static void removeActiveFd (int fd)
+{
+    uint32_t ix = fd_waiters[fd].active_ix;
+    int last = active_fds[--n_active_fds];
+
+    active_fds[ix] = last;
+    fd_waiters[last].active_ix = ix;
+}
+
+static void addPendingFd (int fd, int err)
+{
+    if (fd_waiters[fd].pending == 0) {
+        pushFd(&pending_fds, &n_pending_fds, &pending_fds_size, fd);
+    }
+    fd_waiters[fd].pending = err;
+}
+
+/*
+ * Bring the kernel's registration for fd in line with the threads
+ * currently waiting on it.  O(threads waiting on fd).
+ */
+static void updateFdInterest (int fd)
+{
+    FdWaiters *w = &fd_waiters[fd];
+    struct epoll_event ev;
+    StgTSO *tso;
+    uint32_t events = 0;
+    int r;
+
+    for (tso = w->hd; tso != END_TSO_QUEUE; tso = tso->_link) {
+        events |= tso->why_blocked == BlockedOnRead ? EPOLLIN : EPOLLOUT;
+    }
+
+    // After forkProcess() we are only tearing down; see
+    // resetFdWaitersAfterFork().
+    if (w->pending != 0 || epoll_fd < 0 || events == w->events) {
+        return;
+    }
+
+    if (events == 0) {
+        // Can fail if the fd has been closed already, which is fine.
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        w->events = 0;
+        return;
+    }
+
+    ev.events = events;
+    ev.data.fd = fd;
+    if (w->events == 0) {
+        r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        if (r < 0 && errno == EEXIST) {
+            // registered by a previous open file with this number
+            r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        }
+    } else {
+        r = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        if (r < 0 && errno == ENOENT) {
+            // closed and reopened since we registered it
+            r = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+    }
+
+    if (r < 0) {
+        switch (errno) {
+        case EPERM:
+        case EBADF:
+            addPendingFd(fd, errno);
+            w->events = 0;
+            return;
+        default:
+            sysErrorBelch("epoll_ctl");
+            stg_exit(EXIT_FAILURE);
+        }
+    }
+    w->events = events;
+}
+
+static bool useEpoll (void)
+{
+    if (io_backend == IO_BACKEND_USE_SELECT) {
+        return false;
+    }
+    if (epoll_fd < 0) {
+        // first use, or first use since forkProcess()
+        ASSERT(n_active_fds == 0);
+        if (RtsFlags.MiscFlags.ioBackend == IO_BACKEND_SELECT ||
+            (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+            IF_DEBUG(scheduler,
+                     debugBelch("scheduler: using select() for I/O\n"));
+            io_backend = IO_BACKEND_USE_SELECT;
+            return false;
+        }
+        io_backend = IO_BACKEND_USE_EPOLL;
+    }
+    return true;
+}
+
+/*
+ * Wake the threads blocked on fd that are interested in revents.
+ */
+static void wakeFdWaiters (int fd, uint32_t revents)
+{
+    FdWaiters *w = &fd_waiters[fd];
+    StgTSO *tso, *next, *prev = END_TSO_QUEUE;
+    bool ready;
+
+    for (tso = w->hd; tso != END_TSO_QUEUE; tso = next) {
+        next = tso->_link;
+        if (tso->why_blocked == BlockedOnRead) {
+            ready = revents & (EPOLLIN | EPOLLERR | EPOLLHUP);
+        } else {
+            ready = revents & (EPOLLOUT | EPOLLERR | EPOLLHUP);
+        }
+
+        if (ready) {
+            IF_DEBUG(scheduler,
+                debugBelch("Waking up blocked thread %lu\n",
+                           (unsigned long)tso->id));
+            tso->why_blocked = NotBlocked;
+            tso->_link = END_TSO_QUEUE;
+            pushOnRunQueue(&MainCapability,tso);
+        } else {
+            if (prev == END_TSO_QUEUE)
+                w->hd = tso;
+            else
+                setTSOLink(&MainCapability, prev, tso);
+            prev = tso;
+        }
+    }
+
+    if (prev == END_TSO_QUEUE) {
+        if (w->hd != END_TSO_QUEUE) {
+            removeActiveFd(fd);
+        }
+        w->hd = w->tl = END_TSO_QUEUE;
+    } else {
+        prev->_link = END_TSO_QUEUE;
+        w->tl = prev;
+    }
+
+    updateFdInterest(fd);
+}
+
+/*
+ * Deal with the fds that epoll would not take; see Note [Event-driven
+ * I/O waiting].
+ */
+static void wakePendingFds (void)
+{
+    FdWaiters *w;
+    StgTSO *tso, *next;
+    uint32_t i;
+    int fd, err;
+
+    for (i = 0; i < n_pending_fds; i++) {
+        fd = pending_fds[i];
+        w = &fd_waiters[fd];
+        err = w->pending;
+        w->pending = 0;
+
+        tso = w->hd;
+        if (tso != END_TSO_QUEUE) {
+            removeActiveFd(fd);
+        }
+        w->hd = w->tl = END_TSO_QUEUE;
+
+        for (; tso != END_TSO_QUEUE; tso = next) {
+            next = tso->_link;
+            tso->_link = END_TSO_QUEUE;
+            if (err == EBADF) {
+                IF_DEBUG(scheduler,
+                    debugBelch("Killing blocked thread %lu on bad fd=%i\n",
+                               (unsigned long)tso->id, fd));
+                raiseAsync(&MainCapability, tso,
+                    (StgClosure *)blockedOnBadFD_closure, false, NULL);
+            } else {
+                IF_DEBUG(scheduler,
+                    debugBelch("Waking up blocked thread %lu\n",
+                               (unsigned long)tso->id));
+                tso->why_blocked = NotBlocked;
+                pushOnRunQueue(&MainCapability,tso);
+            }
+        }
+    }
+    n_pending_fds = 0;
+}
+
+/*
+ * Find the fds with waiters that have been closed, and deal with them
+ * as wakePendingFds() does.  Returns true if any were found.  See Note
+ * [Event-driven I/O waiting].
+ */
+static bool checkClosedFds (void)
+{
+    uint32_t i;
+    int fd;
+
+    for (i = 0; i < n_active_fds; i++) {
+        fd = active_fds[i];
+        if (fd_waiters[fd].pending == 0 &&
+            fcntl(fd, F_GETFD) < 0 && errno == EBADF) {
+            // the kernel has dropped the registration already
+            fd_waiters[fd].events = 0;
+            addPendingFd(fd, EBADF);
+        }
+    }
+    if (n_pending_fds == 0) {
+        return false;
+    }
+    wakePendingFds();
+    return true;
+}
+
+static void
+awaitEventEpoll(bool wait)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int numFound, timeout, i;
+    LowResTime now;
+
+    do {
+
+      now = getLowResTimeOfDay();
+      if (wakeUpSleepingThreads(now)) {
+          return;
+      }
+
+      if (n_pending_fds > 0) {
+          wakePendingFds();
+      }
+
+      if (!wait || !emptyRunQueue(&MainCapability)) {
+          // just poll
+          timeout = 0;
+      } else if (n_sleepers > 0) {
+          // Round up: waking up early just sends us round the loop again.
+          Time min = LowResTimeToTime(sleepers[0].target - now);
+          StgWord64 ms = (TimeToUS(min) + 999) / 1000;
+          timeout = ms > INT_MAX ? INT_MAX : (int)ms;
+      } else if (checkClosedFds()) {
+          timeout = 0;
+      } else {
+          timeout = -1;
+      }
+
+      while ((numFound = epoll_wait(epoll_fd, events,
+                                    MAX_EPOLL_EVENTS, timeout)) < 0) {
+          if (errno != EINTR) {
+              sysErrorBelch("epoll_wait");
+              stg_exit(EXIT_FAILURE);
+          }
+          if (interruptedWait()) {
+              return; /* still hold the lock */
+          }
+      }
+
+      if (numFound == 0 && timeout != 0) {
+          checkClosedFds();
+      }
+
+      for (i = 0; i < numFound; i++) {
+          wakeFdWaiters(events[i].data.fd, events[i].events);
+      }
+
+    } while (wait && sched_state == SCHED_RUNNING
+             && emptyRunQueue(&MainCapability));
+}
+
+#else /* !USE_EPOLL */
+
+static bool useEpoll (void)
+{
+    io_backend = IO_BACKEND_USE_SELECT;
+    return false;
+}
+
+#endif /* USE_EPOLL */
+
+/* Argument 'wait' says whether to wait for I/O to become available,
+ * or whether to just check and return immediately.  If there are
+ * other threads ready to run, we normally do the non-waiting variety,
+ * otherwise we wait (see Schedule.c).
+ *
+ * SMP note: must be called with sched_mutex locked.
+ */
+void
+awaitEvent(bool wait)
+{
+    IF_DEBUG(scheduler,
+             debugBelch("scheduler: checking for threads blocked on I/O");
+             if (wait) {
+                 debugBelch(" (waiting)");
+             }
+             debugBelch("\n");
+             );
+
+#if defined(USE_EPOLL)
+    if (io_backend == IO_BACKEND_USE_EPOLL && epoll_fd >= 0) {
+        awaitEventEpoll(wait);
+        return;
+    }
+#endif
+    awaitEventSelect(wait);
+}
+
+/* Called from waitRead#/waitWrite# with why_blocked and block_info
+ * already set. */
+void
+blockOnFd (StgTSO *tso)
+{
+    if (!useEpoll()) {
+        appendToBlockedQueue(tso);
+        return;
+    }
+
+#if defined(USE_EPOLL)
+    int fd = (int)tso->block_info.fd;
+    FdWaiters *w;
+
+    if (fd < 0) {
+        fdOutOfRange(fd);
+    }
+    if ((uint32_t)fd >= fd_waiters_size) {
+        growFdWaiters(fd);
+    }
+
+    w = &fd_waiters[fd];
+    ASSERT(tso->_link == END_TSO_QUEUE);
+    if (w->hd == END_TSO_QUEUE) {
+        w->hd = tso;
+        addActiveFd(fd);
+    } else {
+        setTSOLink(&MainCapability, w->tl, tso);
+    }
+    w->tl = tso;
+
+    updateFdInterest(fd);
+#endif
+}
+
+/* Called when a thread blocked on I/O is killed or times out. */
+void
+removeFdWaiter (Capability *cap, StgTSO *tso)
+{
+#if defined(USE_EPOLL)
+    if (io_backend == IO_BACKEND_USE_EPOLL) {
+        int fd = (int)tso->block_info.fd;
+        FdWaiters *w = &fd_waiters[fd];
+
+        removeThreadFromDeQueue(cap, &w->hd, &w->tl, tso);
+        if (w->hd == END_TSO_QUEUE) {
+            removeActiveFd(fd);
+        }
+        updateFdInterest(fd);
+        return;
+    }
+#endif
+    removeThreadFromDeQueue(cap, &blocked_queue_hd, &blocked_queue_tl, tso);
+}
+
+bool
+anyFdWaiters (void)
+{
+#if defined(USE_EPOLL)
+    return n_active_fds > 0;
+#else
+    return false;
+#endif
+}
+
+void
+markFdWaiters (evac_fn evac USED_IF_EPOLL, void *user USED_IF_EPOLL)
+{
+#if defined(USE_EPOLL)
+    uint32_t i;
+
+    for (i = 0; i < n_active_fds; i++) {
+        FdWaiters *w = &fd_waiters[active_fds[i]];
+        evac(user, (StgClosure **)(void *)&w->hd);
+        evac(user, (StgClosure **)(void *)&w->tl);
+    }
+#endif
+}
+
+void
+resetFdWaitersAfterFork (void)
+{
+#if defined(USE_EPOLL)
+    uint32_t i;
+
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    for (i = 0; i < n_active_fds; i++) {
+        fd_waiters[active_fds[i]].events = 0;
+    }
+#endif
+}
+
 #endif /* THREADED_RTS */
@@ -17,6 +17,7 @@
 #include "Ticker.h"
 #include "ThreadLabels.h"
 #include "Libdw.h"
+#include "HeapSnapshot.h"
 
 #if defined(alpha_HOST_ARCH)
 # if defined(linux_HOST_OS)
@@ -540,6 +541,18 @@ backtrace_handler(int sig STG_UNUSED)
 #endif
 }
 
+/* -----------------------------------------------------------------------------
+ * SIGUSR2 handler, with +RTS --heap-snapshot.
+ *
+ * The snapshot is written by the next major GC, which the scheduler does
+ * when it sees the request.  See Note [Heap snapshots] in HeapSnapshot.c.
+ * -------------------------------------------------------------------------- */
+static void
+heap_snapshot_handler(int sig STG_UNUSED)
+{
+    requestHeapSnapshot();
+}
+
 /* -----------------------------------------------------------------------------
  * An empty signal handler, currently used for SIGPIPE
  * -------------------------------------------------------------------------- */
@@ -721,6 +734,16 @@ initDefaultHandlers(void)
         sysErrorBelch("warning: failed to install SIGQUIT handler");
     }
 
+    // Write a heap snapshot on SIGUSR2, if asked to
+    if (RtsFlags.ProfFlags.heapSnapshotSignal) {
+        action.sa_handler = heap_snapshot_handler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = 0;
+        if (sigaction(SIGUSR2, &action, &oact) != 0) {
+            sysErrorBelch("warning: failed to install SIGUSR2 handler");
+        }
+    }
+
     set_sigtstp_action(true);
 }
 
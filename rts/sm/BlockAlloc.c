@@ -26,6 +26,7 @@
 #include <string.h>
 
 static void  initMBlock(void *mblock, uint32_t node);
+static void  free_mega_group (bdescr *mg);
 
 /* -----------------------------------------------------------------------------
 
@@ -372,13 +373,29 @@ alloc_mega_group (uint32_t node, StgWord mblocks)
     else
     {
         void *mblock;
+        StgWord extra = 0;
+
+        // Only ask the OS for whole huge pages, see Note [Huge pages]
+        if (RtsFlags.GcFlags.hugePages) {
+            extra = (MBLOCKS_PER_HUGE_PAGE - mblocks % MBLOCKS_PER_HUGE_PAGE)
+                    % MBLOCKS_PER_HUGE_PAGE;
+        }
         if (RtsFlags.GcFlags.numa) {
-            mblock = getMBlocksOnNode(node, mblocks);
+            mblock = getMBlocksOnNode(node, mblocks + extra);
         } else {
-            mblock = getMBlocks(mblocks);
+            mblock = getMBlocks(mblocks + extra);
         }
         initMBlock(mblock, node); // only need to init the 1st one
         bd = FIRST_BDESCR(mblock);
+
+        if (extra > 0) {
+            // the rest of the last huge page goes on the free list
+            StgWord8 *rest = (StgWord8*)mblock + mblocks * MBLOCK_SIZE;
+            bdescr *rest_bd = FIRST_BDESCR(rest);
+            initMBlock(rest, node);
+            rest_bd->blocks = MBLOCK_GROUP_BLOCKS(extra);
+            free_mega_group(rest_bd);
+        }
     }
     bd->blocks = MBLOCK_GROUP_BLOCKS(mblocks);
     return bd;
@@ -541,6 +558,75 @@ bdescr* allocLargeChunk (W_ min, W_ max)
     return allocLargeChunkOnNode(nodeWithLeastBlocks(), min, max);
 }
 
+// Take over the n mblocks at mblocks, which the caller has just got
+// from getMBlocks() or getMBlocksAt() and filled in, as the block
+// groups start[i] of blocks[i] blocks each (in order of address), and
+// put the blocks in between on the free list.  A group either fits in
+// one mblock or is an mblock group.  Afterwards each group is as
+// allocGroup() would return it.  Used for compact regions that were
+// laid out in a file (Note [Compact files] in CNF.c).
+//
+void
+allocGroupsAt (void *mblocks, uint32_t n, void *start[], W_ blocks[],
+               uint32_t n_groups)
+{
+    StgWord8 *mblock, *end;
+    bdescr *bd, *gap;
+    uint32_t i;
+
+    end = (StgWord8*)mblocks + (W_)n * MBLOCK_SIZE;
+    recordAllocatedBlocks(0, n * BLOCKS_PER_MBLOCK);
+
+    // First the groups.  We don't touch the bdescrs of the second and
+    // later mblocks of an mblock group, they are part of its data.
+    i = 0;
+    for (mblock = mblocks; mblock < end; mblock += MBLOCK_SIZE) {
+        initMBlock(mblock, 0);
+        for (; i < n_groups && (StgWord8*)start[i] < mblock + MBLOCK_SIZE;
+             i++) {
+            ASSERT((StgWord8*)start[i] >= mblock);
+            bd = Bdescr((StgPtr)start[i]);
+            bd->blocks = blocks[i];
+            initGroup(bd);
+            if (blocks[i] > BLOCKS_PER_MBLOCK) {
+                ASSERT(bd == FIRST_BDESCR(mblock));
+                ASSERT(blocks[i] == MBLOCK_GROUP_BLOCKS(
+                           BLOCKS_TO_MBLOCKS(blocks[i])));
+                mblock += (BLOCKS_TO_MBLOCKS(blocks[i]) - 1) * MBLOCK_SIZE;
+            }
+        }
+    }
+    ASSERT(i == n_groups);
+
+    // Then free what lies between them, a whole gap at a time, so
+    // that freeGroup() only ever sees allocated neighbours.
+    i = 0;
+    for (mblock = mblocks; mblock < end; mblock += MBLOCK_SIZE) {
+        bd = FIRST_BDESCR(mblock);
+        while (bd <= LAST_BDESCR(mblock)) {
+            if (i < n_groups && bd->start == start[i]) {
+                if (blocks[i] > BLOCKS_PER_MBLOCK) {
+                    mblock += (BLOCKS_TO_MBLOCKS(blocks[i]) - 1)
+                        * MBLOCK_SIZE;
+                    i++;
+                    break;
+                }
+                bd += blocks[i];
+                i++;
+                continue;
+            }
+            gap = bd;
+            while (bd <= LAST_BDESCR(mblock)
+                   && !(i < n_groups && bd->start == start[i])) {
+                bd++;
+            }
+            gap->blocks = bd - gap;
+            initGroup(gap);
+            freeGroup(gap);
+        }
+    }
+}
+
 bdescr *
 allocGroup_lock(W_ n)
 {
@@ -581,6 +667,86 @@ allocBlockOnNode_lock(uint32_t node)
     return bd;
 }
 
+/* -----------------------------------------------------------------------------
+   Block magazines
+
+   Note [Block magazines]
+   ~~~~~~~~~~~~~~~~~~~~~~
+   Most requests to the block allocator are for a single block: a new
+   nursery or pinned block in allocate() and allocatePinned(), a new
+   mutable list block in recordMutableCap(), and during GC to-space,
+   mark stack and mutable list blocks.  All of these go through a lock
+   (sm_mutex for the mutator, gc_alloc_block_sync during GC) that every
+   Capability and GC thread competes for.
+
+   So each Capability and each gc_thread has a BlockMagazine: a short
+   list of free single blocks that only its owner touches.  Taking a
+   block from a non-empty magazine, or giving one back, needs no lock.
+   When the magazine is empty we refill it with MAGAZINE_BATCH blocks
+   in one visit to the free list, and when frees push it past
+   MAGAZINE_SIZE blocks we spill it back to MAGAZINE_BATCH, so the lock
+   is taken at most once per MAGAZINE_BATCH operations.
+
+   Blocks in a magazine count as allocated as far as n_alloc_blocks and
+   the heap size checks are concerned, so the magazines are kept
+   small, and GC empties them all after a major collection so that
+   they don't stop returnMemoryToOS() from releasing megablocks.  They
+   are accounted for separately by memInventory().
+
+   A magazine only holds blocks from its own NUMA node; blocks from
+   other nodes are freed to the global free list as before.
+
+   The hits/refills/spills counters are reported by +RTS -s
+   --internal-counters and in the machine-readable statistics.
+   -------------------------------------------------------------------------- */
+
+void
+initBlockMagazine (BlockMagazine *mag, uint32_t node)
+{
+    mag->blocks   = NULL;
+    mag->n_blocks = 0;
+    mag->node     = node;
+    mag->hits     = 0;
+    mag->refills  = 0;
+    mag->spills   = 0;
+}
+
+void
+refillBlockMagazine (BlockMagazine *mag)
+{
+    bdescr *bd;
+    W_ i, n;
+
+    bd = allocLargeChunkOnNode(mag->node, 1, MAGAZINE_BATCH);
+    // NB. allocLargeChunk, rather than allocGroup(n), to allocate in a
+    // fragmentation-friendly way.
+    n = bd->blocks;
+    for (i = 0; i < n; i++) {
+        bd[i].blocks = 1;
+        bd[i].link = &bd[i+1];
+        bd[i].free = bd[i].start;
+    }
+    bd[n-1].link = mag->blocks;
+    mag->blocks = bd;
+    mag->n_blocks += n;
+}
+
+void
+spillBlockMagazine (BlockMagazine *mag, uint32_t keep)
+{
+    bdescr *bd, *next;
+
+    if (mag->n_blocks <= keep) return;
+    mag->spills++;
+    while (mag->n_blocks > keep) {
+        bd = mag->blocks;
+        next = bd->link;
+        freeGroup(bd);
+        mag->blocks = next;
+        mag->n_blocks--;
+    }
+}
+
 /* -----------------------------------------------------------------------------
    De-Allocation
    -------------------------------------------------------------------------- */
@@ -804,6 +970,83 @@ countAllocdBlocks(bdescr *bd)
     return n;
 }
 
+/*
+  Note [Huge pages]
+  ~~~~~~~~~~~~~~~~~
+  With +RTS --huge-pages we want the OS to back the heap with
+  transparent huge pages (HUGE_PAGE_SIZE, 2MB), which are bigger than
+  our mblocks, to cut down on TLB misses with large heaps.  The kernel
+  can only use a huge page for a huge-page-aligned range of address
+  space that is mapped in its entirety, so:
+
+    - the heap is reserved at a HUGE_PAGE_SIZE-aligned address
+      (osReserveHeapMemory()), and committed memory is marked with
+      MADV_HUGEPAGE (post_mmap_madvise());
+
+    - alloc_mega_group() only asks getMBlocks() for whole huge pages,
+      putting any mblocks it doesn't need on the free list, so that
+      with the large address space every huge page we commit is
+      committed in one go;
+
+    - returnMemoryToOS() only gives back whole, aligned huge pages: a
+      free mgroup that covers only part of a huge page stays on the
+      free list, since releasing it would make the kernel split the
+      huge page.
+
+  The heap may still end up partly in small pages, e.g. if the kernel
+  has no huge pages to spare.  The +RTS -s output reports how much of
+  the heap was backed by huge pages (osHugePageBytes()).
+*/
+
+// Like returnMemoryToOS(), but only release whole huge pages.  Returns
+// the number of mblocks we still wanted to free.
+static uint32_t
+return_huge_pages (uint32_t node, uint32_t n)
+{
+    bdescr *bd, *top, **link;
+    StgWord8 *start, *end, *lo, *hi;
+    StgWord size;
+
+    link = &free_mblock_list[node];
+    while (n >= MBLOCKS_PER_HUGE_PAGE && (bd = *link) != NULL) {
+        start = MBLOCK_ROUND_DOWN(bd->start);
+        end   = start + BLOCKS_TO_MBLOCKS(bd->blocks) * MBLOCK_SIZE;
+        lo    = HUGE_PAGE_ROUND_UP(start);
+        hi    = HUGE_PAGE_ROUND_DOWN(end);
+        if (hi <= lo) {
+            // no whole huge page in this mgroup
+            link = &bd->link;
+            continue;
+        }
+
+        // free from the top, as returnMemoryToOS() does
+        size = stg_min((W_)(hi - lo) / MBLOCK_SIZE,
+                       n - n % MBLOCKS_PER_HUGE_PAGE);
+        lo = hi - size * MBLOCK_SIZE;
+
+        // any part of a huge page above what we free stays on the list
+        if (end > hi) {
+            top = FIRST_BDESCR(hi);
+            initMBlock(hi, node);
+            top->blocks = MBLOCK_GROUP_BLOCKS((W_)(end - hi) / MBLOCK_SIZE);
+            top->link = bd->link;
+            bd->link = top;
+        }
+
+        // and so does everything below it
+        if (lo > start) {
+            bd->blocks = MBLOCK_GROUP_BLOCKS((W_)(lo - start) / MBLOCK_SIZE);
+            link = &bd->link;
+        } else {
+            *link = bd->link;
+        }
+
+        freeMBlocks(lo, size);
+        n -= size;
+    }
+    return n;
+}
+
 void returnMemoryToOS(uint32_t n /* megablocks */)
 {
     bdescr *bd;
@@ -812,6 +1055,10 @@ void returnMemoryToOS(uint32_t n /* megablocks */)
 
     // ToDo: not fair, we free all the memory starting with node 0.
     for (node = 0; n > 0 && node < n_numa_nodes; node++) {
+        if (RtsFlags.GcFlags.hugePages) {
+            n = return_huge_pages(node, n);
+            continue;
+        }
         bd = free_mblock_list[node];
         while ((n > 0) && (bd != NULL)) {
             size = BLOCKS_TO_MBLOCKS(bd->blocks);
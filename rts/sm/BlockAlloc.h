@@ -13,12 +13,75 @@
 bdescr *allocLargeChunk (W_ min, W_ max);
 bdescr *allocLargeChunkOnNode (uint32_t node, W_ min, W_ max);
 
+void allocGroupsAt (void *mblocks, uint32_t n, void *start[], W_ blocks[],
+                    uint32_t n_groups);
+
+/* Block magazines --------------------------------------------------------- */
+
+// A small cache of free single blocks owned by one Capability or one
+// GC thread.  Only the owner touches it, so taking or returning a
+// block needs no lock; the global free list is only visited to
+// refill or spill a whole batch.  See Note [Block magazines].
+
+#define MAGAZINE_BATCH  16              // blocks per refill or spill
+#define MAGAZINE_SIZE   (2*MAGAZINE_BATCH) // spill when we have more
+
+typedef struct BlockMagazine_ {
+    bdescr  *blocks;        // free blocks, linked by bd->link
+    uint32_t n_blocks;
+    uint32_t node;          // the NUMA node our blocks come from
+    StgWord  hits;          // blocks taken without a refill
+    StgWord  refills;       // blocks taken after a refill
+    StgWord  spills;        // batches given back to the free list
+} BlockMagazine;
+
+void initBlockMagazine   (BlockMagazine *mag, uint32_t node);
+
+// These need the block allocator's lock (sm_mutex, or
+// gc_alloc_block_sync during GC):
+void refillBlockMagazine (BlockMagazine *mag);
+void spillBlockMagazine  (BlockMagazine *mag, uint32_t keep);
+
+// Take a block from a non-empty magazine.  Like allocBlock(), the
+// result has free == start and link == NULL, and the caller sets the
+// flags and generation.
+INLINE_HEADER bdescr *
+takeMagazineBlock (BlockMagazine *mag)
+{
+    bdescr *bd = mag->blocks;
+    ASSERT(bd != NULL && bd->blocks == 1);
+    mag->blocks = bd->link;
+    mag->n_blocks--;
+    bd->link = NULL;
+    bd->free = bd->start;
+    return bd;
+}
+
+// Return a single block belonging to the magazine's node.  Returns true
+// if the magazine is now over-full and the caller should spill it.
+INLINE_HEADER bool
+putMagazineBlock (BlockMagazine *mag, bdescr *bd)
+{
+    ASSERT(bd->blocks == 1 && bd->node == mag->node);
+    bd->gen = NULL;
+    bd->gen_no = 0;
+    bd->link = mag->blocks;
+    mag->blocks = bd;
+    mag->n_blocks++;
+    return mag->n_blocks > MAGAZINE_SIZE;
+}
+
 /* Debugging  -------------------------------------------------------------- */
 
 extern W_ countBlocks       (bdescr *bd);
 extern W_ countAllocdBlocks (bdescr *bd);
 extern void returnMemoryToOS(uint32_t n);
 
+// The background thread that returns free megablocks to the OS, see
+// Note [Background decommit] in MBlock.c
+void startDecommitThread(void);
+void stopDecommitThread(void);
+
 #if defined(DEBUG)
 void checkFreeListSanity(void);
 W_   countFreeList(void);
@@ -18,13 +18,15 @@
 #include "GC.h"
 #include "Storage.h"
 #include "CNF.h"
-#include "Hash.h"
 #include "HeapAlloc.h"
 #include "BlockAlloc.h"
 #include "Trace.h"
 #include "sm/ShouldCompact.h"
+#include "OSMem.h"
 
+#include <fs_rts.h>
 #include <string.h>
+#include <errno.h>
 
 #if defined(HAVE_UNISTD_H)
 #include <unistd.h>
@@ -89,9 +91,9 @@
   * The data inside a CNF block is ordinary closures
 
   * During compaction (with sharing enabled) the hash field points to
-    a HashTable mapping heap addresses outside the compact to
+    a CompactHash mapping heap addresses outside the compact to
     addresses within it.  If a GC strikes during compaction, this
-    HashTable must be scanned by the GC.
+    table must be scanned by the GC.
 
   Invariants
   ~~~~~~~~~~
@@ -536,12 +538,133 @@ allocateForCompact (Capability *cap,
 }
 
 
+/*
+  Note [Sharing in compactAddWithSharing]
+  ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+  compactAddWithSharing# has to remember every object it has copied, so
+  that a second pointer to the same object gets the same copy.  It used
+  a general-purpose HashTable (Hash.c), which made it several times
+  slower than compactAdd#: each insertion allocates a chained entry,
+  and each lookup follows a chain through memory that is nowhere near
+  the bucket.
+
+  The keys are just addresses, and we never delete, so CompactHash is
+  an open-addressing table with linear probing over an array of
+  key/value pairs.  A lookup costs one multiplication (Fibonacci
+  hashing, so that the low bits of aligned addresses don't matter) and,
+  since the table is never more than half full, almost always a single
+  cache miss.  The table starts small and doubles when it gets to half
+  full, because we don't know in advance how much of the heap the
+  object being compacted will drag in.
+
+  We can't instead mark the copied objects themselves, as the copying
+  GC does with forwarding pointers: they are still live, other threads
+  may be looking at them, and compaction can be interrupted by an
+  exception.
+
+  The GC moves the keys, so it rebuilds the table (scavenge_compact()).
+*/
+
+#define COMPACT_HASH_INIT_SIZE 1024
+
+#if SIZEOF_VOID_P == 8
+#define COMPACT_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+#else
+#define COMPACT_HASH_MULTIPLIER 0x9E3779B9UL
+#endif
+
+static void
+init_compact_hash (CompactHash *hash, StgWord size)
+{
+    uint32_t log2size = 0;
+
+    while (((StgWord)1 << log2size) < size) {
+        log2size++;
+    }
+    hash->size = size;
+    hash->count = 0;
+    hash->shift = sizeof(W_) * 8 - log2size;
+    hash->entries = stgCallocBytes(size, sizeof(CompactHashEntry),
+                                   "allocCompactHash");
+}
+
+CompactHash *
+allocCompactHash (void)
+{
+    CompactHash *hash;
+
+    hash = stgMallocBytes(sizeof(CompactHash), "allocCompactHash");
+    init_compact_hash(hash, COMPACT_HASH_INIT_SIZE);
+    return hash;
+}
+
+void
+freeCompactHash (CompactHash *hash)
+{
+    stgFree(hash->entries);
+    stgFree(hash);
+}
+
+STATIC_INLINE StgWord
+compact_hash_slot (CompactHash *hash, StgWord key)
+{
+    return (key * COMPACT_HASH_MULTIPLIER) >> hash->shift;
+}
+
+StgClosure *
+lookupCompactHash (CompactHash *hash, StgClosure *p)
+{
+    StgWord key = (StgWord)p, mask = hash->size - 1, i;
+    CompactHashEntry *e;
+
+    for (i = compact_hash_slot(hash, key); ; i = (i + 1) & mask) {
+        e = &hash->entries[i];
+        if (e->key == key) {
+            return e->value;
+        }
+        if (e->key == 0) {
+            return NULL;
+        }
+    }
+}
+
+void
+insertCompactHashEntry (CompactHash *hash, StgClosure *p, StgClosure *to)
+{
+    StgWord key = (StgWord)p, mask, i;
+    CompactHashEntry *old;
+    StgWord old_size, j;
+
+    if ((hash->count + 1) * 2 > hash->size) {
+        old = hash->entries;
+        old_size = hash->size;
+        init_compact_hash(hash, old_size * 2);
+        for (j = 0; j < old_size; j++) {
+            if (old[j].key != 0) {
+                insertCompactHashEntry(hash, (StgClosure*)old[j].key,
+                                       old[j].value);
+            }
+        }
+        stgFree(old);
+    }
+
+    mask = hash->size - 1;
+    for (i = compact_hash_slot(hash, key); hash->entries[i].key != 0;
+         i = (i + 1) & mask) {
+        ASSERT(hash->entries[i].key != key);
+    }
+    hash->entries[i].key = key;
+    hash->entries[i].value = to;
+    hash->count++;
+}
+
 void
 insertCompactHash (Capability *cap,
                    StgCompactNFData *str,
                    StgClosure *p, StgClosure *to)
 {
-    insertHashTable(str->hash, (StgWord)p, (const void*)to);
+    insertCompactHashEntry(str->hash, p, to);
     if (str->header.info == &stg_COMPACT_NFDATA_CLEAN_info) {
         str->header.info = &stg_COMPACT_NFDATA_DIRTY_info;
         recordClosureMutated(cap, (StgClosure*)str);
@@ -791,51 +914,61 @@ any_needs_fixup(StgCompactNFDataBlock *block)
     return false;
 }
 
+// A fixup table says where each block of a compact used to be, and
+// where it is now.  The entries are sorted by old address.
+typedef struct {
+    StgWord old;
+    StgWord new;
+    StgWord size;       // in bytes
+} FixupEntry;
+
+typedef struct {
+    FixupEntry *entries;
+    uint32_t count;
+    // If every block moved by the same amount, a pointer into
+    // [lo, hi) can be adjusted without searching the table.  This is
+    // the case when a compact file can't be loaded where it was laid
+    // out (Note [Compact files]).  There may be gaps between the
+    // blocks, so 'present' has a bit for each block in [lo, hi), set if
+    // one of the entries covers it; a pointer into a gap is left to the
+    // search, which rejects it.
+    bool uniform;
+    StgWord lo, hi, delta;
+    StgWord *present;
+} FixupTable;
+
 #if defined(DEBUG)
 static void
-spew_failing_pointer(StgWord *fixup_table, uint32_t count, StgWord address)
+spew_failing_pointer(FixupTable *table, StgWord address)
 {
     uint32_t i;
-    StgWord key, value;
-    StgCompactNFDataBlock *block;
-    bdescr *bd;
-    StgWord size;
+    FixupEntry *e;
 
     debugBelch("Failed to adjust 0x%" FMT_HexWord ". Block dump follows...\n",
                address);
 
-    for (i  = 0; i < count; i++) {
-        key = fixup_table [2 * i];
-        value = fixup_table [2 * i + 1];
-
-        block = (StgCompactNFDataBlock*)value;
-        bd = Bdescr((P_)block);
-        size = (W_)bd->free - (W_)bd->start;
-
+    for (i  = 0; i < table->count; i++) {
+        e = &table->entries[i];
         debugBelch("%" FMT_Word32 ": was 0x%" FMT_HexWord "-0x%" FMT_HexWord
-                   ", now 0x%" FMT_HexWord "-0x%" FMT_HexWord "\n", i, key,
-                   key+size, value, value+size);
+                   ", now 0x%" FMT_HexWord "-0x%" FMT_HexWord "\n", i, e->old,
+                   e->old + e->size, e->new, e->new + e->size);
     }
 }
 #endif
 
-STATIC_INLINE StgCompactNFDataBlock *
-find_pointer(StgWord *fixup_table, uint32_t count, StgClosure *q)
+STATIC_INLINE FixupEntry *
+find_pointer(FixupTable *table, StgClosure *q)
 {
     StgWord address = (W_)q;
     uint32_t a, b, c;
-    StgWord key, value;
-    bdescr *bd;
+    FixupEntry *e;
 
     a = 0;
-    b = count;
+    b = table->count;
     while (a < b-1) {
         c = (a+b)/2;
 
-        key = fixup_table[c * 2];
-        value = fixup_table[c * 2 + 1];
-
-        if (key > address)
+        if (table->entries[c].old > address)
             b = c;
         else
             a = c;
@@ -843,93 +976,97 @@ find_pointer(StgWord *fixup_table, uint32_t count, StgClosure *q)
 
     // three cases here: 0, 1 or 2 blocks to check
     for ( ; a < b; a++) {
-        key = fixup_table[a * 2];
-        value = fixup_table[a * 2 + 1];
+        e = &table->entries[a];
 
-        if (key > address)
+        if (e->old > address)
             goto fail;
 
-        bd = Bdescr((P_)value);
-
-        if (key + bd->blocks * BLOCK_SIZE <= address)
+        if (e->old + e->size <= address)
             goto fail;
 
-        return (StgCompactNFDataBlock*)value;
+        return e;
     }
 
  fail:
     // We should never get here
 
 #if defined(DEBUG)
-    spew_failing_pointer(fixup_table, count, address);
+    spew_failing_pointer(table, address);
 #endif
     return NULL;
 }
 
 static bool
-fixup_one_pointer(StgWord *fixup_table, uint32_t count, StgClosure **p)
+fixup_one_pointer(FixupTable *table, StgClosure **p)
 {
     StgWord tag;
     StgClosure *q;
-    StgCompactNFDataBlock *block;
+    FixupEntry *e;
 
 
     q = *p;
     tag = GET_CLOSURE_TAG(q);
     q = UNTAG_CLOSURE(q);
 
+    if (table->uniform && (W_)q >= table->lo && (W_)q < table->hi) {
+        StgWord b = ((W_)q - table->lo) / BLOCK_SIZE;
+        if (table->present[b / BITS_IN(W_)] & ((W_)1 << (b % BITS_IN(W_)))) {
+            q = (StgClosure*)((W_)q + table->delta);
+            *p = TAG_CLOSURE(tag, q);
+            return true;
+        }
+    }
+
     // We can encounter a pointer outside the compact if it points to
     // a static constructor that does not (directly or indirectly)
     // reach any CAFs. (see Note [Compact Normal Forms])
     if (!HEAP_ALLOCED(q))
         return true;
 
-    block = find_pointer(fixup_table, count, q);
-    if (block == NULL)
+    e = find_pointer(table, q);
+    if (e == NULL)
         return false;
-    if (block == block->self)
+    if (e->old == e->new)
         return true;
 
-    q = (StgClosure*)((W_)q - (W_)block->self + (W_)block);
+    q = (StgClosure*)((W_)q - e->old + e->new);
     *p = TAG_CLOSURE(tag, q);
 
     return true;
 }
 
 static bool
-fixup_mut_arr_ptrs (StgWord          *fixup_table,
-                    uint32_t               count,
-                    StgMutArrPtrs    *a)
+fixup_mut_arr_ptrs (FixupTable *table, StgMutArrPtrs *a)
 {
     StgPtr p, q;
 
     p = (StgPtr)&a->payload[0];
     q = (StgPtr)&a->payload[a->ptrs];
     for (; p < q; p++) {
-        if (!fixup_one_pointer(fixup_table, count, (StgClosure**)p))
+        if (!fixup_one_pointer(table, (StgClosure**)p))
             return false;
     }
 
     return true;
 }
 
+// Fix up the objects from start to limit, which are the contents of a
+// compact block (not necessarily where the block is: compactWriteFile()
+// works on a copy).
 static bool
-fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
+fixup_objects(StgPtr start, StgPtr limit, FixupTable *table)
 {
     const StgInfoTable *info;
-    bdescr *bd;
     StgPtr p;
 
-    bd = Bdescr((P_)block);
-    p = bd->start + sizeofW(StgCompactNFDataBlock);
-    while (p < bd->free) {
+    p = start;
+    while (p < limit) {
         ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
         info = get_itbl((StgClosure*)p);
 
         switch (info->type) {
         case CONSTR_1_0:
-            if (!fixup_one_pointer(fixup_table, count,
-                                   &((StgClosure*)p)->payload[0]))
+            if (!fixup_one_pointer(table, &((StgClosure*)p)->payload[0]))
                 return false;
             FALLTHROUGH;
         case CONSTR_0_1:
@@ -937,13 +1074,11 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
             break;
 
         case CONSTR_2_0:
-            if (!fixup_one_pointer(fixup_table, count,
-                                   &((StgClosure*)p)->payload[1]))
+            if (!fixup_one_pointer(table, &((StgClosure*)p)->payload[1]))
                 return false;
             FALLTHROUGH;
         case CONSTR_1_1:
-            if (!fixup_one_pointer(fixup_table, count,
-                                   &((StgClosure*)p)->payload[0]))
+            if (!fixup_one_pointer(table, &((StgClosure*)p)->payload[0]))
                 return false;
             FALLTHROUGH;
         case CONSTR_0_2:
@@ -958,7 +1093,7 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
 
             end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
             for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-                if (!fixup_one_pointer(fixup_table, count, (StgClosure **)p))
+                if (!fixup_one_pointer(table, (StgClosure **)p))
                     return false;
             }
             p += info->layout.payload.nptrs;
@@ -971,7 +1106,7 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
 
         case MUT_ARR_PTRS_FROZEN_CLEAN:
         case MUT_ARR_PTRS_FROZEN_DIRTY:
-            fixup_mut_arr_ptrs(fixup_table, count, (StgMutArrPtrs*)p);
+            fixup_mut_arr_ptrs(table, (StgMutArrPtrs*)p);
             p += mut_arr_ptrs_sizeW((StgMutArrPtrs*)p);
             break;
 
@@ -982,8 +1117,7 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
             StgSmallMutArrPtrs *arr = (StgSmallMutArrPtrs*)p;
 
             for (i = 0; i < arr->ptrs; i++) {
-                if (!fixup_one_pointer(fixup_table, count,
-                                       &arr->payload[i]))
+                if (!fixup_one_pointer(table, &arr->payload[i]))
                     return false;
             }
 
@@ -992,7 +1126,7 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
         }
 
         case COMPACT_NFDATA:
-            if (p == (bd->start + sizeofW(StgCompactNFDataBlock))) {
+            if (p == start) {
                 // Ignore the COMPACT_NFDATA header
                 // (it will be fixed up later)
                 p += sizeofW(StgCompactNFData);
@@ -1011,21 +1145,83 @@ fixup_block(StgCompactNFDataBlock *block, StgWord *fixup_table, uint32_t count)
     return true;
 }
 
+static bool
+fixup_block(StgCompactNFDataBlock *block, FixupTable *table)
+{
+    bdescr *bd;
+
+    bd = Bdescr((P_)block);
+    return fixup_objects(bd->start + sizeofW(StgCompactNFDataBlock), bd->free,
+                         table);
+}
+
 static int
 cmp_fixup_table_item (const void *e1, const void *e2)
 {
-    const StgWord *w1 = e1;
-    const StgWord *w2 = e2;
+    const FixupEntry *w1 = e1;
+    const FixupEntry *w2 = e2;
 
-    return *w1 - *w2;
+    return w1->old < w2->old ? -1 : w1->old > w2->old;
 }
 
-static StgWord *
-build_fixup_table (StgCompactNFDataBlock *block, uint32_t *pcount)
+// Sort the entries and see whether they all moved by the same amount.
+static void
+sort_fixup_table (FixupTable *table)
+{
+    FixupEntry *e;
+    uint32_t i;
+    StgWord b, n, total;
+
+    qsort(table->entries, table->count, sizeof(FixupEntry),
+          cmp_fixup_table_item);
+
+    e = table->entries;
+    table->uniform = true;
+    table->present = NULL;
+    table->delta = e[0].new - e[0].old;
+    total = e[0].size / BLOCK_SIZE;
+    for (i = 1; i < table->count; i++) {
+        if (e[i].new - e[i].old != table->delta) {
+            table->uniform = false;
+            return;
+        }
+        total += e[i].size / BLOCK_SIZE;
+    }
+    table->lo = e[0].old;
+    table->hi = e[table->count - 1].old + e[table->count - 1].size;
+
+    // The blocks of a compact file are packed together, but don't
+    // build a huge map for blocks scattered over the address space.
+    n = (table->hi - table->lo) / BLOCK_SIZE;
+    if (n > total * 8) {
+        table->uniform = false;
+        return;
+    }
+    table->present = stgCallocBytes((n + BITS_IN(W_) - 1) / BITS_IN(W_),
+                                    sizeof(W_), "sort_fixup_table");
+    for (i = 0; i < table->count; i++) {
+        for (b = (e[i].old - table->lo) / BLOCK_SIZE;
+             b < (e[i].old + e[i].size - table->lo) / BLOCK_SIZE; b++) {
+            table->present[b / BITS_IN(W_)] |= (W_)1 << (b % BITS_IN(W_));
+        }
+    }
+}
+
+static void
+free_fixup_table (FixupTable *table)
+{
+    stgFree(table->entries);
+    if (table->present != NULL) {
+        stgFree(table->present);
+    }
+}
+
+static void
+build_fixup_table (StgCompactNFDataBlock *block, FixupTable *table)
 {
     uint32_t count;
     StgCompactNFDataBlock *tmp;
-    StgWord *table;
+    FixupEntry *e;
 
     count = 0;
     tmp = block;
@@ -1034,33 +1230,32 @@ build_fixup_table (StgCompactNFDataBlock *block, uint32_t *pcount)
         tmp = tmp->next;
     } while(tmp && tmp->owner);
 
-    table = stgMallocBytes(sizeof(StgWord) * 2 * count, "build_fixup_table");
+    e = stgMallocBytes(sizeof(FixupEntry) * count, "build_fixup_table");
 
     count = 0;
     do {
-        table[count * 2] = (W_)block->self;
-        table[count * 2 + 1] = (W_)block;
+        e[count].old = (W_)block->self;
+        e[count].new = (W_)block;
+        e[count].size = Bdescr((P_)block)->blocks * BLOCK_SIZE;
         count++;
         block = block->next;
     } while(block && block->owner);
 
-    qsort(table, count, sizeof(StgWord) * 2, cmp_fixup_table_item);
-
-    *pcount = count;
-    return table;
+    table->entries = e;
+    table->count = count;
+    sort_fixup_table(table);
 }
 
 static bool
 fixup_loop(StgCompactNFDataBlock *block, StgClosure **proot)
 {
-    StgWord *table;
+    FixupTable table;
     bool ok;
-    uint32_t count;
 
-    table = build_fixup_table (block, &count);
+    build_fixup_table (block, &table);
 
     do {
-        if (!fixup_block(block, table, count)) {
+        if (!fixup_block(block, &table)) {
             ok = false;
             goto out;
         }
@@ -1068,10 +1263,10 @@ fixup_loop(StgCompactNFDataBlock *block, StgClosure **proot)
         block = block->next;
     } while(block && block->owner);
 
-    ok = fixup_one_pointer(table, count, proot);
+    ok = fixup_one_pointer(&table, proot);
 
  out:
-    stgFree(table);
+    free_fixup_table(&table);
     return ok;
 }
 
@@ -1106,7 +1301,8 @@ fixup_late(StgCompactNFData *str, StgCompactNFDataBlock *block)
         if (block->owner != NULL) {
             if (bd->free != bd->start)
                 nursery = block;
-            block->owner = str;
+            if (block->owner != str)
+                block->owner = str;
         }
 
         block = block->next;
@@ -1184,3 +1380,449 @@ compactFixupPointers(StgCompactNFData *str,
 
     return (StgPtr)root;
 }
+
+/* -----------------------------------------------------------------------------
+   Compact files
+   -------------------------------------------------------------------------- */
+
+/*
+  Note [Compact files]
+  ~~~~~~~~~~~~~~~~~~~~
+
+  importCompact copies every block of a serialized compact into a block
+  we have just allocated, and then fixes up every pointer by searching
+  a table of the old block addresses.  That is fine for small compacts,
+  but loading a multi-gigabyte data set this way means reading all of
+  it before the program can start.
+
+  compactWriteFile() instead writes a compact as an image of whole
+  megablocks, laid out the way the block allocator would lay them out
+  (the bdescrs at the start of each megablock are left zero), with the
+  pointers already adjusted to an address chosen in advance.
+  compactReadFile() asks the megablock allocator for exactly those
+  megablocks (getMBlocksAt()), reads the image into them, and gives the
+  blocks to the block allocator (allocGroupsAt()).  That is one large
+  sequential read, and nothing needs to be fixed up:
+  compactFixupPointers() sees that every block is where it thinks it is.
+
+  We don't map the file into the heap, although the image is laid out
+  so that we could.  The mapping would outlive the compact: when it is
+  freed its megablocks go back to the free list still backed by the
+  file, and if the file is later truncated or replaced, whoever gets
+  those megablocks next dies with SIGBUS.  Reading into ordinary
+  anonymous memory avoids that, and the file can change or go away as
+  soon as compactReadFile() has returned.
+
+  We can't simply use the addresses the blocks had when they were
+  written: they are scattered all over the heap of the writing program,
+  and the reading program, which is the same binary, will usually have
+  put its own heap at those addresses.  So compactWriteFile() packs the
+  blocks together and places the image at the top of the address space
+  that the RTS reserves (with USE_LARGE_ADDRESS_SPACE), which the heap
+  only reaches when it is very large.
+
+  If the megablocks are taken (for example when the same file is read
+  twice), or we can't ask for particular ones (without
+  USE_LARGE_ADDRESS_SPACE), the image goes into any free megablocks.
+  Because it is still in one piece, every block has moved by the same
+  amount, and compactFixupPointers() adjusts each pointer with a range
+  check, a bitmap test and an addition (FixupTable.uniform), rather
+  than a search.
+
+  Like importCompact, this only works with the binary that wrote the
+  file, loaded at the same address: info pointers and pointers to static
+  closures are not adjusted.  We check the address of one info table
+  and refuse files that don't match.
+*/
+
+#define COMPACT_FILE_MAGIC      "GHCCMPCT"
+#define COMPACT_FILE_VERSION    1
+// The image starts at a multiple of this in the file, so that it is
+// page aligned for any page size up to 64k.
+#define COMPACT_FILE_ALIGN      65536
+
+typedef struct {
+    char    magic[8];
+    StgWord version;
+    StgWord word_size;          // these three must match the reader's
+    StgWord block_size;
+    StgWord mblock_size;
+    StgWord info;               // &stg_COMPACT_NFDATA_CLEAN_info
+    StgWord base;               // where the image belongs
+    StgWord n_mblocks;          // the size of the image
+    StgWord n_blocks;           // number of CompactFileBlocks
+    StgWord root;
+    StgWord data_offset;        // of the image in the file
+} CompactFileHeader;
+
+// Followed by one of these for each block of the compact, in the order
+// of the chain, which is also the order of address.
+typedef struct {
+    StgWord addr;               // of the StgCompactNFDataBlock
+    StgWord blocks;             // bd->blocks
+    StgWord used;               // bytes from addr to bd->free
+} CompactFileBlock;
+
+// Pack the blocks into megablocks, in order, like allocGroup() would
+// place them in fresh memory.  Sets addr relative to the start of the
+// image, and returns its size in megablocks.
+static StgWord
+layout_compact_file (CompactFileBlock *blocks, StgWord n_blocks)
+{
+    StgWord i, mblock, next;
+
+    mblock = 0;
+    next = 0;                   // first free block in the mblock
+    for (i = 0; i < n_blocks; i++) {
+        if (blocks[i].blocks > BLOCKS_PER_MBLOCK) {
+            if (next != 0) {
+                mblock++;
+            }
+            blocks[i].addr = mblock * MBLOCK_SIZE + FIRST_BLOCK_OFF;
+            mblock += BLOCKS_TO_MBLOCKS(blocks[i].blocks);
+            next = 0;
+            continue;
+        }
+        if (next + blocks[i].blocks > BLOCKS_PER_MBLOCK) {
+            mblock++;
+            next = 0;
+        }
+        blocks[i].addr = mblock * MBLOCK_SIZE + FIRST_BLOCK_OFF
+            + next * BLOCK_SIZE;
+        next += blocks[i].blocks;
+    }
+    return next == 0 ? mblock : mblock + 1;
+}
+
+static bool
+write_zeros (FILE *f, StgWord n)
+{
+    static const char zeros[BLOCK_SIZE];
+    StgWord len;
+
+    while (n > 0) {
+        len = stg_min(n, sizeof(zeros));
+        if (fwrite(zeros, 1, len, f) != len) {
+            return false;
+        }
+        n -= len;
+    }
+    return true;
+}
+
+/*
+ * Write the compact whose first block is first, with root as its root,
+ * to path.  Returns 0, or -1 with errno set.
+ */
+int
+compactWriteFile (StgCompactNFDataBlock *first, StgClosure *root,
+                  const char *path)
+{
+    CompactFileHeader hdr;
+    CompactFileBlock *blocks = NULL;
+    StgCompactNFData *str;
+    StgCompactNFDataBlock *block, *copy = NULL;
+    FixupTable table = { NULL, 0, false, 0, 0, 0, NULL };
+    StgWord n_blocks, i, pos, size;
+    FILE *f = NULL;
+    int saved_errno;
+    bdescr *bd;
+
+    // As in stg_compactGetFirstBlockzh, the nursery's bd->free may be
+    // behind
+    str = firstBlockGetCompact(first);
+    Bdescr((P_)str->nursery)->free = str->hp;
+
+    n_blocks = 0;
+    for (block = first; block != NULL; block = block->next) {
+        n_blocks++;
+    }
+
+    blocks = stgMallocBytes(n_blocks * sizeof(CompactFileBlock),
+                            "compactWriteFile");
+    table.entries = stgMallocBytes(n_blocks * sizeof(FixupEntry),
+                                   "compactWriteFile");
+    for (block = first, i = 0; block != NULL; block = block->next, i++) {
+        bd = Bdescr((P_)block);
+        blocks[i].blocks = bd->blocks;
+        blocks[i].used = (W_)bd->free - (W_)bd->start;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, COMPACT_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = COMPACT_FILE_VERSION;
+    hdr.word_size = sizeof(W_);
+    hdr.block_size = BLOCK_SIZE;
+    hdr.mblock_size = MBLOCK_SIZE;
+    hdr.info = (W_)&stg_COMPACT_NFDATA_CLEAN_info;
+    hdr.n_blocks = n_blocks;
+    hdr.n_mblocks = layout_compact_file(blocks, n_blocks);
+    size = hdr.n_mblocks * MBLOCK_SIZE;
+#if defined(USE_LARGE_ADDRESS_SPACE)
+    if (size <= mblock_address_space.end - mblock_address_space.begin) {
+        hdr.base = mblock_address_space.end - size;
+    } else {
+        hdr.base = mblock_address_space.begin;
+    }
+#else
+    // Wherever it goes, it will have to be fixed up
+    hdr.base = (W_)MBLOCK_ROUND_DOWN(first);
+#endif
+    hdr.data_offset =
+        (sizeof(hdr) + n_blocks * sizeof(CompactFileBlock)
+         + COMPACT_FILE_ALIGN - 1) & ~(W_)(COMPACT_FILE_ALIGN - 1);
+
+    for (block = first, i = 0; block != NULL; block = block->next, i++) {
+        blocks[i].addr += hdr.base;
+        table.entries[i].old = (W_)block;
+        table.entries[i].new = blocks[i].addr;
+        table.entries[i].size = blocks[i].blocks * BLOCK_SIZE;
+    }
+    table.count = n_blocks;
+    sort_fixup_table(&table);
+
+    hdr.root = (W_)root;
+    if (!fixup_one_pointer(&table, (StgClosure**)&hdr.root)) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    f = __rts_fopen(path, "wb");
+    if (f == NULL) {
+        goto fail;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(blocks, sizeof(CompactFileBlock), n_blocks, f) != n_blocks ||
+        !write_zeros(f, hdr.data_offset - sizeof(hdr)
+                        - n_blocks * sizeof(CompactFileBlock))) {
+        goto fail;
+    }
+
+    // Each block goes through a copy, in which we adjust the pointers
+    pos = hdr.base;
+    for (block = first, i = 0; block != NULL; block = block->next, i++) {
+        copy = stgMallocBytes(blocks[i].used, "compactWriteFile");
+        memcpy(copy, block, blocks[i].used);
+
+        copy->self = (StgCompactNFDataBlock*)blocks[i].addr;
+        copy->owner = (StgCompactNFData*)(blocks[0].addr
+                                          + sizeof(StgCompactNFDataBlock));
+        copy->next = block->next == NULL ? NULL
+            : (StgCompactNFDataBlock*)blocks[i+1].addr;
+        if (i == 0) {
+            // compactFixupPointers() sets up the rest
+            firstBlockGetCompact(copy)->hash = NULL;
+        }
+
+        if (!fixup_objects((P_)copy + sizeofW(StgCompactNFDataBlock),
+                           (P_)((W_)copy + blocks[i].used), &table)) {
+            errno = EINVAL;
+            goto fail;
+        }
+
+        if (!write_zeros(f, blocks[i].addr - pos) ||
+            fwrite(copy, 1, blocks[i].used, f) != blocks[i].used) {
+            goto fail;
+        }
+        pos = blocks[i].addr + blocks[i].used;
+        stgFree(copy);
+        copy = NULL;
+    }
+
+    // The whole image is in the file, so that it can be read in one go
+    if (!write_zeros(f, hdr.base + size - pos)) {
+        goto fail;
+    }
+    if (fclose(f) != 0) {
+        f = NULL;
+        goto fail;
+    }
+
+    debugTrace(DEBUG_compact, "compactWriteFile: %" FMT_Word " blocks, "
+               "%" FMT_Word " mblocks at %p", n_blocks, hdr.n_mblocks,
+               (void*)hdr.base);
+
+    free_fixup_table(&table);
+    stgFree(blocks);
+    return 0;
+
+fail:
+    saved_errno = errno;
+    if (f != NULL) {
+        fclose(f);
+    }
+    if (copy != NULL) {
+        stgFree(copy);
+    }
+    free_fixup_table(&table);
+    stgFree(blocks);
+    errno = saved_errno;
+    return -1;
+}
+
+static bool
+valid_compact_file (CompactFileHeader *hdr, CompactFileBlock *blocks)
+{
+    StgWord i, off, end, image;
+
+    image = hdr->n_mblocks * MBLOCK_SIZE;
+    end = 0;
+    for (i = 0; i < hdr->n_blocks; i++) {
+        if (blocks[i].addr < hdr->base
+            || (blocks[i].addr & BLOCK_MASK) != 0
+            || blocks[i].blocks == 0
+            || blocks[i].blocks > image / BLOCK_SIZE
+            || blocks[i].used < sizeof(StgCompactNFDataBlock)
+               + (i == 0 ? sizeof(StgCompactNFData) : 0)
+            || blocks[i].used > blocks[i].blocks * BLOCK_SIZE
+            || (blocks[i].used & (sizeof(W_) - 1)) != 0) {
+            return false;
+        }
+        off = blocks[i].addr - hdr->base;
+        if (off < end || off >= image
+            || (off & MBLOCK_MASK) < FIRST_BLOCK_OFF) {
+            return false;
+        }
+        if (blocks[i].blocks > BLOCKS_PER_MBLOCK) {
+            if ((off & MBLOCK_MASK) != FIRST_BLOCK_OFF
+                || blocks[i].blocks != MBLOCK_GROUP_BLOCKS(
+                       BLOCKS_TO_MBLOCKS(blocks[i].blocks))) {
+                return false;
+            }
+            end = (off & ~MBLOCK_MASK)
+                + BLOCKS_TO_MBLOCKS(blocks[i].blocks) * MBLOCK_SIZE;
+        } else {
+            end = off + blocks[i].blocks * BLOCK_SIZE;
+            if (end > (off & ~MBLOCK_MASK) + MBLOCK_SIZE) {
+                return false;
+            }
+        }
+        if (end > image) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Read a compact written by compactWriteFile().  Returns -1 with errno
+ * set if the file can't be read, 0 if it isn't a compact file that this
+ * program can use, and 1 if it is.  In that case *first and *root are
+ * the first block of the compact and its root, ready for
+ * compactFixupPointers(), which links the compact into the heap.
+ */
+int
+compactReadFile (const char *path, StgCompactNFDataBlock **first,
+                 StgClosure **root)
+{
+    CompactFileHeader hdr;
+    CompactFileBlock *blocks = NULL;
+    void **start = NULL;
+    W_ *n = NULL;
+    StgCompactNFDataBlock *block;
+    StgWord i, j, size, delta;
+    bdescr *head, *bd;
+    void *mem;
+    FILE *f;
+    int ret = 0;
+
+    f = __rts_fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1
+        || memcmp(hdr.magic, COMPACT_FILE_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.version != COMPACT_FILE_VERSION
+        || hdr.word_size != sizeof(W_)
+        || hdr.block_size != BLOCK_SIZE
+        || hdr.mblock_size != MBLOCK_SIZE
+        || hdr.info != (W_)&stg_COMPACT_NFDATA_CLEAN_info
+        || hdr.n_blocks == 0
+        || hdr.n_mblocks == 0
+        || hdr.n_mblocks > HS_INT32_MAX
+        || hdr.n_mblocks > ~(W_)0 / MBLOCK_SIZE
+        || (hdr.base & MBLOCK_MASK) != 0
+        || hdr.data_offset < sizeof(hdr)
+        || hdr.n_blocks > (hdr.data_offset - sizeof(hdr))
+                          / sizeof(CompactFileBlock)) {
+        goto out;
+    }
+
+    blocks = stgMallocBytes(hdr.n_blocks * sizeof(CompactFileBlock),
+                            "compactReadFile");
+    if (fread(blocks, sizeof(CompactFileBlock), hdr.n_blocks, f)
+          != hdr.n_blocks
+        || !valid_compact_file(&hdr, blocks)) {
+        goto out;
+    }
+
+    size = hdr.n_mblocks * MBLOCK_SIZE;
+    start = stgMallocBytes(hdr.n_blocks * sizeof(void*), "compactReadFile");
+    n = stgMallocBytes(hdr.n_blocks * sizeof(W_), "compactReadFile");
+
+    // We hold the lock until the block allocator knows about the
+    // mblocks, so that memInventory() never sees them half set up.
+    // That includes reading the image, since allocGroupsAt() needs it
+    // in place: the bdescrs live in the mblocks we are reading into.
+    ACQUIRE_SM_LOCK;
+
+    mem = getMBlocksAt((void*)hdr.base, (uint32_t)hdr.n_mblocks);
+    if (mem == NULL) {
+        mem = getMBlocks((uint32_t)hdr.n_mblocks);
+    }
+    delta = (W_)mem - hdr.base;
+
+    if (fseek(f, hdr.data_offset, SEEK_SET) != 0
+        || fread(mem, 1, size, f) != size) {
+        freeMBlocks(mem, (uint32_t)hdr.n_mblocks);
+        RELEASE_SM_LOCK;
+        goto out;
+    }
+
+    for (i = 0; i < hdr.n_blocks; i++) {
+        start[i] = (void*)(blocks[i].addr + delta);
+        n[i] = blocks[i].blocks;
+    }
+    allocGroupsAt(mem, (uint32_t)hdr.n_mblocks, start, n,
+                  (uint32_t)hdr.n_blocks);
+
+    // Now make them the blocks of a compact being imported, as
+    // compactAllocateBlock() would
+    for (i = 0; i < hdr.n_blocks; i++) {
+        block = (StgCompactNFDataBlock*)start[i];
+        head = Bdescr((P_)block);
+        initBdescr(head, g0, g0);
+        head->flags = BF_COMPACT;
+        head->free = (P_)((W_)block + blocks[i].used);
+        for (j = 1, bd = head + 1;
+             j < blocks[i].blocks && bd <= LAST_BDESCR(MBLOCK_ROUND_DOWN(head));
+             j++, bd++) {
+            bd->link = head;
+            bd->blocks = 0;
+            bd->flags = BF_COMPACT;
+        }
+        if (delta != 0) {
+            block->next = i + 1 < hdr.n_blocks ? start[i+1] : NULL;
+        }
+        g0->n_compact_blocks_in_import += blocks[i].blocks;
+        g0->n_new_large_words += blocks[i].blocks * BLOCK_SIZE_W;
+    }
+    dbl_link_onto(Bdescr((P_)start[0]), &g0->compact_blocks_in_import);
+
+    RELEASE_SM_LOCK;
+
+    debugTrace(DEBUG_compact, "compactReadFile: %" FMT_Word " mblocks at %p%s",
+               hdr.n_mblocks, mem, delta == 0 ? "" : ", needs fixing up");
+
+    *first = (StgCompactNFDataBlock*)start[0];
+    *root = (StgClosure*)hdr.root;
+    ret = 1;
+
+out:
+    fclose(f);
+    if (blocks != NULL) stgFree(blocks);
+    if (start != NULL) stgFree(start);
+    if (n != NULL) stgFree(n);
+    return ret;
+}
@@ -73,6 +73,29 @@ extern void *allocateForCompact (Capability *cap,
                                  StgCompactNFData *str,
                                  StgWord sizeW);
 
+// The objects already copied by compactAddWithSharing#, mapping each
+// (untagged) source object to its (tagged) copy.  An open-addressing
+// table with linear probing; a key of 0 is an empty slot.  See Note
+// [Sharing in compactAddWithSharing] in CNF.c.
+typedef struct {
+    StgWord key;
+    StgClosure *value;
+} CompactHashEntry;
+
+typedef struct CompactHash_ {
+    CompactHashEntry *entries;
+    StgWord size;               // a power of 2
+    StgWord count;
+    uint32_t shift;             // sizeof(W_)*8 - log2(size)
+} CompactHash;
+
+extern CompactHash *allocCompactHash (void);
+extern void freeCompactHash (CompactHash *hash);
+extern StgClosure *lookupCompactHash (CompactHash *hash, StgClosure *p);
+// Just insert; insertCompactHash() also dirties the compact
+extern void insertCompactHashEntry (CompactHash *hash,
+                                    StgClosure *p, StgClosure *to);
+
 extern void insertCompactHash (Capability *cap,
                                StgCompactNFData *str,
                                StgClosure *p, StgClosure *to);
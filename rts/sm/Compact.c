@@ -70,12 +70,27 @@
    if we throw away some of the tags).
    ------------------------------------------------------------------------- */
 
+// Install a new head for the chain of fields pointing at q.  In a
+// parallel compaction other GC threads may be threading fields onto the
+// same chain at the same time, so we have to use a CAS.
+STATIC_INLINE bool
+set_chain_head (StgPtr q, StgWord old, StgWord head)
+{
+#if defined(THREADED_RTS)
+    if (n_compact_threads > 1) {
+        return cas((StgVolatilePtr)q, old, head) == old;
+    }
+#endif
+    *q = head;
+    return true;
+}
+
 STATIC_INLINE void
 thread (StgClosure **p)
 {
     StgClosure *q0;
     StgPtr q;
-    StgWord iptr;
+    StgWord iptr, head;
     bdescr *bd;
 
     q0  = *p;
@@ -90,22 +105,27 @@ thread (StgClosure **p)
 
         if (bd->flags & BF_MARKED)
         {
-            iptr = *q;
-            switch (GET_CLOSURE_TAG((StgClosure *)iptr))
-            {
-            case 0:
-                // this is the info pointer; we are creating a new chain.
-                // save the original tag at the end of the chain.
-                *p = (StgClosure *)((StgWord)iptr + GET_CLOSURE_TAG(q0));
-                *q = (StgWord)p + 1;
-                break;
-            case 1:
-            case 2:
-                // this is a chain of length 1 or more
-                *p = (StgClosure *)iptr;
-                *q = (StgWord)p + 2;
-                break;
-            }
+            do {
+                iptr = *q;
+                switch (GET_CLOSURE_TAG((StgClosure *)iptr))
+                {
+                case 0:
+                    // this is the info pointer; we are creating a new
+                    // chain.  save the original tag at the end of the
+                    // chain.
+                    *p = (StgClosure *)((StgWord)iptr + GET_CLOSURE_TAG(q0));
+                    head = (StgWord)p + 1;
+                    break;
+                case 1:
+                case 2:
+                    // this is a chain of length 1 or more
+                    *p = (StgClosure *)iptr;
+                    head = (StgWord)p + 2;
+                    break;
+                default:
+                    return;
+                }
+            } while (!set_chain_head(q, iptr, head));
         }
     }
 }
@@ -850,8 +870,11 @@ update_fwd_compact( bdescr *blocks )
     }
 }
 
+// Slide the live objects in blocks down to the start of the list.
+// Returns the number of blocks still in use; *last_bd is set to the
+// last of them, and the blocks after it can be freed.
 static W_
-update_bkwd_compact( generation *gen )
+update_bkwd_compact( bdescr *blocks, bdescr **last_bd )
 {
     StgPtr p, free;
 #if 0
@@ -863,7 +886,7 @@ update_bkwd_compact( generation *gen )
     W_ free_blocks;
     StgWord iptr;
 
-    bd = free_bd = gen->old_blocks;
+    bd = free_bd = blocks;
     free = free_bd->start;
     free_blocks = 1;
 
@@ -929,16 +952,294 @@ update_bkwd_compact( generation *gen )
         }
     }
 
-    // free the remaining blocks and count what's left.
     free_bd->free = free;
-    if (free_bd->link != NULL) {
-        freeChain(free_bd->link);
-        free_bd->link = NULL;
+    *last_bd = free_bd;
+    return free_blocks;
+}
+
+/* ----------------------------------------------------------------------------
+   Parallel compaction
+
+   Note [Parallel compaction]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   With +RTS -qc, a compacting major GC is a parallel GC (see
+   scheduleDoGC()).  Marking is still done by the main GC thread on
+   its own, because the mark stack is not thread-safe, and the other
+   GC threads stand by meanwhile.  Once marking is done,
+   GarbageCollect() wakes them up and they all run compact() together;
+   the other threads enter through compactWorker().
+
+   The sequential algorithm interleaves the threading of pointers with
+   the calculation of forwarding addresses (update_fwd_compact()),
+   which relies on visiting the heap in address order.  In parallel we
+   do these in separate phases instead, with a barrier between each:
+
+     1. the main GC thread threads the roots, and divides the blocks
+        of the compacted generation into regions: runs of consecutive
+        blocks in old_blocks.
+
+     2. all threads thread the pointer fields of every live object.
+        Several threads may add to the same chain at once, so thread()
+        installs the new head of a chain with a CAS.  The regions, the
+        other generations, and the segments of the stable pointer table
+        are handed out to threads one at a time.
+
+     3. each region is compacted independently: objects only ever move
+        within their own region.  Now that every pointer to an object
+        is on its chain, we can compute the object's new address and
+        unthread the chain in one go (unthread_compact()).  Nothing
+        else touches the chain of an object in this phase, and
+        computing the size of an object only looks at its non-pointer
+        fields, which are never on a chain.
+
+     4. each region slides its objects down (update_bkwd_compact(), in
+        which unthreading has nothing left to do).
+
+   Finally, the main GC thread links the regions back together and
+   frees the blocks they no longer need.  Each region leaves a
+   partly-filled block behind, so we don't make regions too small.
+   ------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+typedef struct {
+    bdescr *blocks;     // the blocks of this region, NULL-terminated
+    bdescr *last_bd;    // the last block in use after compaction
+    W_ n_blocks;        // number of blocks in use after compaction
+} CompactRegion;
+
+// Aim for a few regions per thread, for load balancing, but don't
+// split the generation into regions smaller than this.
+#define MIN_REGION_BLOCKS 64
+
+static CompactRegion *regions;
+static uint32_t n_regions;
+
+// Segments of the stable pointer table, threaded in phase 2.
+static uint32_t n_sp_segments;
+
+// Each phase hands out work through its own counter.
+static volatile StgWord next_fwd_task, next_unthread_task, next_bkwd_task;
+
+static volatile StgWord barrier_count;
+static volatile StgWord barrier_epoch;
+
+static void
+compact_barrier (void)
+{
+    StgWord epoch = barrier_epoch;
+
+    if (atomic_inc(&barrier_count, 1) == n_compact_threads) {
+        barrier_count = 0;
+        write_barrier();
+        barrier_epoch = epoch + 1;
+    } else {
+        while (barrier_epoch == epoch) {
+            busy_wait_nop();
+        }
     }
+    load_load_barrier();
+}
 
-    return free_blocks;
+// Phase 2: thread the pointer fields of the live objects in blocks,
+// which belong to the compacted generation.
+static void
+thread_compact( bdescr *blocks )
+{
+    StgPtr p;
+    bdescr *bd;
+    StgInfoTable *info;
+    StgWord iptr;
+
+    for (bd = blocks; bd != NULL; bd = bd->link) {
+        p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+            if (p >= bd->free) {
+                break;
+            }
+
+            iptr = get_threaded_info(p);
+            info = INFO_PTR_TO_STRUCT((StgInfoTable *)UNTAG_CLOSURE((StgClosure *)iptr));
+            p = thread_obj(info, p);
+        }
+    }
+}
+
+// Phase 2 for generation g, apart from the blocks being compacted.
+static void
+update_fwd_gen( uint32_t g )
+{
+    generation *gen = &generations[g];
+    uint32_t n;
+
+    update_fwd(gen->blocks);
+    for (n = 0; n < n_capabilities; n++) {
+        update_fwd(gc_threads[n]->gens[g].todo_bd);
+        update_fwd(gc_threads[n]->gens[g].part_list);
+    }
+    update_fwd_large(gen->scavenged_large_objects);
+}
+
+// Phase 3: compute the new address of each live object in blocks, and
+// point everything that refers to it at that address.  As in
+// update_fwd_compact(), we mark the word after an object that will
+// spill into the next block.
+static void
+unthread_compact( bdescr *blocks )
+{
+    StgPtr p, q, free;
+    bdescr *bd, *free_bd;
+    const StgInfoTable *info;
+    StgWord size;
+    StgWord iptr;
+
+    free_bd = blocks;
+    free = free_bd->start;
+
+    for (bd = blocks; bd != NULL; bd = bd->link) {
+        p = bd->start;
+
+        while (p < bd->free) {
+
+            while (p < bd->free && !is_marked(p,bd)) {
+                p++;
+            }
+            if (p >= bd->free) {
+                break;
+            }
+
+            iptr = get_threaded_info(p);
+            info = INFO_PTR_TO_STRUCT((StgInfoTable *)UNTAG_CLOSURE((StgClosure *)iptr));
+            size = closure_sizeW_((StgClosure *)p, info);
+
+            q = p;
+            p += size;
+
+            if (free + size > free_bd->start + BLOCK_SIZE_W) {
+                mark(q+1,bd);
+                free_bd = free_bd->link;
+                free = free_bd->start;
+            } else {
+                ASSERT(!is_marked(q+1,bd));
+            }
+
+            unthread(q,(StgWord)free + GET_CLOSURE_TAG((StgClosure *)iptr));
+            free += size;
+        }
+    }
+}
+
+static void
+split_regions( generation *gen )
+{
+    bdescr *bd, *next;
+    W_ n, per_region;
+    uint32_t i;
+
+    n_regions = 0;
+    regions = NULL;
+    next_fwd_task = 0;
+    next_unthread_task = 0;
+    next_bkwd_task = 0;
+
+    if (gen->old_blocks == NULL) return;
+
+    n = gen->n_old_blocks / MIN_REGION_BLOCKS;
+    if (n > n_compact_threads * 4) n = n_compact_threads * 4;
+    if (n == 0) n = 1;
+    per_region = (gen->n_old_blocks + n - 1) / n;
+
+    regions = stgMallocBytes(n * sizeof(CompactRegion), "split_regions");
+
+    bd = gen->old_blocks;
+    for (i = 0; bd != NULL; i++) {
+        ASSERT(i < n);
+        regions[i].blocks = bd;
+        for (n = 1; n < per_region && bd->link != NULL; n++) {
+            bd = bd->link;
+        }
+        next = bd->link;
+        bd->link = NULL;
+        bd = next;
+    }
+    n_regions = i;
+}
+
+// Link the compacted regions back together, freeing the blocks they
+// don't need any more.  Returns the number of blocks left.
+static W_
+join_regions( generation *gen USED_IF_DEBUG )
+{
+    W_ blocks = 0;
+    uint32_t i;
+    bdescr *last_bd;
+
+    ASSERT(n_regions == 0 || gen->old_blocks == regions[0].blocks);
+
+    for (i = 0; i < n_regions; i++) {
+        last_bd = regions[i].last_bd;
+        if (last_bd->link != NULL) {
+            freeChain(last_bd->link);
+        }
+        last_bd->link = i+1 < n_regions ? regions[i+1].blocks : NULL;
+        blocks += regions[i].n_blocks;
+    }
+
+    stgFree(regions);
+    regions = NULL;
+    return blocks;
+}
+
+// Phases 2-4, run by all the compacting threads.
+static void
+compact_phases( void )
+{
+    StgWord i;
+
+    // 2. thread the heap
+    while ((i = atomic_inc(&next_fwd_task, 1) - 1) <
+           n_regions + RtsFlags.GcFlags.generations + n_sp_segments) {
+        if (i < n_regions) {
+            thread_compact(regions[i].blocks);
+        } else if (i < n_regions + RtsFlags.GcFlags.generations) {
+            update_fwd_gen(i - n_regions);
+        } else {
+            markStablePtrSegment(i - n_regions - RtsFlags.GcFlags.generations,
+                                 (evac_fn)thread_root, NULL);
+        }
+    }
+    compact_barrier();
+
+    // 3. compute the forwarding addresses and unthread
+    while ((i = atomic_inc(&next_unthread_task, 1) - 1) < n_regions) {
+        unthread_compact(regions[i].blocks);
+    }
+    compact_barrier();
+
+    // 4. move the objects
+    while ((i = atomic_inc(&next_bkwd_task, 1) - 1) < n_regions) {
+        regions[i].n_blocks =
+            update_bkwd_compact(regions[i].blocks, &regions[i].last_bd);
+    }
+    compact_barrier();
 }
 
+void
+compactWorker (void)
+{
+    // wait for the main GC thread to thread the roots
+    compact_barrier();
+    compact_phases();
+}
+
+#endif /* THREADED_RTS */
+
 void
 compact(StgClosure *static_objects)
 {
@@ -969,6 +1270,12 @@ compact(StgClosure *static_objects)
             for (bd = capabilities[n]->mut_lists[g];
                  bd != NULL; bd = bd->link) {
                 for (p = bd->start; p < bd->free; p++) {
+                    if (IS_MUT_LIST_CARD(*p)) {
+                        // card entries refer to large objects, which
+                        // don't move; skip the card index too
+                        p++;
+                        continue;
+                    }
                     thread((StgClosure **)p);
                 }
             }
@@ -1000,8 +1307,15 @@ compact(StgClosure *static_objects)
     // the static objects
     thread_static(static_objects /* ToDo: ok? */);
 
-    // the stable pointer table
-    threadStablePtrTable((evac_fn)thread_root, NULL);
+    // the stable pointer table, which a parallel compaction threads in
+    // phase 2 instead
+#if defined(THREADED_RTS)
+    n_sp_segments = stablePtrTableSegments();
+    if (n_compact_threads == 1)
+#endif
+    {
+        threadStablePtrTable((evac_fn)thread_root, NULL);
+    }
 
     // the stable name table
     threadStableNameTable((evac_fn)thread_root, NULL);
@@ -1009,6 +1323,27 @@ compact(StgClosure *static_objects)
     // the CAF list (used by GHCi)
     markCAFs((evac_fn)thread_root, NULL);
 
+#if defined(THREADED_RTS)
+    if (n_compact_threads > 1) {
+        gen = oldest_gen;
+        split_regions(gen);
+        debugTrace(DEBUG_gc, "compact: %d threads, %d regions",
+                   n_compact_threads, n_regions);
+
+        compact_barrier();
+        compact_phases();
+
+        if (gen->old_blocks != NULL) {
+            blocks = join_regions(gen);
+            debugTrace(DEBUG_gc,
+                       "update_bkwd: %d (compact, old: %d blocks, now %d blocks)",
+                       gen->no, gen->n_old_blocks, blocks);
+            gen->n_old_blocks = blocks;
+        }
+        return;
+    }
+#endif
+
     // 2. update forward ptrs
     for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
         gen = &generations[g];
@@ -1029,7 +1364,13 @@ compact(StgClosure *static_objects)
     // 3. update backward ptrs
     gen = oldest_gen;
     if (gen->old_blocks != NULL) {
-        blocks = update_bkwd_compact(gen);
+        bdescr *last_bd;
+        blocks = update_bkwd_compact(gen->old_blocks, &last_bd);
+        // free the remaining blocks
+        if (last_bd->link != NULL) {
+            freeChain(last_bd->link);
+            last_bd->link = NULL;
+        }
         debugTrace(DEBUG_gc,
                    "update_bkwd: %d (compact, old: %d blocks, now %d blocks)",
                    gen->no, gen->n_old_blocks, blocks);
@@ -46,5 +46,8 @@ is_marked(StgPtr p, bdescr *bd)
 }
 
 void compact (StgClosure *static_objects);
+#if defined(THREADED_RTS)
+void compactWorker (void);
+#endif
 
 #include "EndPrivate.h"
@@ -0,0 +1,905 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Marking the oldest generation concurrently with the mutator
+ * (+RTS --concurrent-mark).
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "ConcMark.h"
+#include "Storage.h"
+#include "GC.h"
+#include "GCThread.h"
+#include "GCUtils.h"
+#include "Compact.h"
+#include "CNF.h"
+#include "Sweep.h"
+#include "BlockAlloc.h"
+#include "Hash.h"
+#include "RtsUtils.h"
+#include "Trace.h"
+#include "Weak.h"
+
+#include <string.h> // for memset()
+
+/* -----------------------------------------------------------------------------
+   Note [Concurrent marking]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   With +RTS --concurrent-mark, a major GC of a mark/sweep oldest
+   generation is replaced by a *cycle*: the marking is done by a
+   separate OS thread (the marker) while the mutator runs, and only the
+   start and the end of the cycle are done in a GC pause.
+
+   The cycle starts in a GC of all the generations but the oldest, which
+   scheduleDoGC() asks for (concMarkCollectGen()) when a major GC would
+   be due.  startConcMark() takes a snapshot of the oldest generation:
+
+     - the small objects are in oldest_gen->blocks, once we have flushed
+       the partly-filled blocks of the GC threads there, and they get a
+       mark bitmap as in a major GC.  The blocks that later GCs add to
+       the generation go on the front of the list, so the snapshot is
+       always the tail of the list from snapshot_head;
+
+     - the large objects (except the capabilities' current pinned
+       blocks) and the compacts get BF_CONC_MARK, and BF_CONC_MARKED
+       once they are marked.
+
+   Whatever the GCs promote into the oldest generation during the cycle
+   is outside the snapshot, and survives it.
+
+   The marker takes objects off the mark queue, and marks and queues the
+   objects in the snapshot that they point to.  It marks the static
+   objects too (in marked_statics), because a CAF may be the only thing
+   that keeps an object in the snapshot alive.  The mutator may be
+   changing an object while the marker looks at it, so the marker reads
+   the info pointer only once.  It doesn't look inside TSOs and STACKs,
+   which the mutator changes without any barrier: the ones in the
+   snapshot are marked and scavenged by the GC that starts the cycle
+   (scavenge_conc_mark_threads() in Scav.c).
+
+   A snapshot-at-the-beginning mark would need the old value of every
+   pointer that the mutator overwrites, which we don't have:
+   dirty_MUT_VAR() is called after the store, an array write only marks
+   a card, and thunks are blackholed and updated by compiled code.  So
+   this is an *incremental update* mark instead, built on the write
+   barrier of the generational GC:
+
+     - every write of a pointer into an object of the oldest generation
+       puts the object on a mutable list (dirty_MUT_VAR(), dirty_TVAR(),
+       dirty_MVAR(), dirty_TSO(), dirty_STACK(), the cards of an array,
+       updateWithIndirection(), newCAF()), where it stays until the next
+       GC scavenges it;
+
+     - every GC during the cycle evacuates all the roots, the mutable
+       lists and everything it copies, and evacuate() shades the objects
+       in the snapshot that it comes across (concMarkShade(), and
+       concMarkShadeStatic() for the static objects, whose SRTs the
+       minor GCs follow during a cycle).
+
+   So a pointer that the mutator stores in an object that the marker has
+   already looked at is shaded by the next GC, and so is a pointer that
+   the mutator keeps only on a stack or in a young object.  An object in
+   the snapshot that the GC keeps without evacuating it (the key of a
+   weak pointer, a spark) is shaded too, by concMarkIsDead().
+
+   When the marker has run out of work, the next GC collects all the
+   generations but the oldest, so that everything that may point into
+   the snapshot is scanned, and then:
+
+     - syncConcMark() finishes the marking in the pause and deals with
+       the weak pointers in the snapshot, as traverseWeakPtrList() would
+       in a major GC;
+
+     - from then on (conc_mark_sync), isAlive() and pruneSparkQueue()
+       look at the marks;
+
+     - finishConcMark() removes the dead objects from the mutable lists,
+       frees the large objects and compacts that weren't marked, and
+       hands the small blocks of the snapshot to the lazy sweeper (see
+       Note [Lazy sweeping] in Sweep.c).
+
+   The marker stops during each GC (pauseConcMark()) and carries on
+   after it (resumeConcMark()).  A major GC, for example from
+   performMajorGC or for a heap census, abandons the cycle.  If the
+   oldest generation grows to twice its limit during the cycle, the
+   marker is falling behind, and the next GC finishes the marking in the
+   pause.
+   -------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+bool conc_mark_active = false;
+bool conc_mark_sync = false;
+
+// set by requestConcMark() for the next GC
+static bool start_requested = false;
+
+// the next GC must finish the mark, see concMarkCollectGen()
+static bool sync_forced = false;
+
+// The small blocks of the snapshot: snapshot_head and the blocks after
+// it in oldest_gen->blocks, with snapshot_words words in use.
+static bdescr *snapshot_head = NULL;
+static W_ snapshot_words = 0;
+
+// Words of small objects marked, for gen->live_estimate
+static W_ marked_words = 0;
+
+// The static objects that we have marked
+static HashTable *marked_statics = NULL;
+
+// Marked objects that we have yet to look inside.  The GC threads push
+// onto it (under shade_lock) only while the marker is stopped.
+static StgClosure **mark_queue = NULL;
+static volatile W_ mark_queue_len = 0;
+static W_ mark_queue_size = 0;
+
+// Room for the pointers of the closure being traced
+static StgClosure **trace_ptrs = NULL;
+static W_ trace_ptrs_size = 0;
+
+static SpinLock shade_lock;
+
+static Mutex marker_mutex;
+static Condition marker_cond;       // work to do, or stop
+static Condition marker_idle_cond;  // marker_busy was cleared, or the
+                                    // thread stopped
+// the mutator is running, so the marker may run too
+static volatile bool marker_run = false;
+static volatile bool marker_stop = false;
+// the marker is tracing, with marker_mutex released
+static bool marker_busy = false;
+static bool marker_running = false;
+
+/* -----------------------------------------------------------------------------
+   Marking
+   -------------------------------------------------------------------------- */
+
+static void
+push_mark_queue (StgClosure *p)
+{
+    if (mark_queue_len == mark_queue_size) {
+        mark_queue_size = mark_queue_size == 0 ? 4096 : mark_queue_size * 2;
+        mark_queue = stgReallocBytes(mark_queue,
+                                     mark_queue_size * sizeof(StgClosure *),
+                                     "push_mark_queue");
+    }
+    mark_queue[mark_queue_len++] = p;
+}
+
+// The block descriptor that holds the mark of p, a heap object, or NULL
+// if p isn't in the snapshot.
+STATIC_INLINE bdescr *
+snapshot_bdescr (StgClosure *p)
+{
+    bdescr *bd = Bdescr((P_)p);
+
+    if (bd->flags & BF_COMPACT) {
+        bd = Bdescr((P_)objectGetCompact(p));
+    }
+    return (bd->flags & BF_CONC_MARK) ? bd : NULL;
+}
+
+STATIC_INLINE bool
+is_marked_object (StgClosure *p, bdescr *bd)
+{
+    if (bd->flags & (BF_LARGE | BF_COMPACT)) {
+        return (bd->flags & BF_CONC_MARKED) != 0;
+    }
+    return is_marked((P_)p, bd) != 0;
+}
+
+// Mark p, which is in the snapshot, and queue it if we have to look
+// inside it.
+static void
+mark_object (StgClosure *p, bdescr *bd)
+{
+    if (bd->flags & (BF_LARGE | BF_COMPACT)) {
+        if (bd->flags & BF_CONC_MARKED) return;
+        bd->flags |= BF_CONC_MARKED;
+        // nothing in a compact or a pinned block points outside it
+        if (bd->flags & (BF_COMPACT | BF_PINNED)) return;
+    } else {
+        if (is_marked((P_)p, bd)) return;
+        mark((P_)p, bd);
+    }
+    push_mark_queue(p);
+}
+
+// Does the static object p point to anything?  The same cases as in
+// evacuate().
+static bool
+static_has_pointers (StgClosure *p)
+{
+    const StgInfoTable *info = get_itbl(p);
+
+    switch (info->type) {
+    case THUNK_STATIC:
+        return info->srt != 0;
+    case FUN_STATIC:
+        return info->srt != 0 || info->layout.payload.ptrs != 0;
+    case CONSTR_0_1:
+    case CONSTR_0_2:
+    case CONSTR_NOCAF:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static void
+mark_static (StgClosure *p)
+{
+    if (!static_has_pointers(p)) return;
+    if (lookupHashTable(marked_statics, (StgWord)p) != NULL) return;
+    insertHashTable(marked_statics, (StgWord)p, p);
+    push_mark_queue(p);
+}
+
+static void
+mark_ptr (StgClosure *p)
+{
+    bdescr *bd;
+
+    if (p == NULL) return;
+    p = UNTAG_CLOSURE(p);
+    if (!HEAP_ALLOCED_GC(p)) {
+        mark_static(p);
+        return;
+    }
+    bd = snapshot_bdescr(p);
+    if (bd != NULL) {
+        mark_object(p, bd);
+    }
+}
+
+// Mark everything that p points to.  With concurrent, the mutator is
+// running, and we give up on an object that it has locked if we are
+// asked to stop: it goes back on the queue.
+static void
+trace_closure (StgClosure *p, bool concurrent)
+{
+    const StgInfoTable *info;
+    StgWord i, n;
+    StgPtr q, end;
+
+    info = (const StgInfoTable *)VOLATILE_LOAD(&p->header.info);
+    while (info == &stg_WHITEHOLE_info) {
+        if (concurrent && (!marker_run || marker_stop)) {
+            push_mark_queue(p);
+            return;
+        }
+        busy_wait_nop();
+        info = (const StgInfoTable *)VOLATILE_LOAD(&p->header.info);
+    }
+    // the fields were written before the info pointer
+    load_load_barrier();
+    info = INFO_PTR_TO_STRUCT(info);
+
+    switch (info->type) {
+
+    case TSO:
+    case STACK:
+        // see scavenge_conc_mark_threads()
+        return;
+
+    case WEAK:
+        // the other fields are dealt with by syncConcMark()
+        mark_ptr(((StgWeak *)p)->cfinalizers);
+        break;
+
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        q = (P_)((StgMutArrPtrs *)p)->payload;
+        end = q + ((StgMutArrPtrs *)p)->ptrs;
+        for (; q < end; q++) {
+            mark_ptr((StgClosure *)VOLATILE_LOAD(q));
+        }
+        break;
+
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+    case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+    case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+        q = (P_)((StgSmallMutArrPtrs *)p)->payload;
+        end = q + ((StgSmallMutArrPtrs *)p)->ptrs;
+        for (; q < end; q++) {
+            mark_ptr((StgClosure *)VOLATILE_LOAD(q));
+        }
+        break;
+
+    default:
+        n = closure_sizeW_(p, info) + 1;
+        if (n > trace_ptrs_size) {
+            trace_ptrs_size = stg_max(n, 2 * trace_ptrs_size);
+            trace_ptrs = stgReallocBytes(trace_ptrs,
+                                         trace_ptrs_size * sizeof(StgClosure *),
+                                         "trace_closure");
+        }
+        n = collect_closure_pointers(p, info, trace_ptrs, true);
+        for (i = 0; i < n; i++) {
+            mark_ptr(trace_ptrs[i]);
+        }
+        break;
+    }
+
+    if (HEAP_ALLOCED_GC(p) && !(Bdescr((P_)p)->flags & BF_LARGE)) {
+        marked_words += closure_sizeW_(p, info);
+    }
+}
+
+// Trace everything on the queue.  Only when the marker isn't running.
+static void
+drain_mark_queue (void)
+{
+    while (mark_queue_len > 0) {
+        trace_closure(mark_queue[--mark_queue_len], false);
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   The marker thread
+   -------------------------------------------------------------------------- */
+
+static void *
+markerThread (void *arg STG_UNUSED)
+{
+    ACQUIRE_LOCK(&marker_mutex);
+    while (!marker_stop) {
+        if (!marker_run || mark_queue_len == 0) {
+            marker_busy = false;
+            signalCondition(&marker_idle_cond);
+            waitCondition(&marker_cond, &marker_mutex);
+            continue;
+        }
+
+        marker_busy = true;
+        RELEASE_LOCK(&marker_mutex);
+        while (marker_run && !marker_stop && mark_queue_len > 0) {
+            trace_closure(mark_queue[--mark_queue_len], true);
+        }
+        ACQUIRE_LOCK(&marker_mutex);
+    }
+    marker_busy = false;
+    marker_running = false;
+    signalCondition(&marker_idle_cond);
+    RELEASE_LOCK(&marker_mutex);
+    return NULL;
+}
+
+// Start the marker thread if there is a cycle for it.  We must hold
+// marker_mutex.
+static void
+start_marker_thread (void)
+{
+    OSThreadId tid;
+
+    if (marker_running || !conc_mark_active) return;
+
+    marker_running = true;
+    if (createOSThread(&tid, "ghc_marker", markerThread, NULL) != 0) {
+        // leave this cycle to a major GC, and don't start another
+        marker_running = false;
+        RtsFlags.GcFlags.concurrentMark = false;
+        sysErrorBelch("concurrent mark thread creation failed");
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Called by scheduleDoGC()
+   -------------------------------------------------------------------------- */
+
+// Which generation should this GC collect?  A major GC that we can
+// replace with a concurrent mark becomes a GC of the younger
+// generations that starts one (*start), and during a cycle the GCs
+// collect no more than the younger generations, and all of them when
+// the mark is about to finish.
+uint32_t
+concMarkCollectGen (uint32_t collect_gen, bool force_major, bool *start)
+{
+    generation *gen = oldest_gen;
+    W_ blocks;
+
+    *start = false;
+    if (!RtsFlags.GcFlags.concurrentMark || gen->no == 0 || force_major) {
+        return collect_gen;
+    }
+
+    if (conc_mark_active) {
+        blocks = gen->n_blocks + gen->n_large_blocks + gen->n_compact_blocks;
+        if (blocks > 2 * gen->max_blocks) {
+            sync_forced = true;
+        }
+        if (sync_forced || mark_queue_len == 0) {
+            return gen->no - 1;
+        }
+        return stg_min(collect_gen, gen->no - 1);
+    }
+
+    // a major GC finishes an outstanding lazy sweep first
+    if (collect_gen == gen->no && gen->mark && !gen->compact
+        && !lazySweepPending(gen)) {
+        *start = true;
+        return gen->no - 1;
+    }
+    return collect_gen;
+}
+
+void
+requestConcMark (void)
+{
+    start_requested = true;
+}
+
+/* -----------------------------------------------------------------------------
+   Called by GarbageCollect()
+   -------------------------------------------------------------------------- */
+
+static void
+reset_conc_mark (void)
+{
+    snapshot_head = NULL;
+    snapshot_words = 0;
+    marked_words = 0;
+    mark_queue_len = 0;
+    mark_queue_size = 0;
+    stgFree(mark_queue);
+    mark_queue = NULL;
+    trace_ptrs_size = 0;
+    stgFree(trace_ptrs);
+    trace_ptrs = NULL;
+    if (marked_statics != NULL) {
+        freeHashTable(marked_statics, NULL);
+        marked_statics = NULL;
+    }
+    sync_forced = false;
+    conc_mark_active = false;
+}
+
+// Drop the cycle: a major GC is about to mark everything anyway.
+static void
+abandon_conc_mark (void)
+{
+    generation *gen = oldest_gen;
+    bdescr *bd;
+
+    debugTrace(DEBUG_gc, "concurrent mark: abandoned");
+
+    for (bd = snapshot_head; bd != NULL; bd = bd->link) {
+        bd->flags &= ~BF_CONC_MARK;
+    }
+    for (bd = gen->large_objects; bd != NULL; bd = bd->link) {
+        bd->flags &= ~(BF_CONC_MARK | BF_CONC_MARKED);
+    }
+    for (bd = gen->compact_objects; bd != NULL; bd = bd->link) {
+        bd->flags &= ~(BF_CONC_MARK | BF_CONC_MARKED);
+    }
+    if (gen->bitmap != NULL) {
+        freeGroup(gen->bitmap);
+        gen->bitmap = NULL;
+    }
+    reset_conc_mark();
+}
+
+// Stop the marker for the duration of the GC.  Returns true if this GC
+// should finish the mark.
+bool
+pauseConcMark (bool major)
+{
+    ACQUIRE_LOCK(&marker_mutex);
+    marker_run = false;
+    while (marker_busy) {
+        waitCondition(&marker_idle_cond, &marker_mutex);
+    }
+    RELEASE_LOCK(&marker_mutex);
+
+    if (!conc_mark_active) return false;
+
+    if (major) {
+        abandon_conc_mark();
+        return false;
+    }
+
+    // the final sync must scan all the younger generations
+    return N == oldest_gen->no - 1
+        && (sync_forced || mark_queue_len == 0 || !marker_running);
+}
+
+// Take the snapshot, if scheduleDoGC() asked for a cycle.  Called
+// before the GC evacuates anything.  Returns true if the cycle started.
+bool
+startConcMark (void)
+{
+    generation *gen = oldest_gen;
+    gen_workspace *ws;
+    bdescr *bd, *next, *bitmap_bdescr;
+    StgWord *bitmap;
+    W_ n_blocks, bitmap_size;
+    uint32_t n;
+
+    if (!start_requested) return false;
+    start_requested = false;
+
+    if (conc_mark_active || N != gen->no - 1 || !gen->mark || gen->compact
+        || lazySweepPending(gen)) {
+        return false;
+    }
+
+    // grab the partly-filled blocks in the gc_thread workspaces, as
+    // prepare_collected_gen() does, so that everything in the
+    // generation is in gen->blocks.
+    for (n = 0; n < n_capabilities; n++) {
+        ws = &gc_threads[n]->gens[gen->no];
+
+        for (bd = ws->part_list; bd != NULL; bd = next) {
+            next = bd->link;
+            bd->link = gen->blocks;
+            gen->blocks = bd;
+            gen->n_blocks += bd->blocks;
+            gen->n_words += bd->free - bd->start;
+        }
+        ws->part_list = NULL;
+        ws->n_part_blocks = 0;
+        ws->n_part_words = 0;
+
+        if (ws->todo_free != ws->todo_bd->start) {
+            ws->todo_bd->free = ws->todo_free;
+            ws->todo_bd->link = gen->blocks;
+            gen->blocks = ws->todo_bd;
+            gen->n_blocks += ws->todo_bd->blocks;
+            gen->n_words += ws->todo_bd->free - ws->todo_bd->start;
+            alloc_todo_block(ws,0); // always has one block.
+        }
+    }
+
+    // the mark bitmap, as in prepare_collected_gen()
+    n_blocks = gen->n_blocks;
+    bitmap_size = n_blocks * BLOCK_SIZE / BITS_IN(W_);
+
+    ASSERT(gen->bitmap == NULL);
+    if (bitmap_size > 0) {
+        bitmap_bdescr = allocGroup((StgWord)BLOCK_ROUND_UP(bitmap_size)
+                                   / BLOCK_SIZE);
+        gen->bitmap = bitmap_bdescr;
+        bitmap = bitmap_bdescr->start;
+
+        memset(bitmap, 0, bitmap_size);
+
+        for (bd = gen->blocks; bd != NULL; bd = bd->link) {
+            bd->u.bitmap = bitmap;
+            bitmap += BLOCK_SIZE_W / BITS_IN(W_);
+            bd->flags |= BF_CONC_MARK;
+        }
+    }
+
+    for (bd = gen->large_objects; bd != NULL; bd = bd->link) {
+        for (n = 0; n < n_capabilities; n++) {
+            if (capabilities[n]->pinned_object_block == bd) break;
+        }
+        // the mutator is still allocating in this one
+        if (n < n_capabilities) continue;
+        bd->flags |= BF_CONC_MARK;
+    }
+
+    for (bd = gen->compact_objects; bd != NULL; bd = bd->link) {
+        bd->flags |= BF_CONC_MARK;
+    }
+
+    snapshot_head = gen->blocks;
+    snapshot_words = gen->n_words;
+    marked_words = 0;
+    marked_statics = allocHashTable();
+    sync_forced = false;
+    conc_mark_active = true;
+
+    debugTrace(DEBUG_gc, "concurrent mark: started, %ld blocks",
+               (long)(n_blocks + gen->n_large_blocks + gen->n_compact_blocks));
+
+    return true;
+}
+
+static bool
+is_live (StgClosure *p)
+{
+    bdescr *bd;
+
+    p = UNTAG_CLOSURE(p);
+    if (!HEAP_ALLOCED_GC(p)) return true;
+    bd = snapshot_bdescr(p);
+    return bd == NULL || is_marked_object(p, bd);
+}
+
+// Finish the marking, in the GC that the mark is complete.  The weak
+// pointers in the snapshot are treated as in traverseWeakPtrList():
+// those with a live key are live, and keep their value and finalizer
+// alive, and the others are dead, and go on dead_weak_ptr_list so that
+// their finalizers run.
+void
+syncConcMark (void)
+{
+    generation *gen = oldest_gen;
+    StgWeak *w, *next, **last, *pending, *live;
+    bool changed;
+
+    drain_mark_queue();
+
+    pending = NULL;
+    live = NULL;
+    for (w = gen->weak_ptr_list; w != NULL; w = next) {
+        next = w->link;
+        if (w->header.info == &stg_DEAD_WEAK_info) {
+            // finalizeWeak# already ran it, see tidyWeakList()
+            continue;
+        }
+        if (snapshot_bdescr((StgClosure *)w) == NULL) {
+            w->link = live;
+            live = w;
+        } else {
+            w->link = pending;
+            pending = w;
+        }
+    }
+
+    do {
+        changed = false;
+        last = &pending;
+        while ((w = *last) != NULL) {
+            if (is_live(w->key)) {
+                *last = w->link;
+                mark_ptr((StgClosure *)w);
+                mark_ptr(w->value);
+                mark_ptr(w->finalizer);
+                drain_mark_queue();
+                w->link = live;
+                live = w;
+                changed = true;
+            } else {
+                last = &w->link;
+            }
+        }
+    } while (changed);
+
+    for (w = pending; w != NULL; w = next) {
+        next = w->link;
+        mark_ptr((StgClosure *)w);
+        // If we have C finalizers, keep the value alive for this GC, as
+        // collectDeadWeakPtrs() does.
+        if (w->cfinalizers != &stg_NO_FINALIZER_closure) {
+            mark_ptr(w->value);
+        }
+        mark_ptr(w->finalizer);
+        w->link = dead_weak_ptr_list;
+        dead_weak_ptr_list = w;
+    }
+    drain_mark_queue();
+
+    gen->weak_ptr_list = live;
+    conc_mark_sync = true;
+}
+
+// Remove the dead objects from the mutable list bd.  A card entry takes
+// two words, see recordMutableCardCap().
+static void
+prune_mut_list (bdescr *bd)
+{
+    StgPtr p, q;
+
+    for (; bd != NULL; bd = bd->link) {
+        q = bd->start;
+        for (p = bd->start; p < bd->free; p++) {
+            if (IS_MUT_LIST_CARD(*p)) {
+                if (!concMarkIsDead((StgClosure *)(*p & ~MUT_LIST_CARD_TAG))) {
+                    *q++ = p[0];
+                    *q++ = p[1];
+                }
+                p++;
+            } else if (!concMarkIsDead((StgClosure *)*p)) {
+                *q++ = *p;
+            }
+        }
+        bd->free = q;
+    }
+}
+
+// Free what the mark found dead.  Called after syncConcMark(), once
+// nothing else in the GC needs the marks.
+void
+finishConcMark (void)
+{
+    generation *gen = oldest_gen;
+    bdescr *bd, *next, *prev;
+    StgCompactNFData *str;
+    StgCompactNFDataBlock *block;
+    W_ large_freed = 0, compacts_freed = 0;
+    uint32_t n;
+
+    ASSERT(conc_mark_sync);
+
+    for (n = 0; n < n_capabilities; n++) {
+        prune_mut_list(capabilities[n]->mut_lists[gen->no]);
+    }
+
+    for (bd = gen->large_objects; bd != NULL; bd = next) {
+        next = bd->link;
+        if (!(bd->flags & BF_CONC_MARK)) continue;
+        if (!(bd->flags & BF_CONC_MARKED)) {
+            dbl_link_remove(bd, &gen->large_objects);
+            gen->n_large_blocks -= bd->blocks;
+            gen->n_large_words  -= bd->free - bd->start;
+            large_freed++;
+            bd->flags &= ~BF_CONC_MARK;
+            freeGroup(bd);
+            continue;
+        }
+        bd->flags &= ~(BF_CONC_MARK | BF_CONC_MARKED);
+    }
+
+    for (bd = gen->compact_objects; bd != NULL; bd = next) {
+        next = bd->link;
+        if (!(bd->flags & BF_CONC_MARK)) continue;
+        if (!(bd->flags & BF_CONC_MARKED)) {
+            dbl_link_remove(bd, &gen->compact_objects);
+            str = ((StgCompactNFDataBlock*)bd->start)->owner;
+            gen->n_compact_blocks -= str->totalW / BLOCK_SIZE_W;
+            compacts_freed++;
+            bd->flags &= ~BF_CONC_MARK;
+            // compactFree() expects from-space blocks
+            for (block = (StgCompactNFDataBlock*)bd->start; block != NULL;
+                 block = block->next) {
+                Bdescr((P_)block)->flags &= ~BF_EVACUATED;
+            }
+            compactFree(str);
+            continue;
+        }
+        bd->flags &= ~(BF_CONC_MARK | BF_CONC_MARKED);
+    }
+
+    // for resize_generations()
+    gen->live_estimate = gen->n_words - snapshot_words + marked_words;
+
+    debugTrace(DEBUG_gc, "concurrent mark: %ld of %ld words live, "
+               "%ld large objects and %ld compacts freed",
+               (long)marked_words, (long)snapshot_words,
+               (long)large_freed, (long)compacts_freed);
+
+    if (snapshot_head != NULL) {
+        prev = NULL;
+        if (gen->blocks != snapshot_head) {
+            for (prev = gen->blocks; prev->link != snapshot_head;
+                 prev = prev->link) {}
+        }
+        startLazySweepSegment(gen, prev, snapshot_head);
+    }
+
+    reset_conc_mark();
+}
+
+// Let the marker carry on at the end of the GC.
+void
+resumeConcMark (void)
+{
+    conc_mark_sync = false;
+
+    ACQUIRE_LOCK(&marker_mutex);
+    marker_run = true;
+    if (conc_mark_active) {
+        start_marker_thread();
+        signalCondition(&marker_cond);
+    }
+    RELEASE_LOCK(&marker_mutex);
+}
+
+/* -----------------------------------------------------------------------------
+   Called by the GC threads
+   -------------------------------------------------------------------------- */
+
+void
+concMarkShade (StgClosure *p)
+{
+    bdescr *bd;
+
+    p = UNTAG_CLOSURE(p);
+    bd = snapshot_bdescr(p);
+    if (bd == NULL || is_marked_object(p, bd)) return;
+
+    ACQUIRE_SPIN_LOCK(&shade_lock);
+    mark_object(p, bd);
+    RELEASE_SPIN_LOCK(&shade_lock);
+}
+
+void
+concMarkShadeStatic (StgClosure *p)
+{
+    if (!static_has_pointers(p)) return;
+
+    ACQUIRE_SPIN_LOCK(&shade_lock);
+    mark_static(p);
+    RELEASE_SPIN_LOCK(&shade_lock);
+}
+
+bool
+concMarkPremark (StgClosure *p)
+{
+    bdescr *bd;
+
+    bd = snapshot_bdescr(p);
+    if (bd == NULL || is_marked_object(p, bd)) return false;
+
+    if (bd->flags & BF_LARGE) {
+        bd->flags |= BF_CONC_MARKED;
+    } else {
+        mark((P_)p, bd);
+        marked_words += closure_sizeW(p);
+    }
+    return true;
+}
+
+bool
+concMarkIsDead (StgClosure *p)
+{
+    bdescr *bd;
+
+    p = UNTAG_CLOSURE(p);
+    if (!HEAP_ALLOCED_GC(p)) return false;
+    bd = snapshot_bdescr(p);
+    if (bd == NULL) return false;
+
+    if (conc_mark_sync) {
+        return !is_marked_object(p, bd);
+    }
+    concMarkShade(p);
+    return false;
+}
+
+#endif /* THREADED_RTS */
+
+/* -----------------------------------------------------------------------------
+   Starting and stopping the marker thread
+   -------------------------------------------------------------------------- */
+
+void
+initConcMark (void)
+{
+#if defined(THREADED_RTS)
+    initMutex(&marker_mutex);
+    initCondition(&marker_cond);
+    initCondition(&marker_idle_cond);
+    initSpinLock(&shade_lock);
+#endif
+}
+
+// Restart the marker thread, after forkProcess(), if a cycle is under
+// way.
+void
+startConcMarkThread (void)
+{
+#if defined(THREADED_RTS)
+    ACQUIRE_LOCK(&marker_mutex);
+    start_marker_thread();
+    signalCondition(&marker_cond);
+    RELEASE_LOCK(&marker_mutex);
+#endif
+}
+
+// Wait for the marker thread to exit.  The cycle is left as it is.
+void
+stopConcMarkThread (void)
+{
+#if defined(THREADED_RTS)
+    ACQUIRE_LOCK(&marker_mutex);
+    marker_stop = true;
+    signalCondition(&marker_cond);
+    while (marker_running) {
+        waitCondition(&marker_idle_cond, &marker_mutex);
+    }
+    marker_stop = false;
+    RELEASE_LOCK(&marker_mutex);
+#endif
+}
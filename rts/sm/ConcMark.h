@@ -0,0 +1,70 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Marking the oldest generation concurrently with the mutator
+ * (+RTS --concurrent-mark).  See Note [Concurrent marking] in ConcMark.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "Capability.h"
+
+#include "BeginPrivate.h"
+
+#if defined(THREADED_RTS)
+
+// true from the GC that starts a concurrent mark until the GC that
+// finishes it (or abandons it).  Only changed in a GC, by the main GC
+// thread.
+extern bool conc_mark_active;
+
+// true during the GC that finishes a concurrent mark, once the marking
+// is done: isAlive() looks at the marks from then on.
+extern bool conc_mark_sync;
+
+// Called by scheduleDoGC()
+uint32_t concMarkCollectGen   (uint32_t collect_gen, bool force_major,
+                               bool *start);
+void     requestConcMark      (void);
+
+// Called by GarbageCollect()
+bool     pauseConcMark        (bool major);
+bool     startConcMark        (void);
+void     syncConcMark         (void);
+void     finishConcMark       (void);
+void     resumeConcMark       (void);
+
+// Called by evacuate() and friends, for an object in a block with
+// BF_CONC_MARK, and for a static object.
+void     concMarkShade        (StgClosure *p);
+void     concMarkShadeStatic  (StgClosure *p);
+
+// Called by scavenge_conc_mark_threads(): p is a TSO or a STACK that
+// the marker won't look inside.  Returns false if it isn't in the
+// snapshot.
+bool     concMarkPremark      (StgClosure *p);
+
+// Called by isAlive() and pruneSparkQueue() for an object that the GC
+// would keep without evacuating it.  During the final sync, returns
+// true if the object is in the snapshot and wasn't marked; before
+// that, the object is shaded and the result is false.
+bool     concMarkIsDead       (StgClosure *p);
+
+#else
+
+#define conc_mark_active false
+#define conc_mark_sync   false
+
+#define concMarkShade(p)       /* nothing */
+#define concMarkShadeStatic(p) /* nothing */
+
+#endif
+
+// Called at startup and shutdown, and by forkProcess()
+void     initConcMark         (void);
+void     stopConcMarkThread   (void);
+void     startConcMarkThread  (void);
+
+#include "EndPrivate.h"
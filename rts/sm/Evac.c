@@ -27,6 +27,8 @@
 #include "LdvProfile.h"
 #include "CNF.h"
 #include "Scav.h"
+#include "Pinned.h"
+#include "ConcMark.h"
 
 #if defined(THREADED_RTS) && !defined(PARALLEL_GC)
 #define evacuate(p) evacuate1(p)
@@ -69,6 +71,15 @@ alloc_for_copy (uint32_t size, uint32_t gen_no)
         }
     }
 
+    // fill a hole in the oldest generation if we can, see Note
+    // [Filling holes] in Sweep.c
+    if (gct->hole_mask != 0 && gen_no == oldest_gen->no) {
+        to = alloc_in_hole(size);
+        if (to != NULL) {
+            return to;
+        }
+    }
+
     ws = &gct->gens[gen_no];  // zero memory references here
 
     /* chain a new block onto the to-space for the destination gen if
@@ -274,6 +285,9 @@ evacuate_large(StgPtr p)
         TICK_GC_FAILED_PROMOTION();
     }
     RELEASE_SPIN_LOCK(&gen->sync);
+    if (bd->flags & BF_CONC_MARK) {
+        concMarkShade((StgClosure *)p);
+    }
     return;
   }
 
@@ -338,12 +352,14 @@ evacuate_static_object (StgClosure **link_field, StgClosure *q)
 #if !defined(THREADED_RTS)
         *link_field = gct->static_objects;
         gct->static_objects = (StgClosure *)new_list_head;
+        gct->n_static_objects++;
 #else
         StgWord prev;
         prev = cas((StgVolatilePtr)link_field, link,
                    (StgWord)gct->static_objects);
         if (prev == link) {
             gct->static_objects = (StgClosure *)new_list_head;
+            gct->n_static_objects++;
         }
 #endif
     }
@@ -386,6 +402,9 @@ evacuate_compact (StgPtr p)
             gct->failed_to_evac = true;
             TICK_GC_FAILED_PROMOTION();
         }
+        if (bd->flags & BF_CONC_MARK) {
+            concMarkShade((StgClosure *)p);
+        }
         return;
     }
 
@@ -516,7 +535,13 @@ loop:
   ASSERTM(LOOKS_LIKE_CLOSURE_PTR(q), "invalid closure, info=%p", q->header.info);
 
   if (!HEAP_ALLOCED_GC(q)) {
-      if (!major_gc) return;
+      if (!major_gc) {
+          // see Note [Concurrent marking] in ConcMark.c
+          if (conc_mark_active) {
+              concMarkShadeStatic(q);
+          }
+          return;
+      }
 
       info = get_itbl(q);
       switch (info->type) {
@@ -570,6 +595,13 @@ loop:
       // happen often, but allowing it makes certain things a bit
       // easier; e.g. scavenging an object is idempotent, so it's OK to
       // have an object on the mutable list multiple times.
+
+      // A pinned object in a block whose holes we want to reuse has to
+      // be marked, see Note [Reusing pinned holes] in Pinned.c.
+      if (bd->flags & BF_PINNED_MARKS) {
+          markPinnedObject((P_)q, bd);
+      }
+
       if (bd->flags & BF_EVACUATED) {
           // We aren't copying this object, so we have to check
           // whether it is already in the target generation.  (this is
@@ -578,6 +610,11 @@ loop:
               gct->failed_to_evac = true;
               TICK_GC_FAILED_PROMOTION();
           }
+          // the object is in the snapshot of a concurrent mark: it must
+          // be marked, see Note [Concurrent marking] in ConcMark.c
+          if (bd->flags & BF_CONC_MARK) {
+              concMarkShade(q);
+          }
           return;
       }
 
@@ -906,6 +943,9 @@ evacuate_BLACKHOLE(StgClosure **p)
             gct->failed_to_evac = true;
             TICK_GC_FAILED_PROMOTION();
         }
+        if (bd->flags & BF_CONC_MARK) {
+            concMarkShade(q);
+        }
         return;
     }
     if (bd->flags & BF_MARKED) {
@@ -1047,6 +1087,9 @@ selector_chain:
         if (bd->flags & BF_EVACUATED) {
             unchain_thunk_selectors(prev_thunk_selector, (StgClosure *)p);
             *q = (StgClosure *)p;
+            if (bd->flags & BF_CONC_MARK) {
+                concMarkShade((StgClosure *)p);
+            }
             // shortcut, behave as for:  if (evac) evacuate(q);
             if (evac && bd->gen_no < gct->evac_gen_no) {
                 gct->failed_to_evac = true;
@@ -27,6 +27,8 @@
 #include "MarkWeak.h"
 #include "Sparks.h"
 #include "Sweep.h"
+#include "Pinned.h"
+#include "ConcMark.h"
 
 #include "Arena.h"
 #include "Storage.h"
@@ -38,6 +40,7 @@
 #include "Sanity.h"
 #include "BlockAlloc.h"
 #include "ProfHeap.h"
+#include "HeapSnapshot.h"
 #include "Weak.h"
 #include "Prelude.h"
 #include "RtsSignals.h"
@@ -116,6 +119,7 @@ static W_ g0_pcnt_kept = 30; // percentage of g0 live at last minor GC
 #if defined(DEBUG)
 uint32_t mutlist_MUTVARS,
     mutlist_MUTARRS,
+    mutlist_CARDS,
     mutlist_MVARS,
     mutlist_TVAR,
     mutlist_TVAR_WATCH_QUEUE,
@@ -138,9 +142,27 @@ StgWord8 the_gc_thread[sizeof(gc_thread) + 64 * sizeof(gen_workspace)]
 // step->todos[] lists we have to look in to find work.
 uint32_t n_gc_threads;
 
+// Number of threads compacting the oldest generation in this GC.  See
+// Note [Parallel compaction] in Compact.c.
+uint32_t n_compact_threads = 1;
+
 // For stats:
 static long copied;        // *words* copied & scavenged during this GC
 
+// Segments of the stable pointer table, handed out to the GC threads
+// by mark_stable_ptrs().
+static uint32_t n_stable_ptr_segments;
+static volatile StgWord next_stable_ptr_segment;
+
+#if defined(THREADED_RTS)
+// The other GC threads help the main one with the weak pointers, in
+// rounds; see Note [Parallel weak pointer processing] in MarkWeak.c.
+static uint32_t n_gc_workers;                  // other GC threads running
+static volatile StgWord weak_round;            // bumped to start a round
+static volatile StgWord weak_rounds_done;      // no more rounds in this GC
+static volatile StgWord n_weak_round_waiting;  // workers waiting for a round
+#endif
+
 #if defined(PROF_SPIN) && defined(THREADED_RTS)
 // spin and yield counts for the quasi-SpinLock in waitForGcThreads
 volatile StgWord64 waitForGcThreads_spin = 0;
@@ -160,6 +182,7 @@ DECLARE_GCT
    -------------------------------------------------------------------------- */
 
 static void mark_root               (void *user, StgClosure **root);
+static void mark_stable_ptrs        (void);
 static void prepare_collected_gen   (generation *gen);
 static void prepare_uncollected_gen (generation *gen);
 static void init_gc_thread          (gc_thread *t);
@@ -171,8 +194,19 @@ static StgWord inc_running          (void);
 static StgWord dec_running          (void);
 static void wakeup_gc_threads       (uint32_t me, bool idle_cap[]);
 static void shutdown_gc_threads     (uint32_t me, bool idle_cap[]);
+static void wait_for_gc_workers     (void);
+static void start_weak_round        (void);
+static void end_weak_rounds         (void);
+#if defined(THREADED_RTS)
+static bool wait_for_weak_round     (void);
+#endif
+#if defined(THREADED_RTS)
+static void wakeup_compact_threads  (uint32_t me, bool idle_cap[]);
+static void shutdown_compact_threads (uint32_t me, bool idle_cap[]);
+#endif
 static void collect_gct_blocks      (void);
 static void collect_pinned_object_blocks (void);
+static void free_mark_bitmaps       (void);
 static void heapOverflow            (void);
 
 #if defined(DEBUG)
@@ -209,8 +243,11 @@ GarbageCollect (uint32_t collect_gen,
       any_work, no_work, scav_find_work;
 #if defined(THREADED_RTS)
   gc_thread *saved_gct;
+  bool par_compact;
+  bool conc_sync;
 #endif
   uint32_t g, n;
+  bool do_heap_snapshot;
 
   // necessary if we stole a callee-saves register for gct:
 #if defined(THREADED_RTS)
@@ -242,10 +279,14 @@ GarbageCollect (uint32_t collect_gen,
   // Lock the StablePtr table. This prevents FFI calls manipulating
   // the table from occurring during GC.
   stablePtrLock();
+  freeOldStablePtrTables();
+  n_stable_ptr_segments = stablePtrTableSegments();
+  next_stable_ptr_segment = 0;
 
 #if defined(DEBUG)
   mutlist_MUTVARS = 0;
   mutlist_MUTARRS = 0;
+  mutlist_CARDS = 0;
   mutlist_MVARS = 0;
   mutlist_TVAR = 0;
   mutlist_TVAR_WATCH_QUEUE = 0;
@@ -267,6 +308,16 @@ GarbageCollect (uint32_t collect_gen,
   N = collect_gen;
   major_gc = (N == RtsFlags.GcFlags.generations-1);
 
+  // Decide now, since a snapshot needs the pinned marks and the mark
+  // bitmap from this GC; see Note [Heap snapshots] in HeapSnapshot.c.
+  do_heap_snapshot = major_gc && heapSnapshotPending();
+
+#if defined(THREADED_RTS)
+  // Stop the concurrent marker, and decide whether this GC finishes the
+  // mark; see Note [Concurrent marking] in ConcMark.c.
+  conc_sync = pauseConcMark(major_gc);
+#endif
+
   if (major_gc) {
       prev_static_flag = static_flag;
       static_flag =
@@ -301,6 +352,16 @@ GarbageCollect (uint32_t collect_gen,
   } else {
       n_gc_threads = 1;
   }
+
+  /* Marking the oldest generation is sequential, so if this is a
+   * parallel compacting GC (+RTS -qc) we mark on our own and the
+   * other GC threads stand by until it is time to compact, or to sweep.
+   */
+  par_compact = false;
+  if (n_gc_threads > 1 && major_gc && oldest_gen->mark) {
+      par_compact = true;
+      n_gc_threads = 1;
+  }
 #else
   n_gc_threads = 1;
 #endif
@@ -313,6 +374,14 @@ GarbageCollect (uint32_t collect_gen,
   memInventory(DEBUG_gc);
 #endif
 
+  // scheduleDoGC() finishes any lazy sweeping before a major GC
+  ASSERT(!major_gc || !lazySweepPending(oldest_gen));
+
+  // the holes left by the last sweep are in blocks we are collecting
+  if (major_gc && RtsFlags.GcFlags.fillHoles) {
+      discardHoles();
+  }
+
   // do this *before* we start scavenging
   collectFreshWeakPtrs();
 
@@ -332,6 +401,13 @@ GarbageCollect (uint32_t collect_gen,
       prepare_uncollected_gen(&generations[g]);
   }
 
+  // mark the live objects in the pinned blocks we are collecting, so
+  // that we can reuse the space between them, or so that a heap
+  // snapshot can find them
+  if (RtsFlags.GcFlags.reusePinned || do_heap_snapshot) {
+      preparePinnedBlocks(N, do_heap_snapshot);
+  }
+
   // Prepare this gc_thread
   init_gc_thread(gct);
 
@@ -349,6 +425,15 @@ GarbageCollect (uint32_t collect_gen,
       mark_sp           = NULL;
   }
 
+#if defined(THREADED_RTS)
+  // Start a concurrent mark of the oldest generation, if the scheduler
+  // asked for one.  The threads in the snapshot are scavenged now,
+  // because the marker doesn't look inside them.
+  if (startConcMark()) {
+      scavenge_conc_mark_threads();
+  }
+#endif
+
   /* -----------------------------------------------------------------------
    * follow all the roots that we know about:
    */
@@ -406,8 +491,8 @@ GarbageCollect (uint32_t collect_gen,
   markWeakPtrList();
   initWeakForGC();
 
-  // Mark the stable pointer table.
-  markStablePtrTable(mark_root, gct);
+  // Mark the stable pointer table, or whatever is left of it.
+  mark_stable_ptrs();
 
   // Remember old stable name addresses.
   rememberOldStableNameAddresses ();
@@ -419,22 +504,35 @@ GarbageCollect (uint32_t collect_gen,
   for (;;)
   {
       scavenge_until_all_done();
-      // The other threads are now stopped.  We might recurse back to
-      // here, but from now on this is the only thread.
+      // Wait for the other threads to stop too.  They wait for us to
+      // decide whether there is another round of work.
+      wait_for_gc_workers();
 
       // must be last...  invariant is that everything is fully
       // scavenged at this point.
       if (traverseWeakPtrList()) { // returns true if evaced something
-          inc_running();
+          // All the GC threads tidy the weak pointers, if
+          // traverseWeakPtrList() asked for that, and scavenge again.
+          start_weak_round();
+          tidyWeakPtrs();
           continue;
       }
 
       // If we get to here, there's really nothing left to do.
       break;
   }
+  end_weak_rounds();
 
   shutdown_gc_threads(gct->thread_index, idle_cap);
 
+#if defined(THREADED_RTS)
+  // Everything that points into the snapshot has been scanned: finish
+  // the concurrent mark, before anything looks at the marks.
+  if (conc_sync) {
+      syncConcMark();
+  }
+#endif
+
   // Now see which stable names are still alive.
   gcStableNameTable();
 
@@ -450,6 +548,11 @@ GarbageCollect (uint32_t collect_gen,
          }
       }
   }
+
+  // Free what the concurrent mark found dead, and start sweeping.
+  if (conc_mark_sync) {
+      finishConcMark();
+  }
 #endif
 
 #if defined(PROFILING)
@@ -465,12 +568,37 @@ GarbageCollect (uint32_t collect_gen,
 
   // NO MORE EVACUATION AFTER THIS POINT!
 
-  // Finally: compact or sweep the oldest generation.
+  // find the holes in the pinned blocks that survived, before the dead
+  // ones are freed.  See Note [Reusing pinned holes] in Pinned.c.
+  if (RtsFlags.GcFlags.reusePinned || do_heap_snapshot) {
+      collectPinnedHoles(major_gc);
+  }
+
+  // Finally: compact or sweep the oldest generation.  A lazy sweep
+  // leaves most of the work for the mutator, see Note [Lazy sweeping];
+  // the heap census needs to see a fully swept heap, though.
   if (major_gc && oldest_gen->mark) {
-      if (oldest_gen->compact)
+#if defined(THREADED_RTS)
+      if (par_compact) {
+          wakeup_compact_threads(gct->thread_index, idle_cap);
+      }
+#endif
+      if (oldest_gen->compact) {
+          stat_startCompact();
           compact(gct->scavenged_static_objects);
+          stat_endCompact(n_compact_threads);
+      }
+      else if (RtsFlags.GcFlags.lazySweep && !RtsFlags.GcFlags.fillHoles
+               && !do_heap_census)
+          startLazySweep(oldest_gen);
       else
-          sweep(oldest_gen);
+          sweep(oldest_gen, gct);
+#if defined(THREADED_RTS)
+      if (par_compact) {
+          shutdown_compact_threads(gct->thread_index, idle_cap);
+          n_compact_threads = 1;
+      }
+#endif
   }
 
   copied = 0;
@@ -557,9 +685,10 @@ GarbageCollect (uint32_t collect_gen,
         copied +=  mut_list_size;
 
         debugTrace(DEBUG_gc,
-                   "mut_list_size: %lu (%d vars, %d arrays, %d MVARs, %d TVARs, %d TVAR_WATCH_QUEUEs, %d TREC_CHUNKs, %d TREC_HEADERs, %d others)",
+                   "mut_list_size: %lu (%d vars, %d arrays, %d cards, %d MVARs, %d TVARs, %d TVAR_WATCH_QUEUEs, %d TREC_CHUNKs, %d TREC_HEADERs, %d others)",
                    (unsigned long)(mut_list_size * sizeof(W_)),
-                   mutlist_MUTVARS, mutlist_MUTARRS, mutlist_MVARS,
+                   mutlist_MUTVARS, mutlist_MUTARRS, mutlist_CARDS,
+                   mutlist_MVARS,
                    mutlist_TVAR, mutlist_TVAR_WATCH_QUEUE,
                    mutlist_TREC_CHUNK, mutlist_TREC_HEADER,
                    mutlist_OTHERS);
@@ -717,13 +846,10 @@ GarbageCollect (uint32_t collect_gen,
       freeChain(mark_stack_top_bd);
   }
 
-  // Free any bitmaps.
-  for (g = 0; g <= N; g++) {
-      gen = &generations[g];
-      if (gen->bitmap != NULL) {
-          freeGroup(gen->bitmap);
-          gen->bitmap = NULL;
-      }
+  // Free any bitmaps, except one still needed for lazy sweeping or a
+  // heap snapshot.
+  if (!do_heap_snapshot) {
+      free_mark_bitmaps();
   }
 
   resize_nursery();
@@ -779,6 +905,18 @@ GarbageCollect (uint32_t collect_gen,
       ACQUIRE_SM_LOCK;
   }
 
+  // A heap snapshot needs a major GC, and for the same reason as the
+  // heap census it must come before resurrectThreads().  See Note
+  // [Heap snapshots] in HeapSnapshot.c.
+  if (do_heap_snapshot) {
+      debugTrace(DEBUG_sched, "writing heap snapshot");
+      RELEASE_SM_LOCK;
+      writeHeapSnapshots();
+      ACQUIRE_SM_LOCK;
+      free_mark_bitmaps();
+  }
+  releasePinnedMarks();
+
   // send exceptions to any threads which were about to die
   RELEASE_SM_LOCK;
   resurrectThreads(resurrected_threads);
@@ -828,6 +966,13 @@ GarbageCollect (uint32_t collect_gen,
 
       need = BLOCKS_TO_MBLOCKS(need);
 
+      // Empty the block magazines, so that they don't keep otherwise
+      // free megablocks alive.  See Note [Block magazines].
+      for (i = 0; i < n_capabilities; i++) {
+          spillBlockMagazine(&capabilities[i]->block_mag, 0);
+          spillBlockMagazine(&gc_threads[i]->block_mag, 0);
+      }
+
       got = mblocks_allocated;
 
       if (got > need) {
@@ -855,6 +1000,11 @@ GarbageCollect (uint32_t collect_gen,
   memInventory(DEBUG_gc);
 #endif
 
+#if defined(THREADED_RTS)
+  // let the concurrent marker carry on
+  resumeConcMark();
+#endif
+
   // ok, GC over: tell the stats department what happened.
   stat_endGC(cap, gct, live_words, copied,
              live_blocks * BLOCK_SIZE_W - live_words /* slop */,
@@ -888,6 +1038,32 @@ static void heapOverflow(void)
    Initialise the gc_thread structures.
    -------------------------------------------------------------------------- */
 
+/* Note [NUMA-aware GC]
+   ~~~~~~~~~~~~~~~~~~~~
+   GC thread n belongs to Capability n, and runs on that Capability's
+   NUMA node, capNoToNumaNode(n).  We try to keep the work of each
+   thread on memory local to that node:
+
+     - A thread copies objects into to-space blocks from its own node:
+       alloc_todo_block() allocates with allocGroup_sync(), which takes
+       the thread's node, and the thread's block magazine only holds
+       blocks from that node (Note [Block magazines] in BlockAlloc.c).
+
+     - When a thread runs out of work, it steals from the threads on its
+       own node first (steal_todo_block()), and only then from threads
+       on other nodes.  A stolen block is in the victim's memory, and
+       the objects it points to are most likely there too, so stealing
+       locally means that the copies stay on the node where the owning
+       Capability will use them.
+
+     - With +RTS --fill-holes, the holes in a swept block are given to
+       a thread on the block's node (hole_owner() in Sweep.c).
+
+   The number of words copied and the blocks stolen locally and remotely
+   are counted per node, and shown by +RTS -s when there is more than one
+   node (see stat_endGC()).
+*/
+
 static void
 new_gc_thread (uint32_t n, gc_thread *t)
 {
@@ -907,9 +1083,22 @@ new_gc_thread (uint32_t n, gc_thread *t)
 #endif
 
     t->thread_index = n;
-    t->free_blocks = NULL;
+    initBlockMagazine(&t->block_mag, capNoToNumaNode(n));
     t->gc_count = 0;
 
+#if defined(THREADED_RTS)
+    t->array_q = newWSDeque(128);
+    t->free_array_chunks = NULL;
+    t->array_chunk_blocks = NULL;
+#endif
+
+    for (g = 0; g < N_HOLE_CLASSES; g++) {
+        t->hole_lists[g] = NULL;
+    }
+    t->hole_mask = 0;
+    t->hole_todo_bd = NULL;
+    t->hole_todo_sp = NULL;
+
     init_gc_thread(t);
 
     for (g = 0; g < RtsFlags.GcFlags.generations; g++)
@@ -963,6 +1152,7 @@ initGcThreads (uint32_t from USED_IF_THREADS, uint32_t to USED_IF_THREADS)
     } else {
         gc_threads = stgMallocBytes (to * sizeof(gc_thread*),
                                      "initGcThreads");
+        initSpinLock(&static_pool_sync);
     }
 
     for (i = from; i < to; i++) {
@@ -993,6 +1183,7 @@ freeGcThreads (void)
             {
                 freeWSDeque(gc_threads[i]->gens[g].todo_q);
             }
+            freeWSDeque(gc_threads[i]->array_q);
             stgFree (gc_threads[i]);
         }
         stgFree (gc_threads);
@@ -1057,6 +1248,9 @@ any_work (void)
 #if defined(THREADED_RTS)
     if (work_stealing) {
         uint32_t n;
+        // static objects offered by another thread, see Note [Parallel
+        // static scavenging] in Scav.c
+        if (major_gc && static_pool_n > 0) return true;
         // look for work to steal
         for (n = 0; n < n_gc_threads; n++) {
             if (n == gct->thread_index) continue;
@@ -1064,6 +1258,7 @@ any_work (void)
                 ws = &gc_threads[n]->gens[g];
                 if (!looksEmptyWSDeque(ws->todo_q)) return true;
             }
+            if (!looksEmptyWSDeque(gc_threads[n]->array_q)) return true;
         }
     }
 #endif
@@ -1120,6 +1315,11 @@ loop:
         // scavenge_loop() to perform any pending work.
     }
 
+#if defined(THREADED_RTS)
+    // Nobody is looking at the pieces of arrays any more
+    free_array_chunk_blocks();
+#endif
+
     traceEventGcDone(gct->cap);
 }
 
@@ -1151,22 +1351,39 @@ gcWorkerThread (Capability *cap)
 
     traceEventGcWork(gct->cap);
 
-    // Every thread evacuates some roots.
-    gct->evac_gen_no = 0;
-    markCapability(mark_root, gct, cap, true/*prune sparks*/);
-    scavenge_capability_mut_lists(cap);
-
-    scavenge_until_all_done();
+    if (major_gc && oldest_gen->mark) {
+        // The main GC thread did all the marking; we were woken up to
+        // help with compaction or sweeping.  See Note [Parallel
+        // compaction] in Compact.c and Note [Parallel sweeping] in
+        // Sweep.c.
+        if (oldest_gen->compact) {
+            compactWorker();
+        } else {
+            sweepWorker(gct);
+        }
+        traceEventGcDone(gct->cap);
+    } else {
+        // Every thread evacuates some roots.
+        gct->evac_gen_no = 0;
+        markCapability(mark_root, gct, cap, true/*prune sparks*/);
+        scavenge_capability_mut_lists(cap);
+        mark_stable_ptrs();
+
+        scavenge_until_all_done();
+
+        // Help the main GC thread with the weak pointers until it has
+        // finished with them.  See Note [Parallel weak pointer
+        // processing] in MarkWeak.c.
+        while (wait_for_weak_round()) {
+            tidyWeakPtrs();
+            scavenge_until_all_done();
+        }
 
-#if defined(THREADED_RTS)
-    // Now that the whole heap is marked, we discard any sparks that
-    // were found to be unreachable.  The main GC thread is currently
-    // marking heap reachable via weak pointers, so it is
-    // non-deterministic whether a spark will be retained if it is
-    // only reachable via weak pointers.  To fix this problem would
-    // require another GC barrier, which is too high a price.
-    pruneSparkQueue(cap);
-#endif
+        // Now that the whole heap is marked, including the parts
+        // reachable only via weak pointers, we discard any sparks that
+        // were found to be unreachable.
+        pruneSparkQueue(cap);
+    }
 
     // Wait until we're told to continue
     RELEASE_SPIN_LOCK(&gct->gc_spin);
@@ -1258,11 +1475,16 @@ wakeup_gc_threads (uint32_t me USED_IF_THREADS,
 #if defined(THREADED_RTS)
     uint32_t i;
 
+    n_gc_workers = 0;
+    weak_rounds_done = 0;
+    n_weak_round_waiting = 0;
+
     if (n_gc_threads == 1) return;
 
     for (i=0; i < n_gc_threads; i++) {
         if (i == me || idle_cap[i]) continue;
         inc_running();
+        n_gc_workers++;
         debugTrace(DEBUG_gc, "waking up gc thread %d", i);
         if (gc_threads[i]->wakeup != GC_THREAD_STANDING_BY)
             barf("wakeup_gc_threads");
@@ -1296,7 +1518,109 @@ shutdown_gc_threads (uint32_t me USED_IF_THREADS,
 #endif
 }
 
+/* ----------------------------------------------------------------------------
+   Rounds of weak pointer processing.
+
+   When the GC threads have run out of work, the main GC thread waits for
+   the others to stop (wait_for_gc_workers) and calls traverseWeakPtrList().
+   If that finds more to do, start_weak_round() sets all the GC threads
+   going again; otherwise end_weak_rounds() lets the others finish.  See
+   Note [Parallel weak pointer processing] in MarkWeak.c.
+   ------------------------------------------------------------------------- */
+
+static void
+wait_for_gc_workers (void)
+{
+#if defined(THREADED_RTS)
+    while (n_weak_round_waiting != n_gc_workers) {
+        busy_wait_nop();
+    }
+    // nobody increments this again until we start the next round
+    n_weak_round_waiting = 0;
+#endif
+}
+
+static void
+start_weak_round (void)
+{
+    inc_running();
+#if defined(THREADED_RTS)
+    uint32_t i;
+
+    for (i = 0; i < n_gc_workers; i++) {
+        inc_running();
+    }
+    write_barrier();
+    weak_round++;
+#endif
+}
+
+static void
+end_weak_rounds (void)
+{
 #if defined(THREADED_RTS)
+    weak_rounds_done = 1;
+    write_barrier();
+    weak_round++;
+#endif
+}
+
+#if defined(THREADED_RTS)
+// Called by a GC thread other than the main one when it has run out of
+// work: wait until the main GC thread starts another round, and return
+// false if it has finished instead.
+static bool
+wait_for_weak_round (void)
+{
+    StgWord round = weak_round;
+
+    atomic_inc(&n_weak_round_waiting, 1);
+    while (weak_round == round) {
+        busy_wait_nop();
+    }
+    load_load_barrier();
+    return !weak_rounds_done;
+}
+#endif
+
+#if defined(THREADED_RTS)
+// In a parallel compacting GC the other GC threads stand by while we
+// mark (see GarbageCollect()).  Wake them up to help with compaction.
+static void
+wakeup_compact_threads (uint32_t me, bool idle_cap[])
+{
+    uint32_t i;
+
+    n_compact_threads = 1;
+    for (i=0; i < n_capabilities; i++) {
+        if (i == me || idle_cap[i]) continue;
+        debugTrace(DEBUG_gc, "waking up gc thread %d to compact", i);
+        if (gc_threads[i]->wakeup != GC_THREAD_STANDING_BY)
+            barf("wakeup_compact_threads");
+
+        n_compact_threads++;
+        gc_threads[i]->wakeup = GC_THREAD_RUNNING;
+        ACQUIRE_SPIN_LOCK(&gc_threads[i]->mut_spin);
+        RELEASE_SPIN_LOCK(&gc_threads[i]->gc_spin);
+    }
+}
+
+// Wait for the compacting threads to finish, so that
+// releaseGCThreads() finds them all waiting to continue.
+static void
+shutdown_compact_threads (uint32_t me, bool idle_cap[])
+{
+    uint32_t i;
+
+    for (i=0; i < n_capabilities; i++) {
+        if (i == me || idle_cap[i]) continue;
+        while (gc_threads[i]->wakeup != GC_THREAD_WAITING_TO_CONTINUE) {
+            busy_wait_nop();
+            write_barrier();
+        }
+    }
+}
+
 void
 releaseGCThreads (Capability *cap USED_IF_THREADS, bool idle_cap[])
 {
@@ -1555,6 +1879,23 @@ collect_pinned_object_blocks (void)
     }
 }
 
+// Free the mark bitmaps of the generations we collected, except one
+// still needed for lazy sweeping.
+static void
+free_mark_bitmaps (void)
+{
+    generation *gen;
+    uint32_t g;
+
+    for (g = 0; g <= N; g++) {
+        gen = &generations[g];
+        if (gen->bitmap != NULL && !lazySweepPending(gen)) {
+            freeGroup(gen->bitmap);
+            gen->bitmap = NULL;
+        }
+    }
+}
+
 /* -----------------------------------------------------------------------------
    Initialise a gc_thread before GC
    -------------------------------------------------------------------------- */
@@ -1564,6 +1905,7 @@ init_gc_thread (gc_thread *t)
 {
     t->static_objects = END_OF_STATIC_OBJECT_LIST;
     t->scavenged_static_objects = END_OF_STATIC_OBJECT_LIST;
+    t->n_static_objects = 0;
     t->scan_bd = NULL;
     t->mut_lists = t->cap->mut_lists;
     t->evac_gen_no = 0;
@@ -1575,6 +1917,11 @@ init_gc_thread (gc_thread *t)
     t->any_work = 0;
     t->no_work = 0;
     t->scav_find_work = 0;
+    t->steals_local = 0;
+    t->steals_remote = 0;
+    t->static_scavenged = 0;
+    t->static_steals = 0;
+    t->static_time = 0;
 }
 
 /* -----------------------------------------------------------------------------
@@ -1586,9 +1933,10 @@ mark_root(void *user USED_IF_THREADS, StgClosure **root)
 {
     // we stole a register for gct, but this function is called from
     // *outside* the GC where the register variable is not in effect,
-    // so we need to save and restore it here.  NB. only call
-    // mark_root() from the main GC thread, otherwise gct will be
-    // incorrect.
+    // so we need to save and restore it here.  NB. 'user' must be the
+    // gc_thread of the GC thread calling mark_root(), otherwise gct will
+    // be incorrect.  Usually that is the main GC thread, but every GC
+    // thread marks the stable pointer table (mark_stable_ptrs()).
 #if defined(THREADED_RTS)
     gc_thread *saved_gct;
     saved_gct = gct;
@@ -1600,6 +1948,23 @@ mark_root(void *user USED_IF_THREADS, StgClosure **root)
     SET_GCT(saved_gct);
 }
 
+/* -----------------------------------------------------------------------------
+   Mark segments of the stable pointer table until there are none left.
+   Every GC thread calls this, so the table is marked in parallel; see
+   Note [Stable pointer table] in StablePtr.c.
+   -------------------------------------------------------------------------- */
+
+static void
+mark_stable_ptrs (void)
+{
+    StgWord i;
+
+    while ((i = atomic_inc(&next_stable_ptr_segment, 1) - 1) <
+           n_stable_ptr_segments) {
+        markStablePtrSegment(i, mark_root, gct);
+    }
+}
+
 /* ----------------------------------------------------------------------------
    Reset the sizes of the older generations when we do a major
    collection.
@@ -1614,7 +1979,7 @@ resize_generations (void)
 {
     uint32_t g;
 
-    if (major_gc && RtsFlags.GcFlags.generations > 1) {
+    if ((major_gc || conc_mark_sync) && RtsFlags.GcFlags.generations > 1) {
         W_ live, size, min_alloc, words;
         const W_ max  = RtsFlags.GcFlags.maxHeapSize;
         const W_ gens = RtsFlags.GcFlags.generations;
@@ -1884,6 +2249,12 @@ static void gcCAFs(void)
    preferably when it is idle.  It's safe for multiple capabilities to
    call doIdleGCWork().
 
+   The work we currently leave behind is sweeping the oldest
+   generation (see Note [Lazy sweeping] in Sweep.c) and running C
+   finalizers.  The sweeping only has to be finished before the next
+   major GC, so scheduleDoGC() only asks for all of the work then;
+   before a minor GC it sweeps a paced amount with paceLazySweep().
+
    When 'all' is
      * false: doIdleGCWork() should only take a short, bounded, amount
        of time.
@@ -1896,5 +2267,15 @@ static void gcCAFs(void)
 
 bool doIdleGCWork(Capability *cap STG_UNUSED, bool all)
 {
-    return runSomeFinalizers(all);
+    bool more;
+
+    if (all) {
+        finishLazySweep();
+        runSomeFinalizers(true);
+        return false;
+    }
+
+    more = sweepSomeBlocks();
+    more = runSomeFinalizers(false) || more;
+    return more;
 }
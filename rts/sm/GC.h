@@ -30,6 +30,7 @@ bool doIdleGCWork(Capability *cap, bool all);
 
 extern uint32_t N;
 extern bool major_gc;
+extern uint32_t n_compact_threads;
 
 extern bdescr *mark_stack_bd;
 extern bdescr *mark_stack_top_bd;
@@ -39,6 +40,7 @@ extern bool work_stealing;
 
 #if defined(DEBUG)
 extern uint32_t mutlist_MUTVARS, mutlist_MUTARRS, mutlist_MVARS, mutlist_OTHERS,
+    mutlist_CARDS,
     mutlist_TVAR,
     mutlist_TVAR_WATCH_QUEUE,
     mutlist_TREC_CHUNK,
@@ -17,6 +17,8 @@
 #include "Capability.h"
 #include "Trace.h"
 #include "Schedule.h"
+#include "Pinned.h"
+#include "ConcMark.h"
 // DO NOT include "GCTDecl.h", we don't want the register variable
 
 /* -----------------------------------------------------------------------------
@@ -60,6 +62,20 @@ isAlive(StgClosure *p)
     // ignore closures in generations that we're not collecting.
     bd = Bdescr((P_)q);
 
+    // a pinned object whose block is being marked is alive only if it
+    // was marked itself, see Note [Reusing pinned holes] in Pinned.c
+    if (bd->flags & BF_PINNED_MARKS) {
+        return isPinnedObjectMarked((P_)q, bd) ? p : NULL;
+    }
+
+#if defined(THREADED_RTS)
+    // an object in the snapshot of a concurrent mark is alive only if
+    // the mark found it, see Note [Concurrent marking] in ConcMark.c
+    if (conc_mark_active && concMarkIsDead(q)) {
+        return NULL;
+    }
+#endif
+
     // if it's a pointer into to-space, then we're done
     if (bd->flags & BF_EVACUATED) {
         return p;
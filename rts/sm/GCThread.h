@@ -15,6 +15,8 @@
 
 #include "WSDeque.h"
 #include "GetTime.h" // for Ticks
+#include "BlockAlloc.h" // for BlockMagazine
+#include "HoleLists.h" // for N_HOLE_CLASSES
 
 #include "BeginPrivate.h"
 
@@ -116,6 +118,15 @@ typedef struct gen_workspace_ {
    of the GC threads
    ------------------------------------------------------------------------- */
 
+/* A piece of a huge array, waiting on some thread's array_q to be
+ * scavenged.  See Note [Scavenging huge arrays] in Scav.c.
+ */
+typedef struct ArrayChunk_ {
+    StgClosure *arr;               // MUT_ARR_PTRS or SMALL_MUT_ARR_PTRS
+    W_ from, to;                   // its cards, or elements if small
+    struct ArrayChunk_ *link;      // on free_array_chunks
+} ArrayChunk;
+
 /* values for the wakeup field */
 #define GC_THREAD_INACTIVE             0
 #define GC_THREAD_STANDING_BY          1
@@ -133,18 +144,37 @@ typedef struct gc_thread_ {
 #endif
     uint32_t thread_index;         // a zero based index identifying the thread
 
-    bdescr * free_blocks;          // a buffer of free blocks for this thread
+    BlockMagazine block_mag;       // a buffer of free blocks for this thread
                                    //  during GC without accessing the block
-                                   //   allocators spin lock.
+                                   //   allocators spin lock.  See
+                                   //   Note [Block magazines] in BlockAlloc.c
+
+    // Holes in the oldest generation that alloc_for_copy() can fill
+    // (+RTS --fill-holes), and the objects that we copied into them
+    // but have not scavenged yet.
+    StgPtr   hole_lists[N_HOLE_CLASSES]; // free holes, by size class
+    StgWord  hole_mask;            // bit n set <=> hole_lists[n] != NULL
+    bdescr * hole_todo_bd;         // stack of objects copied into holes
+    StgPtr   hole_todo_sp;
 
     // These two lists are chained through the STATIC_LINK() fields of static
     // objects.  Pointers are tagged with the current static_flag, so before
     // following a pointer, untag it with UNTAG_STATIC_LIST_PTR().
     StgClosure* static_objects;            // live static objects
     StgClosure* scavenged_static_objects;  // static objects scavenged so far
+    W_ n_static_objects;                   // length of static_objects
 
     W_ gc_count;                   // number of GCs this thread has done
 
+#if defined(THREADED_RTS)
+    // Pieces of huge arrays for us or other threads to scavenge, and
+    // the memory for their descriptors.  See Note [Scavenging huge
+    // arrays] in Scav.c.
+    WSDeque *    array_q;
+    ArrayChunk * free_array_chunks;
+    bdescr *     array_chunk_blocks;
+#endif
+
     // block that is currently being scanned
     bdescr *     scan_bd;
 
@@ -186,6 +216,11 @@ typedef struct gc_thread_ {
     W_ any_work;
     W_ no_work;
     W_ scav_find_work;
+    W_ steals_local;               // blocks stolen from threads on the
+    W_ steals_remote;              // same NUMA node / on other nodes
+    W_ static_scavenged;           // static objects scavenged
+    W_ static_steals;              // lists of them taken from the pool
+    Time static_time;              // time spent scavenging them (+RTS -s)
 
     Time gc_start_cpu;   // process CPU time
     Time gc_sync_start_elapsed;  // start of GC sync
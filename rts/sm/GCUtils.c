@@ -26,64 +26,75 @@
 #include "WSDeque.h"
 #endif
 
+#include <string.h> // for memset
+
 #if defined(THREADED_RTS)
 SpinLock gc_alloc_block_sync;
 #endif
 
+// Take a single block from this thread's block magazine, refilling it
+// if necessary.  See Note [Block magazines] in BlockAlloc.c.
+static bdescr *
+allocMagazineBlock_sync(void)
+{
+    BlockMagazine *mag = &gct->block_mag;
+
+    if (mag->blocks == NULL) {
+        // We have to hold the lock until we've finished fiddling with
+        // the metadata, otherwise the block allocator can get confused.
+        ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
+        refillBlockMagazine(mag);
+        RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
+        mag->refills++;
+    } else {
+        mag->hits++;
+    }
+    return takeMagazineBlock(mag);
+}
+
 bdescr* allocGroup_sync(uint32_t n)
 {
-    bdescr *bd;
-    uint32_t node = capNoToNumaNode(gct->thread_index);
-    ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
-    bd = allocGroupOnNode(node,n);
-    RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
-    return bd;
+    return allocGroupOnNode_sync(capNoToNumaNode(gct->thread_index), n);
 }
 
 bdescr* allocGroupOnNode_sync(uint32_t node, uint32_t n)
 {
     bdescr *bd;
+    if (n == 1 && node == gct->block_mag.node) {
+        return allocMagazineBlock_sync();
+    }
     ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
     bd = allocGroupOnNode(node,n);
     RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
     return bd;
 }
 
-static uint32_t
-allocBlocks_sync(uint32_t n, bdescr **hd)
-{
-    bdescr *bd;
-    uint32_t i;
-    uint32_t node = capNoToNumaNode(gct->thread_index);
-    ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
-    bd = allocLargeChunkOnNode(node,1,n);
-    // NB. allocLargeChunk, rather than allocGroup(n), to allocate in a
-    // fragmentation-friendly way.
-    n = bd->blocks;
-    for (i = 0; i < n; i++) {
-        bd[i].blocks = 1;
-        bd[i].link = &bd[i+1];
-        bd[i].free = bd[i].start;
-    }
-    bd[n-1].link = NULL;
-    // We have to hold the lock until we've finished fiddling with the metadata,
-    // otherwise the block allocator can get confused.
-    RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
-    *hd = bd;
-    return n;
-}
-
 void
 freeChain_sync(bdescr *bd)
 {
-    ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
-    freeChain(bd);
-    RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
+    bdescr *next_bd;
+    while (bd != NULL) {
+        next_bd = bd->link;
+        freeGroup_sync(bd);
+        bd = next_bd;
+    }
 }
 
 void
 freeGroup_sync(bdescr *bd)
 {
+    BlockMagazine *mag = &gct->block_mag;
+
+    if (bd->blocks == 1 && bd->node == mag->node) {
+        // fill the block with garbage, as freeGroup() would
+        IF_DEBUG(sanity, memset(bd->start, 0xaa, BLOCK_SIZE));
+        if (putMagazineBlock(mag, bd)) {
+            ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
+            spillBlockMagazine(mag, MAGAZINE_BATCH);
+            RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
+        }
+        return;
+    }
     ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
     freeGroup(bd);
     RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
@@ -118,22 +129,156 @@ grab_local_todo_block (gen_workspace *ws)
 }
 
 #if defined(THREADED_RTS)
+// Steal a block of generation g from another GC thread, either one on
+// our own NUMA node (remote == false) or one on another node (remote ==
+// true).  See Note [NUMA-aware GC] in GC.c.
 bdescr *
-steal_todo_block (uint32_t g)
+steal_todo_block (uint32_t g, bool remote)
 {
-    uint32_t n;
+    uint32_t n, node;
     bdescr *bd;
 
+    node = capNoToNumaNode(gct->thread_index);
+
     // look for work to steal
     for (n = 0; n < n_gc_threads; n++) {
         if (n == gct->thread_index) continue;
+        if ((capNoToNumaNode(n) != node) != remote) continue;
         bd = stealWSDeque(gc_threads[n]->gens[g].todo_q);
         if (bd) {
+            if (remote) {
+                gct->steals_remote++;
+            } else {
+                gct->steals_local++;
+            }
             return bd;
         }
     }
     return NULL;
 }
+
+/* -----------------------------------------------------------------------------
+   The pool of static objects waiting to be scavenged, shared by all
+   the GC threads.  See Note [Parallel static scavenging] in Scav.c.
+   -------------------------------------------------------------------------- */
+
+#define STATIC_POOL_SIZE 32
+
+SpinLock static_pool_sync;
+volatile uint32_t static_pool_n = 0;
+
+static StgClosure *static_pool[STATIC_POOL_SIZE]; // tagged list heads
+static W_ static_pool_len[STATIC_POOL_SIZE];      // ... and their lengths
+
+// Offer a list of n static objects to the other GC threads.  Returns
+// false if the pool is full, in which case the list is still ours.
+bool
+push_static_objects (StgClosure *list, W_ n)
+{
+    bool ok = false;
+
+    ACQUIRE_SPIN_LOCK(&static_pool_sync);
+    if (static_pool_n < STATIC_POOL_SIZE) {
+        static_pool[static_pool_n] = list;
+        static_pool_len[static_pool_n] = n;
+        static_pool_n++;
+        ok = true;
+    }
+    RELEASE_SPIN_LOCK(&static_pool_sync);
+    return ok;
+}
+
+// Take a list of static objects from the pool to be our
+// gct->static_objects, which must be empty.
+bool
+grab_static_objects (void)
+{
+    bool ok = false;
+
+    ASSERT(gct->static_objects == END_OF_STATIC_OBJECT_LIST);
+
+    ACQUIRE_SPIN_LOCK(&static_pool_sync);
+    if (static_pool_n > 0) {
+        static_pool_n--;
+        gct->static_objects = static_pool[static_pool_n];
+        gct->n_static_objects = static_pool_len[static_pool_n];
+        ok = true;
+    }
+    RELEASE_SPIN_LOCK(&static_pool_sync);
+
+    if (ok) gct->static_steals++;
+    return ok;
+}
+
+/* -----------------------------------------------------------------------------
+   Pieces of huge arrays.  See Note [Scavenging huge arrays] in Scav.c.
+
+   The descriptors are carved out of blocks owned by the thread that
+   split the array, and recycled through the free list of the thread
+   that scavenged the piece.  They are all dead once the GC threads have
+   run out of work, when free_array_chunk_blocks() gives the blocks back.
+   -------------------------------------------------------------------------- */
+
+ArrayChunk *
+alloc_array_chunk (void)
+{
+    ArrayChunk *c;
+    bdescr *bd;
+
+    c = gct->free_array_chunks;
+    if (c != NULL) {
+        gct->free_array_chunks = c->link;
+        return c;
+    }
+
+    bd = gct->array_chunk_blocks;
+    if (bd == NULL || bd->free + sizeofW(ArrayChunk) > bd->start + BLOCK_SIZE_W) {
+        bd = allocBlock_sync();
+        bd->link = gct->array_chunk_blocks;
+        gct->array_chunk_blocks = bd;
+    }
+    c = (ArrayChunk *)bd->free;
+    bd->free += sizeofW(ArrayChunk);
+    return c;
+}
+
+void
+free_array_chunk (ArrayChunk *c)
+{
+    c->link = gct->free_array_chunks;
+    gct->free_array_chunks = c;
+}
+
+void
+free_array_chunk_blocks (void)
+{
+    gct->free_array_chunks = NULL;
+    if (gct->array_chunk_blocks != NULL) {
+        freeChain_sync(gct->array_chunk_blocks);
+        gct->array_chunk_blocks = NULL;
+    }
+}
+
+// Steal a piece of an array from another GC thread, preferring the
+// threads on our own NUMA node.
+ArrayChunk *
+steal_array_chunk (void)
+{
+    uint32_t n, node, pass;
+    ArrayChunk *c;
+
+    node = capNoToNumaNode(gct->thread_index);
+
+    for (pass = 0; pass < 2; pass++) {
+        for (n = 0; n < n_gc_threads; n++) {
+            if (n == gct->thread_index) continue;
+            if ((capNoToNumaNode(n) != node) != (pass == 1)) continue;
+            c = stealWSDeque(gc_threads[n]->array_q);
+            if (c != NULL) return c;
+        }
+    }
+    return NULL;
+}
 #endif
 
 void
@@ -322,13 +467,7 @@ alloc_todo_block (gen_workspace *ws, uint32_t size)
             bd = allocGroup_sync((W_)BLOCK_ROUND_UP(size*sizeof(W_))
                                  / BLOCK_SIZE);
         } else {
-            if (gct->free_blocks) {
-                bd = gct->free_blocks;
-                gct->free_blocks = bd->link;
-            } else {
-                allocBlocks_sync(16, &bd);
-                gct->free_blocks = bd->link;
-            }
+            bd = allocMagazineBlock_sync();
         }
         // blocks in to-space get the BF_EVACUATED flag.
         bd->flags = BF_EVACUATED;
@@ -349,3 +488,73 @@ alloc_todo_block (gen_workspace *ws, uint32_t size)
 
     return ws->todo_free;
 }
+
+/* -----------------------------------------------------------------------------
+   Filling holes in the oldest generation.  See Note [Filling holes] in
+   Sweep.c.
+   -------------------------------------------------------------------------- */
+
+// The link to the next hole is the first word of the payload.
+#define HOLE_LINK sizeofW(StgArrBytes)
+
+// Put the free space [p, p+size) on a free list of GC thread t.
+void
+add_hole (gc_thread *t, StgPtr p, W_ size)
+{
+    StgArrBytes *hole = (StgArrBytes *)p;
+
+    ASSERT(size >= HOLE_MIN_WORDS);
+    SET_ARR_HDR(hole, &stg_ARR_WORDS_info, CCS_SYSTEM,
+                (size - sizeofW(StgArrBytes)) * sizeof(W_));
+    push_hole(t->hole_lists, &t->hole_mask, hole_class(size), p, HOLE_LINK);
+}
+
+// Remember an object copied into a hole, for scavenge_holes().
+static void
+push_hole_todo (StgPtr p)
+{
+    bdescr *bd = gct->hole_todo_bd;
+
+    if (bd == NULL || gct->hole_todo_sp == bd->start + BLOCK_SIZE_W) {
+        bdescr *new_bd = allocBlock_sync();
+        new_bd->link = bd;
+        gct->hole_todo_bd = new_bd;
+        gct->hole_todo_sp = new_bd->start;
+    }
+    *gct->hole_todo_sp++ = (StgWord)p;
+}
+
+// Allocate size words in a hole of the oldest generation, or return
+// NULL if we have no hole that is big enough.
+StgPtr
+alloc_in_hole (uint32_t size)
+{
+    StgArrBytes *hole;
+    StgPtr p;
+    W_ rest;
+    uint32_t c;
+
+    // The hole must have room for the object and for an ARR_WORDS
+    // header to cover what is left of it, so look for one that is at
+    // least that big.
+    c = find_hole_class(gct->hole_mask,
+                        hole_class(size + sizeofW(StgArrBytes) - 1) + 1);
+    if (c == N_HOLE_CLASSES) return NULL;
+
+    hole = (StgArrBytes *)pop_hole(gct->hole_lists, &gct->hole_mask, c,
+                                   HOLE_LINK);
+
+    // Take the object from the end of the hole, so that the rest of
+    // it is still covered by the ARR_WORDS at the start.
+    rest = arr_words_sizeW(hole) - size;
+    p = (StgPtr)hole + rest;
+    if (rest >= HOLE_MIN_WORDS) {
+        add_hole(gct, (StgPtr)hole, rest);
+    } else {
+        hole->bytes = (rest - sizeofW(StgArrBytes)) * sizeof(W_);
+    }
+
+    push_hole_todo(p);
+    gct->copied += size;
+    return p;
+}
@@ -13,6 +13,8 @@
 
 #pragma once
 
+#include "Capability.h" // for MUT_LIST_CARD_TAG
+
 #include "BeginPrivate.h"
 
 #include "GCTDecl.h"
@@ -39,9 +41,31 @@ StgPtr  alloc_todo_block     (gen_workspace *ws, uint32_t size);
 
 bdescr *grab_local_todo_block  (gen_workspace *ws);
 #if defined(THREADED_RTS)
-bdescr *steal_todo_block       (uint32_t s);
+bdescr *steal_todo_block       (uint32_t g, bool remote);
+
+// The shared pool of static objects to scavenge; see Note [Parallel
+// static scavenging] in Scav.c.
+extern SpinLock static_pool_sync;
+extern volatile uint32_t static_pool_n;
+
+bool    push_static_objects    (StgClosure *list, W_ n);
+bool    grab_static_objects    (void);
+
+// Pieces of huge arrays; see Note [Scavenging huge arrays] in Scav.c.
+ArrayChunk *alloc_array_chunk  (void);
+void    free_array_chunk       (ArrayChunk *c);
+void    free_array_chunk_blocks (void);
+ArrayChunk *steal_array_chunk  (void);
 #endif
 
+// A free hole is an ARR_WORDS covering the whole hole, with the link to
+// the next hole in the first word of the payload.  See Note [Filling
+// holes] in Sweep.c.
+#define HOLE_MIN_WORDS (sizeofW(StgArrBytes) + 2)
+
+void    add_hole             (gc_thread *t, StgPtr p, W_ size);
+StgPtr  alloc_in_hole        (uint32_t size);
+
 // Returns true if a block is partially full.  This predicate is used to try
 // to re-use partial blocks wherever possible, and to reduce wastage.
 // We might need to tweak the actual value.
@@ -70,4 +94,22 @@ recordMutableGen_GC (StgClosure *p, uint32_t gen_no)
     *bd->free++ = (StgWord)p;
 }
 
+// Card entries take two words, which must be in the same block.
+INLINE_HEADER void
+recordMutableCardGen_GC (StgMutArrPtrs *a, W_ card, uint32_t gen_no)
+{
+    bdescr *bd;
+
+    bd = gct->mut_lists[gen_no];
+    if (bd->free + 1 >= bd->start + BLOCK_SIZE_W) {
+        bdescr *new_bd;
+        new_bd = allocBlock_sync();
+        new_bd->link = bd;
+        bd = new_bd;
+        gct->mut_lists[gen_no] = bd;
+    }
+    *bd->free++ = (StgWord)a | MUT_LIST_CARD_TAG;
+    *bd->free++ = card;
+}
+
 #include "EndPrivate.h"
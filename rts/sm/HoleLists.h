@@ -0,0 +1,77 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Free lists of holes, by size class.  Used for the holes in the swept
+ * blocks of the oldest generation (+RTS --fill-holes, see Note [Filling
+ * holes] in Sweep.c) and in partly-live pinned blocks (+RTS
+ * --reuse-pinned, see Note [Reusing pinned holes] in Pinned.c).
+ *
+ * This doesn't include GCUtils.h, because allocatePinned() uses it
+ * outside the GC.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "BeginPrivate.h"
+
+/* Class n holds the holes of between 2^n and 2^(n+1)-1 words, and bit
+ * n of the list's mask is set if and only if the list for class n is
+ * non-empty.  A hole fits in a block, so this is plenty.
+ *
+ * Each user keeps the link to the next hole in its class at its own
+ * offset in the hole: the 'link' argument below, in words.
+ */
+#define N_HOLE_CLASSES (BLOCK_SHIFT+1)
+
+// The size class of a hole: log_2(size), rounded down.
+INLINE_HEADER uint32_t
+hole_class (W_ size)
+{
+    uint32_t c = 0;
+    while (size >>= 1) c++;
+    return c;
+}
+
+// Put the hole p, of class c, on the front of its list.
+INLINE_HEADER void
+push_hole (StgPtr lists[], StgWord *mask, uint32_t c, StgPtr p, W_ link)
+{
+    ASSERT(c < N_HOLE_CLASSES);
+    p[link] = (StgWord)lists[c];
+    lists[c] = p;
+    *mask |= (StgWord)1 << c;
+}
+
+// The smallest class, no smaller than c, that has a hole, or
+// N_HOLE_CLASSES if there is none.
+INLINE_HEADER uint32_t
+find_hole_class (StgWord mask, uint32_t c)
+{
+    if (c >= N_HOLE_CLASSES) return N_HOLE_CLASSES;
+    mask >>= c;
+    if (mask == 0) return N_HOLE_CLASSES;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        c++;
+    }
+    return c;
+}
+
+// Take the first hole off the list for class c, which must not be
+// empty.
+INLINE_HEADER StgPtr
+pop_hole (StgPtr lists[], StgWord *mask, uint32_t c, W_ link)
+{
+    StgPtr p = lists[c];
+
+    ASSERT(p != NULL);
+    lists[c] = (StgPtr)p[link];
+    if (lists[c] == NULL) {
+        *mask &= ~((StgWord)1 << c);
+    }
+    return p;
+}
+
+#include "EndPrivate.h"
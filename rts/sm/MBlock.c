@@ -15,6 +15,7 @@
 #include "BlockAlloc.h"
 #include "Trace.h"
 #include "OSMem.h"
+#include "GetTime.h"
 
 #include <string.h>
 
@@ -96,6 +97,250 @@ typedef struct free_list {
 
 static free_list *free_list_head;
 static W_ mblock_high_watermark;
+
+/* -----------------------------------------------------------------------------
+   Note [Background decommit]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   When the heap shrinks, returnMemoryToOS() frees megablocks at the
+   end of a GC, while the mutator is stopped, and decommitting each
+   range of them is a system call (madvise() or VirtualFree()).  After
+   a large heap shrinks, those calls can add milliseconds to the pause.
+
+   So in the threaded RTS, if +RTS --decommit-rate is given,
+   decommitMBlocks() still does all the bookkeeping at once -- the
+   megablocks go on the free list, and can be reused straight away --
+   but it queues the range for a background OS thread instead of
+   calling osDecommitMemory().  The thread is started the first time
+   there is something to decommit.  Every DECOMMIT_INTERVAL it
+   decommits at most decommitRate * DECOMMIT_INTERVAL bytes, taking
+   the highest addresses first, so the RSS still goes down, only
+   gradually, and the system calls never hold up the GC.
+
+   The queued memory may be reused before the thread gets to it, so
+   before getReusableMBlocks() or getFreshMBlocks() commit a range they
+   take it out of the queue (cancel_decommit()).  If the thread happens
+   to be decommitting part of that range right now (decommit_busy_*),
+   we wait for it to finish: the thread doesn't hold decommit_mutex
+   during the system call, and it never takes any other lock, so this
+   wait is short and can't deadlock.
+
+   forkProcess() stops the thread before forking (stopDecommitThread()),
+   so that no decommit is in progress in the child, and both processes
+   restart it if there is still work to do (startDecommitThread()).
+
+   This is off by default: an extra thread, and memory that stays
+   resident for a while after the heap shrinks, would be a surprise for
+   programs that never asked for it.
+   -------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS)
+
+// How often the background thread decommits a batch of memory
+#define DECOMMIT_INTERVAL MSToTime(10)
+
+typedef struct decommit_range_ {
+    struct decommit_range_ *next;
+    W_ address;
+    W_ size;
+} decommit_range;
+
+static Mutex decommit_mutex;
+static Condition decommit_cond;       // work was queued, or stop
+static Condition decommit_done_cond;  // the busy range was decommitted,
+                                      // or the thread stopped
+// ranges waiting to be decommitted, by descending address
+static decommit_range *decommit_queue = NULL;
+// the range that the thread is decommitting now, if decommit_busy_size > 0
+static W_ decommit_busy_address = 0;
+static W_ decommit_busy_size = 0;
+static bool decommit_running = false;
+static bool decommit_stop = false;
+
+static void *
+decommitThread (void *arg STG_UNUSED)
+{
+    decommit_range *r;
+    W_ budget, size, address;
+    Time interval, now, next;
+
+    ACQUIRE_LOCK(&decommit_mutex);
+    while (!decommit_stop) {
+        if (decommit_queue == NULL) {
+            waitCondition(&decommit_cond, &decommit_mutex);
+            continue;
+        }
+
+        // a whole number of megablocks per batch; at slow rates, one
+        // megablock at longer intervals
+        budget = RtsFlags.GcFlags.decommitRate
+                     / (TIME_RESOLUTION / DECOMMIT_INTERVAL);
+        if (budget >= MBLOCK_SIZE) {
+            budget &= ~MBLOCK_MASK;
+            interval = DECOMMIT_INTERVAL;
+        } else {
+            budget = MBLOCK_SIZE;
+            interval = (Time)((double)MBLOCK_SIZE * TIME_RESOLUTION
+                              / RtsFlags.GcFlags.decommitRate);
+        }
+        next = getProcessElapsedTime() + interval;
+
+        while (budget > 0 && decommit_queue != NULL && !decommit_stop) {
+            // take the top of the highest range
+            r = decommit_queue;
+            size = stg_min(r->size, budget);
+            address = r->address + r->size - size;
+            r->size -= size;
+            if (r->size == 0) {
+                decommit_queue = r->next;
+                stgFree(r);
+            }
+
+            decommit_busy_address = address;
+            decommit_busy_size = size;
+            RELEASE_LOCK(&decommit_mutex);
+            osDecommitMemory((void*)address, size);
+            ACQUIRE_LOCK(&decommit_mutex);
+            decommit_busy_size = 0;
+            signalCondition(&decommit_done_cond);
+
+            budget -= size;
+        }
+
+        // wait for the next batch; new work doesn't make it come sooner
+        while (!decommit_stop) {
+            now = getProcessElapsedTime();
+            if (now >= next) break;
+            timedWaitCondition(&decommit_cond, &decommit_mutex, next - now);
+        }
+    }
+    decommit_running = false;
+    signalCondition(&decommit_done_cond);
+    RELEASE_LOCK(&decommit_mutex);
+    return NULL;
+}
+
+// Start the background thread if there is work for it.  We must hold
+// decommit_mutex.
+static void
+start_decommit_thread (void)
+{
+    OSThreadId tid;
+
+    if (decommit_running || decommit_queue == NULL) return;
+
+    decommit_running = true;
+    if (createOSThread(&tid, "ghc_decommit", decommitThread, NULL) != 0) {
+        // decommit in the GC from now on
+        decommit_running = false;
+        RtsFlags.GcFlags.decommitRate = 0;
+        sysErrorBelch("decommit thread creation failed");
+    }
+}
+
+// Queue [address, address+size) for the background thread.  Returns
+// false if the caller has to decommit it itself.
+static bool
+queue_decommit (W_ address, W_ size)
+{
+    decommit_range *r, **prev;
+
+    ACQUIRE_LOCK(&decommit_mutex);
+
+    for (prev = &decommit_queue; *prev != NULL; prev = &(*prev)->next) {
+        if ((*prev)->address < address) break;
+    }
+    r = stgMallocBytes(sizeof(decommit_range), "queue_decommit");
+    r->address = address;
+    r->size = size;
+    r->next = *prev;
+    *prev = r;
+
+    start_decommit_thread();
+    if (!decommit_running) {
+        *prev = r->next;
+        stgFree(r);
+        RELEASE_LOCK(&decommit_mutex);
+        return false;
+    }
+    signalCondition(&decommit_cond);
+
+    RELEASE_LOCK(&decommit_mutex);
+    return true;
+}
+
+// We are about to commit [address, address+size) again: make sure the
+// background thread doesn't decommit any of it.
+static void
+cancel_decommit (W_ address, W_ size)
+{
+    decommit_range *r, *high, **prev;
+    W_ end = address + size, r_end;
+
+    ACQUIRE_LOCK(&decommit_mutex);
+
+    while (decommit_busy_size != 0
+           && decommit_busy_address < end
+           && address < decommit_busy_address + decommit_busy_size) {
+        waitCondition(&decommit_done_cond, &decommit_mutex);
+    }
+
+    prev = &decommit_queue;
+    while ((r = *prev) != NULL) {
+        r_end = r->address + r->size;
+        if (r_end <= address || r->address >= end) {
+            prev = &r->next;
+        } else if (r->address < address && r_end > end) {
+            // keep both ends
+            high = stgMallocBytes(sizeof(decommit_range), "cancel_decommit");
+            high->address = end;
+            high->size = r_end - end;
+            high->next = r;
+            *prev = high;
+            r->size = address - r->address;
+            break;
+        } else if (r->address < address) {
+            r->size = address - r->address;
+            prev = &r->next;
+        } else if (r_end > end) {
+            r->address = end;
+            r->size = r_end - end;
+            prev = &r->next;
+        } else {
+            *prev = r->next;
+            stgFree(r);
+        }
+    }
+
+    RELEASE_LOCK(&decommit_mutex);
+}
+
+#endif /* THREADED_RTS */
+
+void
+startDecommitThread (void)
+{
+#if defined(THREADED_RTS)
+    ACQUIRE_LOCK(&decommit_mutex);
+    start_decommit_thread();
+    RELEASE_LOCK(&decommit_mutex);
+#endif
+}
+
+void
+stopDecommitThread (void)
+{
+#if defined(THREADED_RTS)
+    ACQUIRE_LOCK(&decommit_mutex);
+    decommit_stop = true;
+    signalCondition(&decommit_cond);
+    while (decommit_running) {
+        waitCondition(&decommit_done_cond, &decommit_mutex);
+    }
+    decommit_stop = false;
+    RELEASE_LOCK(&decommit_mutex);
+#endif
+}
 /*
  * it is quite important that these are in the same cache line as they
  * are both needed by HEAP_ALLOCED. Moreover, we need to ensure that they
@@ -183,6 +428,9 @@ static void *getReusableMBlocks(uint32_t n)
             stgFree(iter);
         }
 
+#if defined(THREADED_RTS)
+        cancel_decommit((W_)addr, size);
+#endif
         osCommitMemory(addr, size);
         return addr;
     }
@@ -202,6 +450,9 @@ static void *getFreshMBlocks(uint32_t n)
         stg_exit(EXIT_HEAPOVERFLOW);
     }
 
+#if defined(THREADED_RTS)
+    cancel_decommit((W_)addr, size);
+#endif
     osCommitMemory(addr, size);
     mblock_high_watermark += size;
     return addr;
@@ -220,13 +471,105 @@ static void *getCommittedMBlocks(uint32_t n)
     return p;
 }
 
+// Commit the n mblocks at address, if none of them are in use.  They
+// must either be on the free list or above the high watermark; if we
+// skip over some fresh mblocks to get there, those go on the free list.
+static void *getCommittedMBlocksAt(W_ address, uint32_t n)
+{
+    struct free_list *iter, *prev, *rest;
+    W_ size = MBLOCK_SIZE * (W_)n;
+
+    if ((address & MBLOCK_MASK) != 0
+        || address < mblock_address_space.begin
+        || address > mblock_address_space.end
+        || size > mblock_address_space.end - address) {
+        return NULL;
+    }
+
+    if (address >= mblock_high_watermark) {
+        if (address > mblock_high_watermark) {
+            prev = NULL;
+            for (iter = free_list_head; iter != NULL; iter = iter->next) {
+                prev = iter;
+            }
+            if (prev && prev->address + prev->size == mblock_high_watermark) {
+                // coalesce, as decommitMBlocks() does
+                prev->size += address - mblock_high_watermark;
+            } else {
+                rest = stgMallocBytes(sizeof(struct free_list),
+                                      "getCommittedMBlocksAt");
+                rest->address = mblock_high_watermark;
+                rest->size = address - mblock_high_watermark;
+                rest->next = NULL;
+                rest->prev = prev;
+                if (prev) {
+                    prev->next = rest;
+                } else {
+                    free_list_head = rest;
+                }
+            }
+        }
+        mblock_high_watermark = address + size;
+    } else {
+        for (iter = free_list_head; iter != NULL; iter = iter->next) {
+            if (iter->address <= address
+                && address + size <= iter->address + iter->size) {
+                break;
+            }
+        }
+        if (iter == NULL) {
+            return NULL;
+        }
+
+        if (address + size < iter->address + iter->size) {
+            // keep the part after the range in a new entry
+            rest = stgMallocBytes(sizeof(struct free_list),
+                                  "getCommittedMBlocksAt");
+            rest->address = address + size;
+            rest->size = iter->address + iter->size - (address + size);
+            rest->prev = iter;
+            rest->next = iter->next;
+            if (rest->next) {
+                rest->next->prev = rest;
+            }
+            iter->next = rest;
+        }
+
+        iter->size = address - iter->address;
+        if (iter->size == 0) {
+            if (iter->prev) {
+                iter->prev->next = iter->next;
+            } else {
+                ASSERT(free_list_head == iter);
+                free_list_head = iter->next;
+            }
+            if (iter->next) {
+                iter->next->prev = iter->prev;
+            }
+            stgFree(iter);
+        }
+    }
+
+#if defined(THREADED_RTS)
+    cancel_decommit(address, size);
+#endif
+    osCommitMemory((void*)address, size);
+    return (void*)address;
+}
+
 static void decommitMBlocks(char *addr, uint32_t n)
 {
     struct free_list *iter, *prev;
     W_ size = MBLOCK_SIZE * (W_)n;
     W_ address = (W_)addr;
 
-    osDecommitMemory(addr, size);
+    // See Note [Background decommit]
+#if defined(THREADED_RTS)
+    if (RtsFlags.GcFlags.decommitRate == 0 || !queue_decommit(address, size))
+#endif
+    {
+        osDecommitMemory(addr, size);
+    }
 
     prev = NULL;
     for (iter = free_list_head; iter != NULL; iter = iter->next)
@@ -542,6 +885,13 @@ static void *getCommittedMBlocks(uint32_t n)
     return ret;
 }
 
+// We can't choose where the OS puts our mblocks
+static void *getCommittedMBlocksAt(W_ address STG_UNUSED,
+                                   uint32_t n STG_UNUSED)
+{
+    return NULL;
+}
+
 static void decommitMBlocks(void *p, uint32_t n)
 {
     osFreeMBlocks(p, n);
@@ -557,6 +907,16 @@ void releaseFreeMemory(void)
     osReleaseFreeMemory();
 }
 
+// Without the large address space we always decommit in the GC, see
+// Note [Background decommit]
+void startDecommitThread(void)
+{
+}
+
+void stopDecommitThread(void)
+{
+}
+
 #endif /* !USE_LARGE_ADDRESS_SPACE */
 
 /* -----------------------------------------------------------------------------
@@ -587,6 +947,28 @@ getMBlocks(uint32_t n)
     return ret;
 }
 
+// Allocate the 'n' mblocks at 'addr', if they are free.  Returns NULL
+// if they aren't, or if we can't allocate at a given address at all
+// (without USE_LARGE_ADDRESS_SPACE).
+
+void *
+getMBlocksAt(void *addr, uint32_t n)
+{
+    void *ret;
+
+    ret = getCommittedMBlocksAt((W_)addr, n);
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    debugTrace(DEBUG_gc, "allocated %d megablock(s) at %p",n,ret);
+
+    mblocks_allocated += n;
+    peak_mblocks_allocated = stg_max(peak_mblocks_allocated, mblocks_allocated);
+
+    return ret;
+}
+
 void *
 getMBlocksOnNode(uint32_t node, uint32_t n)
 {
@@ -630,6 +1012,19 @@ freeAllMBlocks(void)
         }
     }
 
+#if defined(THREADED_RTS)
+    {
+        decommit_range *r, *next;
+
+        stopDecommitThread();
+        for (r = decommit_queue; r != NULL; r = next) {
+            next = r->next;
+            stgFree(r);
+        }
+        decommit_queue = NULL;
+    }
+#endif
+
     osReleaseHeapMemory();
 
     mblock_address_space.begin = (W_)-1;
@@ -672,6 +1067,11 @@ initMBlocks(void)
         mblock_address_space.end = (W_)addr + size;
         mblock_high_watermark = (W_)addr;
     }
+#if defined(THREADED_RTS)
+    initMutex(&decommit_mutex);
+    initCondition(&decommit_cond);
+    initCondition(&decommit_done_cond);
+#endif
 #elif SIZEOF_VOID_P == 8
     memset(mblock_cache,0xff,sizeof(mblock_cache));
 #endif
@@ -24,6 +24,7 @@
 #include "Weak.h"
 #include "Storage.h"
 #include "Threads.h"
+#include "RtsUtils.h"
 
 #include "sm/GCUtils.h"
 #include "sm/MarkWeak.h"
@@ -69,22 +70,91 @@
 
      No more evacuation is done.
 
+   The weak pointers whose keys have not been found alive yet are kept
+   in an array, weak_pending, which every GC thread tidies in parallel;
+   see Note [Parallel weak pointer processing].
+
    -------------------------------------------------------------------------- */
 
+/* Note [Parallel weak pointer processing]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   A program with many Weak# objects (finalizers for FFI handles, caches
+   keyed on heap objects) spends a noticeable part of every GC checking
+   whether their keys are alive.  Rather than walk each generation's weak
+   pointer list on the main GC thread, we split the work between all the
+   GC threads:
+
+   - markWeakPtrList(), which already visits every weak pointer in the
+     generations being collected, also collects them into the array
+     weak_pending, which initWeakForGC() divides into chunks of
+     WEAK_CHUNK_SIZE entries.
+
+   - traverseWeakPtrList() is still called by the main GC thread alone,
+     when all the GC threads have run out of work, and still makes all
+     the decisions.  But rather than checking the keys itself, it asks for
+     a round of tidying (startTidyWeakPtrs()) and returns true.  GC.c then
+     has every GC thread call tidyWeakPtrs() before scavenging again.
+
+   - tidyWeakPtrs() claims chunks with an atomic counter until there are
+     none left, so a thread that finishes its chunks early takes more of
+     them, as in the parallel marking of the stable pointer table.  For
+     each weak pointer whose key is now alive it scavenges the weak
+     pointer and puts it on a list for its new generation; the lists are
+     pushed onto the generations' weak_ptr_lists with one CAS per chunk
+     and generation.  The weak pointers whose keys are still dead are
+     moved to the front of the chunk.
+
+   - The next call to traverseWeakPtrList(), after the objects reachable
+     from the newly live weak pointers have been scavenged, looks at
+     weak_found_live to decide whether another round is needed.
+
+   So the fixpoint is incremental: a weak pointer is dropped from
+   weak_pending as soon as its key is found to be alive, and each round
+   only rescans the weak pointers that are still pending.  We also avoid
+   the extra scan that the WeakPtrs stage used to make when no threads
+   were resurrected: in that case nothing has been evacuated since the
+   last round found no live keys, so the remaining weak pointers are dead.
+
+   isAlive() can run concurrently with evacuation by other threads during
+   a round, and may then miss a key that is just being evacuated.  That is
+   harmless: something was evacuated, so some thread found a live key, so
+   there will be another round, which will see the key.
+*/
+
+#define WEAK_CHUNK_SIZE 256     /* weak pointers per chunk */
+
 /* Which stage of processing various kinds of weak pointer are we at?
  * (see traverseWeakPtrList() below for discussion).
  */
 typedef enum { WeakPtrs, WeakThreads, WeakDone } WeakStage;
 static WeakStage weak_stage;
 
+// Weak pointers whose keys have not been found alive yet, in chunks of
+// WEAK_CHUNK_SIZE; chunk c holds weak_chunk_len[c] entries starting at
+// weak_pending[c * WEAK_CHUNK_SIZE].
+static StgWeak **weak_pending;
+static StgWord   n_weak_pending;
+static StgWord   weak_pending_size;
+static uint32_t *weak_chunk_len;
+static StgWord   n_weak_chunks;
+
+// Is the current round tidying the weak pointers, and has it found any
+// live keys?  See Note [Parallel weak pointer processing].
+static bool weak_tidy;
+static volatile StgWord weak_found_live;
+static volatile StgWord next_weak_chunk;
+
 // List of weak pointers whose key is dead
 StgWeak *dead_weak_ptr_list;
 
 // List of threads found to be unreachable
 StgTSO *resurrected_threads;
 
-static void    collectDeadWeakPtrs (generation *gen);
-static bool tidyWeakList (generation *gen);
+static void    collectDeadWeakPtrs (void);
+static bool    tidyWeakChunk (StgWord c);
+static void    startTidyWeakPtrs (void);
+static void    freeWeakPending (void);
 static bool resurrectUnreachableThreads (generation *gen);
 static void    tidyThreadList (generation *gen);
 
@@ -92,14 +162,28 @@ void
 initWeakForGC(void)
 {
     uint32_t g;
+    StgWord c;
 
+    // markWeakPtrList() has put the weak pointers of these generations
+    // into weak_pending.
     for (g = 0; g <= N; g++) {
         generation *gen = &generations[g];
-        gen->old_weak_ptr_list = gen->weak_ptr_list;
         gen->weak_ptr_list = NULL;
     }
 
+    n_weak_chunks = (n_weak_pending + WEAK_CHUNK_SIZE - 1) / WEAK_CHUNK_SIZE;
+    if (n_weak_chunks > 0) {
+        weak_chunk_len = stgMallocBytes(n_weak_chunks * sizeof(uint32_t),
+                                        "initWeakForGC");
+        for (c = 0; c < n_weak_chunks; c++) {
+            weak_chunk_len[c] = WEAK_CHUNK_SIZE;
+        }
+        weak_chunk_len[n_weak_chunks-1] =
+            n_weak_pending - (n_weak_chunks-1) * WEAK_CHUNK_SIZE;
+    }
+
     weak_stage = WeakThreads;
+    weak_tidy = false;
     dead_weak_ptr_list = NULL;
     resurrected_threads = END_TSO_QUEUE;
 }
@@ -107,8 +191,13 @@ initWeakForGC(void)
 bool
 traverseWeakPtrList(void)
 {
+  // Did the round that has just finished tidy the weak pointers?  If so,
+  // weak_found_live says whether it found any more live keys.
+  bool tidied = weak_tidy;
   bool flag = false;
 
+  weak_tidy = false;
+
   switch (weak_stage) {
 
   case WeakDone:
@@ -122,22 +211,18 @@ traverseWeakPtrList(void)
   {
       uint32_t g;
 
-      for (g = 0; g <= N; g++) {
-          tidyThreadList(&generations[g]);
-      }
-
       // Use weak pointer relationships (value is reachable if
-      // key is reachable):
-      for (g = 0; g <= N; g++) {
-          if (tidyWeakList(&generations[g])) {
-              flag = true;
+      // key is reachable).  If we evacuated anything new, we must
+      // scavenge thoroughly before we can determine which threads are
+      // unreachable.
+      if (!tidied || weak_found_live) {
+          for (g = 0; g <= N; g++) {
+              tidyThreadList(&generations[g]);
           }
+          startTidyWeakPtrs();
+          return true;
       }
 
-      // if we evacuated anything new, we must scavenge thoroughly
-      // before we can determine which threads are unreachable.
-      if (flag) return true;
-
       // Resurrect any threads which were unreachable
       for (g = 0; g <= N; g++) {
           if (resurrectUnreachableThreads(&generations[g])) {
@@ -153,33 +238,29 @@ traverseWeakPtrList(void)
       // before entering the WeakPtrs stage.
       if (flag) return true;
 
-      // otherwise, fall through...
+      // otherwise, fall through.  Nothing has been evacuated since the
+      // last round found no live keys, so there is no need to look for
+      // them again.
   }
   FALLTHROUGH;
 
   case WeakPtrs:
   {
-      uint32_t g;
-
       // resurrecting threads might have made more weak pointers
       // alive, so traverse those lists again:
-      for (g = 0; g <= N; g++) {
-          if (tidyWeakList(&generations[g])) {
-              flag = true;
-          }
+      if (!tidied || weak_found_live) {
+          startTidyWeakPtrs();
+          return true;
       }
 
       /* If we didn't make any changes, then we can go round and kill all
        * the dead weak pointers.  The dead_weak_ptr list is used as a list
        * of pending finalizers later on.
        */
-      if (flag == false) {
-          for (g = 0; g <= N; g++) {
-              collectDeadWeakPtrs(&generations[g]);
-          }
+      collectDeadWeakPtrs();
+      freeWeakPending();
 
-          weak_stage = WeakDone;  // *now* we're done,
-      }
+      weak_stage = WeakDone;  // *now* we're done,
 
       return true;         // but one more round of scavenging, please
   }
@@ -190,22 +271,70 @@ traverseWeakPtrList(void)
   }
 }
 
-static void collectDeadWeakPtrs (generation *gen)
+/* -----------------------------------------------------------------------------
+   Tidying the weak pointers in parallel.
+
+   startTidyWeakPtrs() is called by the main GC thread to ask for a round
+   of tidying, and then every GC thread calls tidyWeakPtrs() before it
+   scavenges again.  See Note [Parallel weak pointer processing].
+   -------------------------------------------------------------------------- */
+
+static void
+startTidyWeakPtrs (void)
+{
+    weak_tidy = true;
+    weak_found_live = 0;
+    next_weak_chunk = 0;
+}
+
+void
+tidyWeakPtrs (void)
+{
+    StgWord c;
+
+    if (!weak_tidy) return;
+
+    while ((c = atomic_inc(&next_weak_chunk, 1) - 1) < n_weak_chunks) {
+        if (tidyWeakChunk(c)) {
+            weak_found_live = 1;
+        }
+    }
+}
+
+static void collectDeadWeakPtrs (void)
 {
-    StgWeak *w, *next_w;
-    for (w = gen->old_weak_ptr_list; w != NULL; w = next_w) {
-        // If we have C finalizers, keep the value alive for this GC.
-        // See Note [MallocPtr finalizers] in GHC.ForeignPtr, and #10904
-        if (w->cfinalizers != &stg_NO_FINALIZER_closure) {
-            evacuate(&w->value);
+    StgWeak *w;
+    StgWord c;
+    uint32_t i;
+
+    for (c = 0; c < n_weak_chunks; c++) {
+        for (i = 0; i < weak_chunk_len[c]; i++) {
+            w = weak_pending[c * WEAK_CHUNK_SIZE + i];
+            // If we have C finalizers, keep the value alive for this GC.
+            // See Note [MallocPtr finalizers] in GHC.ForeignPtr, and #10904
+            if (w->cfinalizers != &stg_NO_FINALIZER_closure) {
+                evacuate(&w->value);
+            }
+            evacuate(&w->finalizer);
+            w->link = dead_weak_ptr_list;
+            dead_weak_ptr_list = w;
         }
-        evacuate(&w->finalizer);
-        next_w = w->link;
-        w->link = dead_weak_ptr_list;
-        dead_weak_ptr_list = w;
     }
 }
 
+static void freeWeakPending (void)
+{
+    if (weak_pending != NULL) {
+        stgFree(weak_pending);
+        stgFree(weak_chunk_len);
+    }
+    weak_pending = NULL;
+    weak_chunk_len = NULL;
+    n_weak_pending = 0;
+    weak_pending_size = 0;
+    n_weak_chunks = 0;
+}
+
 static bool resurrectUnreachableThreads (generation *gen)
 {
     StgTSO *t, *tmp, *next;
@@ -233,84 +362,98 @@ static bool resurrectUnreachableThreads (generation *gen)
     return flag;
 }
 
-static bool tidyWeakList(generation *gen)
+/* -----------------------------------------------------------------------------
+   Tidy one chunk of weak_pending: scavenge the weak pointers whose keys
+   are alive and put them on the weak_ptr_list of their new generation,
+   and keep the rest.  Returns true if any keys were found alive.
+   -------------------------------------------------------------------------- */
+
+static bool tidyWeakChunk(StgWord c)
 {
-    StgWeak *w, **last_w, *next_w;
+    StgWeak **ws = &weak_pending[c * WEAK_CHUNK_SIZE];
+    uint32_t i, n, len = weak_chunk_len[c];
+    uint32_t g, n_gens = RtsFlags.GcFlags.generations;
+    StgWeak *hd[n_gens], *tl[n_gens];
+    StgWeak *w, *old;
     const StgInfoTable *info;
     StgClosure *new;
     bool flag = false;
-    last_w = &gen->old_weak_ptr_list;
-    for (w = gen->old_weak_ptr_list; w != NULL; w = next_w) {
+
+    for (g = 0; g < n_gens; g++) {
+        hd[g] = NULL;
+        tl[g] = NULL;
+    }
+
+    for (i = 0, n = 0; i < len; i++) {
+        w = ws[i];
 
         /* There might be a DEAD_WEAK on the list if finalizeWeak# was
          * called on a live weak pointer object.  Just remove it.
          */
         if (w->header.info == &stg_DEAD_WEAK_info) {
-            next_w = w->link;
-            *last_w = next_w;
             continue;
         }
 
         info = get_itbl((StgClosure *)w);
-        switch (info->type) {
-
-        case WEAK:
-            /* Now, check whether the key is reachable.
-             */
-            new = isAlive(w->key);
-            if (new != NULL) {
-                generation *new_gen;
-
-                w->key = new;
-
-                // Find out which generation this weak ptr is in, and
-                // move it onto the weak ptr list of that generation.
-
-                new_gen = Bdescr((P_)w)->gen;
-                gct->evac_gen_no = new_gen->no;
-                gct->failed_to_evac = false;
-
-                // evacuate the fields of the weak ptr
-                scavengeLiveWeak(w);
-
-                if (gct->failed_to_evac) {
-                    debugTrace(DEBUG_weak,
-                               "putting weak pointer %p into mutable list",
-                               w);
-                    gct->failed_to_evac = false;
-                    recordMutableGen_GC((StgClosure *)w, new_gen->no);
-                }
-
-                // remove this weak ptr from the old_weak_ptr list
-                *last_w = w->link;
-                next_w  = w->link;
-
-                // and put it on the correct weak ptr list.
-                w->link = new_gen->weak_ptr_list;
-                new_gen->weak_ptr_list = w;
-                flag = true;
-
-                if (gen->no != new_gen->no) {
-                    debugTrace(DEBUG_weak,
-                      "moving weak pointer %p from %d to %d",
-                      w, gen->no, new_gen->no);
-                }
-
-
-                debugTrace(DEBUG_weak,
-                           "weak pointer still alive at %p -> %p",
-                           w, w->key);
-                continue;
-            }
-            else {
-                last_w = &(w->link);
-                next_w = w->link;
-                continue;
-            }
+        if (info->type != WEAK) {
+            barf("tidyWeakChunk: not WEAK: %d, %p", info->type, w);
+        }
 
-        default:
-            barf("tidyWeakList: not WEAK: %d, %p", info->type, w);
+        /* Now, check whether the key is reachable.
+         */
+        new = isAlive(w->key);
+        if (new == NULL) {
+            // not alive (yet): keep it in the chunk.
+            ws[n++] = w;
+            continue;
+        }
+
+        generation *new_gen;
+
+        w->key = new;
+
+        // Find out which generation this weak ptr is in, and
+        // move it onto the weak ptr list of that generation.
+
+        new_gen = Bdescr((P_)w)->gen;
+        gct->evac_gen_no = new_gen->no;
+        gct->failed_to_evac = false;
+
+        // evacuate the fields of the weak ptr
+        scavengeLiveWeak(w);
+
+        if (gct->failed_to_evac) {
+            debugTrace(DEBUG_weak,
+                       "putting weak pointer %p into mutable list",
+                       w);
+            gct->failed_to_evac = false;
+            recordMutableGen_GC((StgClosure *)w, new_gen->no);
+        }
+
+        w->link = hd[new_gen->no];
+        hd[new_gen->no] = w;
+        if (tl[new_gen->no] == NULL) {
+            tl[new_gen->no] = w;
         }
+        flag = true;
+
+        debugTrace(DEBUG_weak,
+                   "weak pointer still alive at %p -> %p (gen %d)",
+                   w, w->key, new_gen->no);
+    }
+
+    weak_chunk_len[c] = n;
+
+    // put the live weak ptrs on the correct weak ptr lists.  Other GC
+    // threads may be doing the same.
+    for (g = 0; g < n_gens; g++) {
+        if (hd[g] == NULL) continue;
+        generation *gen = &generations[g];
+        do {
+            old = gen->weak_ptr_list;
+            tl[g]->link = old;
+        } while (cas((StgVolatilePtr)&gen->weak_ptr_list,
+                     (StgWord)old, (StgWord)hd[g]) != (StgWord)old);
     }
 
     return flag;
@@ -395,9 +538,23 @@ void collectFreshWeakPtrs()
 
 /* -----------------------------------------------------------------------------
    Evacuate every weak pointer object on the weak_ptr_list, and update
-   the link fields.
+   the link fields.  The weak pointers are also collected into
+   weak_pending, ready for initWeakForGC().
    -------------------------------------------------------------------------- */
 
+static void
+addWeakPending (StgWeak *w)
+{
+    if (n_weak_pending == weak_pending_size) {
+        weak_pending_size = weak_pending_size == 0 ? 1024
+                                                   : weak_pending_size * 2;
+        weak_pending = stgReallocBytes(weak_pending,
+                                       weak_pending_size * sizeof(StgWeak *),
+                                       "addWeakPending");
+    }
+    weak_pending[n_weak_pending++] = w;
+}
+
 void
 markWeakPtrList ( void )
 {
@@ -424,6 +581,7 @@ markWeakPtrList ( void )
 
             evacuate((StgClosure **)last_w);
             w = *last_w;
+            addWeakPending(w);
             last_w = &(w->link);
         }
     }
@@ -20,6 +20,7 @@ extern StgTSO *resurrected_threads;
 void    collectFreshWeakPtrs   ( void );
 void    initWeakForGC          ( void );
 bool    traverseWeakPtrList    ( void );
+void    tidyWeakPtrs           ( void );
 void    markWeakPtrList        ( void );
 void    scavengeLiveWeak       ( StgWeak * );
 
@@ -24,6 +24,26 @@ uint32_t osNumaNodes(void);
 uint64_t osNumaMask(void);
 void osBindMBlocksToNode(void *addr, StgWord size, uint32_t node);
 
+// With +RTS --huge-pages we align the heap to HUGE_PAGE_SIZE, and only
+// get or release memory from the OS in whole huge pages, so that the
+// OS can back it with transparent huge pages.  2MB is the size of a
+// huge page on x86_64, and on aarch64 with 4k pages.
+#define HUGE_PAGE_SIZE         (2 * MBLOCK_SIZE)
+#define MBLOCKS_PER_HUGE_PAGE  (HUGE_PAGE_SIZE / MBLOCK_SIZE)
+#define HUGE_PAGE_ROUND_DOWN(p) \
+    ((StgWord8 *)((W_)(p) & ~(HUGE_PAGE_SIZE - 1)))
+#define HUGE_PAGE_ROUND_UP(p) \
+    ((StgWord8 *)(((W_)(p) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1)))
+
+// Whether the OS can back the heap with transparent huge pages.  If not,
+// +RTS --huge-pages is rejected: it would only make us take memory from
+// the OS in bigger pieces.
+bool osHugePagesAvailable(void);
+
+// The number of bytes of the heap currently backed by huge pages, or 0
+// if we can't tell.
+W_ osHugePageBytes(void);
+
 INLINE_HEADER size_t
 roundDownToPage (size_t x)
 {
@@ -0,0 +1,387 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Reusing the free space in partly-live blocks of pinned objects
+ * (+RTS --reuse-pinned).
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "PosixSource.h"
+#include "Rts.h"
+
+#include "Storage.h"
+#include "HoleLists.h"
+#include "Hash.h"
+#include "RtsUtils.h"
+#include "Stats.h"
+#include "Trace.h"
+#include "Pinned.h"
+
+#include <string.h> // for memset()
+
+/* -----------------------------------------------------------------------------
+   Note [Reusing pinned holes]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   allocatePinned() bump-allocates small pinned objects into a block,
+   and the GC treats that block as a single large object: the whole
+   block stays alive for as long as any object in it does.  A program
+   that keeps a few small ByteStrings from each block alive can end up
+   with most of its pinned blocks empty but unusable.
+
+   With +RTS --reuse-pinned, the GC finds out which objects in a pinned
+   block are still alive, and allocatePinned() fills the space between
+   them:
+
+     - at the start of a GC, preparePinnedBlocks() gives every
+       single-block BF_PINNED block of the generations being collected a
+       mark bitmap (one bit per word) and sets BF_PINNED_MARKS on it.
+       The bitmap can't go in bd->u.bitmap, because the large object
+       lists are doubly linked through bd->u.back, so we find it through
+       a hash table keyed by the block descriptor.
+
+     - evacuate() sets the bit of every pinned object it is called on
+       in a BF_PINNED_MARKS block (markPinnedObject()), even when the
+       block itself has already been evacuated.  isAlive() looks at the
+       bit too, so a weak pointer whose key shares its block with a live
+       object doesn't keep the key's memory from being reused.
+
+     - once evacuation is over, collectPinnedHoles() walks the marked
+       objects of each surviving block in address order.  Pinned blocks
+       only contain ARR_WORDS, so arr_words_sizeW() gives the end of each
+       object, and everything between the live objects (including
+       alignment padding and the unused end of the block) is a hole.  A
+       hole is a free-list node (HoleLists.h, shared with --fill-holes):
+       the first word links it to the next hole in its size class and
+       the second holds its size.  Pinned
+       blocks are never traversed linearly (see allocatePinned()), so we
+       don't need to cover the holes with dummy objects.
+
+     - the holes are handed out round-robin by block to the free lists
+       of the capabilities (cap->pinned_holes), and allocatePinned()
+       tries allocPinnedHole() before bump-allocating.  This needs no
+       locks: between GCs only the owning capability touches its lists.
+
+   An object allocated in a hole lives in the block's generation, which
+   may be an old one.  That is fine for ARR_WORDS, which contain no
+   pointers.  A block is examined again when its generation is next
+   collected, so at the start of each GC we throw away the holes in the
+   generations being collected; if their blocks survive we find the
+   holes again, minus whatever was allocated in them.
+
+   The figures from each major GC (pinned blocks, live words and words
+   in holes) and the words allocated in holes are reported by +RTS -s;
+   see stat_pinnedHoles().
+
+   A major GC that writes a heap snapshot marks the pinned blocks too,
+   whether or not --reuse-pinned is on, so that the snapshot can find
+   the live objects in them; see Note [Heap snapshots] in
+   HeapSnapshot.c.  It also marks the blocks the capabilities are still
+   allocating into, and keeps the bitmaps until releasePinnedMarks().
+   -------------------------------------------------------------------------- */
+
+#define PINNED_BITMAP_WORDS (BLOCK_SIZE_W / BITS_IN(W_))
+
+// A hole holds a link and its size.
+#define PINNED_HOLE_MIN_WORDS 2
+#define PINNED_HOLE_LINK 0
+
+typedef struct {
+    bdescr *bd;
+    bool current;               // a capability's pinned_object_block
+    StgWord bitmap[PINNED_BITMAP_WORDS];
+} PinnedMarks;
+
+// The blocks we are marking in this GC, and their bitmaps by block.
+// The table is kept until releasePinnedMarks(), after the GC has
+// written any heap snapshot (see Note [Heap snapshots] in
+// HeapSnapshot.c).
+static PinnedMarks *pinned_marks = NULL;
+static uint32_t n_pinned_marks = 0;
+static uint32_t max_pinned_marks = 0;
+static HashTable *pinned_marks_table = NULL;
+
+// Words on the capabilities' free lists after the last GC, and the
+// words allocated in holes since then
+static W_ pinned_hole_words = 0;
+static W_ pinned_hole_reused = 0;
+
+// Put the free space [p, p+size) on a free list of cap.
+static void
+add_pinned_hole (Capability *cap, StgPtr p, W_ size)
+{
+    ASSERT(size >= PINNED_HOLE_MIN_WORDS);
+    p[1] = size;
+    push_hole(cap->pinned_holes, &cap->pinned_hole_mask, hole_class(size),
+              p, PINNED_HOLE_LINK);
+}
+
+StgPtr
+allocPinnedHole (Capability *cap, W_ n)
+{
+    StgPtr p;
+    uint32_t c;
+
+    // The first hole in n's own size class might be big enough;
+    // every hole in the classes above it is.
+    c = hole_class(n);
+    p = cap->pinned_holes[c];
+    if (p == NULL || p[1] < n) {
+        c = find_hole_class(cap->pinned_hole_mask, c + 1);
+        if (c == N_HOLE_CLASSES) return NULL;
+    }
+    p = pop_hole(cap->pinned_holes, &cap->pinned_hole_mask, c,
+                 PINNED_HOLE_LINK);
+
+    // Anything too small to be a hole is left as slop.
+    if (p[1] - n >= PINNED_HOLE_MIN_WORDS) {
+        add_pinned_hole(cap, p + n, p[1] - n);
+    }
+    return p;
+}
+
+/* -----------------------------------------------------------------------------
+   Marking
+   -------------------------------------------------------------------------- */
+
+static void
+add_pinned_marks (bdescr *bd, bool current)
+{
+    pinned_marks[n_pinned_marks].bd = bd;
+    pinned_marks[n_pinned_marks].current = current;
+    insertHashTable(pinned_marks_table, (StgWord)bd,
+                    &pinned_marks[n_pinned_marks]);
+    bd->flags |= BF_PINNED_MARKS;
+    n_pinned_marks++;
+}
+
+// With 'current', also mark the blocks that the capabilities are still
+// allocating into.  A heap snapshot needs those marks; we never look for
+// holes in those blocks, though.
+void
+preparePinnedBlocks (uint32_t N, bool current)
+{
+    uint32_t i, c, g, n;
+    W_ left, kept;
+    StgPtr p, *prev;
+    Capability *cap;
+    bdescr *bd;
+
+    // Drop the holes in the generations we are collecting.
+    left = 0;
+    kept = 0;
+    for (i = 0; i < n_capabilities; i++) {
+        cap = capabilities[i];
+        for (c = 0; c < N_HOLE_CLASSES; c++) {
+            prev = &cap->pinned_holes[c];
+            for (p = *prev; p != NULL; p = (StgPtr)p[PINNED_HOLE_LINK]) {
+                left += p[1];
+                if (Bdescr(p)->gen_no <= N) {
+                    *prev = (StgPtr)p[PINNED_HOLE_LINK];
+                } else {
+                    kept += p[1];
+                    prev = (StgPtr *)&p[PINNED_HOLE_LINK];
+                }
+            }
+            if (cap->pinned_holes[c] == NULL) {
+                cap->pinned_hole_mask &= ~((StgWord)1 << c);
+            }
+        }
+    }
+    pinned_hole_reused = pinned_hole_words - left;
+    pinned_hole_words = kept;
+
+    n = 0;
+    for (g = 0; g <= N; g++) {
+        for (bd = generations[g].large_objects; bd != NULL; bd = bd->link) {
+            if ((bd->flags & BF_PINNED) && bd->blocks == 1) n++;
+        }
+    }
+    if (current) {
+        for (i = 0; i < n_capabilities; i++) {
+            if (capabilities[i]->pinned_object_block != NULL) n++;
+        }
+    }
+    if (n == 0) return;
+
+    if (n > max_pinned_marks) {
+        max_pinned_marks = stg_max(n, 2 * max_pinned_marks);
+        pinned_marks = stgReallocBytes(pinned_marks,
+                                       max_pinned_marks * sizeof(PinnedMarks),
+                                       "preparePinnedBlocks");
+    }
+    memset(pinned_marks, 0, n * sizeof(PinnedMarks));
+    pinned_marks_table = allocHashTable();
+
+    n_pinned_marks = 0;
+    for (g = 0; g <= N; g++) {
+        for (bd = generations[g].large_objects; bd != NULL; bd = bd->link) {
+            if ((bd->flags & BF_PINNED) && bd->blocks == 1) {
+                add_pinned_marks(bd, false);
+            }
+        }
+    }
+    if (current) {
+        for (i = 0; i < n_capabilities; i++) {
+            bd = capabilities[i]->pinned_object_block;
+            if (bd != NULL) {
+                add_pinned_marks(bd, true);
+            }
+        }
+    }
+}
+
+void
+markPinnedObject (StgPtr p, bdescr *bd)
+{
+    PinnedMarks *m;
+    StgWord *w, bit, off;
+
+    m = lookupHashTable(pinned_marks_table, (StgWord)bd);
+    ASSERT(m != NULL);
+    off = p - bd->start;
+    w = &m->bitmap[off / BITS_IN(W_)];
+    bit = (StgWord)1 << (off % BITS_IN(W_));
+
+#if defined(THREADED_RTS)
+    StgWord old;
+    do {
+        old = *w;
+        if (old & bit) return;
+    } while (cas((StgVolatilePtr)w, old, old | bit) != old);
+#else
+    *w |= bit;
+#endif
+}
+
+bool
+isPinnedObjectMarked (StgPtr p, bdescr *bd)
+{
+    PinnedMarks *m;
+    StgWord off;
+
+    m = lookupHashTable(pinned_marks_table, (StgWord)bd);
+    ASSERT(m != NULL);
+    off = p - bd->start;
+    return (m->bitmap[off / BITS_IN(W_)] >> (off % BITS_IN(W_))) & 1;
+}
+
+/* -----------------------------------------------------------------------------
+   Finding the holes
+   -------------------------------------------------------------------------- */
+
+// The offset of the first marked word at or after word i of a block,
+// or BLOCK_SIZE_W if there is none.
+STATIC_INLINE W_
+next_marked (StgWord *bitmap, W_ i)
+{
+    StgWord w;
+
+    while (i < BLOCK_SIZE_W) {
+        w = bitmap[i / BITS_IN(W_)] >> (i % BITS_IN(W_));
+        if (w == 0) {
+            i = (i / BITS_IN(W_) + 1) * BITS_IN(W_);
+            continue;
+        }
+        while ((w & 1) == 0) {
+            w >>= 1;
+            i++;
+        }
+        return i;
+    }
+    return BLOCK_SIZE_W;
+}
+
+// Put the holes between the marked objects in bd on the free lists of
+// cap.  Returns the number of words in the holes.
+static W_
+collect_block_holes (bdescr *bd, StgWord *bitmap, Capability *cap, W_ *live)
+{
+    StgPtr p, q, end;
+    W_ holes = 0, size;
+
+    end = bd->start + BLOCK_SIZE_W;
+    p = bd->start;
+    while (p < end) {
+        q = bd->start + next_marked(bitmap, p - bd->start);
+        if ((W_)(q - p) >= PINNED_HOLE_MIN_WORDS) {
+            add_pinned_hole(cap, p, q - p);
+            holes += q - p;
+            // we are giving away the end of the block
+            if (q == end) bd->free = end;
+        }
+        if (q == end) break;
+        ASSERT(get_itbl((StgClosure *)q)->type == ARR_WORDS);
+        size = arr_words_sizeW((StgArrBytes *)q);
+        *live += size;
+        p = q + size;
+    }
+
+    return holes;
+}
+
+void
+collectPinnedHoles (bool major)
+{
+    uint32_t i;
+    W_ blocks = 0, live = 0, holes = 0;
+    bdescr *bd;
+
+    for (i = 0; i < n_pinned_marks; i++) {
+        bd = pinned_marks[i].bd;
+        bd->flags &= ~BF_PINNED_MARKS;
+        if (!RtsFlags.GcFlags.reusePinned || pinned_marks[i].current) {
+            continue;
+        }
+        // blocks that weren't evacuated are dead, and will be freed
+        if (bd->flags & BF_EVACUATED) {
+            holes += collect_block_holes(
+                bd, pinned_marks[i].bitmap,
+                capabilities[blocks % enabled_capabilities], &live);
+            blocks++;
+        }
+    }
+
+    if (!RtsFlags.GcFlags.reusePinned) {
+        return;
+    }
+
+    pinned_hole_words += holes;
+
+    debugTrace(DEBUG_gc, "pinned blocks: %ld, live words: %ld, holes: %ld",
+               (long)blocks, (long)live, (long)holes);
+
+    stat_pinnedHoles(major, blocks, live, holes, pinned_hole_reused);
+}
+
+StgWord *
+pinnedBlockMarks (bdescr *bd)
+{
+    PinnedMarks *m;
+
+    if (pinned_marks_table == NULL) {
+        return NULL;
+    }
+    m = lookupHashTable(pinned_marks_table, (StgWord)bd);
+    return m == NULL ? NULL : m->bitmap;
+}
+
+void
+releasePinnedMarks (void)
+{
+    if (pinned_marks_table != NULL) {
+        freeHashTable(pinned_marks_table, NULL);
+        pinned_marks_table = NULL;
+    }
+    n_pinned_marks = 0;
+}
+
+void
+freePinnedMarks (void)
+{
+    releasePinnedMarks();
+    stgFree(pinned_marks);
+    pinned_marks = NULL;
+    max_pinned_marks = 0;
+}
@@ -0,0 +1,30 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Reusing the free space in partly-live blocks of pinned objects
+ * (+RTS --reuse-pinned).  See Note [Reusing pinned holes] in Pinned.c.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include "Capability.h"
+
+#include "BeginPrivate.h"
+
+// Called by the GC
+void    preparePinnedBlocks  (uint32_t N, bool current);
+void    markPinnedObject     (StgPtr p, bdescr *bd);
+bool    isPinnedObjectMarked (StgPtr p, bdescr *bd);
+void    collectPinnedHoles   (bool major);
+void    releasePinnedMarks   (void);
+void    freePinnedMarks      (void);
+
+// Called by the heap snapshot, before releasePinnedMarks()
+StgWord *pinnedBlockMarks    (bdescr *bd);
+
+// Called by allocatePinned()
+StgPtr  allocPinnedHole      (Capability *cap, W_ n);
+
+#include "EndPrivate.h"
@@ -630,6 +630,18 @@ checkMutableList( bdescr *mut_bd, uint32_t gen )
 
     for (bd = mut_bd; bd != NULL; bd = bd->link) {
         for (q = bd->start; q < bd->free; q++) {
+            if (IS_MUT_LIST_CARD(*q)) {
+                // See Note [Card remembered set] in Scav.c
+                StgMutArrPtrs *a =
+                    (StgMutArrPtrs *)(*q & ~MUT_LIST_CARD_TAG);
+                ASSERT(isCardRemSetArray(a));
+                ASSERT(Bdescr((P_)a)->gen_no == gen);
+                ASSERT(q + 1 < bd->free);
+                ASSERT(q[1] < mutArrPtrsCards(a->ptrs));
+                checkClosure((StgClosure *)a);
+                q++;
+                continue;
+            }
             p = (StgClosure *)*q;
             ASSERT(!HEAP_ALLOCED(p) || Bdescr((P_)p)->gen_no == gen);
             checkClosure(p);
@@ -813,6 +825,7 @@ findMemoryLeak (void)
             markBlocks(gc_threads[i]->gens[g].todo_bd);
         }
         markBlocks(generations[g].blocks);
+        markBlocks(generations[g].bitmap);
         markBlocks(generations[g].large_objects);
         markCompactBlocks(generations[g].compact_objects);
     }
@@ -822,7 +835,8 @@ findMemoryLeak (void)
     }
 
     for (i = 0; i < n_capabilities; i++) {
-        markBlocks(gc_threads[i]->free_blocks);
+        markBlocks(gc_threads[i]->block_mag.blocks);
+        markBlocks(capabilities[i]->block_mag.blocks);
         markBlocks(capabilities[i]->pinned_object_block);
     }
 
@@ -889,6 +903,7 @@ genBlocks (generation *gen)
     ASSERT(countCompactBlocks(gen->compact_objects) == gen->n_compact_blocks);
     ASSERT(countCompactBlocks(gen->compact_blocks_in_import) == gen->n_compact_blocks_in_import);
     return gen->n_blocks + gen->n_old_blocks +
+        countAllocdBlocks(gen->bitmap) +
         countAllocdBlocks(gen->large_objects) +
         countAllocdCompactBlocks(gen->compact_objects) +
         countAllocdCompactBlocks(gen->compact_blocks_in_import);
@@ -900,7 +915,7 @@ memInventory (bool show)
   uint32_t g, i;
   W_ gen_blocks[RtsFlags.GcFlags.generations];
   W_ nursery_blocks, retainer_blocks,
-      arena_blocks, exec_blocks, gc_free_blocks = 0;
+      arena_blocks, exec_blocks, gc_free_blocks = 0, mag_blocks = 0;
   W_ live_blocks = 0, free_blocks = 0;
   bool leak;
 
@@ -923,7 +938,8 @@ memInventory (bool show)
       nursery_blocks += nurseries[i].n_blocks;
   }
   for (i = 0; i < n_capabilities; i++) {
-      gc_free_blocks += countBlocks(gc_threads[i]->free_blocks);
+      gc_free_blocks += countBlocks(gc_threads[i]->block_mag.blocks);
+      mag_blocks += countBlocks(capabilities[i]->block_mag.blocks);
       if (capabilities[i]->pinned_object_block != NULL) {
           nursery_blocks += capabilities[i]->pinned_object_block->blocks;
       }
@@ -951,7 +967,8 @@ memInventory (bool show)
       live_blocks += gen_blocks[g];
   }
   live_blocks += nursery_blocks +
-               + retainer_blocks + arena_blocks + exec_blocks + gc_free_blocks;
+               + retainer_blocks + arena_blocks + exec_blocks + gc_free_blocks
+               + mag_blocks;
 
 #define MB(n) (((double)(n) * BLOCK_SIZE_W) / ((1024*1024)/sizeof(W_)))
 
@@ -978,6 +995,8 @@ memInventory (bool show)
                  exec_blocks, MB(exec_blocks));
       debugBelch("  GC free pool : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  gc_free_blocks, MB(gc_free_blocks));
+      debugBelch("  magazines    : %5" FMT_Word " blocks (%6.1lf MB)\n",
+                 mag_blocks, MB(mag_blocks));
       debugBelch("  free         : %5" FMT_Word " blocks (%6.1lf MB)\n",
                  free_blocks, MB(free_blocks));
       debugBelch("  total        : %5" FMT_Word " blocks (%6.1lf MB)\n",
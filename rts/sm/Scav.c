@@ -58,7 +58,10 @@
 #include "Sanity.h"
 #include "Capability.h"
 #include "LdvProfile.h"
-#include "Hash.h"
+#include "RtsUtils.h"
+#include "CNF.h"
+#include "GetTime.h"
+#include "ConcMark.h"
 
 #include "sm/MarkWeak.h"
 
@@ -137,28 +140,6 @@ scavengeTSO (StgTSO *tso)
    Scavenging compact objects
    ------------------------------------------------------------------------- */
 
-typedef struct {
-    // We must save gct when calling mapHashTable(), which is compiled
-    // without GCThread.h and so uses a different calling convention.
-    // See also GC.c:mark_root where we do a similar thing.
-    gc_thread *saved_gct;
-    HashTable *newHash;
-} MapHashData;
-
-static void
-evacuate_hash_entry(MapHashData *dat, StgWord key, const void *value)
-{
-    StgClosure *p = (StgClosure*)key;
-#if defined(THREADED_RTS)
-    gc_thread *old_gct = gct;
-#endif
-
-    SET_GCT(dat->saved_gct);
-    evacuate(&p);
-    insertHashTable(dat->newHash, (StgWord)p, value);
-    SET_GCT(old_gct);
-}
-
 static void
 scavenge_compact(StgCompactNFData *str)
 {
@@ -167,13 +148,24 @@ scavenge_compact(StgCompactNFData *str)
     gct->eager_promotion = false;
 
     if (str->hash) {
-        MapHashData dat;
-        dat.saved_gct = gct;
-        HashTable *newHash = allocHashTable();
-        dat.newHash = newHash;
-        mapHashTable(str->hash, (void*)&dat, (MapHashFn)evacuate_hash_entry);
-        freeHashTable(str->hash, NULL);
-        str->hash = newHash;
+        // The keys are objects outside the compact, which may have
+        // moved, so put them all back in a fresh table.
+        CompactHash *hash = str->hash;
+        CompactHashEntry *old = hash->entries;
+        StgWord i, old_size = hash->size;
+        StgClosure *p;
+
+        hash->entries = stgCallocBytes(old_size, sizeof(CompactHashEntry),
+                                       "scavenge_compact");
+        hash->count = 0;
+        for (i = 0; i < old_size; i++) {
+            if (old[i].key != 0) {
+                p = (StgClosure*)old[i].key;
+                evacuate(&p);
+                insertCompactHashEntry(hash, p, old[i].value);
+            }
+        }
+        stgFree(old);
     }
 
     debugTrace(DEBUG_compact,
@@ -263,6 +255,105 @@ static StgPtr scavenge_mut_arr_ptrs_marked (StgMutArrPtrs *a)
     return (StgPtr)a + mut_arr_ptrs_sizeW(a);
 }
 
+/* Note [Card remembered set]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~
+   A MUT_ARR_PTRS in an old generation normally stays on the mutable
+   list for good, and every minor GC looks at each of its card bytes to
+   find the dirty ones.  For a big array that is written now and then,
+   that is work in proportion to the size of the array, not to the
+   number of writes.
+
+   With +RTS --card-remset, arrays with at least CARD_REMSET_MIN_CARDS
+   full cards (isCardRemSetArray()) are remembered card by card instead:
+
+     - The mutable list of an old generation holds a two-word card
+       entry (recordMutableCardCap()) for each dirty card of the array,
+       and the array itself is not on the list.  The invariant is that a
+       card byte of such an array in an old generation is 1 only if the
+       card has an entry on some mutable list.
+
+     - The write barrier in compiled code calls dirty_MUT_ARR_PTRS_card()
+       when the card it writes to is clean, which sets the card and
+       records it.  The barrier tells these arrays apart by comparing
+       their size with card_remset_min_ptrs, and for all other arrays
+       (and for all arrays without the flag) it stores the card byte
+       inline as before, so only the arrays that are tracked pay for
+       the check of the card byte.
+
+     - scavenge_mutable_list() scavenges only the card named by a card
+       entry, and records it again only if the card still points into a
+       younger generation.
+
+     - When the whole array is scavenged (it has just been promoted, or
+       its generation was collected), the cards that are left dirty are
+       recorded one by one (record_dirty_cards()).  unsafeThaw# can still
+       put the whole array on the list; scavenge_mutable_list() turns
+       such an entry into card entries.
+
+   These arrays are always large objects, so they never move, and a
+   card entry stays valid until the array's generation is collected, when
+   the mutable list is thrown away anyway.  A card may end up with two
+   entries if two Capabilities dirty it at the same time; scavenging it
+   twice is harmless.
+*/
+
+STATIC_INLINE bool
+is_card_remset_closure (StgClosure *p)
+{
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        return isCardRemSetArray((StgMutArrPtrs *)p);
+    default:
+        return false;
+    }
+}
+
+// Put every dirty card of a card-mode array on the mutable list.
+static void
+record_dirty_cards (StgMutArrPtrs *a, uint32_t gen_no)
+{
+    W_ m;
+
+    for (m = 0; m < mutArrPtrsCards(a->ptrs); m++) {
+        if (*mutArrPtrsCard(a,m) != 0) {
+            recordMutableCardGen_GC(a, m, gen_no);
+        }
+    }
+}
+
+// Scavenge the card named by a card entry on the mutable list.
+static void
+scavenge_mut_arr_ptrs_card (StgMutArrPtrs *a, W_ m, uint32_t gen_no)
+{
+    StgPtr p, q;
+    bool saved_eager_promotion;
+
+    ASSERT(m < mutArrPtrsCards(a->ptrs));
+
+    saved_eager_promotion = gct->eager_promotion;
+    gct->eager_promotion = false;
+
+    p = (StgPtr)&a->payload[m << MUT_ARR_PTRS_CARD_BITS];
+    q = stg_min(p + (1 << MUT_ARR_PTRS_CARD_BITS),
+                (StgPtr)&a->payload[a->ptrs]);
+    for (; p < q; p++) {
+        evacuate((StgClosure**)p);
+    }
+
+    gct->eager_promotion = saved_eager_promotion;
+
+    if (gct->failed_to_evac) {
+        gct->failed_to_evac = false;
+        *mutArrPtrsCard(a,m) = 1;
+        recordMutableCardGen_GC(a, m, gen_no);
+    } else {
+        *mutArrPtrsCard(a,m) = 0;
+    }
+}
+
 STATIC_INLINE StgPtr
 scavenge_small_bitmap (StgPtr p, StgWord size, StgWord bitmap)
 {
@@ -365,7 +456,9 @@ scavenge_thunk_srt(const StgInfoTable *info)
 {
     StgThunkInfoTable *thunk_info;
 
-    if (!major_gc) return;
+    // a concurrent mark needs the static objects too, see
+    // Note [Concurrent marking] in ConcMark.c
+    if (!major_gc && !conc_mark_active) return;
 
     thunk_info = itbl_to_thunk_itbl(info);
     if (thunk_info->i.srt) {
@@ -379,7 +472,9 @@ scavenge_fun_srt(const StgInfoTable *info)
 {
     StgFunInfoTable *fun_info;
 
-    if (!major_gc) return;
+    // a concurrent mark needs the static objects too, see
+    // Note [Concurrent marking] in ConcMark.c
+    if (!major_gc && !conc_mark_active) return;
 
     fun_info = itbl_to_fun_itbl(info);
     if (fun_info->i.srt) {
@@ -388,6 +483,126 @@ scavenge_fun_srt(const StgInfoTable *info)
     }
 }
 
+/* Note [Prefetching in scavenge_block]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   scavenge_block() calls evacuate() on each pointer field of each object
+   in turn, and evacuate() almost always starts with a cache miss: it
+   reads the block descriptor of the object that the field points to,
+   and then its info pointer.  For a large heap of small objects (a big
+   Data.Map, say) the GC spends much of its time waiting for these.
+
+   With +RTS --gc-prefetch, scavenge_block() doesn't evacuate the
+   fields of the common, simple objects (prefetchable_closure())
+   straight away.  It prefetches the block descriptor and the header of
+   the object that the field points to, and puts the field in a small
+   ring buffer (PrefetchRing); it evacuates a field only when
+   PREFETCH_DEPTH more fields have been put in after it, by which time
+   the object should have arrived in the cache.
+
+   Simple objects have no per-object state to update after their fields
+   have been evacuated, except that an object whose field points into a
+   younger generation (gct->failed_to_evac) goes on the mutable list.
+   So the ring remembers the object that each field is in, and
+   prefetch_evac_oldest() records the object itself; the fields of an
+   object leave the ring one after the other, so remembering the last
+   object recorded is enough to record each object only once.
+
+   The ring is emptied before any other kind of object, since they
+   change eager_promotion or look at failed_to_evac themselves, and at
+   the end of the block, after which we must look again for objects
+   copied into the block.
+
+   PREFETCH_DEPTH is a compromise between a distance long enough to
+   hide the latency of memory, and a ring short enough that we don't
+   prefetch so far ahead that the lines are gone again by the time we
+   get to them.
+   -------------------------------------------------------------------------- */
+
+#define PREFETCH_DEPTH 8        /* must be a power of 2 */
+
+typedef struct {
+    StgClosure **field[PREFETCH_DEPTH]; // fields waiting to be evacuated
+    StgClosure *obj[PREFETCH_DEPTH];    // ... and the objects they belong to
+    uint32_t head;                      // index of the oldest field
+    uint32_t n;                         // number of fields in the ring
+    StgClosure *recorded;               // last object put on the mut list
+} PrefetchRing;
+
+// Objects whose fields can go through the PrefetchRing (ARR_WORDS has
+// none, but needn't empty the ring either).  Static objects are never
+// in a block, so don't need to be excluded here.
+STATIC_INLINE bool
+prefetchable_closure (StgHalfWord type)
+{
+    return type <= THUNK_SELECTOR
+        || type == BLACKHOLE || type == WEAK || type == PRIM
+        || type == ARR_WORDS;
+}
+
+STATIC_INLINE void
+prefetch_evac_oldest (PrefetchRing *r, uint32_t gen_no)
+{
+    StgClosure **field = r->field[r->head];
+    StgClosure *obj = r->obj[r->head];
+
+    r->head = (r->head + 1) & (PREFETCH_DEPTH - 1);
+    r->n--;
+
+    evacuate(field);
+    if (gct->failed_to_evac) {
+        gct->failed_to_evac = false;
+        if (gen_no > 0 && obj != r->recorded) {
+            recordMutableGen_GC(obj, gen_no);
+            r->recorded = obj;
+        }
+    }
+}
+
+// Prefetch what field points to, and evacuate it later.  obj is the
+// object that contains the field, in generation gen_no.
+STATIC_INLINE void
+prefetch_evac (PrefetchRing *r, StgClosure **field, StgClosure *obj,
+               uint32_t gen_no)
+{
+    StgPtr q = (StgPtr)UNTAG_CLOSURE(*field);
+    uint32_t i;
+
+    // evacuate() looks at the block descriptor first, and then the info
+    // pointer.  If q is a static closure, Bdescr(q) is junk, but
+    // prefetching it is harmless.
+    __builtin_prefetch(Bdescr(q));
+    __builtin_prefetch(q);
+
+    if (r->n == PREFETCH_DEPTH) {
+        prefetch_evac_oldest(r, gen_no);
+    }
+    i = (r->head + r->n) & (PREFETCH_DEPTH - 1);
+    r->field[i] = field;
+    r->obj[i] = obj;
+    r->n++;
+}
+
+STATIC_INLINE void
+prefetch_flush (PrefetchRing *r, uint32_t gen_no)
+{
+    while (r->n > 0) {
+        prefetch_evac_oldest(r, gen_no);
+    }
+}
+
+// Evacuate a field of the object q, which must satisfy
+// prefetchable_closure(), in scavenge_block().
+#define scav_field(field)                                               \
+    do {                                                                \
+        if (prefetching) {                                              \
+            prefetch_evac(&ring, (StgClosure **)(field),                \
+                          (StgClosure *)q, bd->gen_no);                 \
+        } else {                                                        \
+            evacuate((StgClosure **)(field));                           \
+        }                                                               \
+    } while (0)
+
 /* -----------------------------------------------------------------------------
    Scavenge a block from the given scan pointer up to bd->free.
 
@@ -407,6 +622,8 @@ scavenge_block (bdescr *bd)
   const StgInfoTable *info;
   bool saved_eager_promotion;
   gen_workspace *ws;
+  bool prefetching;
+  PrefetchRing ring;
 
   debugTrace(DEBUG_gc, "scavenging block %p (gen %d) @ %p",
              bd->start, bd->gen_no, bd->u.scan);
@@ -420,6 +637,13 @@ scavenge_block (bdescr *bd)
 
   p = bd->u.scan;
 
+  // See Note [Prefetching in scavenge_block]
+  prefetching = RtsFlags.GcFlags.prefetch;
+  ring.head = 0;
+  ring.n = 0;
+  ring.recorded = NULL;
+
+loop:
   // we might be evacuating into the very object that we're
   // scavenging, so we have to check the real bd->free pointer each
   // time around the loop.
@@ -431,6 +655,10 @@ scavenge_block (bdescr *bd)
 
     ASSERT(gct->thunk_selector_depth == 0);
 
+    if (ring.n > 0 && !prefetchable_closure(info->type)) {
+        prefetch_flush(&ring, bd->gen_no);
+    }
+
     q = p;
     switch (info->type) {
 
@@ -472,27 +700,27 @@ scavenge_block (bdescr *bd)
 
     case FUN_2_0:
         scavenge_fun_srt(info);
-        evacuate(&((StgClosure *)p)->payload[1]);
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scav_field(&((StgClosure *)p)->payload[1]);
+        scav_field(&((StgClosure *)p)->payload[0]);
         p += sizeofW(StgHeader) + 2;
         break;
 
     case THUNK_2_0:
         scavenge_thunk_srt(info);
-        evacuate(&((StgThunk *)p)->payload[1]);
-        evacuate(&((StgThunk *)p)->payload[0]);
+        scav_field(&((StgThunk *)p)->payload[1]);
+        scav_field(&((StgThunk *)p)->payload[0]);
         p += sizeofW(StgThunk) + 2;
         break;
 
     case CONSTR_2_0:
-        evacuate(&((StgClosure *)p)->payload[1]);
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scav_field(&((StgClosure *)p)->payload[1]);
+        scav_field(&((StgClosure *)p)->payload[0]);
         p += sizeofW(StgHeader) + 2;
         break;
 
     case THUNK_1_0:
         scavenge_thunk_srt(info);
-        evacuate(&((StgThunk *)p)->payload[0]);
+        scav_field(&((StgThunk *)p)->payload[0]);
         p += sizeofW(StgThunk) + 1;
         break;
 
@@ -500,7 +728,7 @@ scavenge_block (bdescr *bd)
         scavenge_fun_srt(info);
         FALLTHROUGH;
     case CONSTR_1_0:
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scav_field(&((StgClosure *)p)->payload[0]);
         p += sizeofW(StgHeader) + 1;
         break;
 
@@ -530,7 +758,7 @@ scavenge_block (bdescr *bd)
 
     case THUNK_1_1:
         scavenge_thunk_srt(info);
-        evacuate(&((StgThunk *)p)->payload[0]);
+        scav_field(&((StgThunk *)p)->payload[0]);
         p += sizeofW(StgThunk) + 2;
         break;
 
@@ -538,7 +766,7 @@ scavenge_block (bdescr *bd)
         scavenge_fun_srt(info);
         FALLTHROUGH;
     case CONSTR_1_1:
-        evacuate(&((StgClosure *)p)->payload[0]);
+        scav_field(&((StgClosure *)p)->payload[0]);
         p += sizeofW(StgHeader) + 2;
         break;
 
@@ -553,7 +781,7 @@ scavenge_block (bdescr *bd)
         scavenge_thunk_srt(info);
         end = (P_)((StgThunk *)p)->payload + info->layout.payload.ptrs;
         for (p = (P_)((StgThunk *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
+            scav_field(p);
         }
         p += info->layout.payload.nptrs;
         break;
@@ -569,7 +797,7 @@ scavenge_block (bdescr *bd)
 
         end = (P_)((StgClosure *)p)->payload + info->layout.payload.ptrs;
         for (p = (P_)((StgClosure *)p)->payload; p < end; p++) {
-            evacuate((StgClosure **)p);
+            scav_field(p);
         }
         p += info->layout.payload.nptrs;
         break;
@@ -585,7 +813,7 @@ scavenge_block (bdescr *bd)
     }
 
     case BLACKHOLE:
-        evacuate(&((StgInd *)p)->indirectee);
+        scav_field(&((StgInd *)p)->indirectee);
         p += sizeofW(StgInd);
         break;
 
@@ -626,7 +854,7 @@ scavenge_block (bdescr *bd)
     case THUNK_SELECTOR:
     {
         StgSelector *s = (StgSelector *)p;
-        evacuate(&s->selectee);
+        scav_field(&s->selectee);
         p += THUNK_SELECTOR_sizeW();
         break;
     }
@@ -813,6 +1041,12 @@ scavenge_block (bdescr *bd)
     }
   }
 
+  if (ring.n > 0) {
+      // evacuating these may copy more objects into this block
+      prefetch_flush(&ring, bd->gen_no);
+      goto loop;
+  }
+
   if (p > bd->free)  {
       gct->copied += ws->todo_free - bd->free;
       bd->free = p;
@@ -833,6 +1067,8 @@ scavenge_block (bdescr *bd)
 
   gct->scan_bd = NULL;
 }
+
+#undef scav_field
 /* -----------------------------------------------------------------------------
    Scavenge everything on the mark stack.
 
@@ -1296,7 +1532,7 @@ scavenge_one(StgPtr p)
     }
 
     case WEAK:
-        // This WEAK object will not be considered by tidyWeakList during this
+        // This WEAK object will not be considered by tidyWeakPtrs during this
         // collection because it is in a generation > N, but it is on the
         // mutable list so we must evacuate all of its pointers because some
         // of them may point into a younger generation.
@@ -1571,6 +1807,19 @@ scavenge_mutable_list(bdescr *bd, generation *gen)
     for (; bd != NULL; bd = bd->link) {
         for (q = bd->start; q < bd->free; q++) {
             p = (StgPtr)*q;
+
+            if (IS_MUT_LIST_CARD(p)) {
+                // See Note [Card remembered set]
+                q++;
+#if defined(DEBUG)
+                mutlist_CARDS++;
+#endif
+                scavenge_mut_arr_ptrs_card(
+                    (StgMutArrPtrs *)((StgWord)p & ~MUT_LIST_CARD_TAG),
+                    *q, gen_no);
+                continue;
+            }
+
             ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
 
 #if defined(DEBUG)
@@ -1605,6 +1854,38 @@ scavenge_mutable_list(bdescr *bd, generation *gen)
             }
 #endif
 
+            // A whole-array entry for an array whose cards we
+            // remember individually, put here by unsafeThaw#: scavenge
+            // its dirty cards and record them one by one from now on.
+            // See Note [Card remembered set].
+            if (is_card_remset_closure((StgClosure *)p)) {
+                bool saved_eager_promotion, frozen;
+                StgHalfWord type = get_itbl((StgClosure *)p)->type;
+
+                frozen = type == MUT_ARR_PTRS_FROZEN_CLEAN
+                      || type == MUT_ARR_PTRS_FROZEN_DIRTY;
+
+                saved_eager_promotion = gct->eager_promotion;
+                gct->eager_promotion = false;
+
+                scavenge_mut_arr_ptrs_marked((StgMutArrPtrs *)p);
+
+                if (gct->failed_to_evac) {
+                    ((StgClosure *)p)->header.info = frozen
+                        ? &stg_MUT_ARR_PTRS_FROZEN_DIRTY_info
+                        : &stg_MUT_ARR_PTRS_DIRTY_info;
+                } else {
+                    ((StgClosure *)p)->header.info = frozen
+                        ? &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info
+                        : &stg_MUT_ARR_PTRS_CLEAN_info;
+                }
+
+                gct->eager_promotion = saved_eager_promotion;
+                gct->failed_to_evac = false;
+                record_dirty_cards((StgMutArrPtrs *)p, gen_no);
+                continue;
+            }
+
             // Check whether this object is "clean", that is it
             // definitely doesn't point into a young generation.
             // Clean objects don't need to be scavenged.  Some clean
@@ -1667,6 +1948,59 @@ scavenge_capability_mut_lists (Capability *cap)
     }
 }
 
+/* -----------------------------------------------------------------------------
+   Scavenging the threads for a concurrent mark.
+
+   The concurrent marker doesn't look inside TSOs and STACKs, which the
+   mutator changes without a write barrier.  Instead, the GC that starts
+   a concurrent mark marks the ones in the snapshot and scavenges them,
+   so that what they point to is shaded (see Note [Concurrent marking]
+   in ConcMark.c).  This is done by the main GC thread before the other
+   GC threads start.
+   -------------------------------------------------------------------------- */
+
+#if defined(THREADED_RTS) && !defined(PARALLEL_GC)
+
+static void
+scavenge_conc_mark_object (StgClosure *p)
+{
+    if (!concMarkPremark(p)) return;
+
+    gct->evac_gen_no = oldest_gen->no;
+    if (scavenge_one((StgPtr)p)) {
+        recordMutableGen_GC(p, oldest_gen->no);
+    }
+    gct->evac_gen_no = 0;
+}
+
+void
+scavenge_conc_mark_threads (void)
+{
+    uint32_t g;
+    StgTSO *tso;
+    StgStack *stack;
+    StgUnderflowFrame *frame;
+
+    for (g = 0; g < RtsFlags.GcFlags.generations; g++) {
+        for (tso = generations[g].threads; tso != END_TSO_QUEUE;
+             tso = tso->global_link) {
+            scavenge_conc_mark_object((StgClosure *)tso);
+
+            // and each chunk of its stack
+            for (stack = tso->stackobj; stack != NULL; ) {
+                scavenge_conc_mark_object((StgClosure *)stack);
+                frame = (StgUnderflowFrame*)
+                    (stack->stack + stack->stack_size
+                     - sizeofW(StgUnderflowFrame));
+                if (frame->info != &stg_stack_underflow_frame_info) break;
+                stack = frame->next_chunk;
+            }
+        }
+    }
+}
+
+#endif
+
 /* -----------------------------------------------------------------------------
    Scavenging the static objects.
 
@@ -1675,14 +2009,92 @@ scavenge_capability_mut_lists (Capability *cap)
    remove non-mutable objects from the mutable list at this point.
    -------------------------------------------------------------------------- */
 
+/* Note [Parallel static scavenging]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   In a major GC, the thread that first evacuates a static object puts
+   it on its own gct->static_objects list (see evacuate_static_object()),
+   and scavenge_static() takes it from there.  The static objects that
+   it refers to are evacuated when it is scavenged, so they go on the
+   same list: left alone, the thread that finds the first static
+   closures or CAFs ends up scavenging nearly all of them, which is a
+   long serial phase in every major GC of a program with a lot of
+   static data (large generated modules, big lookup tables).
+
+   So when a parallel GC does load balancing (work_stealing), the
+   static objects are shared out in chunks:
+
+     - each thread keeps count of the objects on its list
+       (n_static_objects).  When it has more than 2*STATIC_CHUNK of them
+       and the shared pool (in GCUtils.c) is empty, it keeps the first
+       STATIC_CHUNK and pushes the rest of the list onto the pool.
+       Finding the split point costs a walk over the objects that the
+       thread is going to scavenge next anyway.
+
+     - a thread whose own list is empty takes a list from the pool in
+       scavenge_loop(), and any_work() wakes up idle threads when there
+       is something there.  A thread that takes a long list splits it
+       again in the same way, so a long list is soon spread over all
+       the threads.
+
+     - a thread doesn't leave scavenge_loop() while the pool is
+       non-empty, so no work can be left behind in it at the end of
+       the GC.
+
+   Only pushing to an empty pool keeps the cost down when every thread
+   is busy: a list left in the pool is taken back by its owner once it
+   has run out of work of its own.
+
+   Each thread ends up with its own scavenged_static_objects list, just
+   as when every thread scavenges the static objects that it evacuated
+   itself.  The time spent here is reported separately in the +RTS -s
+   output.
+   -------------------------------------------------------------------------- */
+
+#if defined(PARALLEL_GC)
+
+#define STATIC_CHUNK 256
+
+// Keep the first STATIC_CHUNK objects on our static_objects list, and
+// offer the rest to the other GC threads.
+static void
+share_static_objects (void)
+{
+    StgClosure *flagged_p, *p;
+    const StgInfoTable *info;
+    uint32_t i;
+
+    flagged_p = gct->static_objects;
+    for (i = 1; i < STATIC_CHUNK; i++) {
+        p = UNTAG_STATIC_LIST_PTR(flagged_p);
+        flagged_p = *STATIC_LINK(get_itbl(p),p);
+    }
+    p = UNTAG_STATIC_LIST_PTR(flagged_p);
+    info = get_itbl(p);
+
+    if (push_static_objects(*STATIC_LINK(info,p),
+                            gct->n_static_objects - STATIC_CHUNK)) {
+        // still tagged with static_flag, so p stays marked as visited
+        *STATIC_LINK(info,p) = END_OF_STATIC_OBJECT_LIST;
+        gct->n_static_objects = STATIC_CHUNK;
+    }
+}
+
+#endif
+
 static void
 scavenge_static(void)
 {
   StgClosure *flagged_p, *p;
   const StgInfoTable *info;
+  Time start = 0;
 
   debugTrace(DEBUG_gc, "scavenging static objects");
 
+  if (RtsFlags.GcFlags.giveStats != NO_GC_STATS) {
+      start = getProcessElapsedTime();
+  }
+
   /* Always evacuate straight to the oldest generation for static
    * objects */
   gct->evac_gen_no = oldest_gen->no;
@@ -1700,6 +2112,15 @@ scavenge_static(void)
     if (flagged_p == END_OF_STATIC_OBJECT_LIST) {
           break;
     }
+
+#if defined(PARALLEL_GC)
+    // See Note [Parallel static scavenging]
+    if (gct->n_static_objects > 2 * STATIC_CHUNK &&
+        work_stealing && static_pool_n == 0) {
+        share_static_objects();
+    }
+#endif
+
     p = UNTAG_STATIC_LIST_PTR(flagged_p);
 
     ASSERT(LOOKS_LIKE_CLOSURE_PTR(p));
@@ -1712,6 +2133,9 @@ scavenge_static(void)
     gct->static_objects = *STATIC_LINK(info,p);
     *STATIC_LINK(info,p) = gct->scavenged_static_objects;
     gct->scavenged_static_objects = flagged_p;
+    ASSERT(gct->n_static_objects > 0);
+    gct->n_static_objects--;
+    gct->static_scavenged++;
 
     switch (info -> type) {
 
@@ -1768,6 +2192,12 @@ scavenge_static(void)
 
     ASSERT(gct->failed_to_evac == false);
   }
+
+  ASSERT(gct->n_static_objects == 0);
+
+  if (RtsFlags.GcFlags.giveStats != NO_GC_STATS) {
+      gct->static_time += getProcessElapsedTime() - start;
+  }
 }
 
 /* -----------------------------------------------------------------------------
@@ -1908,7 +2338,7 @@ scavenge_stack(StgPtr p, StgPtr stack_end)
         p = scavenge_small_bitmap(p, size, bitmap);
 
     follow_srt:
-        if (major_gc && info->i.srt) {
+        if ((major_gc || conc_mark_active) && info->i.srt) {
             StgClosure *srt = (StgClosure*)GET_SRT(info);
             evacuate(&srt);
         }
@@ -1958,6 +2388,262 @@ scavenge_stack(StgPtr p, StgPtr stack_end)
   }
 }
 
+/* Note [Scavenging huge arrays]
+   ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+
+   An array is a large object, and the large objects of a workspace are
+   scavenged one at a time by scavenge_large() on the thread that
+   evacuated them.  When the heap is dominated by a few huge arrays,
+   that leaves the other threads of a parallel GC with nothing to do
+   while one thread walks an array of millions of elements.
+
+   So in a parallel GC with load balancing (work_stealing), an array of
+   more than two pieces, where a piece is ARRAY_CHUNK_CARDS cards of a
+   MUT_ARR_PTRS or as many elements of a SMALL_MUT_ARR_PTRS, is
+   scavenged by scavenge_huge_array() instead:
+
+     - the range of pieces still to do is split in half repeatedly, and
+       the top halves are pushed onto the thread's array_q, a WSDeque
+       of ArrayChunk descriptors that the other threads steal from
+       just as they steal blocks from the todo_q of a workspace.  A
+       thread that takes a range from a deque splits it again in the
+       same way, so the array is soon shared out, and the deques never
+       hold more than a few entries per array.
+
+     - pieces are whole cards, so every card byte is written by the one
+       thread that scavenged the card, and with --card-remset that
+       thread also records the card (Note [Card remembered set]).
+
+     - the array is marked clean before any of it is pushed, and the
+       first thread to find a card that still points into a younger
+       generation marks it dirty with a CAS.  A mutable array is
+       always on the mutable list, so we put it there up front; a
+       frozen one is put there by whoever won the CAS.
+
+   Nothing waits for all the pieces of an array to be done: the header
+   and the mutable list are correct as soon as the last piece is.
+   -------------------------------------------------------------------------- */
+
+#if defined(PARALLEL_GC)
+
+#define ARRAY_CHUNK_CARDS 32
+#define SMALL_ARRAY_CHUNK (ARRAY_CHUNK_CARDS << MUT_ARR_PTRS_CARD_BITS)
+
+// The size of a piece of array p, in the units of an ArrayChunk
+STATIC_INLINE W_
+array_piece (StgClosure *p)
+{
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        return ARRAY_CHUNK_CARDS;
+    default:
+        return SMALL_ARRAY_CHUNK;
+    }
+}
+
+// Is p an array that is worth scavenging in pieces?  Returns the number
+// of cards (elements, for a small array) if so, and 0 otherwise.
+static W_
+huge_array_size (StgClosure *p)
+{
+    W_ n;
+
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        n = mutArrPtrsCards(((StgMutArrPtrs *)p)->ptrs);
+        break;
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+    case SMALL_MUT_ARR_PTRS_FROZEN_CLEAN:
+    case SMALL_MUT_ARR_PTRS_FROZEN_DIRTY:
+        n = ((StgSmallMutArrPtrs *)p)->ptrs;
+        break;
+    default:
+        return 0;
+    }
+    return n > 2 * array_piece(p) ? n : 0;
+}
+
+// Mark a huge array dirty, unless some other thread already has.
+// Returns true if we did it.
+static bool
+dirty_huge_array (StgClosure *p)
+{
+    const StgInfoTable *clean, *dirty;
+
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+        clean = &stg_MUT_ARR_PTRS_CLEAN_info;
+        dirty = &stg_MUT_ARR_PTRS_DIRTY_info;
+        break;
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        clean = &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info;
+        dirty = &stg_MUT_ARR_PTRS_FROZEN_DIRTY_info;
+        break;
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+        clean = &stg_SMALL_MUT_ARR_PTRS_CLEAN_info;
+        dirty = &stg_SMALL_MUT_ARR_PTRS_DIRTY_info;
+        break;
+    default:
+        clean = &stg_SMALL_MUT_ARR_PTRS_FROZEN_CLEAN_info;
+        dirty = &stg_SMALL_MUT_ARR_PTRS_FROZEN_DIRTY_info;
+        break;
+    }
+    return cas((StgVolatilePtr)&p->header.info,
+               (StgWord)clean, (StgWord)dirty) == (StgWord)clean;
+}
+
+// Scavenge the pieces [from,to) of a huge array, one after the other.
+static void
+scavenge_array_piece (StgClosure *p, W_ from, W_ to, uint32_t gen_no)
+{
+    StgPtr q, lim, end;
+    W_ m;
+    bool mutable, cards, failed, saved_eager_promotion;
+
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+        mutable = true;
+        break;
+    default:
+        mutable = false;
+        break;
+    }
+
+    gct->evac_gen_no = gen_no;
+    saved_eager_promotion = gct->eager_promotion;
+    if (mutable) {
+        // see scavenge_block()
+        gct->eager_promotion = false;
+    }
+
+    failed = false;
+    if (array_piece(p) == ARRAY_CHUNK_CARDS) {
+        StgMutArrPtrs *a = (StgMutArrPtrs *)p;
+
+        cards = gen_no > 0 && isCardRemSetArray(a);
+        end = (StgPtr)&a->payload[a->ptrs];
+        for (m = from; m < to; m++) {
+            q = (StgPtr)&a->payload[m << MUT_ARR_PTRS_CARD_BITS];
+            lim = stg_min(q + (1 << MUT_ARR_PTRS_CARD_BITS), end);
+            for (; q < lim; q++) {
+                evacuate((StgClosure**)q);
+            }
+            if (gct->failed_to_evac) {
+                failed = true;
+                gct->failed_to_evac = false;
+                *mutArrPtrsCard(a,m) = 1;
+                if (cards) {
+                    // See Note [Card remembered set]
+                    recordMutableCardGen_GC(a, m, gen_no);
+                }
+            } else {
+                *mutArrPtrsCard(a,m) = 0;
+            }
+        }
+    } else {
+        StgSmallMutArrPtrs *a = (StgSmallMutArrPtrs *)p;
+
+        cards = false;
+        end = (StgPtr)&a->payload[to];
+        for (q = (StgPtr)&a->payload[from]; q < end; q++) {
+            evacuate((StgClosure**)q);
+        }
+        failed = gct->failed_to_evac;
+        gct->failed_to_evac = false;
+    }
+
+    gct->eager_promotion = saved_eager_promotion;
+
+    if (failed && dirty_huge_array(p) && !mutable && !cards && gen_no > 0) {
+        recordMutableGen_GC(p, gen_no);
+    }
+}
+
+// Scavenge the pieces [from,to) of a huge array, pushing the top half
+// of the range for other threads to steal for as long as it is more
+// than one piece.
+static void
+scavenge_array_range (StgClosure *p, W_ from, W_ to, uint32_t gen_no)
+{
+    W_ piece, n;
+    ArrayChunk *c;
+
+    piece = array_piece(p);
+    while ((n = (to - from + piece - 1) / piece) > 1) {
+        c = alloc_array_chunk();
+        c->arr = p;
+        c->from = from + (n / 2) * piece;
+        c->to = to;
+        if (!pushWSDeque(gct->array_q, c)) {
+            // the deque is full: just do the rest ourselves
+            free_array_chunk(c);
+            break;
+        }
+        to = c->from;
+    }
+    scavenge_array_piece(p, from, to, gen_no);
+}
+
+// Scavenge a range of a huge array that we took from a deque
+static void
+scavenge_array_chunk (ArrayChunk *c)
+{
+    StgClosure *p = c->arr;
+    W_ from = c->from, to = c->to;
+
+    free_array_chunk(c);
+    scavenge_array_range(p, from, to, Bdescr((StgPtr)p)->gen_no);
+}
+
+// Scavenge a huge array of n cards (elements, if small) in gen_no that
+// we have just taken off the large objects list.
+static void
+scavenge_huge_array (StgClosure *p, W_ n, uint32_t gen_no)
+{
+    switch (get_itbl(p)->type) {
+    case MUT_ARR_PTRS_CLEAN:
+    case MUT_ARR_PTRS_DIRTY:
+        SET_INFO(p, &stg_MUT_ARR_PTRS_CLEAN_info);
+        if (gen_no > 0 && !is_card_remset_closure(p)) {
+            recordMutableGen_GC(p, gen_no);
+        }
+        break;
+    case MUT_ARR_PTRS_FROZEN_CLEAN:
+    case MUT_ARR_PTRS_FROZEN_DIRTY:
+        SET_INFO(p, &stg_MUT_ARR_PTRS_FROZEN_CLEAN_info);
+        break;
+    case SMALL_MUT_ARR_PTRS_CLEAN:
+    case SMALL_MUT_ARR_PTRS_DIRTY:
+        SET_INFO(p, &stg_SMALL_MUT_ARR_PTRS_CLEAN_info);
+        if (gen_no > 0) {
+            recordMutableGen_GC(p, gen_no);
+        }
+        break;
+    default:
+        SET_INFO(p, &stg_SMALL_MUT_ARR_PTRS_FROZEN_CLEAN_info);
+        break;
+    }
+
+    // pushWSDeque() has a write barrier, so the clean header is visible
+    // before any piece of the array is
+    scavenge_array_range(p, 0, n, gen_no);
+}
+
+#endif /* PARALLEL_GC */
+
 /*-----------------------------------------------------------------------------
   scavenge the large object list.
 
@@ -1998,9 +2684,27 @@ scavenge_large (gen_workspace *ws)
         }
         RELEASE_SPIN_LOCK(&ws->gen->sync);
 
+#if defined(PARALLEL_GC)
+        if (work_stealing) {
+            W_ n = huge_array_size((StgClosure *)p);
+            if (n > 0) {
+                // See Note [Scavenging huge arrays]
+                scavenge_huge_array((StgClosure *)p, n, ws->gen->no);
+                gct->evac_gen_no = ws->gen->no;
+                gct->scanned += closure_sizeW((StgClosure*)p);
+                continue;
+            }
+        }
+#endif
+
         if (scavenge_one(p)) {
             if (ws->gen->no > 0) {
-                recordMutableGen_GC((StgClosure *)p, ws->gen->no);
+                if (is_card_remset_closure((StgClosure *)p)) {
+                    // See Note [Card remembered set]
+                    record_dirty_cards((StgMutArrPtrs *)p, ws->gen->no);
+                } else {
+                    recordMutableGen_GC((StgClosure *)p, ws->gen->no);
+                }
             }
         }
 
@@ -2009,6 +2713,40 @@ scavenge_large (gen_workspace *ws)
     }
 }
 
+/* ----------------------------------------------------------------------------
+   Scavenge the objects that alloc_in_hole() copied into holes in the
+   oldest generation.  See Note [Filling holes] in Sweep.c.  Holes are
+   only filled in minor GCs, so we can use scavenge_one().
+   ------------------------------------------------------------------------- */
+
+static void
+scavenge_holes (void)
+{
+    bdescr *bd;
+    StgPtr p;
+
+    gct->evac_gen_no = oldest_gen->no;
+
+    while ((bd = gct->hole_todo_bd) != NULL) {
+        if (gct->hole_todo_sp == bd->start) {
+            // the blocks underneath the top one are full
+            gct->hole_todo_bd = bd->link;
+            gct->hole_todo_sp = bd->link == NULL ? NULL
+                : bd->link->start + BLOCK_SIZE_W;
+            freeGroup_sync(bd);
+            continue;
+        }
+
+        p = (StgPtr)*--gct->hole_todo_sp;
+        if (scavenge_one(p)) {
+            recordMutableGen_GC((StgClosure *)p, oldest_gen->no);
+        }
+
+        // stats
+        gct->scanned += closure_sizeW((StgClosure*)p);
+    }
+}
+
 /* ----------------------------------------------------------------------------
    Look for work to do.
 
@@ -2035,6 +2773,9 @@ scavenge_find_work (void)
     gen_workspace *ws;
     bool did_something, did_anything;
     bdescr *bd;
+#if defined(PARALLEL_GC)
+    ArrayChunk *chunk;
+#endif
 
     gct->scav_find_work++;
 
@@ -2042,6 +2783,12 @@ scavenge_find_work (void)
 
 loop:
     did_something = false;
+
+    if (gct->hole_todo_bd != NULL) {
+        scavenge_holes();
+        did_anything = true;
+    }
+
     for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
         ws = &gct->gens[g];
 
@@ -2075,17 +2822,44 @@ loop:
         goto loop;
     }
 
+#if defined(PARALLEL_GC)
+    // pieces of huge arrays, see Note [Scavenging huge arrays]
+    if ((chunk = popWSDeque(gct->array_q)) != NULL) {
+        scavenge_array_chunk(chunk);
+        did_anything = true;
+        goto loop;
+    }
+#endif
+
 #if defined(THREADED_RTS)
     if (work_stealing) {
-        // look for work to steal
+        // look for work to steal, from the threads on our own NUMA
+        // node first (see Note [NUMA-aware GC] in GC.c)
         for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
-            if ((bd = steal_todo_block(g)) != NULL) {
+            if ((bd = steal_todo_block(g, false)) != NULL) {
                 scavenge_block(bd);
                 did_something = true;
                 break;
             }
         }
 
+        if (!did_something && n_numa_nodes > 1) {
+            for (g = RtsFlags.GcFlags.generations-1; g >= 0; g--) {
+                if ((bd = steal_todo_block(g, true)) != NULL) {
+                    scavenge_block(bd);
+                    did_something = true;
+                    break;
+                }
+            }
+        }
+
+#if defined(PARALLEL_GC)
+        if (!did_something && (chunk = steal_array_chunk()) != NULL) {
+            scavenge_array_chunk(chunk);
+            did_something = true;
+        }
+#endif
+
         if (did_something) {
             did_anything = true;
             goto loop;
@@ -2110,10 +2884,19 @@ scavenge_loop(void)
 loop:
     work_to_do = false;
 
-    // scavenge static objects
-    if (major_gc && gct->static_objects != END_OF_STATIC_OBJECT_LIST) {
-        IF_DEBUG(sanity, checkStaticObjects(gct->static_objects));
-        scavenge_static();
+    // scavenge static objects, taking some from the other threads if
+    // we have none of our own (Note [Parallel static scavenging])
+    if (major_gc) {
+#if defined(PARALLEL_GC)
+        if (gct->static_objects == END_OF_STATIC_OBJECT_LIST &&
+            static_pool_n > 0) {
+            grab_static_objects();
+        }
+#endif
+        if (gct->static_objects != END_OF_STATIC_OBJECT_LIST) {
+            IF_DEBUG(sanity, checkStaticObjects(gct->static_objects));
+            scavenge_static();
+        }
     }
 
     // scavenge objects in compacted generation
@@ -2130,4 +2913,8 @@ loop:
     if (scavenge_find_work()) goto loop;
 
     if (work_to_do) goto loop;
+
+#if defined(PARALLEL_GC)
+    if (major_gc && static_pool_n > 0) goto loop;
+#endif
 }
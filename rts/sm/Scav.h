@@ -21,6 +21,7 @@ void    scavenge_capability_mut_lists (Capability *cap);
 #if defined(THREADED_RTS)
 void    scavenge_loop1 (void);
 void    scavenge_capability_mut_Lists1 (Capability *cap);
+void    scavenge_conc_mark_threads (void);
 #endif
 
 #include "EndPrivate.h"
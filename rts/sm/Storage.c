@@ -29,6 +29,8 @@
 #include "Trace.h"
 #include "GC.h"
 #include "Evac.h"
+#include "Pinned.h"
+#include "ConcMark.h"
 #if defined(ios_HOST_OS)
 #include "Hash.h"
 #endif
@@ -48,6 +50,8 @@ bool           keepCAFs;
 W_ large_alloc_lim;    /* GC if n_large_blocks in any nursery
                         * reaches this. */
 
+W_ card_remset_min_ptrs = (W_)-1; /* see isCardRemSetArray() */
+
 bdescr *exec_block;
 
 generation *generations = NULL; /* all the generations */
@@ -119,7 +123,6 @@ initGeneration (generation *gen, int g)
     gen->threads = END_TSO_QUEUE;
     gen->old_threads = END_TSO_QUEUE;
     gen->weak_ptr_list = NULL;
-    gen->old_weak_ptr_list = NULL;
 }
 
 void
@@ -193,11 +196,17 @@ initStorage (void)
       large_alloc_lim = RtsFlags.GcFlags.minAllocAreaSize * BLOCK_SIZE_W;
   }
 
+  if (RtsFlags.GcFlags.cardRemSet) {
+      card_remset_min_ptrs =
+          (W_)CARD_REMSET_MIN_CARDS << MUT_ARR_PTRS_CARD_BITS;
+  }
+
   exec_block = NULL;
 
 #if defined(THREADED_RTS)
   initSpinLock(&gc_alloc_block_sync);
 #endif
+  initConcMark();
   N = 0;
 
   for (n = 0; n < n_numa_nodes; n++) {
@@ -289,6 +298,8 @@ exitStorage (void)
 void
 freeStorage (bool free_heap)
 {
+    stopConcMarkThread();
+    stopDecommitThread();
     stgFree(generations);
     if (free_heap) freeAllMBlocks();
 #if defined(THREADED_RTS)
@@ -299,6 +310,7 @@ freeStorage (bool free_heap)
     freeThreadLocalKey(&gctKey);
 #endif
     freeGcThreads();
+    freePinnedMarks();
 }
 
 /* -----------------------------------------------------------------------------
@@ -890,6 +902,10 @@ allocateMightFail (Capability *cap, W_ n)
         bd->flags = BF_LARGE;
         bd->free = bd->start + n;
         cap->total_allocated += n;
+        cap->alloc_sample_left -= n * sizeof(W_);
+        if (RTS_UNLIKELY(cap->alloc_sample_left < 0)) {
+            allocSampleLarge(cap, bd);
+        }
         return bd->start;
     }
 
@@ -909,10 +925,8 @@ allocateMightFail (Capability *cap, W_ n)
         if (bd == NULL) {
             // The nursery is empty: allocate a fresh block (we can't
             // fail here).
-            ACQUIRE_SM_LOCK;
-            bd = allocBlockOnNode(cap->node);
+            bd = allocBlockOnCap(cap);
             cap->r.rNursery->n_blocks++;
-            RELEASE_SM_LOCK;
             initBdescr(bd, g0, g0);
             bd->flags = 0;
             // If we had to allocate a new block, then we'll GC
@@ -1004,6 +1018,16 @@ allocatePinned (Capability *cap, W_ n)
     }
 
     accountAllocation(cap, n);
+
+    // Fill the holes in older pinned blocks first, see Note [Reusing
+    // pinned holes] in Pinned.c.
+    if (cap->pinned_hole_mask != 0) {
+        p = allocPinnedHole(cap, n);
+        if (p != NULL) {
+            return p;
+        }
+    }
+
     bd = cap->pinned_object_block;
 
     // If we don't have a block of pinned objects yet, or the current
@@ -1030,9 +1054,7 @@ allocatePinned (Capability *cap, W_ n)
         if (bd == NULL) {
             // The nursery is empty: allocate a fresh block (we can't fail
             // here).
-            ACQUIRE_SM_LOCK;
-            bd = allocBlockOnNode(cap->node);
-            RELEASE_SM_LOCK;
+            bd = allocBlockOnCap(cap);
             initBdescr(bd, g0, g0);
         } else {
             newNurseryBlock(bd);
@@ -1087,6 +1109,50 @@ dirty_MUT_VAR(StgRegTable *reg, StgClosure *p)
     }
 }
 
+/*
+   This is the write barrier for the cards of a MUT_ARR_PTRS whose cards
+   are on the remembered set (see Note [Card remembered set] in Scav.c).
+   Compiled code sets the card bytes of other arrays itself.  For these,
+   it calls dirty_MUT_ARR_PTRS_card when it writes to an element whose
+   card is clean, and copies call dirty_MUT_ARR_PTRS_cards for the range
+   of elements they wrote.  If the array lives in an old generation, each
+   card that becomes dirty is put on the mutable list.
+*/
+void
+dirty_MUT_ARR_PTRS_card(StgRegTable *reg, StgMutArrPtrs *a, W_ card)
+{
+    StgWord8 *c = mutArrPtrsCard(a, card);
+    if (*c == 0) {
+        *c = 1;
+        if (isCardRemSetArray(a)) {
+            bdescr *bd = Bdescr((StgPtr)a);
+            if (bd->gen_no != 0) {
+                recordMutableCardCap(a, card, regTableToCapability(reg),
+                                     bd->gen_no);
+            }
+        }
+    }
+}
+
+void
+dirty_MUT_ARR_PTRS_cards(StgRegTable *reg, StgMutArrPtrs *a, W_ off, W_ n)
+{
+    W_ m, start, end;
+
+    ASSERT(n > 0);
+    start = off >> MUT_ARR_PTRS_CARD_BITS;
+    end = (off + n - 1) >> MUT_ARR_PTRS_CARD_BITS;
+
+    if (!isCardRemSetArray(a) || Bdescr((StgPtr)a)->gen_no == 0) {
+        memset(mutArrPtrsCard(a, start), 1, end - start + 1);
+        return;
+    }
+
+    for (m = start; m <= end; m++) {
+        dirty_MUT_ARR_PTRS_card(reg, a, m);
+    }
+}
+
 void
 dirty_TVAR(Capability *cap, StgTVar *p)
 {
@@ -1168,6 +1234,9 @@ dirty_MVAR(StgRegTable *reg, StgClosure *p)
  *     CurrentAlloc are added to cap->total_allocated. (see
  *     updateNurseriesStats())
  *
+ *   - Allocation samples are taken at the same places, see
+ *     Note [Allocation sampling] in AllocSample.c.
+ *
  * -------------------------------------------------------------------------- */
 
 //
@@ -1209,6 +1278,8 @@ updateNurseriesStats (void)
         if (bd) finishedNurseryBlock(capabilities[i], bd);
         bd = capabilities[i]->r.rCurrentAlloc;
         if (bd) finishedNurseryBlock(capabilities[i], bd);
+        // a sampled large object might not survive the GC
+        flushAllocSample(capabilities[i]);
     }
 }
 
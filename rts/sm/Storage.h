@@ -49,6 +49,23 @@ extern Mutex sm_mutex;
 void dirty_MVAR(StgRegTable *reg, StgClosure *p);
 void dirty_TVAR(Capability *cap, StgTVar *p);
 
+/* -----------------------------------------------------------------------------
+   Arrays whose dirty cards are remembered individually (+RTS
+   --card-remset).  See Note [Card remembered set] in Scav.c.
+
+   Such arrays are always large objects, so they never move.  Compiled
+   code makes the same test against card_remset_min_ptrs, which is all
+   ones unless --card-remset is given, to decide whether it can set a
+   card byte itself.
+   -------------------------------------------------------------------------- */
+
+#define CARD_REMSET_MIN_CARDS 64
+
+INLINE_HEADER bool isCardRemSetArray (StgMutArrPtrs *a)
+{
+    return a->ptrs >= card_remset_min_ptrs;
+}
+
 /* -----------------------------------------------------------------------------
    Nursery manipulation
    -------------------------------------------------------------------------- */
@@ -82,10 +99,15 @@ bool doYouWantToGC(Capability *cap)
 
 //
 // Called when we are finished allocating into a block; account for the amount
-// allocated in cap->total_allocated.
+// allocated in cap->total_allocated, and take an allocation sample if it is
+// due (see Note [Allocation sampling] in AllocSample.c).
 //
 INLINE_HEADER void finishedNurseryBlock (Capability *cap, bdescr *bd) {
     cap->total_allocated += bd->free - bd->start;
+    cap->alloc_sample_left -= (bd->free - bd->start) * sizeof(W_);
+    if (RTS_UNLIKELY(cap->alloc_sample_left < 0)) {
+        allocSample(cap, bd);
+    }
 }
 
 INLINE_HEADER void newNurseryBlock (bdescr *bd) {
@@ -15,22 +15,350 @@
 #include "Rts.h"
 
 #include "BlockAlloc.h"
+#include "Storage.h"
+#include "GCThread.h"
+#include "GCUtils.h"
+#include "Compact.h"
 #include "Sweep.h"
 #include "Trace.h"
+#include "GC.h"
+#include "RtsUtils.h"
+
+// Count the words of bd's mark bitmap that have at least one bit set.
+// Each bitmap word covers BITS_IN(W_) words of the block.
+STATIC_INLINE W_
+block_resid (bdescr *bd)
+{
+    uint32_t i;
+    W_ resid = 0;
+
+    for (i = 0; i < BLOCK_SIZE_W / BITS_IN(W_); i++)
+    {
+        if (bd->u.bitmap[i] != 0) resid++;
+    }
+    return resid;
+}
+
+/* -----------------------------------------------------------------------------
+   Note [Filling holes]
+   ~~~~~~~~~~~~~~~~~~~~
+
+   sweep() can only free blocks that have no live data at all; the
+   space between the live objects in the other blocks is wasted until
+   the next major GC copies the live objects out of the fragmented
+   blocks.  With +RTS --fill-holes, sweep() also collects that space
+   into free lists, and the minor GCs until the next major GC fill it
+   with the objects they promote into the oldest generation:
+
+     - a hole is a run of dead objects of at least HOLE_MIN_WORDS words
+       between two live objects (or the end of the block).  Only the
+       first word of a live object is marked in the bitmap, so we find
+       the end of each live object from its size.
+
+     - the hole is overwritten with an ARR_WORDS, so that the block can
+       still be traversed linearly (by the heap profiler, for example),
+       and the first word of its payload links it into the free list
+       for its size class (add_hole(), and see HoleLists.h).  Each GC
+       thread has its own free lists (gc_thread.hole_lists), and sweep()
+       hands out the blocks' holes round-robin among the threads on the
+       block's NUMA node (hole_owner()).  A parallel sweep (Note
+       [Parallel sweeping]) gives each thread the holes of the blocks it
+       swept instead, except with --numa, where we sweep serially to keep
+       the holes local.
+
+     - alloc_for_copy() calls alloc_in_hole() when copying an object
+       into the oldest generation.  This takes the object from the end
+       of a hole that is big enough to leave a valid ARR_WORDS behind,
+       and returns the rest of the hole to the free lists.
+
+     - an object copied into a hole is not in a todo block, so it
+       won't be scavenged by scavenge_block().  Instead each GC thread
+       keeps a stack of the objects it has copied into holes, which
+       scavenge_find_work() empties with scavenge_holes().
+
+   A major GC collects the blocks that the holes are in, so it starts
+   by throwing away the free lists (discardHoles()).  Filling holes
+   doesn't add blocks to the oldest generation, so it doesn't bring the
+   next major GC closer: that only happens once the holes run out.
+   -------------------------------------------------------------------------- */
+
+// Put the holes in the swept block bd on the free lists of GC thread
+// t.  Returns the number of words in the holes.
+static W_
+collect_holes (bdescr *bd, gc_thread *t)
+{
+    StgPtr p, q;
+    W_ words = 0;
+
+    p = bd->start;
+    while (p < bd->free) {
+        q = p;
+        while (q < bd->free && !is_marked(q,bd)) {
+            q++;
+        }
+        if ((W_)(q - p) >= HOLE_MIN_WORDS) {
+            add_hole(t, p, q - p);
+            words += q - p;
+        }
+        if (q >= bd->free) {
+            break;
+        }
+        p = q + closure_sizeW((StgClosure *)q);
+    }
+
+    return words;
+}
+
+// The GC thread that gets the holes of block bd, the n'th block swept.
+// We hand the blocks out round-robin among the threads on bd's NUMA
+// node, so that objects copied into a hole end up in memory local to
+// the thread (and Capability) that copied them.  See Note [NUMA-aware
+// GC] in GC.c.
+static gc_thread *
+hole_owner (bdescr *bd, W_ n)
+{
+    uint32_t per_node;
+
+    if (n_numa_nodes == 1 || bd->node >= n_capabilities) {
+        return gc_threads[n % n_capabilities];
+    }
+
+    // Capability i is on node i % n_numa_nodes, see capNoToNumaNode()
+    per_node = (n_capabilities - bd->node + n_numa_nodes - 1) / n_numa_nodes;
+    return gc_threads[bd->node + (n % per_node) * n_numa_nodes];
+}
+
+// Forget all the holes: a major GC is about to collect the blocks that
+// they are in.
+void
+discardHoles (void)
+{
+    uint32_t i, c;
+    gc_thread *t;
+
+    for (i = 0; i < n_capabilities; i++) {
+        t = gc_threads[i];
+        ASSERT(t->hole_todo_bd == NULL);
+        for (c = 0; c < N_HOLE_CLASSES; c++) {
+            t->hole_lists[c] = NULL;
+        }
+        t->hole_mask = 0;
+    }
+}
+
+/* -----------------------------------------------------------------------------
+   Note [Parallel sweeping]
+   ~~~~~~~~~~~~~~~~~~~~~~~~
+
+   In a parallel major GC of a mark/sweep oldest generation, the other GC
+   threads stand by while the main thread marks; see GarbageCollect().
+   They are woken up for the final sweep, and wait in sweepWorker() until
+   the main thread has set up the sweep:
+
+     - sweep() puts the old blocks into an array, sweep_blocks, and the
+       threads claim chunks of SWEEP_CHUNK entries of it with an atomic
+       counter, as the compacting threads do with their regions.
+
+     - each thread keeps its own counters (SweepCounts) and its own chain
+       of empty blocks, and clears their entries in sweep_blocks.  When
+       it runs out of chunks it frees its chain in one go, under
+       gc_alloc_block_sync, and adds its counters to the totals.
+
+     - when every thread has finished, the main thread relinks
+       gen->old_blocks from the blocks left in sweep_blocks, in their
+       original order.
+
+   Sweeping is dominated by reading the mark bitmaps (and, with
+   --fill-holes, the blocks themselves), which the threads now do in
+   parallel; only the relinking is left to the main thread.
+
+   A lazy sweep (Note [Lazy sweeping]) leaves the work to the mutator,
+   so the scheduler doesn't ask for a parallel GC in that case (see
+   scheduleDoGC()); should the threads be waiting anyway,
+   startLazySweep() just lets them go.
+   -------------------------------------------------------------------------- */
+
+#define SWEEP_CHUNK 256         /* blocks per chunk of sweep_blocks */
+
+typedef struct {
+    W_ blocks;                  // marked blocks swept
+    W_ freed;                   // ... of which were empty, and freed
+    W_ fragd;                   // ... of which are fragmented
+    W_ live;                    // estimate of live words
+    W_ holes;                   // words of holes collected
+} SweepCounts;
+
+// Sweep the marked block bd, giving its holes to t, or to hole_owner()
+// if t is NULL.  Returns true if bd is empty and should be freed.
+static bool
+sweep_block (bdescr *bd, gc_thread *t, SweepCounts *c)
+{
+    W_ resid;
+
+    c->blocks++;
+    resid = block_resid(bd);
+    c->live += resid * BITS_IN(W_);
+
+    if (resid == 0) {
+        c->freed++;
+        return true;
+    }
+
+    if (resid < (BLOCK_SIZE_W * 3) / (BITS_IN(W_) * 4)) {
+        c->fragd++;
+        bd->flags |= BF_FRAGMENTED;
+    }
+
+    bd->flags |= BF_SWEPT;
+
+    if (RtsFlags.GcFlags.fillHoles) {
+        c->holes += collect_holes(bd, t != NULL ? t : hole_owner(bd, c->blocks));
+    }
+    return false;
+}
+
+#if defined(THREADED_RTS)
+
+static bdescr **sweep_blocks;           // the old blocks, NULL when freed
+static W_ n_sweep_blocks;
+static volatile StgWord next_sweep_chunk;
+
+static volatile StgWord sweep_go;       // the sweep has been set up
+static volatile StgWord n_sweep_done;   // other GC threads finished
+
+// Totals over all the GC threads
+static volatile StgWord sweep_blocks_total, sweep_freed_total,
+    sweep_fragd_total, sweep_live_total, sweep_holes_total;
+
+// Sweep chunks of sweep_blocks until there are none left.
+static void
+sweep_chunks (gc_thread *t)
+{
+    SweepCounts c = { 0, 0, 0, 0, 0 };
+    bdescr *bd, *freed = NULL;
+    W_ chunk, i, end;
+
+    while ((chunk = atomic_inc(&next_sweep_chunk, 1) - 1) * SWEEP_CHUNK
+           < n_sweep_blocks) {
+        end = stg_min((chunk + 1) * SWEEP_CHUNK, n_sweep_blocks);
+        for (i = chunk * SWEEP_CHUNK; i < end; i++) {
+            bd = sweep_blocks[i];
+            if (!(bd->flags & BF_MARKED)) continue;
+            if (sweep_block(bd, t, &c)) {
+                sweep_blocks[i] = NULL;
+                bd->link = freed;
+                freed = bd;
+            }
+        }
+    }
+
+    if (freed != NULL) {
+        ACQUIRE_SPIN_LOCK(&gc_alloc_block_sync);
+        freeChain(freed);
+        RELEASE_SPIN_LOCK(&gc_alloc_block_sync);
+    }
+
+    atomic_inc(&sweep_blocks_total, c.blocks);
+    atomic_inc(&sweep_freed_total, c.freed);
+    atomic_inc(&sweep_fragd_total, c.fragd);
+    atomic_inc(&sweep_live_total, c.live);
+    atomic_inc(&sweep_holes_total, c.holes);
+}
+
+// Let the other GC threads sweep sweep_blocks (which may be empty) with
+// us, and wait for them to finish.
+static void
+sweep_in_parallel (gc_thread *t)
+{
+    next_sweep_chunk = 0;
+    n_sweep_done = 0;
+    sweep_blocks_total = 0;
+    sweep_freed_total = 0;
+    sweep_fragd_total = 0;
+    sweep_live_total = 0;
+    sweep_holes_total = 0;
+    write_barrier();
+    sweep_go = 1;
+
+    sweep_chunks(t);
+
+    while (n_sweep_done != n_compact_threads - 1) {
+        busy_wait_nop();
+    }
+    // nobody is looking at sweep_go now, so reset it for the next GC
+    sweep_go = 0;
+}
+
+void
+sweepWorker (gc_thread *t)
+{
+    while (sweep_go == 0) {
+        busy_wait_nop();
+    }
+    load_load_barrier();
+    sweep_chunks(t);
+    atomic_inc(&n_sweep_done, 1);
+}
+
+static void
+sweep_parallel (generation *gen, gc_thread *t, SweepCounts *c)
+{
+    bdescr *bd, **last;
+    W_ i;
+
+    sweep_blocks = stgMallocBytes(stg_max(gen->n_old_blocks, 1)
+                                    * sizeof(bdescr *), "sweep_parallel");
+    n_sweep_blocks = 0;
+    for (bd = gen->old_blocks; bd != NULL; bd = bd->link) {
+        sweep_blocks[n_sweep_blocks++] = bd;
+    }
+
+    sweep_in_parallel(t);
+
+    last = &gen->old_blocks;
+    for (i = 0; i < n_sweep_blocks; i++) {
+        if (sweep_blocks[i] != NULL) {
+            *last = sweep_blocks[i];
+            last = &sweep_blocks[i]->link;
+        }
+    }
+    *last = NULL;
+
+    c->blocks = sweep_blocks_total;
+    c->freed  = sweep_freed_total;
+    c->fragd  = sweep_fragd_total;
+    c->live   = sweep_live_total;
+    c->holes  = sweep_holes_total;
+    gen->n_old_blocks -= c->freed;
+
+    stgFree(sweep_blocks);
+    sweep_blocks = NULL;
+    n_sweep_blocks = 0;
+}
+
+#endif /* THREADED_RTS */
 
 void
-sweep(generation *gen)
+sweep(generation *gen, gc_thread *t USED_IF_THREADS)
 {
     bdescr *bd, *prev, *next;
-    uint32_t i;
-    W_ freed, resid, fragd, blocks, live;
-    
+    SweepCounts c = { 0, 0, 0, 0, 0 };
+
     ASSERT(countBlocks(gen->old_blocks) == gen->n_old_blocks);
 
-    live = 0; // estimate of live data in this gen
-    freed = 0;
-    fragd = 0;
-    blocks = 0;
+#if defined(THREADED_RTS)
+    if (n_compact_threads > 1) {
+        if (!(RtsFlags.GcFlags.fillHoles && n_numa_nodes > 1)) {
+            sweep_parallel(gen, t, &c);
+            goto done;
+        }
+        // The other GC threads are waiting for us; see
+        // Note [Parallel sweeping].
+        n_sweep_blocks = 0;
+        sweep_in_parallel(t);
+    }
+#endif
+
     prev = NULL;
     for (bd = gen->old_blocks; bd != NULL; bd = next)
     {
@@ -41,17 +369,157 @@ sweep(generation *gen)
             continue;
         }
 
-        blocks++;
-        resid = 0;
-        for (i = 0; i < BLOCK_SIZE_W / BITS_IN(W_); i++)
+        if (sweep_block(bd, NULL, &c))
         {
-            if (bd->u.bitmap[i] != 0) resid++;
+            gen->n_old_blocks--;
+            if (prev == NULL) {
+                gen->old_blocks = next;
+            } else {
+                prev->link = next;
+            }
+            freeGroup(bd);
+        }
+        else
+        {
+            prev = bd;
+        }
+    }
+
+#if defined(THREADED_RTS)
+done:
+#endif
+    gen->live_estimate = c.live;
+
+    debugTrace(DEBUG_gc, "sweeping: %d blocks, %d were copied, %d freed (%d%%), %d are fragmented, live estimate: %ld%%",
+          gen->n_old_blocks + c.freed,
+          gen->n_old_blocks - c.blocks + c.freed,
+          c.freed,
+          c.blocks == 0 ? 0 : (c.freed * 100) / c.blocks,
+          c.fragd,
+          (unsigned long)((c.blocks - c.freed) == 0 ? 0 : ((c.live / BLOCK_SIZE_W) * 100) / (c.blocks - c.freed)));
+    if (RtsFlags.GcFlags.fillHoles) {
+        debugTrace(DEBUG_gc, "sweeping: %ld words of holes to fill",
+                   (unsigned long)c.holes);
+    }
+
+    ASSERT(countBlocks(gen->old_blocks) == gen->n_old_blocks);
+}
+
+/* -----------------------------------------------------------------------------
+   Note [Lazy sweeping]
+   ~~~~~~~~~~~~~~~~~~~~
+
+   With +RTS --lazy-sweep, a major GC of a mark/sweep oldest generation
+   does not sweep the whole generation before the mutator is restarted.
+   Instead startLazySweep() sweeps the old blocks only as far as the
+   first one that still holds live data: that block is the *anchor*.
+   The blocks after the anchor are left unswept, and the mark bitmap is
+   kept alive in gen->bitmap until they have been dealt with.
+
+   The unswept blocks form a stable segment of gen->blocks:
+
+     - the tidy-up phase of GarbageCollect() puts the marked old blocks
+       in front of the blocks copied during the GC, so the segment runs
+       from anchor->link up to (but not including) the block that was
+       at the head of gen->blocks when startLazySweep() was called;
+
+     - until the next major GC, the only changes to gen->blocks are
+       minor GCs pushing blocks onto the front of the list, and the
+       anchor is live so nothing else will free it.
+
+   The segment is then swept a few blocks at a time:
+
+     - by sweepSomeBlocks(), which is called from doIdleGCWork(), i.e.
+       when a capability has nothing better to do;
+
+     - before each minor GC, by paceLazySweep(), which sweeps
+       LAZY_SWEEP_RATE blocks for each block of the nurseries.  Sweeping
+       a block only reads BLOCK_SIZE_W / BITS_IN(W_) words of the
+       bitmap, so this adds a little to the minor GC in proportion to the
+       nursery, not to the old generation.  Minor GCs don't look at the
+       unswept blocks: they only push blocks onto gen->blocks, as above;
+
+     - and whatever is left is swept by finishLazySweep(), called from
+       doIdleGCWork(cap, true), before the next major GC, which needs the
+       bitmap, and at shutdown (see scheduleDoGC()).
+
+   Only one capability sweeps at a time (lazy_sweep_lock), and blocks are
+   freed and the generation's counters updated under the storage manager
+   lock.
+
+   The unswept blocks get BF_SWEPT straight away, because they may
+   contain dead objects that point to freed memory, which the sanity
+   checker must not look at.  A lazy sweep leaves gen->live_estimate
+   unset, so resize_generations() sizes the heap from gen->n_words.
+
+   This only takes the sweep out of the major GC pause.  With +RTS
+   --concurrent-mark the marking is taken out of the pause too, and the
+   blocks that the concurrent mark looked at are swept the same way, by
+   startLazySweepSegment(): the segment then runs from the anchor to the
+   end of gen->blocks (see Note [Concurrent marking] in ConcMark.c).
+   -------------------------------------------------------------------------- */
+
+// The generation being swept lazily, or NULL if there's nothing to do.
+static generation *lazy_sweep_gen = NULL;
+
+// The last block we kept, and the first block we must not sweep.
+static bdescr *lazy_sweep_prev = NULL;
+static bdescr *lazy_sweep_end  = NULL;
+
+// Totals for debugTrace, as in sweep().
+static W_ lazy_sweep_blocks, lazy_sweep_freed, lazy_sweep_fragd;
+
+// non-zero if a capability is already in sweepSomeBlocks().
+static volatile StgWord lazy_sweep_lock = 0;
+
+// Sweep this many blocks before returning from sweepSomeBlocks(), so
+// that an idle capability responds quickly if new work arrives.
+static const W_ lazy_sweep_chunk = 256;
+
+// The number of blocks paceLazySweep() sweeps for each nursery block.
+#define LAZY_SWEEP_RATE 8
+
+void
+startLazySweep(generation *gen)
+{
+    bdescr *bd, *prev, *next;
+    W_ resid;
+
+    ASSERT(lazy_sweep_gen == NULL);
+    ASSERT(countBlocks(gen->old_blocks) == gen->n_old_blocks);
+
+#if defined(THREADED_RTS)
+    // The other GC threads are waiting for work that we're leaving to
+    // the mutator; see Note [Parallel sweeping].
+    if (n_compact_threads > 1) {
+        n_sweep_blocks = 0;
+        sweep_in_parallel(NULL);
+    }
+#endif
+
+    lazy_sweep_blocks = 0;
+    lazy_sweep_freed  = 0;
+    lazy_sweep_fragd  = 0;
+
+    // Sweep eagerly up to the first block that we keep.  Blocks that
+    // weren't marked were evacuated and will be freed by
+    // GarbageCollect() itself, so they can't be the anchor.
+    prev = NULL;
+    for (bd = gen->old_blocks; bd != NULL; bd = next)
+    {
+        next = bd->link;
+
+        if (!(bd->flags & BF_MARKED)) {
+            prev = bd;
+            continue;
         }
-        live += resid * BITS_IN(W_);
+
+        lazy_sweep_blocks++;
+        resid = block_resid(bd);
 
         if (resid == 0)
         {
-            freed++;
+            lazy_sweep_freed++;
             gen->n_old_blocks--;
             if (prev == NULL) {
                 gen->old_blocks = next;
@@ -62,25 +530,215 @@ sweep(generation *gen)
         }
         else
         {
-            prev = bd;
             if (resid < (BLOCK_SIZE_W * 3) / (BITS_IN(W_) * 4)) {
-                fragd++;
+                lazy_sweep_fragd++;
                 bd->flags |= BF_FRAGMENTED;
             }
-
             bd->flags |= BF_SWEPT;
+            break;
         }
     }
 
-    gen->live_estimate = live;
+    ASSERT(countBlocks(gen->old_blocks) == gen->n_old_blocks);
 
-    debugTrace(DEBUG_gc, "sweeping: %d blocks, %d were copied, %d freed (%d%%), %d are fragmented, live estimate: %ld%%",
-          gen->n_old_blocks + freed,
-          gen->n_old_blocks - blocks + freed,
-          freed,
-          blocks == 0 ? 0 : (freed * 100) / blocks,
-          fragd, 
-          (unsigned long)((blocks - freed) == 0 ? 0 : ((live / BLOCK_SIZE_W) * 100) / (blocks - freed)));
+    if (bd == NULL) {
+        debugTrace(DEBUG_gc, "lazy sweep: %d blocks, %d freed, none deferred",
+                   lazy_sweep_blocks, lazy_sweep_freed);
+        return;
+    }
 
-    ASSERT(countBlocks(gen->old_blocks) == gen->n_old_blocks);
+    // The rest of the old blocks will be swept later; see
+    // Note [Lazy sweeping].
+    for (next = bd->link; next != NULL; next = next->link) {
+        next->flags |= BF_SWEPT;
+    }
+
+    lazy_sweep_gen  = gen;
+    lazy_sweep_prev = bd;
+    lazy_sweep_end  = gen->blocks;
+}
+
+// Sweep lazily the blocks from first to the end of gen->blocks, which
+// the concurrent mark has just marked, the same way; prev is the block
+// in front of first, or NULL.  See Note [Concurrent marking] in
+// ConcMark.c.
+void
+startLazySweepSegment(generation *gen, bdescr *prev, bdescr *first)
+{
+    bdescr *bd, *next;
+    W_ resid;
+
+    ASSERT(lazy_sweep_gen == NULL);
+    ASSERT(prev == NULL ? gen->blocks == first : prev->link == first);
+
+    lazy_sweep_blocks = 0;
+    lazy_sweep_freed  = 0;
+    lazy_sweep_fragd  = 0;
+
+    // Without a block in front of the segment, sweep eagerly up to the
+    // first block that we keep, which becomes the anchor.
+    bd = first;
+    if (prev == NULL) {
+        for (; bd != NULL; bd = next)
+        {
+            next = bd->link;
+            lazy_sweep_blocks++;
+            bd->flags &= ~BF_CONC_MARK;
+            resid = block_resid(bd);
+
+            if (resid == 0)
+            {
+                lazy_sweep_freed++;
+                gen->blocks = next;
+                gen->n_blocks -= bd->blocks;
+                gen->n_words  -= bd->free - bd->start;
+                freeGroup(bd);
+            }
+            else
+            {
+                if (resid < (BLOCK_SIZE_W * 3) / (BITS_IN(W_) * 4)) {
+                    lazy_sweep_fragd++;
+                    bd->flags |= BF_FRAGMENTED;
+                }
+                bd->flags |= BF_SWEPT;
+                break;
+            }
+        }
+
+        if (bd == NULL) {
+            debugTrace(DEBUG_gc, "lazy sweep: %d blocks, %d freed, none deferred",
+                       lazy_sweep_blocks, lazy_sweep_freed);
+            freeGroup(gen->bitmap);
+            gen->bitmap = NULL;
+            return;
+        }
+        prev = bd;
+        bd = bd->link;
+    }
+
+    // The blocks may contain dead objects, so they get BF_SWEPT as in
+    // startLazySweep(), and they are no longer part of the mark.
+    for (; bd != NULL; bd = bd->link) {
+        bd->flags = (bd->flags & ~BF_CONC_MARK) | BF_SWEPT;
+    }
+
+    lazy_sweep_gen  = gen;
+    lazy_sweep_prev = prev;
+    lazy_sweep_end  = NULL;
+}
+
+bool
+lazySweepPending(generation *gen)
+{
+    return lazy_sweep_gen == gen;
+}
+
+//
+// Sweep up to max of the blocks left by startLazySweep().  Returns true
+// if there's more work to do.
+//
+static bool
+lazy_sweep (W_ max)
+{
+    generation *gen;
+    bdescr *bd, *prev;
+    W_ count;
+    W_ resid;
+
+    if (lazy_sweep_gen == NULL)
+        return false;
+
+    if (cas(&lazy_sweep_lock, 0, 1) != 0) {
+        // another capability is doing the work, see runSomeFinalizers()
+        return false;
+    }
+
+    gen = lazy_sweep_gen;
+    if (gen == NULL) {
+        // lost a race with the capability that finished the sweep
+        lazy_sweep_lock = 0;
+        return false;
+    }
+
+    ACQUIRE_SM_LOCK;
+
+    prev = lazy_sweep_prev;
+    count = 0;
+    while ((bd = prev->link) != lazy_sweep_end && count < max)
+    {
+        count++;
+        lazy_sweep_blocks++;
+        resid = block_resid(bd);
+
+        if (resid == 0)
+        {
+            lazy_sweep_freed++;
+            prev->link = bd->link;
+            gen->n_blocks -= bd->blocks;
+            gen->n_words  -= bd->free - bd->start;
+            freeGroup(bd);
+        }
+        else
+        {
+            prev = bd;
+            if (resid < (BLOCK_SIZE_W * 3) / (BITS_IN(W_) * 4)) {
+                lazy_sweep_fragd++;
+                bd->flags |= BF_FRAGMENTED;
+            }
+        }
+    }
+    lazy_sweep_prev = prev;
+
+    if (prev->link == lazy_sweep_end) {
+        debugTrace(DEBUG_gc, "lazy sweep: %d blocks, %d freed (%d%%), %d are fragmented",
+                   lazy_sweep_blocks, lazy_sweep_freed,
+                   lazy_sweep_blocks == 0 ? 0 :
+                       (lazy_sweep_freed * 100) / lazy_sweep_blocks,
+                   lazy_sweep_fragd);
+
+        freeGroup(gen->bitmap);
+        gen->bitmap = NULL;
+        lazy_sweep_gen  = NULL;
+        lazy_sweep_prev = NULL;
+        lazy_sweep_end  = NULL;
+    }
+
+    RELEASE_SM_LOCK;
+
+    write_barrier();
+    lazy_sweep_lock = 0;
+
+    return lazy_sweep_gen != NULL;
+}
+
+bool
+sweepSomeBlocks(void)
+{
+    return lazy_sweep(lazy_sweep_chunk);
+}
+
+// Called before a minor GC, with all the capabilities stopped.
+void
+paceLazySweep(void)
+{
+    W_ blocks = 0;
+    uint32_t i;
+
+    if (lazy_sweep_gen == NULL)
+        return;
+
+    for (i = 0; i < n_nurseries; i++) {
+        blocks += nurseries[i].n_blocks;
+    }
+    lazy_sweep(stg_max(blocks * LAZY_SWEEP_RATE, lazy_sweep_chunk));
+}
+
+// Called before a major GC and at shutdown, with all the capabilities
+// stopped.
+void
+finishLazySweep(void)
+{
+    while (lazy_sweep_gen != NULL) {
+        lazy_sweep((W_)-1);
+    }
 }
@@ -13,4 +13,17 @@
 
 #pragma once
 
-RTS_PRIVATE void sweep(generation *gen);
+#include "GCThread.h"
+
+RTS_PRIVATE void sweep(generation *gen, gc_thread *t);
+#if defined(THREADED_RTS)
+RTS_PRIVATE void sweepWorker(gc_thread *t);
+#endif
+RTS_PRIVATE void discardHoles(void);
+RTS_PRIVATE void startLazySweep(generation *gen);
+RTS_PRIVATE void startLazySweepSegment(generation *gen, bdescr *prev,
+                                       bdescr *first);
+RTS_PRIVATE bool lazySweepPending(generation *gen);
+RTS_PRIVATE bool sweepSomeBlocks(void);
+RTS_PRIVATE void paceLazySweep(void);
+RTS_PRIVATE void finishLazySweep(void);
@@ -418,6 +418,18 @@ size_t getPageSize (void)
     return pagesize;
 }
 
+bool osHugePagesAvailable (void)
+{
+    // Large pages on Windows need SeLockMemoryPrivilege and can't be
+    // committed piecemeal, so we don't support +RTS --huge-pages.
+    return false;
+}
+
+W_ osHugePageBytes (void)
+{
+    return 0;
+}
+
 /* Returns 0 if physical memory size cannot be identified */
 StgWord64 getPhysicalMemorySize (void)
 {
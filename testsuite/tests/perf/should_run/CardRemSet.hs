@@ -0,0 +1,18 @@
+-- Many writes to a large boxed array that has been promoted to the old
+-- generation.  With +RTS --card-remset, each minor GC only looks at the
+-- cards written since the previous one, rather than at every card of
+-- the 10M-element array.
+
+import Control.Monad
+import Data.Array.IO
+import System.Mem
+
+main :: IO ()
+main = do
+  let n = 10000000
+  arr <- newArray (0, n - 1) 0 :: IO (IOArray Int Int)
+  performMajorGC
+  forM_ [1 .. 5000000] $ \i ->
+    writeArray arr ((i * 7919) `mod` n) i
+  s <- foldM (\acc j -> (acc +) <$> readArray arr j) 0 [0, 997 .. n - 1]
+  print s
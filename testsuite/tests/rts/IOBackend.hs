@@ -0,0 +1,46 @@
+import Control.Concurrent
+import Control.Monad
+import Data.Word
+import Foreign.C
+import Foreign.Marshal.Array
+import Foreign.Marshal.Alloc
+import Foreign.Storable
+
+-- The test works only on UNIX like.
+-- unportable bits:
+import qualified System.Posix.Internals as SPI
+import qualified System.Posix.Types as SPT
+
+-- Many threads blocked on different pipes, woken one at a time in an
+-- order unrelated to the order they blocked in.  Exercises the
+-- non-threaded RTS's fd waiting (Note [Event-driven I/O waiting]).
+
+pipe :: IO (CInt, CInt)
+pipe = allocaArray 2 $ \fds -> do
+    throwErrnoIfMinus1_ "pipe" $ SPI.c_pipe fds
+    rd <- peekElemOff fds 0
+    wr <- peekElemOff fds 1
+    return (rd, wr)
+
+n :: Int
+n = 200
+
+main :: IO ()
+main = do
+    pipes <- replicateM n pipe
+    done <- newEmptyMVar
+    forM_ (zip [0..] pipes) $ \(i, (rd, _)) -> forkIO $ do
+        threadWaitRead (SPT.Fd rd)
+        putMVar done (i :: Int)
+    -- a thread waiting to write, on a pipe that always has room
+    (_, wr) <- pipe
+    _ <- forkIO $ threadWaitWrite (SPT.Fd wr) >> putMVar done (-1)
+    yield
+    r0 <- takeMVar done
+    print r0
+    forM_ (reverse (zip [0..] pipes)) $ \(i, (_, w)) ->
+        when (even i) $ alloca $ \p -> do
+            poke p (0 :: Word8)
+            throwErrnoIfMinus1_ "write" $ SPI.c_write w p 1
+    rs <- replicateM (n `div` 2) (takeMVar done)
+    print (sum rs, all even rs)
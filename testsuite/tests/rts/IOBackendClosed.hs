@@ -0,0 +1,31 @@
+import Control.Concurrent
+import Control.Exception
+import Foreign.C
+import Foreign.Marshal.Array
+import Foreign.Storable
+
+-- The test works only on UNIX like.
+-- unportable bits:
+import qualified System.Posix.Internals as SPI
+import qualified System.Posix.Types as SPT
+
+-- A thread blocked on an fd that is then closed gets the blockedOnBadFD
+-- exception rather than staying blocked (Note [Event-driven I/O waiting]).
+
+pipe :: IO (CInt, CInt)
+pipe = allocaArray 2 $ \fds -> do
+    throwErrnoIfMinus1_ "pipe" $ SPI.c_pipe fds
+    rd <- peekElemOff fds 0
+    wr <- peekElemOff fds 1
+    return (rd, wr)
+
+main :: IO ()
+main = do
+    (rd, _) <- pipe
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+        r <- try (threadWaitRead (SPT.Fd rd))
+        putMVar done (either (\e -> show (e :: IOException)) show r)
+    yield
+    throwErrnoIfMinus1_ "close" $ SPI.c_close rd
+    takeMVar done >>= putStrLn
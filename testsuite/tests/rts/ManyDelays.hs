@@ -0,0 +1,24 @@
+import Control.Concurrent
+import Control.Monad
+import System.Timeout
+
+-- Lots of concurrent threadDelays, some expiring and some cancelled.
+-- Exercises the non-threaded RTS's heap of sleeping threads
+-- (Note [Sleeping threads]).
+
+main :: IO ()
+main = do
+    -- sleepers that are killed before they wake up
+    long <- forM [1..2000 :: Int] $ \i ->
+        forkIO $ threadDelay (10000000 + i)
+    -- sleepers that wake up, in an order unrelated to creation order
+    mvs <- forM [1..2000 :: Int] $ \i -> do
+        mv <- newEmptyMVar
+        _ <- forkIO $ threadDelay ((i * 7919) `mod` 20000) >> putMVar mv i
+        return mv
+    mapM_ killThread (reverse long)
+    xs <- mapM takeMVar mvs
+    print (sum xs)
+    -- the main thread's own sleep is cancelled by timeout
+    rs <- forM [1..100 :: Int] $ \_ -> timeout 1000 (threadDelay 10000000)
+    print (all (== Nothing) rs)
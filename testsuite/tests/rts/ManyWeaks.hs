@@ -0,0 +1,34 @@
+import Control.Monad
+import Data.IORef
+import Data.Maybe
+import System.Mem
+import System.Mem.Weak
+
+-- Many weak pointers, some with live keys, some with dead keys, and a
+-- chain of weak pointers each of whose key is reachable only from the
+-- value of the previous one.  Exercises the GC's processing of weak
+-- pointers (Note [Parallel weak pointer processing]), which takes one
+-- round per link of the chain.
+
+main :: IO ()
+main = do
+    live <- mapM newIORef [1 .. 50000 :: Int]
+    liveWeaks <- mapM (\r -> mkWeakIORef r (return ())) live
+    deadWeaks <- forM [1 .. 50000 :: Int] $ \i -> do
+        r <- newIORef i
+        mkWeakIORef r (return ())
+    chain <- mapM newIORef [1 .. 100 :: Int]
+    chainWeaks <- zipWithM (\k v -> mkWeak k v Nothing) chain (tail chain)
+    case chain of
+      [] -> return ()
+      root : _ -> do
+        performMajorGC
+        a <- mapM deRefWeak liveWeaks
+        b <- mapM deRefWeak deadWeaks
+        c <- mapM deRefWeak chainWeaks
+        print (length (filter isJust a), length (filter isJust b),
+               length (filter isJust c))
+        -- keep the live keys and the root of the chain alive
+        xs <- mapM readIORef live
+        x <- readIORef root
+        print (sum xs + x)
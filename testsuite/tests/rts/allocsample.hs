@@ -0,0 +1,23 @@
+-- Exercise +RTS --alloc-sample: allocate small objects from compiled
+-- code, and large pinned objects through allocate(), while the RTS takes
+-- allocation samples, and check that the results are not disturbed.
+
+import Control.Monad
+import Data.IORef
+import Foreign.ForeignPtr
+import Foreign.Ptr
+import Foreign.Storable
+import System.Mem
+
+main :: IO ()
+main = do
+  total <- newIORef (0 :: Int)
+  forM_ [1 .. 200 :: Int] $ \i -> do
+    fp <- mallocForeignPtrBytes (8192 + i)
+    withForeignPtr fp $ \p -> do
+      poke (castPtr p) i
+      x <- peek (castPtr p)
+      modifyIORef' total (+ x)
+    modifyIORef' total (+ sum (map (`div` 2) [1 .. 1000 * i]))
+    when (i `mod` 50 == 0) performMajorGC
+  readIORef total >>= print
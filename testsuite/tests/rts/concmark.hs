@@ -0,0 +1,29 @@
+-- Exercise +RTS --concurrent-mark: keep a large old generation that the
+-- program keeps changing while the marking thread runs, so that several
+-- mark cycles start and finish between minor GCs.  No performMajorGC
+-- here, because a major GC abandons the cycle.
+
+import qualified Data.Map.Strict as Map
+import Data.IORef
+import Control.Monad
+
+main :: IO ()
+main = do
+  ref <- newIORef Map.empty
+  -- boxes in the old generation, written during the marking
+  boxes <- forM [0 .. 999 :: Int] $ \i -> newIORef (show i)
+  forM_ [1 .. 40 :: Int] $ \r -> do
+    forM_ [1 .. 20000 :: Int] $ \i ->
+      modifyIORef' ref (Map.insert (r * 100000 + i) (show i))
+    -- drop all but every tenth element
+    modifyIORef' ref (Map.filterWithKey (\k _ -> k `mod` 10 == 0))
+    forM_ (zip [0 ..] boxes) $ \(i, b) ->
+      writeIORef b (show (i + r))
+    -- a weak pointer whose key dies straight away
+    k <- newIORef r
+    _ <- mkWeakIORef k (return ())
+    return ()
+  m <- readIORef ref
+  print (Map.size m, sum (map length (Map.elems m)))
+  strs <- mapM readIORef boxes
+  print (sum (map read strs :: [Int]))
@@ -0,0 +1,19 @@
+-- Exercise the background decommit thread: the heap grows, shrinks and
+-- grows again, so the second round reuses megablocks that are still
+-- waiting to be returned to the OS (+RTS --decommit-rate is slow here).
+
+import qualified Data.Map.Strict as Map
+import Data.List (foldl')
+import Control.Monad
+import System.Mem
+
+build :: Int -> Map.Map Int Int
+build n = foldl' (\m i -> Map.insert i (i * 3) m) Map.empty [1 .. n]
+
+main :: IO ()
+main = forM_ [1 .. 3 :: Int] $ \r -> do
+  let m = build (300000 * r)
+  print (Map.size m, Map.foldl' (+) 0 m)
+  performMajorGC
+  -- the big map is dead: this GC shrinks the heap
+  performMajorGC
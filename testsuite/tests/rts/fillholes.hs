@@ -0,0 +1,20 @@
+-- Exercise +RTS --fill-holes: each major GC leaves holes in the old
+-- generation, which the minor GCs that follow fill with promoted data.
+
+import qualified Data.Map.Strict as Map
+import Data.IORef
+import Control.Monad
+import System.Mem
+
+main :: IO ()
+main = do
+  ref <- newIORef Map.empty
+  forM_ [1 .. 20 :: Int] $ \r -> do
+    -- drop every other element, so the live data is full of holes
+    modifyIORef' ref (Map.filterWithKey (\k _ -> even k))
+    performMajorGC
+    forM_ [1 .. 10000 :: Int] $ \i -> do
+      modifyIORef' ref (Map.insert (r * 100000 + i) (show i))
+      when (i `mod` 1000 == 0) performMinorGC
+  m <- readIORef ref
+  print (Map.size m, sum (map length (Map.elems m)))
@@ -0,0 +1,56 @@
+{-# LANGUAGE BangPatterns #-}
+-- Test and benchmark for forkIO throughput, see Note [Recycling thread
+-- stacks] in rts/Threads.c.
+--
+-- With no arguments, fork and join a few thousand threads on every
+-- capability and check that they all ran.  With an argument N, each
+-- capability forks and joins N threads, one at a time, and we report
+-- the rate per capability; e.g.
+--
+--   ./forkjoin 1000000 +RTS -N4 -RTS
+
+import Control.Concurrent
+import Control.Monad
+import GHC.Clock
+import System.Environment
+import Text.Printf
+
+-- fork n short-lived threads one after the other, waiting for each
+forkJoin :: Int -> IO Int
+forkJoin n = go 0 0
+  where
+    go !i !acc
+      | i == n = return acc
+      | otherwise = do
+          mv <- newEmptyMVar
+          _ <- forkIO $ putMVar mv i
+          r <- takeMVar mv
+          go (i + 1) (acc + r)
+
+-- run forkJoin n on every capability at once
+onEveryCap :: Int -> IO [Int]
+onEveryCap n = do
+  caps <- getNumCapabilities
+  dones <- forM [0 .. caps - 1] $ \c -> do
+    done <- newEmptyMVar
+    _ <- forkOn c $ forkJoin n >>= putMVar done
+    return done
+  mapM takeMVar dones
+
+main :: IO ()
+main = do
+  args <- getArgs
+  caps <- getNumCapabilities
+  case args of
+    [] -> do
+      rs <- onEveryCap 5000
+      print (rs == replicate caps (sum [0 .. 4999]))
+    [arg] -> do
+      let n = read arg
+      t0 <- getMonotonicTime
+      _ <- onEveryCap n
+      t1 <- getMonotonicTime
+      let secs = t1 - t0
+      printf "%d capabilities: %.0f forkIO/join per second per capability\n"
+        caps (fromIntegral n / secs)
+    _ -> error "usage: forkjoin [threads]"
@@ -0,0 +1,42 @@
+-- Test and benchmark for +RTS --gc-prefetch, see Note [Prefetching in
+-- scavenge_block] in rts/sm/Scav.c.
+--
+-- With no arguments, check that a Data.Map survives a few major GCs.
+-- With an argument N, build a map of N elements and report the copying
+-- throughput of major GCs instead; compare
+--
+--   ./gcprefetch 20000000 +RTS -T -A64m -RTS
+--   ./gcprefetch 20000000 +RTS -T -A64m --gc-prefetch -RTS
+--
+-- A map of 20M elements is a little over 1GB of small linked objects.
+
+import Control.Monad
+import qualified Data.Map.Strict as Map
+import GHC.Stats
+import System.Environment
+import System.Mem
+import Text.Printf
+
+build :: Int -> Map.Map Int [Int]
+build n = Map.fromList [ (k * 7919 `mod` n, [k, k + 1]) | k <- [0 .. n - 1] ]
+
+main :: IO ()
+main = do
+  args <- getArgs
+  case args of
+    [] -> do
+      let m = build 200000
+      forM_ [1 .. 3 :: Int] $ \_ -> performMajorGC
+      print (Map.size m, sum (map sum (Map.elems m)))
+    [arg] -> do
+      let m = build (read arg)
+      Map.size m `seq` performMajorGC
+      (bytes, ns) <- fmap unzip $ forM [1 .. 5 :: Int] $ \_ -> do
+        performMajorGC
+        s <- getRTSStats
+        return (gcdetails_copied_bytes (gc s), gcdetails_elapsed_ns (gc s))
+      let mb = fromIntegral (sum bytes) / 1e6 :: Double
+          secs = fromIntegral (sum ns) / 1e9 :: Double
+      printf "%d elements: %.0f MB copied in %.3fs, %.0f MB/s\n"
+        (Map.size m) mb secs (mb / secs)
+    _ -> error "usage: gcprefetch [elements]"
@@ -0,0 +1,109 @@
+{-# LANGUAGE ForeignFunctionInterface #-}
+-- Take a heap snapshot with performHeapSnapshot() while the heap holds
+-- a long list, a compact region, pinned data, a weak pointer and a
+-- blocked thread, then read the snapshot back and check that it is
+-- well-formed: the record counts match the trailer, and every pointer
+-- and root refers to a node in the snapshot.
+
+import Control.Concurrent
+import Data.Bits
+import qualified Data.ByteString as B
+import qualified Data.ByteString.Char8 as BC
+import qualified Data.IntSet as IntSet
+import Foreign.C.String
+import Foreign.ForeignPtr
+import GHC.Compact
+import System.Mem.Weak
+
+foreign import ccall safe "performHeapSnapshot"
+  performHeapSnapshot :: CString -> IO Bool
+
+data Snapshot = Snapshot
+  { nodes :: IntSet.IntSet
+  , targets :: [Int]
+  , nNodes :: Int
+  , nRoots :: Int
+  , trailer :: (Int, Int)
+  }
+
+uleb :: B.ByteString -> Int -> (Int, Int)
+uleb bs = go 0 0
+  where
+    go shift acc i =
+      let b = B.index bs i
+          acc' = acc .|. (fromIntegral (b .&. 0x7f) `shiftL` shift)
+      in if b .&. 0x80 /= 0 then go (shift + 7) acc' (i + 1)
+                            else (acc', i + 1)
+
+sleb :: B.ByteString -> Int -> (Int, Int)
+sleb bs = go 0 0
+  where
+    go shift acc i =
+      let b = B.index bs i
+          acc' = acc .|. (fromIntegral (b .&. 0x7f) `shiftL` shift)
+          shift' = shift + 7
+      in if b .&. 0x80 /= 0 then go shift' acc' (i + 1)
+         else if b .&. 0x40 /= 0 && shift' < finiteBitSize acc
+                then (acc' .|. ((-1) `shiftL` shift'), i + 1)
+                else (acc', i + 1)
+
+parse :: B.ByteString -> Snapshot
+parse bs = records (Snapshot IntSet.empty [] 0 0 (-1, -1)) i2
+  where
+    (_version, i1) = uleb bs 8
+    (_wordSize, i2) = uleb bs i1
+
+    records s i = case B.index bs i of
+      1 -> let (addr, j1) = uleb bs (i + 1)
+               (_info, j2) = uleb bs j1
+               (_type, j3) = uleb bs j2
+               (_size, j4) = uleb bs j3
+               (n, j5) = uleb bs j4
+               (ts, j6) = ptrs addr n j5 []
+           in records s { nodes = IntSet.insert addr (nodes s)
+                        , targets = ts ++ targets s
+                        , nNodes = nNodes s + 1 } j6
+      2 -> let (_kind, j1) = uleb bs (i + 1)
+               (addr, j2) = uleb bs j1
+           in records s { targets = addr : targets s
+                        , nRoots = nRoots s + 1 } j2
+      3 -> records s (snd (uleb bs (i + 1)))
+      4 -> records s (i + 1)
+      0 -> let (n, j1) = uleb bs (i + 1)
+               (r, j2) = uleb bs j1
+           in if j2 == B.length bs then s { trailer = (n, r) }
+                                   else error "junk after the trailer"
+      t -> error ("bad record tag " ++ show t)
+
+    ptrs _ 0 i acc = (acc, i)
+    ptrs addr n i acc = let (d, j) = sleb bs i
+                        in ptrs addr (n - 1 :: Int) j (addr + d : acc)
+
+main :: IO ()
+main = do
+  let xs = [1000 .. 100000] :: [Int]
+  print (sum xs)
+  c <- compact (map show [1 .. 1000 :: Int])
+  fp <- mallocForeignPtrBytes 100
+  w <- mkWeakPtr fp (return ())
+  mv <- newEmptyMVar
+  done <- newEmptyMVar
+  _ <- forkIO $ do { v <- takeMVar mv; putMVar done (v :: Int) }
+  yield
+
+  ok <- withCString "heapsnapshot.hsnap" performHeapSnapshot
+  print ok
+
+  bs <- B.readFile "heapsnapshot.hsnap"
+  BC.putStrLn (B.take 8 bs)
+  let s = parse bs
+  print (trailer s == (nNodes s, nRoots s))
+  print (nNodes s > 100000)
+  print (all (`IntSet.member` nodes s) (targets s))
+
+  -- keep everything alive until after the snapshot
+  print (length xs, length (getCompact c))
+  withForeignPtr fp $ \_ -> return ()
+  deRefWeak w >>= print . maybe False (const True)
+  putMVar mv 42
+  takeMVar done >>= print
@@ -0,0 +1,45 @@
+{-# LANGUAGE MagicHash, UnboxedTuples #-}
+
+-- Scavenge a few huge arrays with several GC threads, see Note
+-- [Scavenging huge arrays] in rts/sm/Scav.c.  The mutable arrays are
+-- written between GCs, so that some of their cards point into the
+-- nursery and others don't.
+
+import Control.Monad
+import Data.Array
+import Data.Array.IO
+import GHC.Exts
+import GHC.IO
+import System.Mem
+
+data SmallArr a = SmallArr (SmallMutableArray# RealWorld a)
+
+newSmall :: Int -> a -> IO (SmallArr a)
+newSmall (I# n) x = IO $ \s -> case newSmallArray# n x s of
+  (# s', a #) -> (# s', SmallArr a #)
+
+readSmall :: SmallArr a -> Int -> IO a
+readSmall (SmallArr a) (I# i) = IO $ \s -> readSmallArray# a i s
+
+writeSmall :: SmallArr a -> Int -> a -> IO ()
+writeSmall (SmallArr a) (I# i) x = IO $ \s -> case writeSmallArray# a i x s of
+  s' -> (# s', () #)
+
+n :: Int
+n = 1000000
+
+main :: IO ()
+main = do
+  let frozen = listArray (0, n - 1) [ i * 3 | i <- [0 .. n - 1] ]
+                 :: Array Int Int
+  marr <- newArray (0, n - 1) 0 :: IO (IOArray Int Int)
+  sarr <- newSmall n (0 :: Int)
+  forM_ [1 .. 10] $ \r -> do
+    forM_ [0, 7 .. n - 1] $ \i -> do
+      writeArray marr i $! i * r + 1000
+      writeSmall sarr i $! i + r + 1000
+    performGC
+    performMajorGC
+  s1 <- foldM (\acc i -> (acc +) <$> readArray marr i) 0 [0 .. n - 1]
+  s2 <- foldM (\acc i -> (acc +) <$> readSmall sarr i) 0 [0 .. n - 1]
+  print (sum (elems frozen), s1, s2)
@@ -0,0 +1,20 @@
+-- Exercise +RTS --lazy-sweep: build up an old generation, let most of
+-- it die, and make sure that the unswept blocks left behind by each
+-- major GC don't confuse the next one.
+
+import qualified Data.Map.Strict as Map
+import Data.IORef
+import Control.Monad
+import System.Mem
+
+main :: IO ()
+main = do
+  ref <- newIORef Map.empty
+  forM_ [1 .. 20 :: Int] $ \r -> do
+    forM_ [1 .. 20000 :: Int] $ \i ->
+      modifyIORef' ref (Map.insert (r * 100000 + i) (show i))
+    -- drop all but every tenth element
+    modifyIORef' ref (Map.filterWithKey (\k _ -> k `mod` 10 == 0))
+    performMajorGC
+  m <- readIORef ref
+  print (Map.size m, sum (map length (Map.elems m)))
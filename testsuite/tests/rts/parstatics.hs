@@ -0,0 +1,34 @@
+-- Exercise the parallel scavenging of static objects: several Haskell
+-- threads evaluate CAFs while others force major GCs, so each major GC
+-- has the static closures and CAFs of this program, base and containers
+-- to share out between the GC threads.
+
+import qualified Data.Map.Strict as Map
+import Control.Concurrent
+import Control.Monad
+import System.Mem
+
+squares, cubes :: Map.Map Int Int
+squares = Map.fromList [ (i, i * i) | i <- [1 .. 20000] ]
+cubes = Map.fromList [ (i, i * i * i) | i <- [1 .. 20000] ]
+
+names :: [String]
+names = map show [1 .. 5000 :: Int]
+
+tables :: [Map.Map Int Int]
+tables = [squares, cubes, Map.map (`div` 2) squares, Map.filter even cubes]
+
+main :: IO ()
+main = do
+  dones <- forM (zip [0 ..] tables) $ \(t, m) -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+      forM_ [1 .. 20 :: Int] $ \r -> do
+        when (t == (0 :: Int)) performMajorGC
+        _ <- evaluate' (Map.foldl' (+) r m + length (concat names))
+        return ()
+      putMVar done (Map.size m, Map.foldl' (+) 0 m `mod` 1000003)
+    return done
+  mapM takeMVar dones >>= mapM_ print
+  where
+    evaluate' x = x `seq` return x
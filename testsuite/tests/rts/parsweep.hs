@@ -0,0 +1,25 @@
+-- Exercise +RTS -w -qc: sweep the oldest generation using several GC
+-- threads, while other Haskell threads have live stacks and data.
+
+import qualified Data.Map.Strict as Map
+import Control.Concurrent
+import Control.Monad
+import System.Mem
+
+main :: IO ()
+main = do
+  dones <- forM [1 .. 4 :: Int] $ \t -> do
+    done <- newEmptyMVar
+    _ <- forkIO $ do
+      let go :: Int -> Map.Map Int String -> IO (Map.Map Int String)
+          go 0 m = return m
+          go r m = do
+            let m' = Map.filterWithKey (\k _ -> k `mod` 3 == 0) $
+                       foldr (\i -> Map.insert (r * 100000 + i) (show (t * i)))
+                             m [1 .. 5000]
+            when (t == 1) performMajorGC
+            Map.size m' `seq` go (r - 1) m'
+      m <- go 20 Map.empty
+      putMVar done (Map.size m, sum (map length (Map.elems m)))
+    return done
+  mapM_ (takeMVar >=> print) dones
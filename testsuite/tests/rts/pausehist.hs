@@ -0,0 +1,30 @@
+-- Check the GC pause histograms of getRTSStats, see Note [GC pause
+-- histograms] in rts/Stats.c.
+
+import Control.Monad
+import GHC.Stats
+import System.Mem
+
+main :: IO ()
+main = do
+  forM_ [1 .. 20 :: Int] $ \i -> do
+    performMinorGC
+    when (i `mod` 5 == 0) performMajorGC
+  s <- getRTSStats
+  let hists = gc_pause_histograms s
+      total h = sum (pausehist_buckets h)
+  -- every GC is counted once in the histogram of its generation
+  print (sum (map pausehist_count hists) == fromIntegral (gcs s))
+  print (all (\h -> total h == pausehist_count h)
+             (gc_sync_histogram s : hists))
+  print (pausehist_count (gc_sync_histogram s) == fromIntegral (gcs s))
+  -- the percentiles are ordered and no longer than the longest pause
+  print (0 < gc_pause_p50_ns s
+         && gc_pause_p50_ns s <= gc_pause_p99_ns s
+         && gc_pause_p99_ns s <= gc_pause_p999_ns s
+         && gc_pause_p999_ns s <= maximum (map maxPause hists))
+  where
+    maxPause h =
+      case [ i | (i, n) <- zip [0 ..] (pausehist_buckets h), n /= 0 ] of
+        [] -> 0
+        is -> pauseHistogramBucketStart (last is + 1)
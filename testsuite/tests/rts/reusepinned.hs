@@ -0,0 +1,28 @@
+-- Exercise +RTS --reuse-pinned: one in ten of the small pinned
+-- ByteStrings survives each major GC, and the ones allocated after it go
+-- into the holes left by the others.  The survivors must be intact.
+
+import qualified Data.ByteString as B
+import Data.IORef
+import Control.Monad
+import System.Mem
+
+len :: Int -> Int
+len i = 16 + i `mod` 200
+
+main :: IO ()
+main = do
+  ref <- newIORef []
+  total <- newIORef 0
+  forM_ [1 .. 10 :: Int] $ \r -> do
+    forM_ [1 .. 20000 :: Int] $ \j -> do
+      let i = r * 20000 + j
+          b = B.replicate (len i) (fromIntegral i)
+      modifyIORef' total (+ fromIntegral (B.last b))
+      when (i `mod` 10 == 0) $ modifyIORef' ref ((i, b) :)
+    performMajorGC
+  kept <- readIORef ref
+  n <- readIORef total
+  print ( length kept
+        , all (\(i, b) -> b == B.replicate (len i) (fromIntegral i)) kept
+        , n :: Int )
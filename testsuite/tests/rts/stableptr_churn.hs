@@ -0,0 +1,32 @@
+import Control.Concurrent
+import Control.Monad
+import Foreign.StablePtr
+import System.Mem
+
+-- Several threads creating and freeing stable pointers at once, with
+-- GCs in between, enough to grow the table by many segments.  See
+-- Note [Stable pointer table] in rts/StablePtr.c.
+
+worker :: Int -> IO Int
+worker k = do
+    sps <- forM [1..20000] $ \i -> newStablePtr (k * 100000 + i)
+    when (k == 0) performMajorGC
+    -- free half, make some more, check everything
+    let (frees, keeps) = splitAt 10000 sps
+    mapM_ freeStablePtr frees
+    more <- forM [1..5000] $ \i -> newStablePtr (k * 100000 + i)
+    vs <- mapM deRefStablePtr (keeps ++ more)
+    mapM_ freeStablePtr (keeps ++ more)
+    return (sum vs)
+
+main :: IO ()
+main = do
+    mvs <- forM [0..7] $ \k -> do
+        mv <- newEmptyMVar
+        _ <- forkIO $ worker k >>= putMVar mv
+        return mv
+    rs <- mapM takeMVar mvs
+    performMajorGC
+    print (rs == [ expected k | k <- [0..7] ])
+  where
+    expected k = sum [ k * 100000 + i | i <- [10001..20000] ++ [1..5000] ]
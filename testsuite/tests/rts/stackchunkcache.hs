@@ -0,0 +1,19 @@
+-- A deep recursion that returns and goes down again repeatedly, so
+-- that the stack keeps crossing chunk boundaries.  The chunks freed on
+-- the way up should be reused on the way down, see Note [Stack chunk
+-- cache] in rts/Threads.c.
+
+import Control.Monad
+import GHC.Stats
+
+depth :: Int -> Int
+depth 0 = 0
+depth n = 1 + depth (n - 1)
+{-# NOINLINE depth #-}
+
+main :: IO ()
+main = do
+  rs <- forM [1 .. 200] $ \i -> return $! depth (20000 + i)
+  print (rs == [ 20000 + i | i <- [1 .. 200] ])
+  s <- getRTSStats
+  print (stack_chunk_cache_hits s > 0)
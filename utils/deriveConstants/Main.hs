@@ -383,6 +383,7 @@ wanteds os = concat
           ,structField C    "Capability" "interrupt"
           ,structField C    "Capability" "sparks"
           ,structField C    "Capability" "total_allocated"
+          ,structField C    "Capability" "alloc_sample_left"
           ,structField C    "Capability" "weak_ptr_list_hd"
           ,structField C    "Capability" "weak_ptr_list_tl"
 
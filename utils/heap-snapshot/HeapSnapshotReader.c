@@ -0,0 +1,745 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Reading heap snapshots, and computing dominators and retained sizes.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "HeapSnapshotReader.h"
+
+#include "rts/HeapSnapshotFormat.h"
+#include "rts/storage/ClosureTypes.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *closure_type_names[N_CLOSURE_TYPES] = {
+    [INVALID_OBJECT]                  = "INVALID_OBJECT",
+    [CONSTR]                          = "CONSTR",
+    [CONSTR_1_0]                      = "CONSTR_1_0",
+    [CONSTR_0_1]                      = "CONSTR_0_1",
+    [CONSTR_2_0]                      = "CONSTR_2_0",
+    [CONSTR_1_1]                      = "CONSTR_1_1",
+    [CONSTR_0_2]                      = "CONSTR_0_2",
+    [CONSTR_NOCAF]                    = "CONSTR_NOCAF",
+    [FUN]                             = "FUN",
+    [FUN_1_0]                         = "FUN_1_0",
+    [FUN_0_1]                         = "FUN_0_1",
+    [FUN_2_0]                         = "FUN_2_0",
+    [FUN_1_1]                         = "FUN_1_1",
+    [FUN_0_2]                         = "FUN_0_2",
+    [FUN_STATIC]                      = "FUN_STATIC",
+    [THUNK]                           = "THUNK",
+    [THUNK_1_0]                       = "THUNK_1_0",
+    [THUNK_0_1]                       = "THUNK_0_1",
+    [THUNK_2_0]                       = "THUNK_2_0",
+    [THUNK_1_1]                       = "THUNK_1_1",
+    [THUNK_0_2]                       = "THUNK_0_2",
+    [THUNK_STATIC]                    = "THUNK_STATIC",
+    [THUNK_SELECTOR]                  = "THUNK_SELECTOR",
+    [BCO]                             = "BCO",
+    [AP]                              = "AP",
+    [PAP]                             = "PAP",
+    [AP_STACK]                        = "AP_STACK",
+    [IND]                             = "IND",
+    [IND_STATIC]                      = "IND_STATIC",
+    [RET_BCO]                         = "RET_BCO",
+    [RET_SMALL]                       = "RET_SMALL",
+    [RET_BIG]                         = "RET_BIG",
+    [RET_FUN]                         = "RET_FUN",
+    [UPDATE_FRAME]                    = "UPDATE_FRAME",
+    [CATCH_FRAME]                     = "CATCH_FRAME",
+    [UNDERFLOW_FRAME]                 = "UNDERFLOW_FRAME",
+    [STOP_FRAME]                      = "STOP_FRAME",
+    [BLOCKING_QUEUE]                  = "BLOCKING_QUEUE",
+    [BLACKHOLE]                       = "BLACKHOLE",
+    [MVAR_CLEAN]                      = "MVAR_CLEAN",
+    [MVAR_DIRTY]                      = "MVAR_DIRTY",
+    [TVAR]                            = "TVAR",
+    [ARR_WORDS]                       = "ARR_WORDS",
+    [MUT_ARR_PTRS_CLEAN]              = "MUT_ARR_PTRS_CLEAN",
+    [MUT_ARR_PTRS_DIRTY]              = "MUT_ARR_PTRS_DIRTY",
+    [MUT_ARR_PTRS_FROZEN_DIRTY]       = "MUT_ARR_PTRS_FROZEN_DIRTY",
+    [MUT_ARR_PTRS_FROZEN_CLEAN]       = "MUT_ARR_PTRS_FROZEN_CLEAN",
+    [MUT_VAR_CLEAN]                   = "MUT_VAR_CLEAN",
+    [MUT_VAR_DIRTY]                   = "MUT_VAR_DIRTY",
+    [WEAK]                            = "WEAK",
+    [PRIM]                            = "PRIM",
+    [MUT_PRIM]                        = "MUT_PRIM",
+    [TSO]                             = "TSO",
+    [STACK]                           = "STACK",
+    [TREC_CHUNK]                      = "TREC_CHUNK",
+    [ATOMICALLY_FRAME]                = "ATOMICALLY_FRAME",
+    [CATCH_RETRY_FRAME]               = "CATCH_RETRY_FRAME",
+    [CATCH_STM_FRAME]                 = "CATCH_STM_FRAME",
+    [WHITEHOLE]                       = "WHITEHOLE",
+    [SMALL_MUT_ARR_PTRS_CLEAN]        = "SMALL_MUT_ARR_PTRS_CLEAN",
+    [SMALL_MUT_ARR_PTRS_DIRTY]        = "SMALL_MUT_ARR_PTRS_DIRTY",
+    [SMALL_MUT_ARR_PTRS_FROZEN_DIRTY] = "SMALL_MUT_ARR_PTRS_FROZEN_DIRTY",
+    [SMALL_MUT_ARR_PTRS_FROZEN_CLEAN] = "SMALL_MUT_ARR_PTRS_FROZEN_CLEAN",
+    [COMPACT_NFDATA]                  = "COMPACT_NFDATA",
+};
+
+static const char *root_kind_names[HSNAP_N_ROOT_KINDS] = {
+    [HSNAP_ROOT_CAPABILITY]           = "capability",
+    [HSNAP_ROOT_SCHEDULER]            = "scheduler",
+    [HSNAP_ROOT_STABLE_PTR]           = "stable pointer",
+    [HSNAP_ROOT_CAF]                  = "CAF",
+    [HSNAP_ROOT_SPARK]                = "spark",
+    [HSNAP_ROOT_THREAD]               = "thread",
+    [HSNAP_ROOT_WEAK]                 = "weak pointer",
+};
+
+const char *
+hsnap_closure_type_name (uint32_t type)
+{
+    if (type < N_CLOSURE_TYPES && closure_type_names[type] != NULL) {
+        return closure_type_names[type];
+    }
+    return "unknown";
+}
+
+const char *
+hsnap_root_kind_name (uint32_t kind)
+{
+    if (kind < HSNAP_N_ROOT_KINDS) {
+        return root_kind_names[kind];
+    }
+    return "unknown";
+}
+
+static void
+set_error (char *err, size_t err_len, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (err == NULL || err_len == 0) {
+        return;
+    }
+    va_start(ap, fmt);
+    vsnprintf(err, err_len, fmt, ap);
+    va_end(ap);
+}
+
+/* -----------------------------------------------------------------------------
+   Growable arrays
+   -------------------------------------------------------------------------- */
+
+static bool
+grow (void **arr, size_t *size, size_t need, size_t elem)
+{
+    size_t new_size;
+    void *p;
+
+    if (need <= *size) {
+        return true;
+    }
+    new_size = *size == 0 ? 1024 : *size;
+    while (new_size < need) {
+        new_size *= 2;
+    }
+    p = realloc(*arr, new_size * elem);
+    if (p == NULL) {
+        return false;
+    }
+    *arr = p;
+    *size = new_size;
+    return true;
+}
+
+/* -----------------------------------------------------------------------------
+   Reading
+   -------------------------------------------------------------------------- */
+
+typedef struct {
+    FILE *file;
+    bool eof;
+} Input;
+
+static uint64_t
+get_uleb (Input *in)
+{
+    uint64_t r = 0;
+    unsigned shift = 0;
+    int c;
+
+    do {
+        c = getc(in->file);
+        if (c == EOF) {
+            in->eof = true;
+            return 0;
+        }
+        if (shift < 64) {
+            r |= (uint64_t)(c & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (c & 0x80);
+    return r;
+}
+
+static int64_t
+get_sleb (Input *in)
+{
+    uint64_t r = 0;
+    unsigned shift = 0;
+    int c;
+
+    do {
+        c = getc(in->file);
+        if (c == EOF) {
+            in->eof = true;
+            return 0;
+        }
+        if (shift < 64) {
+            r |= (uint64_t)(c & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (c & 0x80);
+    if (shift < 64 && (c & 0x40)) {
+        r |= ~(uint64_t)0 << shift;
+    }
+    return (int64_t)r;
+}
+
+// An object in a compact region, before we know the node indices
+typedef struct {
+    uint64_t compact;
+    uint64_t member;
+} CompactMember;
+
+static int
+cmp_node (const void *a, const void *b)
+{
+    uint64_t x = ((const HSnapNode *)a)->addr;
+    uint64_t y = ((const HSnapNode *)b)->addr;
+    return x < y ? -1 : x > y;
+}
+
+uint32_t
+hsnap_find (const HSnapGraph *g, uint64_t addr)
+{
+    size_t lo = 0, hi = g->n_nodes;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (g->nodes[mid].addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < g->n_nodes && g->nodes[lo].addr == addr) {
+        return (uint32_t)lo;
+    }
+    return HSNAP_NO_NODE;
+}
+
+int
+hsnap_read (const char *path, HSnapGraph *g, char *err, size_t err_len)
+{
+    Input in;
+    char magic[HSNAP_MAGIC_LEN];
+    uint64_t version, n_nodes = 0, n_roots = 0;
+    bool done = false;
+
+    // the pointers of each node, as addresses
+    uint64_t *raw_edges = NULL;
+    size_t n_raw_edges = 0, raw_edges_size = 0;
+    size_t nodes_size = 0, roots_size = 0;
+
+    uint64_t *root_addrs = NULL;
+    uint32_t *root_kinds = NULL;
+    size_t root_kinds_size = 0;
+
+    CompactMember *members = NULL;
+    size_t n_members = 0, members_size = 0;
+    uint64_t compact = 0;       // 0 if we're not in a compact region
+
+    size_t i, j, e;
+    uint32_t *counts = NULL;
+
+    memset(g, 0, sizeof(*g));
+
+    in.eof = false;
+    in.file = fopen(path, "rb");
+    if (in.file == NULL) {
+        set_error(err, err_len, "can't open %s", path);
+        return -1;
+    }
+
+    if (fread(magic, 1, HSNAP_MAGIC_LEN, in.file) != HSNAP_MAGIC_LEN ||
+        memcmp(magic, HSNAP_MAGIC, HSNAP_MAGIC_LEN) != 0) {
+        set_error(err, err_len, "%s is not a heap snapshot", path);
+        goto fail;
+    }
+    version = get_uleb(&in);
+    if (version != HSNAP_VERSION) {
+        set_error(err, err_len, "%s: unsupported version %llu", path,
+                  (unsigned long long)version);
+        goto fail;
+    }
+    g->word_size = (unsigned)get_uleb(&in);
+
+    while (!done && !in.eof) {
+        int tag = getc(in.file);
+
+        switch (tag) {
+        case HSNAP_NODE:
+        {
+            HSnapNode *n;
+            uint64_t n_ptrs;
+
+            if (g->n_nodes == HSNAP_NO_NODE - 1) {
+                set_error(err, err_len, "%s: too many nodes", path);
+                goto fail;
+            }
+            if (!grow((void **)&g->nodes, &nodes_size, g->n_nodes + 1,
+                      sizeof(HSnapNode))) {
+                goto oom;
+            }
+            n = &g->nodes[g->n_nodes++];
+            n->addr = get_uleb(&in);
+            n->info = get_uleb(&in);
+            n->type = (uint32_t)get_uleb(&in);
+            n->size = get_uleb(&in);
+            n_ptrs = get_uleb(&in);
+            n->first_edge = n_raw_edges;
+            n->n_edges = (uint32_t)n_ptrs;
+
+            if (!grow((void **)&raw_edges, &raw_edges_size,
+                      n_raw_edges + n_ptrs, sizeof(uint64_t))) {
+                goto oom;
+            }
+            for (i = 0; i < n_ptrs; i++) {
+                raw_edges[n_raw_edges++] = n->addr + get_sleb(&in);
+            }
+
+            if (compact != 0 && n->addr != compact) {
+                if (!grow((void **)&members, &members_size, n_members + 1,
+                          sizeof(CompactMember))) {
+                    goto oom;
+                }
+                members[n_members].compact = compact;
+                members[n_members].member = n->addr;
+                n_members++;
+            }
+            break;
+        }
+
+        case HSNAP_ROOT:
+            if (!grow((void **)&root_addrs, &roots_size, g->n_roots + 1,
+                      sizeof(uint64_t)) ||
+                !grow((void **)&root_kinds, &root_kinds_size, g->n_roots + 1,
+                      sizeof(uint32_t))) {
+                goto oom;
+            }
+            root_kinds[g->n_roots] = (uint32_t)get_uleb(&in);
+            root_addrs[g->n_roots] = get_uleb(&in);
+            g->n_roots++;
+            break;
+
+        case HSNAP_COMPACT_BEGIN:
+            compact = get_uleb(&in);
+            break;
+
+        case HSNAP_COMPACT_END:
+            compact = 0;
+            break;
+
+        case HSNAP_END:
+            n_nodes = get_uleb(&in);
+            n_roots = get_uleb(&in);
+            done = true;
+            break;
+
+        case EOF:
+            in.eof = true;
+            break;
+
+        default:
+            set_error(err, err_len, "%s: bad record tag %d", path, tag);
+            goto fail;
+        }
+    }
+
+    if (!done || in.eof) {
+        set_error(err, err_len, "%s: snapshot is truncated", path);
+        goto fail;
+    }
+    if (n_nodes != g->n_nodes || n_roots != g->n_roots) {
+        set_error(err, err_len, "%s: expected %llu nodes and %llu roots, "
+                  "found %zu and %zu", path, (unsigned long long)n_nodes,
+                  (unsigned long long)n_roots, g->n_nodes, g->n_roots);
+        goto fail;
+    }
+    fclose(in.file);
+    in.file = NULL;
+
+    // Sort the nodes by address; each node still knows where its raw
+    // edges are.
+    qsort(g->nodes, g->n_nodes, sizeof(HSnapNode), cmp_node);
+
+    // Count the edges that resolve to a node, plus an edge from each
+    // compact region to each of its objects.
+    counts = calloc(g->n_nodes + 1, sizeof(uint32_t));
+    if (counts == NULL) goto oom;
+
+    for (i = 0; i < g->n_nodes; i++) {
+        HSnapNode *n = &g->nodes[i];
+        for (j = 0; j < n->n_edges; j++) {
+            if (hsnap_find(g, raw_edges[n->first_edge + j]) != HSNAP_NO_NODE) {
+                counts[i]++;
+            }
+        }
+    }
+    for (i = 0; i < n_members; i++) {
+        uint32_t c = hsnap_find(g, members[i].compact);
+        if (c != HSNAP_NO_NODE) {
+            counts[c]++;
+        }
+    }
+
+    g->n_edges = 0;
+    for (i = 0; i < g->n_nodes; i++) {
+        g->n_edges += counts[i];
+    }
+    g->edges = malloc((g->n_edges + 1) * sizeof(uint32_t));
+    if (g->edges == NULL) goto oom;
+
+    // Fill in the resolved edges, leaving room for the compact members,
+    // which all come after the raw edges of their COMPACT_NFDATA.
+    e = 0;
+    for (i = 0; i < g->n_nodes; i++) {
+        HSnapNode *n = &g->nodes[i];
+        uint64_t first = n->first_edge;
+        uint32_t raw = n->n_edges;
+        uint32_t k = 0;
+
+        n->first_edge = e;
+        for (j = 0; j < raw; j++) {
+            uint32_t t = hsnap_find(g, raw_edges[first + j]);
+            if (t != HSNAP_NO_NODE) {
+                g->edges[e + k++] = t;
+            }
+        }
+        n->n_edges = k;
+        e += counts[i];
+    }
+    for (i = 0; i < n_members; i++) {
+        uint32_t c = hsnap_find(g, members[i].compact);
+        uint32_t m = hsnap_find(g, members[i].member);
+        if (c != HSNAP_NO_NODE) {
+            HSnapNode *n = &g->nodes[c];
+            g->edges[n->first_edge + n->n_edges++] = m;
+        }
+    }
+
+    g->roots = malloc((g->n_roots + 1) * sizeof(HSnapRoot));
+    if (g->roots == NULL) goto oom;
+    for (i = 0, j = 0; i < g->n_roots; i++) {
+        uint32_t t = hsnap_find(g, root_addrs[i]);
+        if (t != HSNAP_NO_NODE) {
+            g->roots[j].kind = root_kinds[i];
+            g->roots[j].node = t;
+            j++;
+        }
+    }
+    g->n_roots = j;
+
+    free(counts);
+    free(raw_edges);
+    free(root_addrs);
+    free(root_kinds);
+    free(members);
+    return 0;
+
+oom:
+    set_error(err, err_len, "%s: out of memory", path);
+fail:
+    if (in.file != NULL) {
+        fclose(in.file);
+    }
+    free(counts);
+    free(raw_edges);
+    free(root_addrs);
+    free(root_kinds);
+    free(members);
+    hsnap_free(g);
+    return -1;
+}
+
+void
+hsnap_free (HSnapGraph *g)
+{
+    free(g->nodes);
+    free(g->edges);
+    free(g->roots);
+    free(g->idom);
+    free(g->retained);
+    memset(g, 0, sizeof(*g));
+}
+
+/* -----------------------------------------------------------------------------
+   Dominators
+
+   This is the simple version of the Lengauer-Tarjan algorithm (path
+   compression, no balancing), with the recursion turned into loops so
+   that it copes with the long chains (lists!) found in real heaps.
+   Node n_nodes is the imaginary root.
+   -------------------------------------------------------------------------- */
+
+typedef struct {
+    HSnapGraph *g;
+    uint32_t root;              // == g->n_nodes
+    uint32_t *dfn;              // preorder number
+    uint32_t *vertex;           // node with a given preorder number
+    uint32_t *parent;
+    uint32_t *semi;             // preorder number of the semidominator
+    uint32_t *ancestor;
+    uint32_t *label;
+    uint32_t *stack;
+
+    // predecessors, in the same layout as HSnapGraph.edges; the
+    // imaginary root is a predecessor of the nodes in is_root_succ
+    uint64_t *pred_first;
+    uint32_t *preds;
+    uint8_t *is_root_succ;
+} Dom;
+
+static void
+dfs (Dom *d, uint32_t start, uint32_t *next_dfn)
+{
+    HSnapGraph *g = d->g;
+    // stack of (node, index of next edge); the edge index is kept in
+    // label[], which isn't needed until later
+    size_t sp = 0;
+
+    d->dfn[start] = (*next_dfn)++;
+    d->vertex[d->dfn[start]] = start;
+    d->parent[start] = d->root;
+    d->label[start] = 0;
+    d->stack[sp++] = start;
+
+    while (sp > 0) {
+        uint32_t v = d->stack[sp - 1];
+        HSnapNode *n = &g->nodes[v];
+
+        if (d->label[v] < n->n_edges) {
+            uint32_t w = g->edges[n->first_edge + d->label[v]++];
+            if (d->dfn[w] == HSNAP_NO_NODE) {
+                d->dfn[w] = (*next_dfn)++;
+                d->vertex[d->dfn[w]] = w;
+                d->parent[w] = v;
+                d->label[w] = 0;
+                d->stack[sp++] = w;
+            }
+        } else {
+            sp--;
+        }
+    }
+}
+
+static void
+compress (Dom *d, uint32_t v)
+{
+    size_t sp = 0;
+    uint32_t x = v;
+
+    while (d->ancestor[d->ancestor[x]] != HSNAP_NO_NODE) {
+        d->stack[sp++] = x;
+        x = d->ancestor[x];
+    }
+    while (sp > 0) {
+        uint32_t a;
+        x = d->stack[--sp];
+        a = d->ancestor[x];
+        if (d->semi[d->label[a]] < d->semi[d->label[x]]) {
+            d->label[x] = d->label[a];
+        }
+        d->ancestor[x] = d->ancestor[a];
+    }
+}
+
+static uint32_t
+eval (Dom *d, uint32_t v)
+{
+    if (d->ancestor[v] == HSNAP_NO_NODE) {
+        return v;
+    }
+    compress(d, v);
+    return d->label[v];
+}
+
+int
+hsnap_dominators (HSnapGraph *g, char *err, size_t err_len)
+{
+    Dom d;
+    size_t n = g->n_nodes + 1;
+    size_t i, j;
+    uint32_t next_dfn, w, v, u;
+    uint32_t *bucket_head = NULL, *bucket_next = NULL;
+    int ret = -1;
+
+    memset(&d, 0, sizeof(d));
+    d.g = g;
+    d.root = (uint32_t)g->n_nodes;
+
+    free(g->idom);
+    free(g->retained);
+    g->idom = malloc(n * sizeof(uint32_t));
+    g->retained = calloc(n, sizeof(uint64_t));
+
+    d.dfn      = malloc(n * sizeof(uint32_t));
+    d.vertex   = malloc(n * sizeof(uint32_t));
+    d.parent   = malloc(n * sizeof(uint32_t));
+    d.semi     = malloc(n * sizeof(uint32_t));
+    d.ancestor = malloc(n * sizeof(uint32_t));
+    d.label    = malloc(n * sizeof(uint32_t));
+    d.stack    = malloc(n * sizeof(uint32_t));
+    d.is_root_succ = calloc(n, 1);
+    d.pred_first = calloc(n + 1, sizeof(uint64_t));
+    d.preds    = malloc((g->n_edges + 1) * sizeof(uint32_t));
+    bucket_head = malloc(n * sizeof(uint32_t));
+    bucket_next = malloc(n * sizeof(uint32_t));
+
+    if (!g->idom || !g->retained || !d.dfn || !d.vertex || !d.parent ||
+        !d.semi || !d.ancestor || !d.label || !d.stack || !d.is_root_succ ||
+        !d.pred_first || !d.preds || !bucket_head || !bucket_next) {
+        goto oom;
+    }
+
+    // Predecessors
+    for (i = 0; i < g->n_nodes; i++) {
+        HSnapNode *nd = &g->nodes[i];
+        for (j = 0; j < nd->n_edges; j++) {
+            d.pred_first[g->edges[nd->first_edge + j] + 1]++;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        d.pred_first[i + 1] += d.pred_first[i];
+    }
+    for (i = 0; i < g->n_nodes; i++) {
+        HSnapNode *nd = &g->nodes[i];
+        for (j = 0; j < nd->n_edges; j++) {
+            uint32_t t = g->edges[nd->first_edge + j];
+            // pred_first[t] is used as a cursor, and put back below
+            d.preds[d.pred_first[t]++] = (uint32_t)i;
+        }
+    }
+    for (i = n - 1; i > 0; i--) {
+        d.pred_first[i] = d.pred_first[i - 1];
+    }
+    d.pred_first[0] = 0;
+
+    // Number the nodes in depth-first order from the roots, then from
+    // each node that we haven't reached yet.
+    for (i = 0; i < n; i++) {
+        d.dfn[i] = HSNAP_NO_NODE;
+        d.ancestor[i] = HSNAP_NO_NODE;
+        bucket_head[i] = HSNAP_NO_NODE;
+    }
+    d.dfn[d.root] = 0;
+    d.vertex[0] = d.root;
+    d.parent[d.root] = HSNAP_NO_NODE;
+    next_dfn = 1;
+
+    for (i = 0; i < g->n_roots; i++) {
+        v = g->roots[i].node;
+        d.is_root_succ[v] = 1;
+        if (d.dfn[v] == HSNAP_NO_NODE) {
+            dfs(&d, v, &next_dfn);
+        }
+    }
+    g->n_unreachable = 0;
+    for (i = 0; i < g->n_nodes; i++) {
+        if (d.dfn[i] == HSNAP_NO_NODE) {
+            g->n_unreachable++;
+            d.is_root_succ[i] = 1;
+            dfs(&d, (uint32_t)i, &next_dfn);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        d.semi[i] = d.dfn[i];
+        d.label[i] = (uint32_t)i;
+    }
+
+    for (i = n - 1; i > 0; i--) {
+        w = d.vertex[i];
+
+        for (j = d.pred_first[w]; j < d.pred_first[w + 1]; j++) {
+            u = eval(&d, d.preds[j]);
+            if (d.semi[u] < d.semi[w]) {
+                d.semi[w] = d.semi[u];
+            }
+        }
+        if (d.is_root_succ[w]) {
+            d.semi[w] = 0;
+        }
+
+        v = d.vertex[d.semi[w]];
+        bucket_next[w] = bucket_head[v];
+        bucket_head[v] = w;
+
+        d.ancestor[w] = d.parent[w];
+
+        v = d.parent[w];
+        while (bucket_head[v] != HSNAP_NO_NODE) {
+            uint32_t x = bucket_head[v];
+            bucket_head[v] = bucket_next[x];
+            u = eval(&d, x);
+            g->idom[x] = d.semi[u] < d.semi[x] ? u : v;
+        }
+    }
+
+    for (i = 1; i < n; i++) {
+        w = d.vertex[i];
+        if (g->idom[w] != d.vertex[d.semi[w]]) {
+            g->idom[w] = g->idom[g->idom[w]];
+        }
+    }
+
+    // Retained sizes: children come after their dominator in preorder.
+    for (i = 0; i < g->n_nodes; i++) {
+        g->retained[i] = g->nodes[i].size;
+    }
+    g->retained[d.root] = 0;
+    for (i = n - 1; i > 0; i--) {
+        w = d.vertex[i];
+        g->retained[g->idom[w]] += g->retained[w];
+    }
+    g->total_size = g->retained[d.root];
+
+    for (i = 0; i < g->n_nodes; i++) {
+        if (g->idom[i] == d.root) {
+            g->idom[i] = HSNAP_NO_NODE;
+        }
+    }
+    ret = 0;
+    goto done;
+
+oom:
+    set_error(err, err_len, "out of memory");
+    free(g->idom);
+    free(g->retained);
+    g->idom = NULL;
+    g->retained = NULL;
+done:
+    free(d.dfn);
+    free(d.vertex);
+    free(d.parent);
+    free(d.semi);
+    free(d.ancestor);
+    free(d.label);
+    free(d.stack);
+    free(d.is_root_succ);
+    free(d.pred_first);
+    free(d.preds);
+    free(bucket_head);
+    free(bucket_next);
+    return ret;
+}
@@ -0,0 +1,85 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * Reading heap snapshots written by the RTS (performHeapSnapshot() or
+ * +RTS --heap-snapshot), and working out what retains what.
+ *
+ * The format is described in includes/rts/HeapSnapshotFormat.h.  This
+ * library doesn't depend on the RTS, so it can be built for any
+ * platform, but it does assume that the snapshot has at most 2^32-2
+ * nodes.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HSNAP_NO_NODE UINT32_MAX
+
+typedef struct {
+    uint64_t addr;
+    uint64_t info;              // info pointer
+    uint64_t size;              // in words
+    uint64_t first_edge;        // index into HSnapGraph.edges
+    uint32_t n_edges;
+    uint32_t type;              // closure type (rts/storage/ClosureTypes.h)
+} HSnapNode;
+
+typedef struct {
+    uint32_t kind;              // HSNAP_ROOT_*
+    uint32_t node;
+} HSnapRoot;
+
+typedef struct {
+    unsigned word_size;         // of the program that wrote the snapshot
+
+    // The nodes, sorted by address.  The edges of a node are
+    // edges[first_edge .. first_edge + n_edges - 1], as node indices.
+    // Pointers that didn't match a node have been dropped, and each
+    // COMPACT_NFDATA node has an edge to every object in its region.
+    size_t n_nodes;
+    HSnapNode *nodes;
+    size_t n_edges;
+    uint32_t *edges;
+
+    size_t n_roots;
+    HSnapRoot *roots;
+
+    // Filled in by hsnap_dominators().  The immediate dominator of a
+    // node, or HSNAP_NO_NODE if only the (imaginary) root dominates it,
+    // and the number of words that would be freed if it went away.
+    uint32_t *idom;
+    uint64_t *retained;
+    uint64_t total_size;        // in words
+    size_t n_unreachable;       // nodes not reachable from a root
+} HSnapGraph;
+
+/*
+ * Read a snapshot.  Returns 0 on success; on failure, returns -1 and
+ * puts a message in err.
+ */
+int hsnap_read (const char *path, HSnapGraph *g, char *err, size_t err_len);
+
+/*
+ * Find a node by address.  Returns HSNAP_NO_NODE if there isn't one.
+ */
+uint32_t hsnap_find (const HSnapGraph *g, uint64_t addr);
+
+/*
+ * Compute the dominator tree and retained sizes.
+ *
+ * The dominator tree is rooted at an imaginary node with an edge to
+ * every root in the snapshot.  Nodes that can't be reached from any
+ * root (for example, threads that are about to be sent
+ * BlockedIndefinitely exceptions) are given edges from the imaginary
+ * root as well, in address order, and counted in n_unreachable.
+ */
+int hsnap_dominators (HSnapGraph *g, char *err, size_t err_len);
+
+void hsnap_free (HSnapGraph *g);
+
+const char *hsnap_closure_type_name (uint32_t type);
+const char *hsnap_root_kind_name (uint32_t kind);
@@ -0,0 +1,202 @@
+/* -----------------------------------------------------------------------------
+ *
+ * (c) The GHC Team 2018
+ *
+ * hsnap: summarise a heap snapshot.
+ *
+ *      hsnap [-n <count>] <file>.hsnap
+ *
+ * prints the number of nodes and roots, the closures that retain the
+ * most memory (with the chain of dominators that keeps each of them
+ * alive), and the info pointers that account for the most memory.
+ * Info pointers can be turned into names with nm or addr2line on the
+ * program that wrote the snapshot.
+ *
+ * ---------------------------------------------------------------------------*/
+
+#include "HeapSnapshotReader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How many dominators of each large retainer to show
+#define MAX_CHAIN 8
+
+static const HSnapGraph *sort_graph;
+
+static int
+cmp_retained (const void *a, const void *b)
+{
+    uint64_t x = sort_graph->retained[*(const uint32_t *)a];
+    uint64_t y = sort_graph->retained[*(const uint32_t *)b];
+    return x > y ? -1 : x < y;
+}
+
+typedef struct {
+    uint64_t info;
+    uint32_t type;
+    uint64_t count;
+    uint64_t words;
+} InfoSummary;
+
+static int
+cmp_info (const void *a, const void *b)
+{
+    uint64_t x = ((const InfoSummary *)a)->info;
+    uint64_t y = ((const InfoSummary *)b)->info;
+    return x < y ? -1 : x > y;
+}
+
+static int
+cmp_info_words (const void *a, const void *b)
+{
+    uint64_t x = ((const InfoSummary *)a)->words;
+    uint64_t y = ((const InfoSummary *)b)->words;
+    return x > y ? -1 : x < y;
+}
+
+static void
+print_node (const HSnapGraph *g, uint32_t i)
+{
+    const HSnapNode *n = &g->nodes[i];
+
+    printf("0x%llx %s (info 0x%llx, %llu bytes)",
+           (unsigned long long)n->addr, hsnap_closure_type_name(n->type),
+           (unsigned long long)n->info,
+           (unsigned long long)n->size * g->word_size);
+}
+
+static void
+top_retainers (const HSnapGraph *g, size_t count)
+{
+    uint32_t *order;
+    size_t i, shown;
+
+    order = malloc(g->n_nodes * sizeof(uint32_t));
+    if (order == NULL) {
+        fprintf(stderr, "hsnap: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < g->n_nodes; i++) {
+        order[i] = (uint32_t)i;
+    }
+    sort_graph = g;
+    qsort(order, g->n_nodes, sizeof(uint32_t), cmp_retained);
+
+    printf("\nLargest retainers:\n");
+    for (i = 0, shown = 0; i < g->n_nodes && shown < count; i++) {
+        uint32_t v = order[i];
+        uint32_t d, depth;
+
+        // Don't show a node whose dominator retains the same amount;
+        // the dominator is more interesting.
+        if (g->idom[v] != HSNAP_NO_NODE &&
+            g->retained[g->idom[v]] == g->retained[v]) {
+            continue;
+        }
+        shown++;
+        printf("%12llu bytes  ",
+               (unsigned long long)g->retained[v] * g->word_size);
+        print_node(g, v);
+        printf("\n");
+        for (d = g->idom[v], depth = 0; d != HSNAP_NO_NODE;
+             d = g->idom[d], depth++) {
+            if (depth == MAX_CHAIN) {
+                printf("%20s\n", "...");
+                break;
+            }
+            printf("%20s", "held by ");
+            print_node(g, d);
+            printf("\n");
+        }
+    }
+    free(order);
+}
+
+static void
+top_info (const HSnapGraph *g, size_t count)
+{
+    InfoSummary *s;
+    size_t i, n = 0;
+
+    s = malloc((g->n_nodes + 1) * sizeof(InfoSummary));
+    if (s == NULL) {
+        fprintf(stderr, "hsnap: out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < g->n_nodes; i++) {
+        s[i].info = g->nodes[i].info;
+        s[i].type = g->nodes[i].type;
+        s[i].count = 1;
+        s[i].words = g->nodes[i].size;
+    }
+    qsort(s, g->n_nodes, sizeof(InfoSummary), cmp_info);
+    for (i = 0; i < g->n_nodes; i++) {
+        if (n > 0 && s[n - 1].info == s[i].info) {
+            s[n - 1].count++;
+            s[n - 1].words += s[i].words;
+        } else {
+            s[n++] = s[i];
+        }
+    }
+    qsort(s, n, sizeof(InfoSummary), cmp_info_words);
+
+    printf("\nLargest info pointers:\n");
+    for (i = 0; i < n && i < count; i++) {
+        printf("%12llu bytes  %10llu closures  info 0x%llx %s\n",
+               (unsigned long long)s[i].words * g->word_size,
+               (unsigned long long)s[i].count,
+               (unsigned long long)s[i].info,
+               hsnap_closure_type_name(s[i].type));
+    }
+    free(s);
+}
+
+int
+main (int argc, char *argv[])
+{
+    HSnapGraph g;
+    char err[256];
+    size_t count = 20;
+    size_t roots[16] = {0};
+    const char *path;
+    size_t i;
+
+    if (argc == 4 && strcmp(argv[1], "-n") == 0) {
+        count = strtoul(argv[2], NULL, 10);
+        path = argv[3];
+    } else if (argc == 2) {
+        path = argv[1];
+    } else {
+        fprintf(stderr, "usage: hsnap [-n <count>] <file>.hsnap\n");
+        return 1;
+    }
+
+    if (hsnap_read(path, &g, err, sizeof(err)) != 0 ||
+        hsnap_dominators(&g, err, sizeof(err)) != 0) {
+        fprintf(stderr, "hsnap: %s\n", err);
+        return 1;
+    }
+
+    printf("%zu nodes, %zu edges, %llu bytes\n", g.n_nodes, g.n_edges,
+           (unsigned long long)g.total_size * g.word_size);
+    for (i = 0; i < g.n_roots; i++) {
+        if (g.roots[i].kind < 16) {
+            roots[g.roots[i].kind]++;
+        }
+    }
+    printf("roots:");
+    for (i = 0; i < 16; i++) {
+        if (roots[i] != 0) {
+            printf(" %zu %s", roots[i], hsnap_root_kind_name((uint32_t)i));
+        }
+    }
+    printf("\n%zu nodes not reachable from a root\n", g.n_unreachable);
+
+    top_retainers(&g, count);
+    top_info(&g, count);
+
+    hsnap_free(&g);
+    return 0;
+}